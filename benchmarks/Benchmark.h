@@ -0,0 +1,353 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Benchmark harness shared by the query programs of query-processing and spatial-data: each of them has a
+ * "bench" mode that builds (or maps) its indexes once, then times every query of a query file, one at a time,
+ * with every method it has, and writes one JSON report.
+ *
+ * A method is benchmarked by benchmark_method(): one counting pass, in which the query collects its work
+ * counters (nodes visited, postings, false drops...), the other warm-up passes, then the timed passes, in
+ * which every query is timed alone, as are its hardware counters when the kernel gives access to them.
+ */
+
+/**
+ * @brief How the methods are benchmarked
+ */
+struct BenchmarkOptions {
+    size_t warmup_passes; ///< Untimed passes over the queries, the first of which collects the work counters
+    size_t timed_passes; ///< Timed passes over the queries
+    std::string output; ///< The JSON report file, or empty for the standard output
+};
+
+constexpr BenchmarkOptions DEFAULT_BENCHMARK_OPTIONS{1, 3, ""};
+
+/**
+ * @brief Parses "--warmup=<N>", "--repeat=<N>" or "--json=<file>"
+ * @param name Option name
+ * @param value Option value
+ * @param options Receives the value
+ * @return False if the option is none of them
+ * @throw std::invalid_argument if a pass count is not a positive number, or the file name is empty
+ */
+inline bool parse_benchmark_option(const std::string& name, const std::string& value, BenchmarkOptions& options) {
+    if (name == "--warmup" || name == "--repeat") {
+        size_t& passes = name == "--warmup" ? options.warmup_passes : options.timed_passes;
+        passes = std::stoull(value);
+        if (passes == 0) throw std::invalid_argument(value);
+        return true;
+    }
+    if (name == "--json") {
+        if (value.empty()) throw std::invalid_argument(value);
+        options.output = value;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Hardware counters of the calling thread, in user space, read through perf_event_open(2) as one group so that
+ * they count over the same instructions. Events the CPU, the kernel or the container does not give are left out;
+ * with none of them (no access to perf events, or a virtual machine without a PMU), available() is false and the
+ * reports have no hardware counters.
+ */
+class PerfCounters {
+public:
+    static constexpr size_t EVENTS = 4;
+    static constexpr std::array<const char*, EVENTS> EVENT_NAMES{"cycles", "instructions", "cache_misses", "branch_misses"};
+
+    PerfCounters() {
+        constexpr std::array<uint64_t, EVENTS> configs{PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                       PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t event = 0; event < EVENTS; event++) {
+            perf_event_attr attributes{};
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = configs[event];
+            attributes.disabled = leader < 0 ? 1 : 0;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP;
+            const auto fd = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, leader, 0));
+            if (fd < 0) continue;
+            if (leader < 0) leader = fd;
+            fds[event] = fd;
+            opened[opened_count++] = event;
+        }
+    }
+
+    ~PerfCounters() {
+        for (const int fd : fds)
+            if (fd >= 0) ::close(fd);
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    [[nodiscard]] bool available() const { return leader >= 0; }
+
+    /**
+     * @param event Index of an event, in [0, EVENTS)
+     * @return True if the event is counted
+     */
+    [[nodiscard]] bool counts(const size_t event) const { return fds[event] >= 0; }
+
+    /**
+     * Resets the counters and starts counting.
+     */
+    void start() const {
+        if (!available()) return;
+        ::ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    /**
+     * Stops counting.
+     * @return The count of every event since start(), 0 for the events not counted
+     */
+    [[nodiscard]] std::array<uint64_t, EVENTS> stop() const {
+        std::array<uint64_t, EVENTS> values{};
+        if (!available()) return values;
+        ::ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        //PERF_FORMAT_GROUP: the number of events, then their values in the order they were opened.
+        std::array<uint64_t, EVENTS + 1> group{};
+        if (::read(leader, group.data(), sizeof(group)) < static_cast<ssize_t>(sizeof(uint64_t))) return values;
+        for (size_t i = 0; i < std::min<uint64_t>(group[0], opened_count); i++) values[opened[i]] = group[i + 1];
+        return values;
+    }
+
+private:
+    int leader = -1;
+    std::array<int, EVENTS> fds{-1, -1, -1, -1};
+    std::array<size_t, EVENTS> opened{};
+    size_t opened_count = 0;
+};
+
+/**
+ * Work counters of a method, summed over the queries of the counting pass, in the order they were first added.
+ */
+class WorkCounters {
+public:
+    /**
+     * @param name Name of the counter, as it appears in the report
+     * @param value Amount to add to it
+     */
+    void add(const std::string_view name, const uint64_t value) {
+        for (auto& [counter, total] : counters) {
+            if (counter == name) {
+                total += value;
+                return;
+            }
+        }
+        counters.emplace_back(name, value);
+    }
+
+    [[nodiscard]] const std::vector<std::pair<std::string, uint64_t>>& totals() const { return counters; }
+
+private:
+    std::vector<std::pair<std::string, uint64_t>> counters;
+};
+
+/**
+ * @brief What benchmark_method() measured for one method
+ */
+struct MethodReport {
+    std::string name; ///< Name of the method
+    size_t queries = 0; ///< Queries of a pass
+    std::vector<uint64_t> latencies; ///< Latency of every timed query in nanoseconds, ascending
+    WorkCounters counters; ///< Work counters of the counting pass
+    std::array<uint64_t, PerfCounters::EVENTS> hardware{}; ///< Hardware counters summed over the timed queries
+};
+
+/**
+ * @brief Benchmarks one method on every query
+ * @param name Name of the method in the report
+ * @param query_count Number of queries
+ * @param options Warm-up and timed passes
+ * @param perf Hardware counters of the calling thread
+ * @param run_query Called as run_query(query, counters) to run query number query in [0, query_count); counters is
+ *                  nullptr but in the counting pass, in which the query adds its work to it
+ * @return The latencies, work counters and hardware counters of the method
+ *
+ * Queries run on the calling thread, one at a time and in file order, so latencies are those of a single query
+ * on warm caches, without queueing.
+ */
+template<typename RunQuery>
+MethodReport benchmark_method(const std::string& name, const size_t query_count, const BenchmarkOptions& options,
+                              const PerfCounters& perf, const RunQuery& run_query) {
+    MethodReport report;
+    report.name = name;
+    report.queries = query_count;
+
+    for (size_t pass = 0; pass < options.warmup_passes; pass++)
+        for (size_t query = 0; query < query_count; query++) run_query(query, pass == 0 ? &report.counters : nullptr);
+
+    report.latencies.reserve(query_count * options.timed_passes);
+    for (size_t pass = 0; pass < options.timed_passes; pass++) {
+        for (size_t query = 0; query < query_count; query++) {
+            perf.start();
+            const auto start = std::chrono::steady_clock::now();
+            run_query(query, nullptr);
+            const auto end = std::chrono::steady_clock::now();
+            const std::array<uint64_t, PerfCounters::EVENTS> counts = perf.stop();
+
+            report.latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+            for (size_t event = 0; event < PerfCounters::EVENTS; event++) report.hardware[event] += counts[event];
+        }
+    }
+    std::sort(report.latencies.begin(), report.latencies.end());
+    return report;
+}
+
+/**
+ * @param text Any text
+ * @return The text as a JSON string, quoted and escaped
+ */
+inline std::string json_string(const std::string_view text) {
+    std::string quoted = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+/**
+ * Properties of the data a benchmark ran on (input files, sizes, parameters), as JSON values in insertion order.
+ */
+class BenchmarkDataset {
+public:
+    void add(const std::string_view name, const std::string_view value) { properties.emplace_back(name, json_string(value)); }
+
+    void add(const std::string_view name, const uint64_t value) { properties.emplace_back(name, std::to_string(value)); }
+
+    [[nodiscard]] const std::vector<std::pair<std::string, std::string>>& json_properties() const { return properties; }
+
+private:
+    std::vector<std::pair<std::string, std::string>> properties;
+};
+
+/**
+ * @param sorted Ascending latencies, not empty
+ * @param fraction In (0, 1], e.g. 0.99 for the 99th percentile
+ * @return The nearest-rank percentile: the smallest latency at least that fraction of the latencies do not exceed
+ */
+inline uint64_t latency_percentile(const std::vector<uint64_t>& sorted, const double fraction) {
+    const auto rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+/**
+ * @brief Writes the JSON report of a benchmark
+ * @param suite Name of the benchmarked program: "containment", "relevance", "range" or "knn"
+ * @param dataset The data it ran on
+ * @param methods The report of every method
+ * @param options The passes, and the file to write (the standard output if empty)
+ * @param perf The hardware counters the reports were measured with
+ * @throw Exits with error if the file cannot be written
+ *
+ * {"suite": ..., "dataset": {...}, "warmup_passes": W, "timed_passes": T, "hardware_counters": true|false,
+ *  "methods": [{"name": ..., "queries": Q,
+ *               "latency_ns": {"mean", "p50", "p90", "p95", "p99", "max"},
+ *               "work": {<counter>: {"total": ..., "per_query": ...}, ...},
+ *               "hardware_per_query": {"cycles", "instructions", "cache_misses", "branch_misses"} or null}, ...]}
+ *
+ * Work totals are those of one pass; hardware counters are means over the timed queries, null if not counted.
+ */
+inline void write_benchmark_report(const std::string& suite, const BenchmarkDataset& dataset, const std::vector<MethodReport>& methods,
+                                   const BenchmarkOptions& options, const PerfCounters& perf) {
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << options.output << " for writing!\n";
+            exit(-1);
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+
+    out << "{\"suite\": " << json_string(suite) << ",\n \"dataset\": {";
+    for (size_t i = 0; i < dataset.json_properties().size(); i++) {
+        const auto& [name, value] = dataset.json_properties()[i];
+        out << (i == 0 ? "" : ", ") << json_string(name) << ": " << value;
+    }
+    out << "},\n \"warmup_passes\": " << options.warmup_passes << ", \"timed_passes\": " << options.timed_passes
+        << ", \"hardware_counters\": " << (perf.available() ? "true" : "false") << ",\n \"methods\": [";
+
+    for (size_t m = 0; m < methods.size(); m++) {
+        const MethodReport& method = methods[m];
+        //Means with two decimals, rather than the six significant digits of the stream.
+        const auto per_query = [&](const uint64_t total, const size_t runs) {
+            char mean[32];
+            std::snprintf(mean, sizeof(mean), "%.2f", runs == 0 ? 0.0 : static_cast<double>(total) / static_cast<double>(runs));
+            return std::string(mean);
+        };
+
+        out << (m == 0 ? "\n  " : ",\n  ") << "{\"name\": " << json_string(method.name) << ", \"queries\": " << method.queries;
+        out << ",\n   \"latency_ns\": {";
+        if (method.latencies.empty()) {
+            out << "}";
+        } else {
+            uint64_t total = 0;
+            for (const uint64_t latency : method.latencies) total += latency;
+            out << "\"mean\": " << per_query(total, method.latencies.size())
+                << ", \"p50\": " << latency_percentile(method.latencies, 0.50) << ", \"p90\": " << latency_percentile(method.latencies, 0.90)
+                << ", \"p95\": " << latency_percentile(method.latencies, 0.95) << ", \"p99\": " << latency_percentile(method.latencies, 0.99)
+                << ", \"max\": " << method.latencies.back() << "}";
+        }
+
+        out << ",\n   \"work\": {";
+        for (size_t c = 0; c < method.counters.totals().size(); c++) {
+            const auto& [name, total] = method.counters.totals()[c];
+            out << (c == 0 ? "" : ", ") << json_string(name) << ": {\"total\": " << total
+                << ", \"per_query\": " << per_query(total, method.queries) << "}";
+        }
+
+        out << "},\n   \"hardware_per_query\": ";
+        if (!perf.available()) {
+            out << "null}";
+            continue;
+        }
+        out << "{";
+        for (size_t event = 0; event < PerfCounters::EVENTS; event++) {
+            out << (event == 0 ? "" : ", ") << json_string(PerfCounters::EVENT_NAMES[event]) << ": ";
+            if (perf.counts(event)) out << per_query(method.hardware[event], method.latencies.size());
+            else out << "null";
+        }
+        out << "}}";
+    }
+    out << "\n ]}\n";
+    out.flush();
+}
+
+#endif //BENCHMARK_H
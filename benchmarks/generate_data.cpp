@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Synthetic inputs for the benchmarks, in the file formats of the programs:
+ *
+ *   transactions: transactions.txt and queries.txt, item sets whose items follow a Zipf distribution, for the
+ *                 containment and relevance programs.
+ *   rectangles:   coords.txt and offsets.txt, rectangular polygons spread uniformly or in clusters, for the bulk
+ *                 loader, with rqueries.txt and knqueries.txt for the range and kNN programs.
+ *
+ * The random numbers come from std::mt19937_64 alone, turned into uniform and normal numbers here rather than by
+ * the <random> distributions, whose results differ between standard libraries: a seed gives the same files
+ * everywhere.
+ */
+
+/**
+ * @brief Uniform and normal random numbers of a seeded std::mt19937_64
+ */
+class RandomNumbers {
+public:
+    explicit RandomNumbers(const uint64_t seed) : engine(seed) {}
+
+    /**
+     * @return A uniform number in [0, 1)
+     */
+    double uniform() { return static_cast<double>(engine() >> 11) * 0x1.0p-53; }
+
+    /**
+     * @return A uniform number in [low, high)
+     */
+    double uniform(const double low, const double high) { return low + (high - low) * uniform(); }
+
+    /**
+     * @return A uniform integer in [0, count), count > 0
+     */
+    size_t index(const size_t count) { return std::min(count - 1, static_cast<size_t>(uniform() * static_cast<double>(count))); }
+
+    /**
+     * @return A normal number of mean 0 and standard deviation 1 (Box-Muller)
+     */
+    double normal() {
+        const double radius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+        return radius * std::cos(2.0 * M_PI * uniform());
+    }
+
+private:
+    std::mt19937_64 engine;
+};
+
+/**
+ * @brief Items of a Zipf distribution: item i in [0, items) has a probability proportional to 1 / (i + 1)^exponent
+ */
+class ZipfItems {
+public:
+    ZipfItems(const size_t items, const double exponent) : cumulative(items) {
+        double total = 0.0;
+        for (size_t item = 0; item < items; item++) {
+            total += 1.0 / std::pow(static_cast<double>(item + 1), exponent);
+            cumulative[item] = total;
+        }
+        for (double& probability : cumulative) probability /= total;
+    }
+
+    /**
+     * @return An item, item 0 being the most frequent
+     */
+    size_t draw(RandomNumbers& random) const {
+        const auto it = std::upper_bound(cumulative.begin(), cumulative.end(), random.uniform());
+        return std::min<size_t>(static_cast<size_t>(it - cumulative.begin()), cumulative.size() - 1);
+    }
+
+private:
+    std::vector<double> cumulative; ///< P(item <= i) for every item i
+};
+
+/**
+ * @brief Options of the transactions generator
+ */
+struct TransactionOptions {
+    size_t transactions = 0; ///< Transactions to generate
+    size_t queries = 0; ///< Queries to generate
+    size_t items = 1000; ///< Items of the vocabulary
+    double zipf_exponent = 1.0; ///< Exponent of the Zipf distribution of items
+    size_t transaction_length = 10; ///< Mean items of a transaction
+    size_t query_length = 3; ///< Mean items of a query
+    uint64_t seed = 1; ///< Random seed
+    std::string output_directory = "."; ///< Directory of the generated files
+};
+
+/**
+ * @brief Options of the rectangles generator
+ */
+struct RectangleOptions {
+    size_t objects = 0; ///< Rectangles to generate
+    size_t queries = 0; ///< Range queries, and kNN queries, to generate
+    bool clustered = false; ///< Rectangles gathered around cluster centers instead of uniform
+    size_t clusters = 20; ///< Cluster centers
+    double spread = 0.02; ///< Standard deviation of a cluster, as a fraction of the extent of the bounds
+    double size = 0.01; ///< Mean side of a rectangle
+    double query_size = 1.0; ///< Mean side of a range query
+    double bounds[4] = {-125.0, 24.0, -66.0, 50.0}; ///< x_low, y_low, x_high, y_high of the space
+    uint64_t seed = 1; ///< Random seed
+    std::string output_directory = "."; ///< Directory of the generated files
+};
+
+/**
+ * @param length Mean length
+ * @param limit Maximum length
+ * @return A length uniform in [1, 2 * length - 1], at most limit
+ */
+size_t draw_length(RandomNumbers& random, const size_t length, const size_t limit) {
+    return std::min(limit, 1 + random.index(2 * length - 1));
+}
+
+/**
+ * @param directory A directory
+ * @param filename A file name
+ * @return The file of that name in the directory, opened for writing
+ * @throw Exits with error if the file cannot be created
+ */
+std::ofstream create_file(const std::string& directory, const std::string& filename) {
+    const std::string path = directory + "/" + filename;
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << path << " for writing!\n";
+        exit(-1);
+    }
+    return file;
+}
+
+/**
+ * @brief Writes item sets of distinct Zipf items, one "[a, b, ...]" per line
+ * @param file Output file
+ * @param count Item sets to write
+ * @param length Mean length of an item set
+ */
+void write_item_sets(std::ofstream& file, RandomNumbers& random, const ZipfItems& zipf, const size_t items,
+                     const size_t count, const size_t length) {
+    std::vector<size_t> item_set;
+    for (size_t i = 0; i < count; i++) {
+        //Distinct items: redraw the ones already in the set.
+        item_set.clear();
+        const size_t target = draw_length(random, length, items);
+        while (item_set.size() < target) {
+            const size_t item = zipf.draw(random);
+            if (std::find(item_set.begin(), item_set.end(), item) == item_set.end()) item_set.push_back(item);
+        }
+
+        file << "[";
+        for (size_t j = 0; j < item_set.size(); j++) file << (j == 0 ? "" : ", ") << item_set[j];
+        file << "]\n";
+    }
+}
+
+/**
+ * @brief Writes transactions.txt and queries.txt
+ */
+void generate_transactions(const TransactionOptions& options) {
+    RandomNumbers random(options.seed);
+    const ZipfItems zipf(options.items, options.zipf_exponent);
+
+    std::ofstream transactions = create_file(options.output_directory, "transactions.txt");
+    write_item_sets(transactions, random, zipf, options.items, options.transactions, options.transaction_length);
+    std::ofstream queries = create_file(options.output_directory, "queries.txt");
+    write_item_sets(queries, random, zipf, options.items, options.queries, options.query_length);
+
+    std::cout << "Wrote " << options.transactions << " transactions and " << options.queries << " queries over "
+              << options.items << " items to " << options.output_directory << "\n";
+}
+
+/**
+ * @brief Writes coords.txt, offsets.txt, rqueries.txt and knqueries.txt
+ *
+ * Every object is a rectangle, written as a closed ring of 5 vertices (the first one repeated), as the rings of
+ * the sample coords.txt. Queries are centered on the centers of random objects, so that they fall where the data
+ * is, clustered or not.
+ */
+void generate_rectangles(const RectangleOptions& options) {
+    RandomNumbers random(options.seed);
+    const double width = options.bounds[2] - options.bounds[0];
+    const double height = options.bounds[3] - options.bounds[1];
+
+    std::vector<double> cluster_x(options.clusters), cluster_y(options.clusters);
+    for (size_t cluster = 0; cluster < options.clusters; cluster++) {
+        cluster_x[cluster] = random.uniform(options.bounds[0], options.bounds[2]);
+        cluster_y[cluster] = random.uniform(options.bounds[1], options.bounds[3]);
+    }
+
+    std::ofstream coords = create_file(options.output_directory, "coords.txt");
+    std::ofstream offsets = create_file(options.output_directory, "offsets.txt");
+    coords << std::fixed << std::setprecision(6);
+
+    std::vector<double> center_x(options.objects), center_y(options.objects);
+    for (size_t object = 0; object < options.objects; object++) {
+        double x, y;
+        if (options.clustered) {
+            const size_t cluster = random.index(options.clusters);
+            x = cluster_x[cluster] + random.normal() * options.spread * width;
+            y = cluster_y[cluster] + random.normal() * options.spread * height;
+        } else {
+            x = random.uniform(options.bounds[0], options.bounds[2]);
+            y = random.uniform(options.bounds[1], options.bounds[3]);
+        }
+        x = std::clamp(x, options.bounds[0], options.bounds[2]);
+        y = std::clamp(y, options.bounds[1], options.bounds[3]);
+        center_x[object] = x;
+        center_y[object] = y;
+
+        const double half_width = random.uniform(0.0, options.size);
+        const double half_height = random.uniform(0.0, options.size);
+        coords << x - half_width << "," << y - half_height << "\n" << x + half_width << "," << y - half_height << "\n"
+               << x + half_width << "," << y + half_height << "\n" << x - half_width << "," << y + half_height << "\n"
+               << x - half_width << "," << y - half_height << "\n";
+        offsets << object << "," << 5 * object << "," << 5 * object + 4 << "\n";
+    }
+
+    std::ofstream range_queries = create_file(options.output_directory, "rqueries.txt");
+    std::ofstream knn_queries = create_file(options.output_directory, "knqueries.txt");
+    range_queries << std::fixed << std::setprecision(6);
+    knn_queries << std::fixed << std::setprecision(6);
+    for (size_t query = 0; query < options.queries && options.objects > 0; query++) {
+        const size_t object = random.index(options.objects);
+        const double half_width = random.uniform(0.0, options.query_size);
+        const double half_height = random.uniform(0.0, options.query_size);
+        range_queries << center_x[object] - half_width << " " << center_y[object] - half_height << " "
+                      << center_x[object] + half_width << " " << center_y[object] + half_height << "\n";
+
+        const size_t neighbor = random.index(options.objects);
+        knn_queries << center_x[neighbor] + random.normal() * options.size << " "
+                    << center_y[neighbor] + random.normal() * options.size << "\n";
+    }
+
+    std::cout << "Wrote " << options.objects << " " << (options.clustered ? "clustered" : "uniform") << " rectangles and "
+              << (options.objects > 0 ? options.queries : 0) << " range and kNN queries to " << options.output_directory << "\n";
+}
+
+/**
+ * @brief Prints the usage and exits with error
+ */
+[[noreturn]] void usage(const char* program) {
+    std::cerr << "Usage:\n"
+              << "  " << program << " transactions <transactions> <queries> [--items=<N>] [--zipf=<exponent>]\n"
+              << "      [--transaction-length=<N>] [--query-length=<N>] [--seed=<N>] [--output-dir=<dir>]\n"
+              << "  " << program << " rectangles <objects> <queries> [--distribution=uniform|clustered] [--clusters=<N>]\n"
+              << "      [--spread=<fraction>] [--size=<side>] [--query-size=<side>] [--bounds=<x_low>,<y_low>,<x_high>,<y_high>]\n"
+              << "      [--seed=<N>] [--output-dir=<dir>]\n";
+    exit(-1);
+}
+
+int main(const int argc, char* argv[]) {
+    if (argc < 4) usage(argv[0]);
+    const std::string mode = argv[1];
+    if (mode != "transactions" && mode != "rectangles") usage(argv[0]);
+
+    TransactionOptions transaction_options;
+    RectangleOptions rectangle_options;
+    try {
+        transaction_options.transactions = rectangle_options.objects = std::stoull(argv[2]);
+        transaction_options.queries = rectangle_options.queries = std::stoull(argv[3]);
+    } catch (const std::exception&) {
+        usage(argv[0]);
+    }
+
+    for (int i = 4; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (name == "--seed") {
+                transaction_options.seed = rectangle_options.seed = std::stoull(value);
+                continue;
+            }
+            if (name == "--output-dir") {
+                if (value.empty()) throw std::invalid_argument(value);
+                transaction_options.output_directory = rectangle_options.output_directory = value;
+                continue;
+            }
+            if (mode == "transactions") {
+                if (name == "--items" || name == "--transaction-length" || name == "--query-length") {
+                    size_t& target = name == "--items" ? transaction_options.items
+                                   : name == "--transaction-length" ? transaction_options.transaction_length
+                                   : transaction_options.query_length;
+                    target = std::stoull(value);
+                    if (target == 0) throw std::invalid_argument(value);
+                    continue;
+                }
+                if (name == "--zipf") {
+                    transaction_options.zipf_exponent = std::stod(value);
+                    if (!(transaction_options.zipf_exponent >= 0.0)) throw std::invalid_argument(value);
+                    continue;
+                }
+            } else {
+                if (name == "--distribution") {
+                    if (value != "uniform" && value != "clustered") throw std::invalid_argument(value);
+                    rectangle_options.clustered = value == "clustered";
+                    continue;
+                }
+                if (name == "--clusters") {
+                    rectangle_options.clusters = std::stoull(value);
+                    if (rectangle_options.clusters == 0) throw std::invalid_argument(value);
+                    continue;
+                }
+                if (name == "--spread" || name == "--size" || name == "--query-size") {
+                    double& target = name == "--spread" ? rectangle_options.spread
+                                   : name == "--size" ? rectangle_options.size : rectangle_options.query_size;
+                    target = std::stod(value);
+                    if (!(target > 0.0)) throw std::invalid_argument(value);
+                    continue;
+                }
+                if (name == "--bounds") {
+                    size_t position = 0;
+                    for (size_t bound = 0; bound < 4; bound++) {
+                        size_t length = 0;
+                        rectangle_options.bounds[bound] = std::stod(value.substr(position), &length);
+                        position += length;
+                        if (bound < 3 && (position >= value.size() || value[position++] != ',')) throw std::invalid_argument(value);
+                    }
+                    if (position != value.size() || !(rectangle_options.bounds[0] < rectangle_options.bounds[2]) ||
+                        !(rectangle_options.bounds[1] < rectangle_options.bounds[3]))
+                        throw std::invalid_argument(value);
+                    continue;
+                }
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << "\n";
+        exit(-1);
+    }
+
+    if (mode == "transactions") generate_transactions(transaction_options);
+    else generate_rectangles(rectangle_options);
+    return 0;
+}
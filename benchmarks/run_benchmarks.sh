@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# Builds the query programs, generates synthetic data, and benchmarks every method of the four query programs
+# on it, then on the sample data of the repository. Writes one JSON report per run into the output directory,
+# and all of them, as one JSON array, into <output directory>/results.json.
+#
+# Usage: benchmarks/run_benchmarks.sh [output directory] [extra options of the bench modes, e.g. --repeat=5]
+#
+# Sizes can be changed through the environment: TRANSACTIONS, ITEM_QUERIES, OBJECTS, SPATIAL_QUERIES, K, SEED.
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+OUT="$(mkdir -p "${1:-benchmark-results}" && cd "${1:-benchmark-results}" && pwd)"
+shift || true
+BENCH_OPTIONS=("$@")
+
+TRANSACTIONS="${TRANSACTIONS:-100000}"
+ITEM_QUERIES="${ITEM_QUERIES:-500}"
+OBJECTS="${OBJECTS:-200000}"
+SPATIAL_QUERIES="${SPATIAL_QUERIES:-2000}"
+K="${K:-10}"
+SEED="${SEED:-1}"
+CXX="${CXX:-g++}"
+CXXFLAGS=(-std=c++20 -O2 -march=native)
+
+echo "Building into $OUT/bin"
+mkdir -p "$OUT/bin" "$OUT/data/transactions" "$OUT/data/uniform" "$OUT/data/clustered" "$OUT/reports"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/benchmarks/generate_data.cpp" -o "$OUT/bin/generate_data"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/query-processing/containment-queries/main.cpp" -o "$OUT/bin/containment"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/query-processing/relevance-queries/main.cpp" -o "$OUT/bin/relevance"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/spatial-data/r_tree_bulk_loading/r_tree_bulk_loading.cpp" -o "$OUT/bin/bulk_loading"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/spatial-data/range_queries/range_queries.cpp" -o "$OUT/bin/range_queries"
+"$CXX" "${CXXFLAGS[@]}" "$ROOT/spatial-data/k_nearest_neighbors/k_nearest_neighbors.cpp" -o "$OUT/bin/k_nearest_neighbors"
+
+echo "Generating data"
+"$OUT/bin/generate_data" transactions "$TRANSACTIONS" "$ITEM_QUERIES" --seed="$SEED" --output-dir="$OUT/data/transactions"
+for distribution in uniform clustered; do
+    "$OUT/bin/generate_data" rectangles "$OBJECTS" "$SPATIAL_QUERIES" --distribution="$distribution" --seed="$SEED" \
+        --output-dir="$OUT/data/$distribution"
+    # The loader writes Rtree.bin into its working directory.
+    (cd "$OUT/data/$distribution" && "$OUT/bin/bulk_loading" coords.txt offsets.txt > bulk_loading.log)
+done
+SAMPLE_TREE_DIR="$OUT/data/sample"
+mkdir -p "$SAMPLE_TREE_DIR"
+(cd "$SAMPLE_TREE_DIR" && "$OUT/bin/bulk_loading" "$ROOT/spatial-data/r_tree_bulk_loading/coords.txt" \
+    "$ROOT/spatial-data/r_tree_bulk_loading/offsets.txt" > bulk_loading.log)
+
+# run <report name> <program> <arguments...>: one bench run, its report in reports/<report name>.json.
+run() {
+    local name="$1"
+    shift
+    echo "Benchmarking $name"
+    "$@" "${BENCH_OPTIONS[@]}" --json="$OUT/reports/$name.json"
+}
+
+for data in "$OUT/data/transactions" "$ROOT/query-processing/containment-queries"; do
+    label="$([ "$data" = "$OUT/data/transactions" ] && echo zipf || echo sample)"
+    # Two words of superimposed signature per transaction of this data set (awk also counts a last line without '\n').
+    transactions="$(awk 'END { print NR }' "$data/transactions.txt")"
+    run "containment_$label" "$OUT/bin/containment" bench "$data/transactions.txt" "$data/queries.txt" --signature-memory=$((transactions * 16))
+done
+for data in "$OUT/data/transactions" "$ROOT/query-processing/relevance-queries"; do
+    label="$([ "$data" = "$OUT/data/transactions" ] && echo zipf || echo sample)"
+    run "relevance_${label}_top$K" "$OUT/bin/relevance" bench "$data/transactions.txt" "$data/queries.txt" "$K"
+    run "relevance_${label}_all" "$OUT/bin/relevance" bench "$data/transactions.txt" "$data/queries.txt" 0
+done
+
+for distribution in uniform clustered; do
+    data="$OUT/data/$distribution"
+    run "range_$distribution" "$OUT/bin/range_queries" bench "$data/Rtree.bin" "$data/rqueries.txt" \
+        --coords="$data/coords.txt" --offsets="$data/offsets.txt"
+    run "knn_$distribution" "$OUT/bin/k_nearest_neighbors" bench "$data/Rtree.bin" "$data/knqueries.txt" "$K" \
+        --coords="$data/coords.txt" --offsets="$data/offsets.txt"
+done
+run range_sample "$OUT/bin/range_queries" bench "$SAMPLE_TREE_DIR/Rtree.bin" "$ROOT/spatial-data/range_queries/rqueries.txt" \
+    --coords="$ROOT/spatial-data/r_tree_bulk_loading/coords.txt" --offsets="$ROOT/spatial-data/r_tree_bulk_loading/offsets.txt"
+run knn_sample "$OUT/bin/k_nearest_neighbors" bench "$SAMPLE_TREE_DIR/Rtree.bin" "$ROOT/spatial-data/k_nearest_neighbors/knqueries.txt" "$K" \
+    --coords="$ROOT/spatial-data/r_tree_bulk_loading/coords.txt" --offsets="$ROOT/spatial-data/r_tree_bulk_loading/offsets.txt"
+
+# Every report is one JSON object: results.json is the array of all of them.
+{
+    echo "["
+    first=1
+    for report in "$OUT"/reports/*.json; do
+        [ "$first" = 1 ] || echo ","
+        first=0
+        cat "$report"
+    done
+    echo "]"
+} > "$OUT/results.json"
+echo "Wrote $OUT/results.json"
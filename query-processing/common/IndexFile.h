@@ -0,0 +1,233 @@
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Versioned binary index file shared by the query-processing programs.
+ *
+ *   IndexFileHeader
+ *   IndexSection sections[section_count]   id, offset and size of every section
+ *   section data                           every section starts at a multiple of INDEX_SECTION_ALIGNMENT
+ *
+ * A section is a plain array of fixed-size records (ints, doubles, offsets, packed words...), so the
+ * program that maps the file reads its index straight from the mapping without parsing anything.
+ * Each program defines its own file kind and section ids. Files are written in the byte order of the
+ * machine that builds them.
+ */
+constexpr char INDEX_FILE_MAGIC[8] = {'Q', 'P', 'I', 'N', 'D', 'E', 'X', '\0'};
+constexpr uint32_t INDEX_FILE_VERSION = 1;
+constexpr size_t INDEX_SECTION_ALIGNMENT = 64;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t section_count;
+    uint32_t padding;
+    uint64_t file_size;
+};
+
+struct IndexSection {
+    uint32_t id;
+    uint32_t padding;
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * Collects sections and writes them out as one index file.
+ * Sections are referenced, not copied: the arrays must stay alive until write() returns.
+ */
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const uint32_t kind) : kind(kind) {}
+
+    /**
+     * Adds a section.
+     * @param id Section id, unique within the file
+     * @param values The records of the section
+     */
+    template<typename T>
+    void add(const uint32_t id, const std::span<const T> values) {
+        sections.push_back({id, reinterpret_cast<const char*>(values.data()), values.size_bytes()});
+    }
+
+    template<typename T>
+    void add(const uint32_t id, const std::vector<T>& values) { add(id, std::span<const T>(values)); }
+
+    /**
+     * Writes the file. Exits with an error message if it cannot be written.
+     * @param file_name The index file to create
+     */
+    void write(const std::string& file_name) const {
+        std::vector<IndexSection> table(sections.size());
+        uint64_t offset = round_up(sizeof(IndexFileHeader) + table.size() * sizeof(IndexSection));
+        for (size_t i = 0; i < sections.size(); i++) {
+            table[i] = {sections[i].id, 0, offset, sections[i].size};
+            offset = round_up(offset + sections[i].size);
+        }
+
+        IndexFileHeader header{};
+        std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+        header.version = INDEX_FILE_VERSION;
+        header.kind = kind;
+        header.section_count = static_cast<uint32_t>(table.size());
+        header.file_size = offset;
+
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not open " << file_name << " for writing" << std::endl;
+            std::exit(-1);
+        }
+
+        uint64_t written = 0;
+        const auto write_bytes = [&](const char* bytes, const size_t size) {
+            out.write(bytes, static_cast<std::streamsize>(size));
+            written += size;
+        };
+        const auto pad_to = [&](const uint64_t position) {
+            static constexpr char zeros[INDEX_SECTION_ALIGNMENT] = {};
+            write_bytes(zeros, position - written);
+        };
+
+        write_bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_bytes(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(IndexSection));
+        for (size_t i = 0; i < sections.size(); i++) {
+            pad_to(table[i].offset);
+            write_bytes(sections[i].bytes, sections[i].size);
+        }
+        pad_to(header.file_size);
+
+        if (!out.flush()) {
+            std::cerr << "Failed to write " << file_name << std::endl;
+            std::exit(-1);
+        }
+    }
+
+private:
+    struct PendingSection {
+        uint32_t id;
+        const char* bytes;
+        size_t size;
+    };
+
+    uint32_t kind;
+    std::vector<PendingSection> sections;
+
+    static uint64_t round_up(const uint64_t value) {
+        return (value + INDEX_SECTION_ALIGNMENT - 1) / INDEX_SECTION_ALIGNMENT * INDEX_SECTION_ALIGNMENT;
+    }
+};
+
+/**
+ * Read-only, memory-mapped index file. Sections are views into the mapping and stay valid as long as the file lives.
+ */
+class IndexFile {
+public:
+    /**
+     * Maps and validates an index file. Exits with an error message if the file is not an index of the expected kind.
+     * @param file_name The index file
+     * @param expected_kind The kind the caller knows how to read
+     */
+    IndexFile(const std::string& file_name, const uint32_t expected_kind) {
+        const int fd = ::open(file_name.c_str(), O_RDONLY);
+        struct stat status{};
+        if (fd < 0 || ::fstat(fd, &status) != 0) {
+            std::cerr << "Could not open file " << file_name << std::endl;
+            std::exit(-1);
+        }
+        size = static_cast<size_t>(status.st_size);
+        if (size > 0) {
+            void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) data = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+
+        IndexFileHeader header{};
+        if (data != nullptr && size >= sizeof(header)) std::memcpy(&header, data, sizeof(header));
+        if (data == nullptr || size < sizeof(header) || std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) != 0) {
+            std::cerr << file_name << " is not an index file" << std::endl;
+            std::exit(-1);
+        }
+        if (header.version != INDEX_FILE_VERSION || header.kind != expected_kind) {
+            std::cerr << file_name << " is an index of version " << header.version << " and kind " << header.kind
+                      << ", expected version " << INDEX_FILE_VERSION << " and kind " << expected_kind
+                      << ". Rebuild it with build-index." << std::endl;
+            std::exit(-1);
+        }
+        if (header.file_size != size || sizeof(header) + header.section_count * sizeof(IndexSection) > size) {
+            std::cerr << file_name << " is truncated or corrupt" << std::endl;
+            std::exit(-1);
+        }
+
+        sections.resize(header.section_count);
+        std::memcpy(sections.data(), data + sizeof(header), sections.size() * sizeof(IndexSection));
+        for (const IndexSection& section : sections) {
+            if (section.offset % INDEX_SECTION_ALIGNMENT != 0 || section.offset + section.size > size) {
+                std::cerr << file_name << " is truncated or corrupt" << std::endl;
+                std::exit(-1);
+            }
+        }
+        this->file_name = file_name;
+    }
+
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+
+    IndexFile(IndexFile&& other) noexcept
+        : file_name(std::move(other.file_name)), data(std::exchange(other.data, nullptr)),
+          size(std::exchange(other.size, 0)), sections(std::move(other.sections)) {}
+
+    ~IndexFile() {
+        if (data != nullptr) ::munmap(const_cast<char*>(data), size);
+    }
+
+    /**
+     * @param file_name Any file
+     * @return True if the file starts like an index file (of any version or kind)
+     */
+    static bool is_index_file(const std::string& file_name) {
+        std::ifstream file(file_name, std::ios::binary);
+        char magic[sizeof(INDEX_FILE_MAGIC)] = {};
+        file.read(magic, sizeof(magic));
+        return file && std::memcmp(magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) == 0;
+    }
+
+    /**
+     * Typed view of a section. Exits with an error message if the section is missing or not a whole number of records.
+     * @param id The section id
+     * @return The records of the section
+     */
+    template<typename T>
+    [[nodiscard]] std::span<const T> section(const uint32_t id) const {
+        for (const IndexSection& section : sections) {
+            if (section.id != id) continue;
+            if (section.size % sizeof(T) != 0) break;
+            return {reinterpret_cast<const T*>(data + section.offset), section.size / sizeof(T)};
+        }
+        std::cerr << file_name << " has no valid section " << id << ". Rebuild it with build-index." << std::endl;
+        std::exit(-1);
+    }
+
+private:
+    std::string file_name;
+    const char* data = nullptr;
+    size_t size = 0;
+    std::vector<IndexSection> sections;
+};
+
+#endif //INDEX_FILE_H
@@ -0,0 +1,322 @@
+#ifndef ITEM_SETS_H
+#define ITEM_SETS_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Item sets (the transactions of a transactions file) in compressed sparse row (CSR) layout:
+ *
+ *   offsets  size() + 1 entries, the items of set i are items[offsets[i] .. offsets[i + 1])
+ *   items    the items of every set, in file order, back to back in one array
+ *
+ * Two allocations in all, however many sets there are, and set i is read as a span. The sets either own the
+ * two arrays or view arrays owned elsewhere (the sections of a mapped index file), and then allocate nothing
+ * until a set is appended.
+ */
+class ItemSets {
+public:
+    ItemSets() : owned_offsets{0} { view_owned(); }
+
+    /**
+     * Views arrays laid out like those of offset_array() and item_array(), e.g. sections of a mapped index file,
+     * without copying them: they must outlive the sets, until push_back() copies them.
+     * Check valid() before reading a view of untrusted data.
+     */
+    ItemSets(const std::span<const uint64_t> offsets, const std::span<const int> items) : offsets(offsets), items(items) {}
+
+    /**
+     * Takes arrays laid out like those of offset_array() and item_array().
+     */
+    ItemSets(std::vector<uint64_t>&& offsets, std::vector<int>&& items)
+        : owned_offsets(std::move(offsets)), owned_items(std::move(items)) { view_owned(); }
+
+    ItemSets(const ItemSets&) = delete;
+    ItemSets& operator=(const ItemSets&) = delete;
+    //Moving a vector keeps its buffer, so the spans stay valid.
+    ItemSets(ItemSets&&) = default;
+    ItemSets& operator=(ItemSets&&) = default;
+
+    /**
+     * @return True if the offsets start at 0, never decrease and end at the number of items
+     */
+    [[nodiscard]] bool valid() const {
+        return !offsets.empty() && offsets.front() == 0 && offsets.back() == items.size() && std::ranges::is_sorted(offsets);
+    }
+
+    /**
+     * @return Number of sets
+     */
+    [[nodiscard]] size_t size() const { return offsets.size() - 1; }
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    /**
+     * @param i Index of a set, in [0, size())
+     * @return Its items, in file order
+     */
+    [[nodiscard]] std::span<const int> operator[](const size_t i) const {
+        return {items.data() + offsets[i], offsets[i + 1] - offsets[i]};
+    }
+
+    /**
+     * Appends a set, which gets index size(). Viewed arrays are copied first.
+     * @param set Its items
+     */
+    void push_back(const std::span<const int> set) {
+        //Owned offsets always hold at least the leading 0: none means a view.
+        if (owned_offsets.empty()) {
+            owned_offsets.assign(offsets.begin(), offsets.end());
+            owned_items.assign(items.begin(), items.end());
+        }
+        owned_items.insert(owned_items.end(), set.begin(), set.end());
+        owned_offsets.push_back(owned_items.size());
+        view_owned();
+    }
+
+    [[nodiscard]] std::span<const uint64_t> offset_array() const { return offsets; }
+
+    [[nodiscard]] std::span<const int> item_array() const { return items; }
+
+    /**
+     * Sets as iterated by a range-for: a span per set.
+     */
+    class Iterator {
+    public:
+        Iterator(const ItemSets& sets, const size_t i) : sets(&sets), i(i) {}
+        std::span<const int> operator*() const { return (*sets)[i]; }
+        Iterator& operator++() { i++; return *this; }
+        bool operator!=(const Iterator& other) const { return i != other.i; }
+
+    private:
+        const ItemSets* sets;
+        size_t i;
+    };
+
+    [[nodiscard]] Iterator begin() const { return {*this, 0}; }
+
+    [[nodiscard]] Iterator end() const { return {*this, size()}; }
+
+private:
+    std::vector<uint64_t> owned_offsets; ///< The offsets, if owned; empty for a view
+    std::vector<int> owned_items;
+    std::span<const uint64_t> offsets; ///< The offsets read, owned or viewed
+    std::span<const int> items;
+
+    void view_owned() {
+        offsets = owned_offsets;
+        items = owned_items;
+    }
+};
+
+// Below this many bytes per thread, a file is parsed by fewer threads.
+constexpr size_t ITEM_SETS_MIN_CHUNK_BYTES = size_t{1} << 20;
+
+/**
+ * Parses lines of item sets: every line is a set and every run of digits an item, anything else
+ * ('[', ']', ',', ' ', '\r') separating them. Lines are the same as std::getline's: a last line
+ * without a line break counts, an empty last line does not.
+ *
+ * The AVX2 kernel classifies 32 bytes at a time into digit and line break masks and jumps from one
+ * digit run boundary or line break to the next with count-trailing-zeros, so separators cost nothing.
+ * The scalar kernel looks at every byte. The kernel is picked at run time, depending on the CPU.
+ */
+class ItemSetParser {
+public:
+    /**
+     * Items and line ends of a parsed chunk. line_ends[i]: number of items up to the end of chunk line i.
+     */
+    struct Chunk {
+        std::vector<int> items;
+        std::vector<uint64_t> line_ends;
+    };
+
+    /**
+     * @param begin First byte of the chunk, at the start of a line
+     * @param end One past its last byte, after a line break or at the end of the file
+     * @return The parsed chunk
+     */
+    static Chunk parse(const char* const begin, const char* const end) {
+        static const auto kernel = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &avx2_kernel : &scalar_kernel;
+        }();
+
+        Chunk chunk;
+        chunk.items.reserve(static_cast<size_t>(end - begin) / 3);
+        kernel(begin, end, chunk);
+        return chunk;
+    }
+
+    static void scalar_kernel(const char* const begin, const char* const end, Chunk& chunk) {
+        uint32_t number = 0;
+        bool building = false;
+        for (const char* p = begin; p < end; p++) {
+            const auto digit = static_cast<uint32_t>(static_cast<unsigned char>(*p) - '0');
+            if (digit <= 9) {
+                number = number * 10 + digit;
+                building = true;
+                continue;
+            }
+            if (building) {
+                chunk.items.push_back(static_cast<int>(number));
+                number = 0;
+                building = false;
+            }
+            if (*p == '\n') chunk.line_ends.push_back(chunk.items.size());
+        }
+        finish(begin, end, building, number, chunk);
+    }
+
+    __attribute__((target("avx2")))
+    static void avx2_kernel(const char* const begin, const char* const end, Chunk& chunk) {
+        const __m256i zero = _mm256_set1_epi8('0' - 1);
+        const __m256i nine = _mm256_set1_epi8('9' + 1);
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const char* number_start = nullptr;   // Start of the digit run being read, if any
+        uint32_t previous_digit = 0;          // 1 if the last byte of the previous block is a digit
+
+        alignas(32) char tail[32];
+        for (const char* block = begin; block < end; block += 32) {
+            const size_t length = std::min<size_t>(32, static_cast<size_t>(end - block));
+            const char* bytes = block;
+            if (length < 32) {
+                //Zeros are neither digits nor line breaks: they close a trailing digit run.
+                std::fill(std::begin(tail), std::end(tail), '\0');
+                std::copy(block, block + length, tail);
+                bytes = tail;
+            }
+
+            //Signed compares are fine: bytes above 0x7F are negative, so never digits.
+            const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+            const auto digits = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpgt_epi8(data, zero), _mm256_cmpgt_epi8(nine, data))));
+            const auto line_breaks = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, newline)));
+
+            //Bit i set where byte i starts or ends (is the first byte after) a digit run.
+            uint32_t events = (digits ^ ((digits << 1) | previous_digit)) | line_breaks;
+            previous_digit = digits >> 31;
+            while (events != 0) {
+                const auto i = static_cast<unsigned>(std::countr_zero(events));
+                events &= events - 1;
+                if ((digits >> i) & 1) {
+                    number_start = block + i;
+                    continue;
+                }
+                if (number_start != nullptr) {
+                    chunk.items.push_back(parse_digits(number_start, block + i));
+                    number_start = nullptr;
+                }
+                if ((line_breaks >> i) & 1) chunk.line_ends.push_back(chunk.items.size());
+            }
+        }
+        //The zero padding closed any digit run, unless the chunk ends exactly at a block boundary.
+        uint32_t number = 0;
+        if (number_start != nullptr) number = static_cast<uint32_t>(parse_digits(number_start, end));
+        finish(begin, end, number_start != nullptr, number, chunk);
+    }
+
+private:
+    static int parse_digits(const char* first, const char* const last) {
+        uint32_t number = 0;
+        for (; first < last; first++) number = number * 10 + static_cast<uint32_t>(*first - '0');
+        return static_cast<int>(number);
+    }
+
+    /**
+     * Adds the item being read at the end of the chunk, and the last line if it has no line break.
+     */
+    static void finish(const char* const begin, const char* const end, const bool building, const uint32_t number, Chunk& chunk) {
+        if (building) chunk.items.push_back(static_cast<int>(number));
+        if (end > begin && end[-1] != '\n') chunk.line_ends.push_back(chunk.items.size());
+    }
+};
+
+/**
+ * Loads a file of item sets, one per line (see ItemSetParser), e.g. "[1, 5, 9]".
+ *
+ * The file is mapped and split into one chunk per thread at line breaks, the chunks are parsed in
+ * parallel, and each thread then copies its items and offsets to their place in the result.
+ * Exits with an error message if the file cannot be read.
+ *
+ * @param file_name The item sets file
+ * @param threads Threads parsing the file at most, one per core by default
+ * @return The item sets, in file order
+ */
+inline ItemSets load_item_sets(const std::string& file_name, size_t threads = std::thread::hardware_concurrency()) {
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    struct stat status{};
+    if (fd < 0 || ::fstat(fd, &status) != 0) {
+        std::cerr << "Could not open file " << file_name << std::endl;
+        std::exit(-1);
+    }
+    const auto size = static_cast<size_t>(status.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return {};
+    }
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Could not map file " << file_name << std::endl;
+        std::exit(-1);
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    const char* const data = static_cast<const char*>(mapping);
+
+    //Chunk c covers [bounds[c], bounds[c + 1]), every bound but the first just after a line break.
+    threads = std::clamp<size_t>(size / ITEM_SETS_MIN_CHUNK_BYTES, 1, std::max<size_t>(threads, 1));
+    std::vector<size_t> bounds{0};
+    for (size_t c = 1; c < threads; c++) {
+        const size_t target = std::max(size * c / threads, bounds.back());
+        const void* line_break = target < size ? std::memchr(data + target, '\n', size - target) : nullptr;
+        bounds.push_back(line_break == nullptr ? size : static_cast<size_t>(static_cast<const char*>(line_break) - data) + 1);
+    }
+    bounds.push_back(size);
+
+    const size_t chunk_count = bounds.size() - 1;
+    std::vector<ItemSetParser::Chunk> chunks(chunk_count);
+    const auto run_parallel = [chunk_count](const auto& work) {
+        std::vector<std::thread> workers;
+        for (size_t c = 1; c < chunk_count; c++) workers.emplace_back(work, c);
+        work(0);
+        for (std::thread& worker : workers) worker.join();
+    };
+
+    run_parallel([&](const size_t c) { chunks[c] = ItemSetParser::parse(data + bounds[c], data + bounds[c + 1]); });
+    ::munmap(mapping, size);
+
+    //Where the items and the lines of every chunk go.
+    std::vector<uint64_t> item_base(chunk_count + 1, 0), line_base(chunk_count + 1, 0);
+    for (size_t c = 0; c < chunk_count; c++) {
+        item_base[c + 1] = item_base[c] + chunks[c].items.size();
+        line_base[c + 1] = line_base[c] + chunks[c].line_ends.size();
+    }
+    std::vector<uint64_t> offsets(line_base.back() + 1, 0);
+    std::vector<int> items(item_base.back());
+    run_parallel([&](const size_t c) {
+        std::copy(chunks[c].items.begin(), chunks[c].items.end(), items.begin() + static_cast<std::ptrdiff_t>(item_base[c]));
+        for (size_t line = 0; line < chunks[c].line_ends.size(); line++)
+            offsets[line_base[c] + line + 1] = item_base[c] + chunks[c].line_ends[line];
+        std::vector<int>().swap(chunks[c].items);
+    });
+
+    return {std::move(offsets), std::move(items)};
+}
+
+#endif //ITEM_SETS_H
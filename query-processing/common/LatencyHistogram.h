@@ -0,0 +1,90 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Histogram of latencies in nanoseconds with log-linear buckets, safe to record into from many threads.
+ *
+ * Values below 2^SUB_BUCKET_BITS get a bucket each; above, every power of two is split into
+ * 2^SUB_BUCKET_BITS equal buckets, so a percentile is reported within 1/8 of its true value whatever
+ * its magnitude. Recording is a handful of relaxed atomic increments, no lock is taken.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = 2 * SUB_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    /**
+     * @param nanoseconds A latency
+     */
+    void record(const uint64_t nanoseconds) {
+        buckets[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t seen = maximum.load(std::memory_order_relaxed);
+        while (nanoseconds > seen && !maximum.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {}
+    }
+
+    /**
+     * @return Number of recorded latencies
+     */
+    [[nodiscard]] uint64_t recorded() const { return count.load(std::memory_order_relaxed); }
+
+    /**
+     * @return Mean latency in nanoseconds, 0 if nothing was recorded
+     */
+    [[nodiscard]] double mean() const {
+        const uint64_t n = recorded();
+        return n == 0 ? 0.0 : static_cast<double>(total.load(std::memory_order_relaxed)) / static_cast<double>(n);
+    }
+
+    /**
+     * @return Largest recorded latency in nanoseconds
+     */
+    [[nodiscard]] uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+
+    /**
+     * @param fraction In [0, 1], e.g. 0.99 for the 99th percentile
+     * @return Upper bound of the bucket holding the percentile (capped at max()), 0 if nothing was recorded
+     */
+    [[nodiscard]] uint64_t percentile(const double fraction) const {
+        const uint64_t n = recorded();
+        if (n == 0) return 0;
+
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * static_cast<double>(n) + 0.5));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+            seen += buckets[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(bucket_upper_bound(bucket), max());
+        }
+        return max();
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> maximum{0};
+
+    static size_t bucket_of(const uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) return static_cast<size_t>(value);
+        const unsigned exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+        const auto sub_bucket = static_cast<size_t>((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    static uint64_t bucket_upper_bound(const size_t bucket) {
+        if (bucket < 2 * SUB_BUCKETS) return bucket;
+        const size_t exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        const uint64_t width = uint64_t{1} << (exponent - SUB_BUCKET_BITS);
+        return (uint64_t{1} << exponent) + (bucket % SUB_BUCKETS + 1) * width - 1;
+    }
+};
+
+#endif //LATENCY_HISTOGRAM_H
@@ -0,0 +1,317 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "LatencyHistogram.h"
+#include "ThreadPool.h"
+
+/**
+ * How a query server runs: worker threads answering requests, and where requests come from.
+ */
+struct ServerOptions {
+    size_t threads;
+    int port;   // 0: one client on stdin/stdout, otherwise TCP connections on 127.0.0.1:port
+};
+
+/**
+ * Parses the optional "--name=value" arguments of the serve mode.
+ * Exits with an error message on an unknown option or a malformed value.
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @return The parsed options: one thread per core and stdin/stdout unless given
+ */
+inline ServerOptions parse_server_options(const int argc, char* argv[], const int first_option) {
+    ServerOptions options{std::max(1u, std::thread::hardware_concurrency()), 0};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (name == "--threads") {
+                options.threads = std::stoull(value);
+                if (options.threads == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--port") {
+                options.port = std::stoi(value);
+                if (options.port <= 0 || options.port > 65535) throw std::invalid_argument(value);
+                continue;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
+/**
+ * Answer to one request. kind selects the latency histogram the request is recorded in.
+ */
+struct ServerResponse {
+    static constexpr size_t UNTIMED = static_cast<size_t>(-1);   // Malformed requests, not recorded
+
+    size_t kind;
+    std::string text;
+};
+
+/**
+ * Long-running server answering one request per line with one response line, over stdin/stdout or TCP.
+ *
+ * Requests run concurrently on a thread pool: the handler must only read the state it shares (the
+ * index built or mapped before the server starts). Requests of one client may complete out of order,
+ * but its responses are written back in request order.
+ *
+ * Requests that change the shared state (appends) are sequenced: the reader of the client waits for every
+ * earlier request of the client to complete, runs the request itself, and reads the next request only once
+ * it is applied. So a client's appends are applied in its request order, its earlier queries do not see
+ * them and its later queries do, as if its requests ran one after the other.
+ *
+ * Besides the requests understood by the handler, "stats" answers with the latency histograms of every
+ * request kind as one JSON line. Latencies are measured from the moment a request is read until its
+ * response is ready, so they include the time spent waiting for a free worker.
+ */
+class QueryServer {
+public:
+    using Handler = std::function<ServerResponse(const std::string& request)>;
+    using Sequenced = std::function<bool(const std::string& request)>;
+
+    // Requests of one client accepted ahead of the response being written; the client is read no further.
+    static constexpr size_t MAX_PENDING_REQUESTS = 1024;
+
+    /**
+     * @param kinds Names of the request kinds, in the order of ServerResponse::kind
+     * @param options Worker threads and port
+     * @param handler Answers a request, called concurrently from the worker threads
+     * @param sequenced Tells the requests that change the shared state, run in request order (see above)
+     */
+    QueryServer(const std::vector<std::string>& kinds, const ServerOptions& options, Handler handler, Sequenced sequenced)
+        : kinds(kinds), options(options), handler(std::move(handler)), sequenced(std::move(sequenced)), pool(options.threads) {
+        for (size_t i = 0; i < kinds.size(); i++) latencies.push_back(std::make_unique<LatencyHistogram>());
+    }
+
+    /**
+     * Serves stdin until it is closed, then prints the statistics to stderr.
+     * With a port, accepts connections forever, each client being served by its own reader thread.
+     */
+    void run() {
+        std::signal(SIGPIPE, SIG_IGN);
+
+        if (options.port == 0) {
+            std::cerr << "Serving requests on stdin with " << pool.size() << " threads" << std::endl;
+            serve_client(STDIN_FILENO, STDOUT_FILENO);
+            std::cerr << stats_json() << std::endl;
+            return;
+        }
+
+        const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listener, SOMAXCONN) != 0) {
+            std::cerr << "Could not listen on port " << options.port << std::endl;
+            std::exit(-1);
+        }
+
+        std::cerr << "Listening on 127.0.0.1:" << options.port << " with " << pool.size() << " threads" << std::endl;
+        while (true) {
+            const int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            std::thread([this, client] {
+                serve_client(client, client);
+                ::close(client);
+            }).detach();
+        }
+    }
+
+    /**
+     * @return For every request kind: count, mean, 50th, 90th, 99th percentile and max latency in microseconds
+     */
+    [[nodiscard]] std::string stats_json() const {
+        std::ostringstream out;
+        out << "{\"requests\": {";
+        for (size_t i = 0; i < kinds.size(); i++) {
+            const LatencyHistogram& histogram = *latencies[i];
+            out << (i > 0 ? ", " : "") << "\"" << kinds[i] << "\": {\"count\": " << histogram.recorded()
+                << ", \"mean_us\": " << histogram.mean() / 1e3
+                << ", \"p50_us\": " << static_cast<double>(histogram.percentile(0.50)) / 1e3
+                << ", \"p90_us\": " << static_cast<double>(histogram.percentile(0.90)) / 1e3
+                << ", \"p99_us\": " << static_cast<double>(histogram.percentile(0.99)) / 1e3
+                << ", \"max_us\": " << static_cast<double>(histogram.max()) / 1e3 << "}";
+        }
+        out << "}}";
+        return out.str();
+    }
+
+private:
+    std::vector<std::string> kinds;
+    ServerOptions options;
+    Handler handler;
+    Sequenced sequenced;
+    std::vector<std::unique_ptr<LatencyHistogram>> latencies;
+    ThreadPool pool;
+
+    /**
+     * Reads requests from in_fd, hands them to the pool and writes their responses to out_fd in order.
+     * Sequenced requests run on the reader, once the requests before them have completed.
+     * Returns once in_fd is closed and every response has been written (or the client went away).
+     */
+    void serve_client(const int in_fd, const int out_fd) {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::future<std::string>> pending;
+        size_t running = 0;   // Requests handed to the pool and not completed yet
+        bool reading = true;
+
+        std::thread writer([&] {
+            while (true) {
+                std::future<std::string> response;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return !pending.empty() || !reading; });
+                    if (pending.empty()) return;
+                    response = std::move(pending.front());
+                }
+                const std::string line = response.get() + '\n';
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending.pop_front();
+                }
+                changed.notify_all();
+                //Keep draining after a write error, so the reader is never left waiting for room.
+                write_all(out_fd, line);
+            }
+        });
+
+        std::string buffer, request;
+        size_t consumed = 0;
+        while (read_line(in_fd, buffer, consumed, request)) {
+            const auto received = std::chrono::steady_clock::now();
+            const auto answer = [this, request, received] {
+                if (request == "stats") return stats_json();
+                ServerResponse response = handler(request);
+                if (response.kind < latencies.size()) {
+                    const auto elapsed = std::chrono::steady_clock::now() - received;
+                    latencies[response.kind]->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                }
+                return std::move(response.text);
+            };
+
+            if (sequenced(request)) {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return running == 0 && pending.size() < MAX_PENDING_REQUESTS; });
+                lock.unlock();
+
+                std::promise<std::string> response;
+                response.set_value(answer());
+                lock.lock();
+                pending.push_back(response.get_future());
+                lock.unlock();
+                changed.notify_all();
+                continue;
+            }
+
+            //The task counts itself out before its response is ready, so nothing of it runs once the writer is done.
+            auto task = std::make_shared<std::packaged_task<std::string()>>([&, answer] {
+                std::string text = answer();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    running--;
+                }
+                changed.notify_all();
+                return text;
+            });
+
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return pending.size() < MAX_PENDING_REQUESTS; });
+            pending.push_back(task->get_future());
+            running++;
+            pool.submit([task] { (*task)(); });
+            lock.unlock();
+            changed.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reading = false;
+        }
+        changed.notify_all();
+        writer.join();
+    }
+
+    /**
+     * Extracts the next line (without its '\n' or "\r\n") from buffered reads of fd.
+     * @return False once fd is closed and no complete or partial line is left
+     */
+    static bool read_line(const int fd, std::string& buffer, size_t& consumed, std::string& line) {
+        while (true) {
+            const size_t end = buffer.find('\n', consumed);
+            if (end != std::string::npos) {
+                line.assign(buffer, consumed, end - consumed);
+                consumed = end + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+
+            buffer.erase(0, consumed);
+            consumed = 0;
+            char chunk[1 << 16];
+            const ssize_t count = ::read(fd, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) {
+                if (buffer.empty()) return false;
+                line = std::move(buffer);
+                buffer.clear();
+                return true;
+            }
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+    }
+
+    static void write_all(const int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            const ssize_t count = ::write(fd, data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return;
+            written += static_cast<size_t>(count);
+        }
+    }
+};
+
+#endif //QUERY_SERVER_H
@@ -0,0 +1,240 @@
+#ifndef INVERTED_INDEX_H
+#define INVERTED_INDEX_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "../common/ItemSets.h"
+
+/**
+ * Inverted index in compressed sparse row (CSR) layout.
+ *
+ *   items     the distinct items, ascending
+ *   offsets   items.size() + 1 entries, the postings of items[i] are postings[offsets[i] .. offsets[i + 1])
+ *   postings  the ascending transaction ids of every item, back to back in one array
+ *
+ * A posting costs 4 bytes and the lists of all items share one allocation, where a std::set pays a
+ * tree node per posting. Lists are handed out as spans into the array, so queries copy nothing.
+ *
+ * An index either owns its three arrays or views arrays stored elsewhere (e.g. a mapped index file).
+ */
+class InvertedIndex {
+public:
+    explicit InvertedIndex(const ItemSets& transactions) {
+        //Pass 1: distinct items and their posting counts. An item repeated in a transaction is counted once.
+        std::unordered_map<int, std::pair<size_t, int>> counts;   // item -> (postings, last transaction)
+        for (int t_id = 0; t_id < static_cast<int>(transactions.size()); t_id++) {
+            for (const int item : transactions[t_id]) {
+                auto [it, inserted] = counts.try_emplace(item, 0, -1);
+                if (it->second.second == t_id) continue;
+                it->second = {it->second.first + 1, t_id};
+            }
+        }
+
+        owned_items.reserve(counts.size());
+        for (const auto& [item, count] : counts) owned_items.push_back(item);
+        std::sort(owned_items.begin(), owned_items.end());
+
+        owned_offsets.resize(owned_items.size() + 1);
+        std::unordered_map<int, size_t> slots;
+        slots.reserve(owned_items.size());
+        for (size_t slot = 0; slot < owned_items.size(); slot++) {
+            owned_offsets[slot + 1] = owned_offsets[slot] + counts[owned_items[slot]].first;
+            slots.emplace(owned_items[slot], slot);
+        }
+
+        //Pass 2: transactions are visited in order, so every list is filled in ascending order.
+        owned_postings.resize(owned_offsets.back());
+        std::vector<uint64_t> fill(owned_offsets.begin(), owned_offsets.end() - 1);
+        for (int t_id = 0; t_id < static_cast<int>(transactions.size()); t_id++) {
+            for (const int item : transactions[t_id]) {
+                const size_t slot = slots[item];
+                if (fill[slot] > owned_offsets[slot] && owned_postings[fill[slot] - 1] == t_id) continue;
+                owned_postings[fill[slot]++] = t_id;
+            }
+        }
+
+        items = owned_items;
+        offsets = owned_offsets;
+        postings = owned_postings;
+    }
+
+    /**
+     * View of arrays laid out like those of a built index (see item_array(), offset_array() and posting_array()).
+     * Check valid() before querying a view of untrusted data.
+     */
+    InvertedIndex(const std::span<const int> items, const std::span<const uint64_t> offsets, const std::span<const int> postings)
+        : items(items), offsets(offsets), postings(postings) {}
+
+    InvertedIndex(const InvertedIndex&) = delete;
+    InvertedIndex& operator=(const InvertedIndex&) = delete;
+    InvertedIndex(InvertedIndex&&) = default;
+    InvertedIndex& operator=(InvertedIndex&&) = default;
+
+    /**
+     * @return True if the arrays are consistent: sorted items, one offset more than items, increasing offsets within postings
+     */
+    [[nodiscard]] bool valid() const {
+        if (offsets.size() != items.size() + 1 || offsets.front() != 0 || offsets.back() != postings.size()) return false;
+        for (size_t slot = 0; slot < items.size(); slot++) {
+            if (offsets[slot] > offsets[slot + 1] || (slot > 0 && items[slot - 1] >= items[slot])) return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] std::span<const int> item_array() const { return items; }
+
+    [[nodiscard]] std::span<const uint64_t> offset_array() const { return offsets; }
+
+    [[nodiscard]] std::span<const int> posting_array() const { return postings; }
+
+    /**
+     * @return Number of distinct items
+     */
+    [[nodiscard]] size_t item_count() const { return items.size(); }
+
+    /**
+     * @return Total number of postings
+     */
+    [[nodiscard]] size_t posting_count() const { return postings.size(); }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The item id
+     */
+    [[nodiscard]] int item(const size_t slot) const { return items[slot]; }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The ascending transaction ids of the item
+     */
+    [[nodiscard]] std::span<const int> postings_of_slot(const size_t slot) const {
+        return {postings.data() + offsets[slot], offsets[slot + 1] - offsets[slot]};
+    }
+
+    /**
+     * @param item Any item id
+     * @return The ascending transaction ids containing item, empty if it appears nowhere
+     */
+    [[nodiscard]] std::span<const int> find(const int item) const {
+        const auto it = std::lower_bound(items.begin(), items.end(), item);
+        if (it == items.end() || *it != item) return {};
+        return postings_of_slot(it - items.begin());
+    }
+
+private:
+    std::vector<int> owned_items;
+    std::vector<uint64_t> owned_offsets;
+    std::vector<int> owned_postings;
+    std::span<const int> items;
+    std::span<const uint64_t> offsets;
+    std::span<const int> postings;
+};
+
+/**
+ * Posting lists of the transactions appended after an InvertedIndex was built, kept apart until they are
+ * merged into a rebuilt index. Appending a transaction costs one push_back per item.
+ */
+class InvertedIndexDelta {
+public:
+    /**
+     * @param t_id Id of the transaction, larger than every id appended before
+     * @param transaction Its items
+     */
+    void append(const int t_id, const std::span<const int> transaction) {
+        for (const int item : transaction) {
+            std::vector<int>& list = lists[item];
+            if (list.empty() || list.back() != t_id) list.push_back(t_id);
+        }
+    }
+
+    /**
+     * @param item Any item id
+     * @return The ascending ids of the appended transactions containing item
+     */
+    [[nodiscard]] std::span<const int> find(const int item) const {
+        const auto it = lists.find(item);
+        if (it == lists.end()) return {};
+        return it->second;
+    }
+
+    void clear() { lists.clear(); }
+
+private:
+    std::unordered_map<int, std::vector<int>> lists;
+};
+
+// A list this many times longer than the other one is galloped through instead of merged.
+constexpr size_t GALLOPING_RATIO = 16;
+
+/**
+ * Intersects two ascending lists of transaction ids.
+ * When one list is much longer, each id of the short list is located in the long one by galloping
+ * (exponential then binary search from the previous match), touching only a few of its entries.
+ * @param shorter The shorter list
+ * @param longer The longer list
+ * @param result Receives the common ids, ascending (cleared first)
+ */
+inline void intersect_postings(const std::span<const int> shorter, const std::span<const int> longer, std::vector<int>& result) {
+    result.clear();
+
+    if (longer.size() / std::max<size_t>(shorter.size(), 1) < GALLOPING_RATIO) {
+        size_t i = 0, j = 0;
+        while (i < shorter.size() && j < longer.size()) {
+            if (shorter[i] < longer[j]) ++i;
+            else if (shorter[i] > longer[j]) ++j;
+            else {
+                result.push_back(shorter[i]);
+                ++i;
+                ++j;
+            }
+        }
+        return;
+    }
+
+    size_t position = 0;
+    for (const int t_id : shorter) {
+        size_t step = 1;
+        while (position + step < longer.size() && longer[position + step] < t_id) step *= 2;
+        const auto first = longer.begin() + static_cast<std::ptrdiff_t>(position + step / 2);
+        const auto last = longer.begin() + static_cast<std::ptrdiff_t>(std::min(position + step + 1, longer.size()));
+        position = std::lower_bound(first, last, t_id) - longer.begin();
+        if (position == longer.size()) return;
+        if (longer[position] == t_id) result.push_back(t_id);
+    }
+}
+
+/**
+ * Finds the transactions containing every item of a query. Posting lists are intersected shortest first.
+ * The two buffers are reused between calls, so a thread running many queries allocates only while they grow.
+ * @param index The inverted index (an InvertedIndex or an InvertedIndexDelta)
+ * @param query_items_set The items of the query
+ * @param result Receives the matching transaction ids, ascending (empty for an empty query)
+ * @param scratch Working buffer
+ */
+template<typename Index>
+void intersect_query_postings(const Index& index, const std::vector<int>& query_items_set,
+                                     std::vector<int>& result, std::vector<int>& scratch) {
+    result.clear();
+    if (query_items_set.empty()) return;
+
+    std::vector<std::span<const int>> lists;
+    lists.reserve(query_items_set.size());
+    for (const int item : query_items_set) {
+        const std::span<const int> list = index.find(item);
+        //An item that appears nowhere leaves nothing to intersect.
+        if (list.empty()) return;
+        lists.push_back(list);
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+
+    result.assign(lists[0].begin(), lists[0].end());
+    for (size_t i = 1; i < lists.size() && !result.empty(); i++) {
+        intersect_postings(result, lists[i], scratch);
+        std::swap(result, scratch);
+    }
+}
+
+#endif //INVERTED_INDEX_H
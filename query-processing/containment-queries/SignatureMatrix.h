@@ -0,0 +1,252 @@
+#ifndef SIGNATURE_MATRIX_H
+#define SIGNATURE_MATRIX_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+#include <immintrin.h>
+
+/**
+ * Transaction signatures packed into one contiguous, cache-line aligned buffer.
+ *
+ * Every signature is padded with zero words to the width of the widest one. Transactions are grouped in
+ * blocks of BLOCK_ROWS, and inside a block the signatures are stored word-major:
+ *
+ *   block b: word 0 of transactions 8b..8b+7, word 1 of transactions 8b..8b+7, ...
+ *
+ * so word w of a whole block fills exactly one cache line (and one AVX-512 register, or two AVX2 ones).
+ * A query is tested against the eight transactions of a block at once, looking only at the words where
+ * the query has bits set, and a block is left as soon as none of its transactions can still match.
+ *
+ * The kernel is picked at run time: AVX-512F, AVX2 or a scalar loop, depending on the CPU.
+ *
+ * A matrix either owns its buffer or is a view of packed words stored elsewhere (e.g. a mapped index file).
+ */
+class SignatureMatrix {
+public:
+    static constexpr size_t BLOCK_ROWS = 8;
+    static constexpr size_t ALIGNMENT = 64;
+    // Blocks handed to the kernel per call, bounded so that their masks fit on the stack.
+    static constexpr size_t KERNEL_BLOCKS = 512;
+
+    explicit SignatureMatrix(const std::vector<std::vector<uint64_t>>& signatures) : row_count(signatures.size()) {
+        for (const auto& signature : signatures) word_count = std::max(word_count, signature.size());
+        block_count = (row_count + BLOCK_ROWS - 1) / BLOCK_ROWS;
+
+        const size_t bytes = std::max<size_t>(packed_word_count() * sizeof(uint64_t), ALIGNMENT);
+        owned_words.reset(static_cast<uint64_t*>(std::aligned_alloc(ALIGNMENT, bytes)));
+        std::memset(owned_words.get(), 0, bytes);
+
+        for (size_t row = 0; row < row_count; row++) {
+            uint64_t* block = owned_words.get() + row / BLOCK_ROWS * block_stride();
+            for (size_t w = 0; w < signatures[row].size(); w++)
+                block[w * BLOCK_ROWS + row % BLOCK_ROWS] = signatures[row][w];
+        }
+        words = owned_words.get();
+    }
+
+    /**
+     * View of signatures already packed by another matrix (see packed_words()).
+     * @param packed The packed words, ALIGNMENT-aligned, packed_size(rows, width) of them
+     * @param rows Number of transactions
+     * @param width Words per signature
+     */
+    SignatureMatrix(const uint64_t* packed, const size_t rows, const size_t width)
+        : row_count(rows), word_count(width), block_count((rows + BLOCK_ROWS - 1) / BLOCK_ROWS), words(packed) {}
+
+    /**
+     * @return Number of packed words a matrix of this shape holds
+     */
+    static size_t packed_size(const size_t rows, const size_t width) {
+        return (rows + BLOCK_ROWS - 1) / BLOCK_ROWS * width * BLOCK_ROWS;
+    }
+
+    /**
+     * @return The packed words, block by block
+     */
+    [[nodiscard]] std::span<const uint64_t> packed_words() const { return {words, packed_word_count()}; }
+
+    /**
+     * @return Number of transactions
+     */
+    [[nodiscard]] size_t rows() const { return row_count; }
+
+    /**
+     * @return Words per (padded) signature
+     */
+    [[nodiscard]] size_t width() const { return word_count; }
+
+    /**
+     * @return Number of blocks of BLOCK_ROWS transactions (the last one may be partial)
+     */
+    [[nodiscard]] size_t blocks() const { return block_count; }
+
+    /**
+     * A query signature reduced to its non-zero words, ready to be tested against the matrix.
+     */
+    struct Query {
+        std::vector<uint32_t> word_indices;
+        std::vector<uint64_t> words;
+        bool satisfiable = true;   // False if a bit lies beyond the widest signature
+    };
+
+    /**
+     * @param query The query signature, of any width
+     * @return The query, prepared for for_each_covering()
+     */
+    [[nodiscard]] Query prepare(const std::vector<uint64_t>& query) const {
+        Query prepared;
+        for (size_t w = 0; w < query.size(); w++) {
+            if (query[w] == 0) continue;
+            //A bit beyond the widest signature is set in no transaction.
+            if (w >= word_count) {
+                prepared.satisfiable = false;
+                break;
+            }
+            prepared.word_indices.push_back(static_cast<uint32_t>(w));
+            prepared.words.push_back(query[w]);
+        }
+        return prepared;
+    }
+
+    /**
+     * Calls visit(t_id), in ascending order, for every transaction of blocks [first_block, last_block)
+     * whose signature has all the bits of query set.
+     * @param query The prepared query
+     * @param first_block First block to scan
+     * @param last_block One past the last block to scan
+     * @param visit Called with every matching transaction id
+     */
+    template<typename Visitor>
+    void for_each_covering(const Query& query, const size_t first_block, const size_t last_block, Visitor&& visit) const {
+        if (!query.satisfiable) return;
+
+        uint8_t block_masks[KERNEL_BLOCKS];
+        for (size_t first = first_block; first < last_block; first += KERNEL_BLOCKS) {
+            const size_t count = std::min(KERNEL_BLOCKS, last_block - first);
+            kernel()(words + first * block_stride(), count, block_stride(), query.word_indices.data(),
+                     query.words.data(), query.words.size(), block_masks);
+
+            for (size_t i = 0; i < count; i++) {
+                const size_t b = first + i;
+                unsigned mask = block_masks[i];
+                //Padding rows of the last block match every query that only has bits inside the signatures.
+                if (b + 1 == block_count && row_count % BLOCK_ROWS != 0) mask &= (1u << row_count % BLOCK_ROWS) - 1;
+                for (; mask != 0; mask &= mask - 1)
+                    visit(static_cast<int>(b * BLOCK_ROWS + std::countr_zero(mask)));
+            }
+        }
+    }
+
+    /**
+     * Calls visit(t_id), in ascending order, for every transaction whose signature has all the bits of query set.
+     * @param query The query signature, of any width
+     * @param visit Called with every matching transaction id
+     */
+    template<typename Visitor>
+    void for_each_covering(const std::vector<uint64_t>& query, Visitor&& visit) const {
+        for_each_covering(prepare(query), 0, block_count, visit);
+    }
+
+private:
+    struct FreeDeleter {
+        void operator()(uint64_t* pointer) const { std::free(pointer); }
+    };
+
+    /**
+     * Computes, for every block, the bit mask of the rows covering the query.
+     * @param words The packed signatures
+     * @param block_count Number of blocks
+     * @param block_stride Words per block
+     * @param query_word_indices Indices of the non-zero query words
+     * @param query_words The non-zero query words
+     * @param query_word_count Number of non-zero query words
+     * @param block_masks Receives one mask per block, bit r set if row r of the block covers the query
+     */
+    using Kernel = void (*)(const uint64_t* words, size_t block_count, size_t block_stride,
+                            const uint32_t* query_word_indices, const uint64_t* query_words, size_t query_word_count,
+                            uint8_t* block_masks);
+
+    size_t row_count;
+    size_t word_count = 0;
+    size_t block_count = 0;
+    std::unique_ptr<uint64_t, FreeDeleter> owned_words;
+    const uint64_t* words = nullptr;
+
+    [[nodiscard]] size_t block_stride() const { return word_count * BLOCK_ROWS; }
+
+    [[nodiscard]] size_t packed_word_count() const { return packed_size(row_count, word_count); }
+
+    static void scalar_kernel(const uint64_t* words, const size_t block_count, const size_t block_stride,
+                              const uint32_t* query_word_indices, const uint64_t* query_words,
+                              const size_t query_word_count, uint8_t* block_masks) {
+        for (size_t b = 0; b < block_count; b++) {
+            const uint64_t* block = words + b * block_stride;
+            unsigned mask = 0;
+            for (size_t row = 0; row < BLOCK_ROWS; row++) {
+                bool covers = true;
+                for (size_t i = 0; i < query_word_count && covers; i++) {
+                    const uint64_t word = block[query_word_indices[i] * BLOCK_ROWS + row];
+                    covers = (word & query_words[i]) == query_words[i];
+                }
+                mask |= static_cast<unsigned>(covers) << row;
+            }
+            block_masks[b] = static_cast<uint8_t>(mask);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void avx2_kernel(const uint64_t* words, const size_t block_count, const size_t block_stride,
+                            const uint32_t* query_word_indices, const uint64_t* query_words,
+                            const size_t query_word_count, uint8_t* block_masks) {
+        for (size_t b = 0; b < block_count; b++) {
+            const uint64_t* block = words + b * block_stride;
+            __m256i low_covers = _mm256_set1_epi64x(-1), high_covers = _mm256_set1_epi64x(-1);
+            for (size_t i = 0; i < query_word_count; i++) {
+                const __m256i query = _mm256_set1_epi64x(static_cast<long long>(query_words[i]));
+                const uint64_t* line = block + query_word_indices[i] * BLOCK_ROWS;
+                const __m256i low = _mm256_load_si256(reinterpret_cast<const __m256i*>(line));
+                const __m256i high = _mm256_load_si256(reinterpret_cast<const __m256i*>(line + 4));
+                low_covers = _mm256_and_si256(low_covers, _mm256_cmpeq_epi64(_mm256_and_si256(low, query), query));
+                high_covers = _mm256_and_si256(high_covers, _mm256_cmpeq_epi64(_mm256_and_si256(high, query), query));
+                if (_mm256_testz_si256(_mm256_or_si256(low_covers, high_covers), _mm256_set1_epi64x(-1))) break;
+            }
+            const unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(low_covers)))
+                                | static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(high_covers))) << 4;
+            block_masks[b] = static_cast<uint8_t>(mask);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    static void avx512_kernel(const uint64_t* words, const size_t block_count, const size_t block_stride,
+                              const uint32_t* query_word_indices, const uint64_t* query_words,
+                              const size_t query_word_count, uint8_t* block_masks) {
+        for (size_t b = 0; b < block_count; b++) {
+            const uint64_t* block = words + b * block_stride;
+            __mmask8 covers = 0xFF;
+            for (size_t i = 0; i < query_word_count && covers != 0; i++) {
+                const __m512i query = _mm512_set1_epi64(static_cast<long long>(query_words[i]));
+                const __m512i line = _mm512_load_si512(block + query_word_indices[i] * BLOCK_ROWS);
+                covers = _mm512_mask_cmpeq_epi64_mask(covers, _mm512_and_si512(line, query), query);
+            }
+            block_masks[b] = covers;
+        }
+    }
+
+    static Kernel kernel() {
+        static const Kernel selected = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return &avx512_kernel;
+            if (__builtin_cpu_supports("avx2")) return &avx2_kernel;
+            return &scalar_kernel;
+        }();
+        return selected;
+    }
+};
+
+#endif //SIGNATURE_MATRIX_H
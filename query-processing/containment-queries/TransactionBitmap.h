@@ -0,0 +1,267 @@
+#ifndef TRANSACTION_BITMAP_H
+#define TRANSACTION_BITMAP_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+/**
+ * Compressed set of transaction ids, organised like a Roaring bitmap.
+ *
+ * Ids are split into a 16-bit chunk number (the high bits) and a 16-bit position inside the chunk.
+ * Every non-empty chunk has one container:
+ *   - an array container: the sorted positions, while the chunk holds at most ARRAY_CONTAINER_MAX_SIZE ids
+ *   - a bitmap container: 1024 uint64_t words, one bit per position, once the chunk gets denser
+ * Chunks are kept sorted by chunk number, so iteration yields ids in ascending order.
+ *
+ * Dense chunks are intersected word by word (a loop the compiler vectorises), and ids are pulled out
+ * of the words with count-trailing-zeros instead of shifting the whole bitmap one bit at a time.
+ */
+class TransactionBitmap {
+public:
+    // Above this many ids a bitmap container (8 KiB) is smaller than an array container.
+    static constexpr size_t ARRAY_CONTAINER_MAX_SIZE = 4096;
+    static constexpr size_t CHUNK_WORDS = (1 << 16) / 64;
+
+    /**
+     * Adds an id. Ids must be appended in non-decreasing order (appending the last id again is a no-op),
+     * which is how the transaction file is scanned.
+     * @param t_id The transaction id
+     */
+    void append(const uint32_t t_id) {
+        const auto chunk = static_cast<uint16_t>(t_id >> 16);
+        const auto position = static_cast<uint16_t>(t_id & 0xFFFF);
+        if (chunks.empty() || chunks.back() != chunk) {
+            chunks.push_back(chunk);
+            containers.emplace_back();
+        }
+
+        Container& container = containers.back();
+        if (container.is_bitmap()) {
+            uint64_t& word = container.words[position / 64];
+            const uint64_t bit = uint64_t{1} << (position % 64);
+            if ((word & bit) == 0) container.cardinality++;
+            word |= bit;
+            return;
+        }
+
+        if (!container.positions.empty() && container.positions.back() == position) return;
+        container.positions.push_back(position);
+        container.cardinality++;
+        if (container.positions.size() > ARRAY_CONTAINER_MAX_SIZE) container.to_bitmap();
+    }
+
+    /**
+     * @return Number of ids in the set
+     */
+    [[nodiscard]] size_t cardinality() const {
+        size_t total = 0;
+        for (const Container& container : containers) total += container.cardinality;
+        return total;
+    }
+
+    [[nodiscard]] bool empty() const { return chunks.empty(); }
+
+    /**
+     * Keeps only the ids that are also in other. Chunks missing on either side are dropped without being looked at.
+     * @param other The set to intersect with
+     */
+    void intersect_with(const TransactionBitmap& other) {
+        size_t kept = 0, j = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            while (j < other.chunks.size() && other.chunks[j] < chunks[i]) j++;
+            if (j == other.chunks.size()) break;
+            if (other.chunks[j] != chunks[i]) continue;
+
+            Container& container = containers[i];
+            container.intersect_with(other.containers[j]);
+            if (container.cardinality == 0) continue;
+
+            if (kept != i) {
+                chunks[kept] = chunks[i];
+                containers[kept] = std::move(container);
+            }
+            kept++;
+        }
+        chunks.resize(kept);
+        containers.resize(kept);
+    }
+
+    /**
+     * Calls visit(t_id) for every id, in ascending order.
+     */
+    template<typename Visitor>
+    void for_each(Visitor&& visit) const {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            const uint32_t base = static_cast<uint32_t>(chunks[i]) << 16;
+            const Container& container = containers[i];
+            if (!container.is_bitmap()) {
+                for (const uint16_t position : container.positions) visit(static_cast<int>(base | position));
+                continue;
+            }
+            for (size_t w = 0; w < CHUNK_WORDS; w++) {
+                for (uint64_t word = container.words[w]; word != 0; word &= word - 1)
+                    visit(static_cast<int>(base | (w * 64 + std::countr_zero(word))));
+            }
+        }
+    }
+
+    /**
+     * Uncompressed form of the set: bit t_id of the result (least significant word first) is set for every id.
+     * @return The words, without trailing zero words
+     */
+    [[nodiscard]] std::vector<uint64_t> to_words() const {
+        std::vector<uint64_t> words;
+        if (chunks.empty()) return words;
+
+        words.resize((static_cast<size_t>(chunks.back()) + 1) * CHUNK_WORDS);
+        for (size_t i = 0; i < chunks.size(); i++) {
+            uint64_t* chunk_words = words.data() + static_cast<size_t>(chunks[i]) * CHUNK_WORDS;
+            const Container& container = containers[i];
+            if (container.is_bitmap()) std::copy(container.words.begin(), container.words.end(), chunk_words);
+            else for (const uint16_t position : container.positions) chunk_words[position / 64] |= uint64_t{1} << (position % 64);
+        }
+        while (!words.empty() && words.back() == 0) words.pop_back();
+        return words;
+    }
+
+    /**
+     * Fixed-size description of a container in serialized form. Data is counted in uint64_t words:
+     * array containers pack four positions per word, bitmap containers take CHUNK_WORDS words.
+     */
+    struct SerializedContainer {
+        uint16_t chunk;
+        uint16_t is_bitmap;
+        uint32_t cardinality;
+        uint64_t data_offset;
+    };
+
+    /**
+     * Appends the containers of the set and their data to flat arrays shared by many sets.
+     * @param serialized_containers Receives one entry per container
+     * @param data Receives the positions or words of the containers
+     */
+    void serialize(std::vector<SerializedContainer>& serialized_containers, std::vector<uint64_t>& data) const {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            const Container& container = containers[i];
+            serialized_containers.push_back({chunks[i], container.is_bitmap(), static_cast<uint32_t>(container.cardinality), data.size()});
+            if (container.is_bitmap()) {
+                data.insert(data.end(), container.words.begin(), container.words.end());
+                continue;
+            }
+            const size_t first_word = data.size();
+            data.resize(first_word + (container.positions.size() + 3) / 4, 0);
+            std::memcpy(data.data() + first_word, container.positions.data(), container.positions.size() * sizeof(uint16_t));
+        }
+    }
+
+    /**
+     * Rebuilds a set from the containers written by serialize().
+     * @param serialized_containers The containers of the set
+     * @param data The data array the containers point into
+     * @param bitmap Receives the set
+     * @return False if a container is malformed or points outside data
+     */
+    static bool deserialize(const std::span<const SerializedContainer> serialized_containers,
+                            const std::span<const uint64_t> data, TransactionBitmap& bitmap) {
+        bitmap = TransactionBitmap();
+        for (const SerializedContainer& serialized : serialized_containers) {
+            if (!bitmap.chunks.empty() && serialized.chunk <= bitmap.chunks.back()) return false;
+            if (serialized.cardinality == 0 || serialized.cardinality > (1 << 16)) return false;
+
+            Container container;
+            container.cardinality = serialized.cardinality;
+            const size_t word_count = serialized.is_bitmap ? CHUNK_WORDS : (serialized.cardinality + 3) / 4;
+            if (serialized.data_offset > data.size() || word_count > data.size() - serialized.data_offset) return false;
+
+            const uint64_t* words = data.data() + serialized.data_offset;
+            if (serialized.is_bitmap) {
+                container.words.assign(words, words + CHUNK_WORDS);
+            } else {
+                container.positions.resize(serialized.cardinality);
+                std::memcpy(container.positions.data(), words, serialized.cardinality * sizeof(uint16_t));
+            }
+            bitmap.chunks.push_back(serialized.chunk);
+            bitmap.containers.push_back(std::move(container));
+        }
+        return true;
+    }
+
+private:
+    struct Container {
+        std::vector<uint16_t> positions;   // array container, sorted
+        std::vector<uint64_t> words;       // bitmap container, CHUNK_WORDS words
+        size_t cardinality = 0;
+
+        [[nodiscard]] bool is_bitmap() const { return !words.empty(); }
+
+        [[nodiscard]] bool contains(const uint16_t position) const {
+            if (is_bitmap()) return (words[position / 64] >> (position % 64)) & 1;
+            return std::binary_search(positions.begin(), positions.end(), position);
+        }
+
+        void to_bitmap() {
+            words.assign(CHUNK_WORDS, 0);
+            for (const uint16_t position : positions) words[position / 64] |= uint64_t{1} << (position % 64);
+            positions = {};
+        }
+
+        void to_array() {
+            positions.reserve(cardinality);
+            for (size_t w = 0; w < CHUNK_WORDS; w++) {
+                for (uint64_t word = words[w]; word != 0; word &= word - 1)
+                    positions.push_back(static_cast<uint16_t>(w * 64 + std::countr_zero(word)));
+            }
+            words = {};
+        }
+
+        void intersect_with(const Container& other) {
+            if (is_bitmap() && other.is_bitmap()) {
+                uint64_t* __restrict mine = words.data();
+                const uint64_t* __restrict theirs = other.words.data();
+                for (size_t w = 0; w < CHUNK_WORDS; w++) mine[w] &= theirs[w];
+
+                cardinality = 0;
+                for (size_t w = 0; w < CHUNK_WORDS; w++) cardinality += std::popcount(mine[w]);
+                if (cardinality <= ARRAY_CONTAINER_MAX_SIZE) to_array();
+                return;
+            }
+
+            if (is_bitmap()) {
+                // The result cannot be larger than the other (array) side, so it becomes an array container.
+                std::vector<uint16_t> kept;
+                kept.reserve(other.cardinality);
+                for (const uint16_t position : other.positions)
+                    if (contains(position)) kept.push_back(position);
+                words = {};
+                positions = std::move(kept);
+                cardinality = positions.size();
+                return;
+            }
+
+            // Array against array or bitmap: filtered in place, order is kept.
+            size_t kept = 0;
+            if (other.is_bitmap()) {
+                for (const uint16_t position : positions)
+                    if (other.contains(position)) positions[kept++] = position;
+            } else {
+                size_t j = 0;
+                for (const uint16_t position : positions) {
+                    while (j < other.positions.size() && other.positions[j] < position) j++;
+                    if (j == other.positions.size()) break;
+                    if (other.positions[j] == position) positions[kept++] = position;
+                }
+            }
+            positions.resize(kept);
+            cardinality = kept;
+        }
+    };
+
+    std::vector<uint16_t> chunks;
+    std::vector<Container> containers;
+};
+
+#endif //TRANSACTION_BITMAP_H
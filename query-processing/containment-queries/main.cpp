@@ -20,74 +20,283 @@
  * @date 2025-05-30
  */
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 #include <chrono>
 #include <map>
+#include <optional>
 #include <set>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/multiprecision/cpp_int.hpp>
+#include "../common/IndexFile.h"
+#include "../common/ItemSets.h"
+#include "../common/QueryServer.h"
+#include "../../benchmarks/Benchmark.h"
+#include "InvertedIndex.h"
+#include "SignatureMatrix.h"
+#include "TransactionBitmap.h"
 
 
 using Signature = std::vector<uint64_t>;
 using QueryResult = std::unordered_map<int, std::unordered_set<int>>;
 using ItemToTransactionMap = std::map<int, std::set<int>>;
+using ItemToTransactionBitmap = std::map<int, TransactionBitmap>;
+using QueryMatches = std::vector<std::vector<int>>;
+
+/**
+ * Signatures of the Signature File Method.
+ *
+ * With width_bits 0 (and no memory budget) the signatures are exact: item i sets bit i, so a signature is as wide
+ * as the largest item id and a covering signature is a match. Otherwise every signature is width_bits wide and
+ * every item sets `hashes` bits of it (superimposed coding): memory no longer depends on the item ids, and the
+ * transactions whose signature covers the query are candidates, checked against the query items.
+ */
+struct SignatureScheme {
+    size_t width_bits;      // Multiple of 64; 0 for exact signatures, or to derive it from memory_bytes
+    size_t hashes;          // Bits per item; 0 to pick the count with the lowest estimated false drop rate
+    size_t memory_bytes;    // Budget for all transaction signatures; 0 if the width is given
+};
+
+constexpr SignatureScheme EXACT_SIGNATURES{0, 0, 0};
+
+/**
+ * How the methods run. When all queries are processed (query number -1), queries are taken in batches
+ * of batch_size, and the batches are spread over worker threads.
+ */
+struct MethodOptions {
+    size_t threads;
+    size_t batch_size;
+    SignatureScheme signature;
+};
 
 
 std::vector<std::vector<int>> load_item_sets_from_file(const std::string& item_sets_file);
-std::vector<QueryResult> run_method(const std::string& transactions_file, const std::string& queries_file, int query_number , int method_number);
+std::vector<int> parse_item_set(const std::string& line);
+ItemSets load_transactions(const std::string& transactions_file, const std::optional<IndexFile>& index_file);
+std::vector<QueryResult> run_method(const std::string& transactions_file, const std::string& queries_file, int query_number , int method_number, const MethodOptions& options);
 inline void print_query_resulted_item_ids(const std::string& method_name, const std::unordered_set<int>& item_ids);
+MethodOptions parse_method_options(int argc, char* argv[], int first_option, BenchmarkOptions* benchmark = nullptr);
+void for_each_query_batch(size_t query_count, const MethodOptions& options, const std::function<void(size_t, size_t)>& process_batch);
+void store_query_matches(const QueryMatches& matches, QueryResult& query_results);
+
+
 
+bool transaction_contains_query(std::span<const int> transaction, const std::vector<int>& query);
+inline void process_single_query_naive(const ItemSets& transactions,const std::vector<int>& query, int query_number, QueryResult& query_results);
+void process_query_batch_naive(const ItemSets& transactions, const std::vector<std::vector<int>>& queries, size_t first_query, size_t last_query, QueryMatches& matches);
+QueryResult naive_method(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options);
 
 
-inline void process_single_query_naive(const std::vector<std::vector<int>>& transactions,const std::vector<int>& query, int query_number, QueryResult& query_results);
-QueryResult naive_method(const std::string& transactions_file, const std::string& queries_file, int query_number);
+Signature compute_signature(std::span<const int> item_set);
+Signature compute_superimposed_signature(std::span<const int> item_set, const SignatureScheme& scheme);
+SignatureScheme resolve_signature_scheme(const SignatureScheme& requested, const ItemSets& transactions);
+double estimated_false_drop_rate(size_t width_bits, size_t hashes, const ItemSets& transactions);
+size_t remove_false_drops(const ItemSets& transactions, const std::vector<int>& query, std::vector<int>& candidates);
+SignatureMatrix build_signature_matrix(const ItemSets& transactions, bool write_signature_file, const SignatureScheme& scheme = EXACT_SIGNATURES);
+inline void process_single_query_signature_file(const SignatureMatrix& transaction_signatures, const Signature& query_signature, int query_number, QueryResult& query_results);
+void process_query_batch_signature_file(const SignatureMatrix& transaction_signatures, const std::vector<Signature>& query_signatures, size_t first_query, size_t last_query, QueryMatches& matches);
+QueryResult signature_file_method(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options);
 
 
-Signature compute_signature(const std::vector<int>& item_set);
-bool transaction_signature_covers_query(const Signature& transaction_sig, const Signature& query_sig);
-inline void process_single_query_signature_file(const std::vector<Signature> &transaction_signatures, const Signature& query_signature, int query_number, QueryResult& query_results);
-QueryResult signature_file_method(const std::string& transactions_file, const std::string& queries_file, int query_number);
+ItemToTransactionBitmap build_item_transactions_bit_map(const ItemSets& transactions);
+void write_bitslice_signatures(const ItemToTransactionBitmap& item_transactions_bit_map,std::ofstream& bitslice_file);
+TransactionBitmap intersect_query_bitmaps(const ItemToTransactionBitmap& item_transactions_bit_map, const std::vector<int>& query_items_set);
+inline void process_single_query_exact_bitslice(const ItemToTransactionBitmap& item_transactions_bit_map,const std::vector<int>& query_items_set,int query_number,QueryResult& query_results);
+void process_query_batch_exact_bitslice(const ItemToTransactionBitmap& item_transactions_bit_map, const std::vector<std::vector<int>>& queries, size_t first_query, size_t last_query, QueryMatches& matches);
+QueryResult exact_bitslice_signature_file(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options);
 
 
-std::map<int, boost::multiprecision::cpp_int> build_item_transactions_bit_map(const std::vector<std::vector<int>>& transactions);
-void write_bitslice_signatures(const std::map<int, boost::multiprecision::cpp_int>& item_transactions_bit_map,std::ofstream& bitslice_file);
-inline void process_single_query_exact_bitslice(const std::map<int, boost::multiprecision::cpp_int>& item_transactions_bit_map,const std::vector<int>& query_items_set,int query_number,QueryResult& query_results);
-QueryResult exact_bitslice_signature_file(const std::string& transactions_file, const std::string& queries_file, int query_number);
 
+InvertedIndex build_inverted_index(const ItemSets& transactions);
+void write_inverted_index_to_file(const InvertedIndex& inverted_index);
+inline void process_single_query_inverted_index(const InvertedIndex& inverted_index,const std::vector<int>& query_items_set,int query_number,QueryResult& query_results);
+void process_query_batch_inverted_index(const InvertedIndex& inverted_index, const std::vector<std::vector<int>>& queries, size_t first_query, size_t last_query, QueryMatches& matches);
+QueryResult inverted_file_with_intersection(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options);
 
 
-std::map<int, std::set<int>> build_inverted_index(const std::vector<std::vector<int>>& transactions);
-void write_inverted_index_to_file(const std::map<int, std::set<int>>& inverted_index);
-inline void process_single_query_inverted_index(const std::map<int, std::set<int>>& inverted_index,const std::vector<int>& query_items_set,int query_number,QueryResult& query_results);
-QueryResult inverted_file_with_intersection(const std::string& transactions_file, const std::string& queries_file, int query_number);
+void build_index_file(const std::string& transactions_file, const std::string& index_file);
+std::optional<IndexFile> open_index_file(const std::string& transactions_file);
+ItemSets transactions_from_index(const IndexFile& index_file);
+SignatureMatrix signature_matrix_from_index(const IndexFile& index_file);
+ItemToTransactionBitmap bit_map_from_index(const IndexFile& index_file);
+InvertedIndex inverted_index_from_index(const IndexFile& index_file);
 
+//Server
+
+/**
+ * What the server answers queries from. Transactions [0, base_transaction_count) are in the signature
+ * matrix and the inverted index; the ones appended since are in delta_signatures and inverted_delta.
+ * The transactions and the bitmaps cover all of them.
+ */
+struct ServedIndexes {
+    ItemSets transactions;
+    std::optional<SignatureMatrix> signature_matrix;
+    std::vector<Signature> delta_signatures;
+    ItemToTransactionBitmap item_transactions_bit_map;
+    std::optional<InvertedIndex> inverted_index;
+    InvertedIndexDelta inverted_delta;
+    size_t base_transaction_count;
+};
+
+ServedIndexes load_served_indexes(const std::string& transactions_file, const std::optional<IndexFile>& index_file);
+void serve_queries(const std::string& transactions_file, const ServerOptions& options);
+std::vector<int> answer_served_query(const ServedIndexes& indexes, int method_number, const std::vector<int>& query);
+bool signature_covers_query(const Signature& signature, const Signature& query_signature);
+int append_transaction(ServedIndexes& indexes, const std::vector<int>& transaction);
+
+//Benchmark
+void benchmark_methods(const std::string& transactions_file, const std::string& queries_file, const MethodOptions& options, const BenchmarkOptions& benchmark);
 
 constexpr int NAIVE = 0;
 constexpr int SIGNATURE_FILE = 1;
 constexpr int EXACT_BITSLICE_SIGNATURE_FILE = 2;
 constexpr int INVERTED_FILE = 3;
 
+constexpr size_t DEFAULT_QUERY_BATCH_SIZE = 64;
+// Largest number of bits per item tried when the hash count of superimposed signatures is chosen.
+constexpr size_t MAX_SIGNATURE_HASHES = 32;
+// Transactions a whole query batch is run against before moving on, small enough to stay in cache.
+constexpr size_t TRANSACTION_BLOCK_SIZE = 4096;
+
+// Binary index file (see IndexFile.h) written by build-index: its kind and the ids of its sections.
+constexpr uint32_t CONTAINMENT_INDEX_KIND = 1;
+constexpr uint32_t TRANSACTION_OFFSETS_SECTION = 1;        // uint64_t, transactions + 1
+constexpr uint32_t TRANSACTION_ITEMS_SECTION = 2;          // int
+constexpr uint32_t SIGNATURE_SHAPE_SECTION = 3;            // uint64_t {rows, words per signature}
+constexpr uint32_t SIGNATURE_WORDS_SECTION = 4;            // uint64_t, packed as in SignatureMatrix
+constexpr uint32_t BITSLICE_ITEMS_SECTION = 5;             // int, ascending
+constexpr uint32_t BITSLICE_CONTAINER_OFFSETS_SECTION = 6; // uint64_t, items + 1
+constexpr uint32_t BITSLICE_CONTAINERS_SECTION = 7;        // TransactionBitmap::SerializedContainer
+constexpr uint32_t BITSLICE_DATA_SECTION = 8;              // uint64_t
+constexpr uint32_t INVERTED_ITEMS_SECTION = 9;             // int, ascending
+constexpr uint32_t INVERTED_OFFSETS_SECTION = 10;          // uint64_t, items + 1
+constexpr uint32_t INVERTED_POSTINGS_SECTION = 11;         // int
+
+// The server's delta segment is merged into rebuilt indexes once it holds this fraction of the base, and this many transactions.
+constexpr size_t DELTA_MERGE_FRACTION = 4;
+constexpr size_t DELTA_MERGE_MIN_TRANSACTIONS = 1024;
+constexpr size_t APPEND_REQUEST_KIND = 4;   // Histogram of the append requests, after the four methods
+
 
 
 //
 //Main Function
 //
 int main(const int argc, char* argv[]) {
+    if (argc == 4 && std::string(argv[1]) == "build-index") {
+        build_index_file(argv[2], argv[3]);
+        return 0;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "serve") {
+        serve_queries(argv[2], parse_server_options(argc, argv, 3));
+        return 0;
+    }
+
+    if (argc >= 4 && std::string(argv[1]) == "bench") {
+        BenchmarkOptions benchmark = DEFAULT_BENCHMARK_OPTIONS;
+        const MethodOptions options = parse_method_options(argc, argv, 4, &benchmark);
+        benchmark_methods(argv[2], argv[3], options, benchmark);
+        return 0;
+    }
+
     if (argc < 5) {
         std::cerr << "Invalid number of arguments" << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <transactions.txt> <queries.txt> <qnum> <method>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <transactions.txt|index file> <queries.txt> <qnum> <method> [--threads=<N>] [--batch-size=<N>]"
+                  << " [--signature-bits=<F>] [--signature-hashes=<m>] [--signature-memory=<bytes>]" << std::endl;
+        std::cerr << "       " << argv[0] << " build-index <transactions.txt> <index file>" << std::endl;
+        std::cerr << "       " << argv[0] << " serve <transactions.txt|index file> [--threads=<N>] [--port=<N>]" << std::endl;
+        std::cerr << "       " << argv[0] << " bench <transactions.txt|index file> <queries.txt> [--warmup=<N>] [--repeat=<N>] [--json=<file>]"
+                  << " [--signature-bits=<F>] [--signature-hashes=<m>] [--signature-memory=<bytes>]" << std::endl;
         return 1;
     }
 
+    const MethodOptions options = parse_method_options(argc, argv, 5);
     std::vector<QueryResult> results =
-        run_method(argv[1],argv[2], std::stoi(argv[3]), std::stoi(argv[4]));
+        run_method(argv[1],argv[2], std::stoi(argv[3]), std::stoi(argv[4]), options);
     return 0;
 }
 
 
+/**
+ * Parses the optional "--name=value" arguments that follow the positional arguments.
+ * Exits with an error message on an unknown option or a malformed value.
+ *
+ * @param argc Argument count as received by main.
+ * @param argv Argument vector as received by main.
+ * @param first_option Index of the first optional argument.
+ * @param benchmark If given, also receives the benchmark options (--warmup, --repeat, --json).
+ * @return The parsed options, with defaults for everything not given.
+ */
+MethodOptions parse_method_options(const int argc, char* argv[], const int first_option, BenchmarkOptions* benchmark) {
+    MethodOptions options{1, DEFAULT_QUERY_BATCH_SIZE, EXACT_SIGNATURES};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (name == "--threads") {
+                options.threads = std::stoull(value);
+                if (options.threads == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--batch-size") {
+                options.batch_size = std::stoull(value);
+                if (options.batch_size == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--signature-bits") {
+                //Rounded up to whole words.
+                options.signature.width_bits = (std::stoull(value) + 63) / 64 * 64;
+                if (options.signature.width_bits == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--signature-hashes") {
+                options.signature.hashes = std::stoull(value);
+                if (options.signature.hashes == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--signature-memory") {
+                options.signature.memory_bytes = std::stoull(value);
+                if (options.signature.memory_bytes == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (benchmark != nullptr && parse_benchmark_option(name, value, *benchmark)) continue;
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << std::endl;
+        exit(-1);
+    }
+
+    const SignatureScheme& signature = options.signature;
+    if (signature.width_bits != 0 && signature.memory_bytes != 0) {
+        std::cerr << "Give either --signature-bits or --signature-memory, not both" << std::endl;
+        exit(-1);
+    }
+    if (signature.hashes != 0 && signature.width_bits == 0 && signature.memory_bytes == 0) {
+        std::cerr << "--signature-hashes needs --signature-bits or --signature-memory" << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
+
 /**
  * Executes a specified query processing method on transaction and query files.
  *
@@ -105,6 +314,7 @@ int main(const int argc, char* argv[]) {
  *                      (0 for naive, 1 for signature file,
  *                      2 for exact bitslice signature file,
  *                      3 for inverted file, and -1 for all methods).
+ * @param options How the queries are batched and threaded when all of them are processed.
  * @return A vector containing four QueryResult elements, each corresponding
  *         to results from a specific query processing method.
  */
@@ -112,32 +322,33 @@ std::vector<QueryResult> run_method(
     const std::string& transactions_file,
     const std::string& queries_file,
     const int query_number ,
-    const int method_number) {
+    const int method_number,
+    const MethodOptions& options) {
 
     std::vector<QueryResult> method_results(4);
 
     switch(method_number) {
         case 0  :
-            method_results[NAIVE] = naive_method(transactions_file, queries_file, query_number);
+            method_results[NAIVE] = naive_method(transactions_file, queries_file, query_number, options);
             break;
 
         case 1:
-            method_results[SIGNATURE_FILE] = signature_file_method(transactions_file, queries_file, query_number);
+            method_results[SIGNATURE_FILE] = signature_file_method(transactions_file, queries_file, query_number, options);
             break;
 
         case 2:
-            method_results[EXACT_BITSLICE_SIGNATURE_FILE] = exact_bitslice_signature_file(transactions_file,queries_file,query_number);
+            method_results[EXACT_BITSLICE_SIGNATURE_FILE] = exact_bitslice_signature_file(transactions_file,queries_file,query_number, options);
             break;
 
         case 3:
-            method_results[INVERTED_FILE] = inverted_file_with_intersection(transactions_file,queries_file,query_number);
+            method_results[INVERTED_FILE] = inverted_file_with_intersection(transactions_file,queries_file,query_number, options);
             break;
 
         case -1:
-            method_results[NAIVE] = naive_method(transactions_file, queries_file, query_number);
-            method_results[SIGNATURE_FILE] = signature_file_method(transactions_file, queries_file, query_number);
-            method_results[EXACT_BITSLICE_SIGNATURE_FILE] = exact_bitslice_signature_file(transactions_file,queries_file,query_number);
-            method_results[INVERTED_FILE] = inverted_file_with_intersection(transactions_file,queries_file,query_number);
+            method_results[NAIVE] = naive_method(transactions_file, queries_file, query_number, options);
+            method_results[SIGNATURE_FILE] = signature_file_method(transactions_file, queries_file, query_number, options);
+            method_results[EXACT_BITSLICE_SIGNATURE_FILE] = exact_bitslice_signature_file(transactions_file,queries_file,query_number, options);
+            method_results[INVERTED_FILE] = inverted_file_with_intersection(transactions_file,queries_file,query_number, options);
             break;
 
         default:
@@ -149,50 +360,67 @@ std::vector<QueryResult> run_method(
 }
 
 /**
- * Parses a file containing item sets and loads them into a vector of vectors of integers.
- * Each line in the file represents a transaction, with integer items separated in a suitable format.
+ * Parses a file containing item sets (the queries) and loads them into a vector of vectors of integers.
+ * Each line in the file represents an item set, with integer items separated in a suitable format.
  * Ignores non-numeric characters like '[', ']', ',', and spaces while parsing.
  *
+ * The file is parsed by load_item_sets (see ItemSets.h); queries are few, so they are then copied out of
+ * its CSR arrays into one vector each. Transactions are kept in the CSR arrays.
  * If the file cannot be opened, the program terminates with an error message.
  *
  * @param item_sets_file The name or path of the file containing item sets to be loaded.
- * @return A vector of transactions, where each transaction is a vector of integers representing items.
+ * @return A vector of item sets, where each item set is a vector of integers representing items.
  */
 std::vector<std::vector<int>> load_item_sets_from_file(const std::string& item_sets_file) {
-    std::ifstream file(item_sets_file);
-    if (!file) {
-        std::cerr << "Could not open file " << item_sets_file << std::endl;
-        std::exit(-1);
-    }
-
-    std::vector<std::vector<int>> transactions;
-    std::string line;
-
-    while (std::getline(file, line)) {
-        std::vector<int> transaction;
-        int number = 0;
-        bool building = false;
+    const ItemSets item_sets = load_item_sets(item_sets_file);
 
-        for (char c : line) {
-            if (c >= '0' && c <= '9') {
-                number = number * 10 + (c - '0');   // Convert digit character to int
-                building = true;
-            } else if (building) {
-                transaction.push_back(number);
-                number = 0;
-                building = false;
-            }
-            // ignore anything else: '[', ']', ',', ' '
-        }
+    std::vector<std::vector<int>> sets;
+    sets.reserve(item_sets.size());
+    for (const std::span<const int> set : item_sets)
+        sets.emplace_back(set.begin(), set.end());
+    return sets;
+}
 
-        if (building) {
+/**
+ * Parses one line of an item sets file, e.g. "[1, 5, 9]", into its item IDs.
+ *
+ * @param line The line, without its line break.
+ * @return The items, in the order they appear on the line.
+ */
+std::vector<int> parse_item_set(const std::string& line) {
+    std::vector<int> transaction;
+    int number = 0;
+    bool building = false;
+
+    for (char c : line) {
+        if (c >= '0' && c <= '9') {
+            number = number * 10 + (c - '0');   // Convert digit character to int
+            building = true;
+        } else if (building) {
             transaction.push_back(number);
+            number = 0;
+            building = false;
         }
+        // ignore anything else: '[', ']', ',', ' '
+    }
 
-        transactions.push_back(transaction);
+    if (building) {
+        transaction.push_back(number);
     }
 
-    return transactions;
+    return transaction;
+}
+
+/**
+ * Loads the transactions, either parsed from a transactions text file or read back from an index file
+ * written by build-index.
+ *
+ * @param transactions_file A transactions text file or an index file.
+ * @param index_file The mapped index file if transactions_file is one; it must outlive the transactions.
+ * @return The transactions, in CSR layout.
+ */
+ItemSets load_transactions(const std::string& transactions_file, const std::optional<IndexFile>& index_file) {
+    return index_file ? transactions_from_index(*index_file) : load_item_sets(transactions_file);
 }
 
 /**
@@ -211,6 +439,46 @@ inline void print_query_resulted_item_ids(const std::string& method_name, const
     std::cout << "}" << std::endl;
 }
 
+/**
+ * Splits the queries into batches and runs process_batch on every batch.
+ * Batches are handed out to options.threads threads (the calling thread being one of them) as they
+ * become free, so batches of cheap and expensive queries even out.
+ *
+ * @param query_count Number of queries.
+ * @param options Batch size and number of threads.
+ * @param process_batch Called with the first and one past the last query index of every batch.
+ *                      Called concurrently, for disjoint batches.
+ */
+void for_each_query_batch(const size_t query_count, const MethodOptions& options, const std::function<void(size_t, size_t)>& process_batch) {
+    std::atomic<size_t> next_query{0};
+    const auto work = [&] {
+        while (true) {
+            const size_t first_query = next_query.fetch_add(options.batch_size);
+            if (first_query >= query_count) return;
+            process_batch(first_query, std::min(first_query + options.batch_size, query_count));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < options.threads; i++)
+        workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+/**
+ * Moves the matches collected by the batched methods into the results, query by query.
+ *
+ * @param matches For every query, the matching transaction ids in ascending order.
+ * @param query_results The results to fill.
+ */
+void store_query_matches(const QueryMatches& matches, QueryResult& query_results) {
+    for (size_t i = 0; i < matches.size(); i++)
+        for (const int t_id : matches[i])
+            query_results[static_cast<int>(i)].insert(t_id);
+}
+
 
 
 ////
@@ -222,7 +490,8 @@ inline void print_query_resulted_item_ids(const std::string& method_name, const
  * The function executes a naive query processing approach where each query is
  * compared against every transaction in the dataset. For a specific query number,
  * the result of that query is printed and stored. If all queries need to be processed,
- * the method iterates through all queries and computes results for each one.
+ * they are processed in batches: each block of transactions is checked against every query
+ * of a batch while it is in cache.
  *
  * Additionally, the method performs timing measurement and prints the
  * total computation time required to process the query or queries.
@@ -231,18 +500,23 @@ inline void print_query_resulted_item_ids(const std::string& method_name, const
  * @param queries_file The file path containing the queries data.
  * @param query_number The identifier for the specific query to process.
  *                     If -1 is passed, all queries are processed.
+ * @param options How the queries are batched and threaded when all of them are processed.
  * @return A QueryResult which maps query indices to the set of matched transaction IDs.
  */
-QueryResult naive_method(const std::string& transactions_file, const std::string& queries_file, const int query_number) {
-    const std::vector<std::vector<int>> transactions = load_item_sets_from_file(transactions_file);
+QueryResult naive_method(const std::string& transactions_file, const std::string& queries_file, const int query_number, const MethodOptions& options) {
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    const ItemSets transactions = load_transactions(transactions_file, index_file);
     const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
     QueryResult query_results;
 
     const auto start = std::chrono::high_resolution_clock::now();
 
     if(query_number == -1) {
-        for(int i = 0; i < queries.size(); i++)
-            process_single_query_naive(transactions,queries[i], i, query_results);
+        QueryMatches matches(queries.size());
+        for_each_query_batch(queries.size(), options, [&](const size_t first_query, const size_t last_query) {
+            process_query_batch_naive(transactions, queries, first_query, last_query, matches);
+        });
+        store_query_matches(matches, query_results);
 
     }else {
         process_single_query_naive(transactions,queries[query_number],query_number,query_results);
@@ -264,38 +538,73 @@ QueryResult naive_method(const std::string& transactions_file, const std::string
  * identifier is added to the results for the query. The results are updated
  * in the provided query_results map for the given query number.
  *
- * @param transactions A vector of transactions where each transaction is a vector of integers representing item IDs.
+ * @param transactions The transactions, each a list of item IDs.
  * @param query A vector of integers representing the items in the query to process.
  * @param query_number The index of the query, used for storing results in the query_results map.
  * @param query_results A reference to a map where each query number maps to a set of transaction IDs
  *                      that satisfy the query.
  */
 inline void process_single_query_naive(
-    const std::vector<std::vector<int>>& transactions,
+    const ItemSets& transactions,
     const std::vector<int>& query, const int query_number,
     QueryResult& query_results) {
 
     for (int transaction_id = 0; transaction_id < transactions.size(); transaction_id++) {
-        bool all_found = true;
-
-        for (const int query_item_id : query) {
-            bool found = false;
+        if (transaction_contains_query(transactions[transaction_id], query))
+            query_results[query_number].insert(transaction_id);
+    }
+}
 
-            for (const int transaction_item_id : transactions[transaction_id]) {
-                if (query_item_id == transaction_item_id) {
-                    found = true;
-                    break;
-                }
-            }
+/**
+ * Checks, item by item, whether a transaction contains every item of a query.
+ *
+ * @param transaction The item IDs of the transaction.
+ * @param query The item IDs of the query.
+ * @return True if every query item is found in the transaction.
+ */
+bool transaction_contains_query(const std::span<const int> transaction, const std::vector<int>& query) {
+    for (const int query_item_id : query) {
+        bool found = false;
 
-            if (!found) {
-                all_found = false;
+        for (const int transaction_item_id : transaction) {
+            if (query_item_id == transaction_item_id) {
+                found = true;
                 break;
             }
         }
 
-        if (all_found)
-            query_results[query_number].insert(transaction_id);
+        if (!found) return false;
+    }
+    return true;
+}
+
+/**
+ * Processes a batch of queries using the naive method.
+ *
+ * Transactions are visited in blocks of TRANSACTION_BLOCK_SIZE, and every query of the
+ * batch is checked against a block before the next one is loaded, so each transaction is
+ * brought into cache once per batch instead of once per query.
+ *
+ * @param transactions The transactions, each a list of item IDs.
+ * @param queries All the queries.
+ * @param first_query Index of the first query of the batch.
+ * @param last_query One past the index of the last query of the batch.
+ * @param matches Receives, for every query of the batch, the matching transaction IDs in ascending order.
+ */
+void process_query_batch_naive(
+    const ItemSets& transactions,
+    const std::vector<std::vector<int>>& queries,
+    const size_t first_query,
+    const size_t last_query,
+    QueryMatches& matches) {
+
+    for (size_t block_start = 0; block_start < transactions.size(); block_start += TRANSACTION_BLOCK_SIZE) {
+        const size_t block_end = std::min(block_start + TRANSACTION_BLOCK_SIZE, transactions.size());
+
+        for (size_t q = first_query; q < last_query; q++)
+            for (size_t transaction_id = block_start; transaction_id < block_end; transaction_id++)
+                if (transaction_contains_query(transactions[transaction_id], queries[q]))
+                    matches[q].push_back(static_cast<int>(transaction_id));
     }
 }
 
@@ -317,7 +626,7 @@ inline void process_single_query_naive(
  *                 Each item is represented as an integer.
  * @return A signature representing the input item set as a vector of 64-bit integers.
  */
-Signature compute_signature(const std::vector<int>& item_set) {
+Signature compute_signature(const std::span<const int> item_set) {
     Signature signature;
 
     for (const int item : item_set) {
@@ -334,38 +643,129 @@ Signature compute_signature(const std::vector<int>& item_set) {
 }
 
 /**
- * Checks if a transaction signature covers a query signature.
+ * Computes the superimposed-coding signature of a set of items.
+ *
+ * Every item sets scheme.hashes bits of a scheme.width_bits-bit signature, at positions h1 + i * h2
+ * (i = 0 .. hashes - 1) modulo the width, where h1 and h2 are two halves of a 64-bit mix of the item
+ * (double hashing). The signature of a set is the OR of the signatures of its items, so it covers the
+ * signature of every subset, and possibly of sets that are not subsets (false drops).
  *
- * This function determines whether all bits set in the query signature
- * are also set in the corresponding positions of the transaction signature.
- * It ensures that the transaction signature has equal or greater length than
- * the query signature and performs a bitwise check to verify that all bits
- * set in the query are also set in the transaction.
+ * @param item_set The set of items for which the signature is to be computed.
+ * @param scheme The signature width and the number of bits per item.
+ * @return A signature of scheme.width_bits / 64 words.
+ */
+Signature compute_superimposed_signature(const std::span<const int> item_set, const SignatureScheme& scheme) {
+    Signature signature(scheme.width_bits / 64, 0);
 
+    for (const int item : item_set) {
+        //splitmix64 finalizer.
+        uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(item)) + 0x9E3779B97F4A7C15ULL;
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+        hash ^= hash >> 31;
+
+        const uint64_t h1 = (hash & 0xFFFFFFFF) % scheme.width_bits;
+        const uint64_t h2 = ((hash >> 32) | 1) % scheme.width_bits;
+        for (size_t i = 0; i < scheme.hashes; i++) {
+            const uint64_t bit = (h1 + i * h2) % scheme.width_bits;
+            signature[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+    return signature;
+}
+
+/**
+ * Estimates how often a transaction not containing a query item still has all the bits of that item set.
  *
- * @param transaction_sig The signature of the transaction to be checked.
- * @param query_sig The signature of the query being compared to the transaction.
- * @return True if the transaction signature covers the query signature,
- *         false otherwise.
+ * A transaction of n items sets a given bit with probability p(n) = 1 - (1 - 1/F)^(m n), so an item missing from
+ * it is a false drop with probability p(n)^m. The estimate averages this over the transaction lengths. Every extra
+ * query item multiplies the false drop rate of a query by about as much again.
+ *
+ * @param width_bits The signature width F, in bits.
+ * @param hashes The number m of bits per item.
+ * @param transactions The transactions.
+ * @return The estimated false drop rate of a one-item query, in [0, 1].
  */
-bool transaction_signature_covers_query(const Signature& transaction_sig, const Signature& query_sig) {
-    if (transaction_sig.size() < query_sig.size()) return false;
+double estimated_false_drop_rate(const size_t width_bits, const size_t hashes, const ItemSets& transactions) {
+    if (transactions.empty()) return 0.0;
+
+    std::map<size_t, size_t> length_counts;
+    for (const std::span<const int> transaction : transactions)
+        length_counts[transaction.size()]++;
+
+    const double bit_clear = 1.0 - 1.0 / static_cast<double>(width_bits);
+    double false_drops = 0.0;
+    for (const auto& [length, count] : length_counts) {
+        const double bit_set = 1.0 - std::pow(bit_clear, static_cast<double>(hashes * length));
+        false_drops += static_cast<double>(count) * std::pow(bit_set, static_cast<double>(hashes));
+    }
+    return false_drops / static_cast<double>(transactions.size());
+}
+
+/**
+ * Turns the requested signature scheme into the one used for the given transactions.
+ *
+ * With a memory budget the width F is the widest whole number of words that fits the budget for all the
+ * transactions: a wider signature always lowers the false drop rate. Without a hash count, m is the count
+ * (up to MAX_SIGNATURE_HASHES) with the lowest estimated false drop rate at that width, near F ln 2 / n for
+ * transactions of n items.
+ *
+ * @param requested The scheme given on the command line.
+ * @param transactions The transactions to sign.
+ * @return The scheme: exact if requested, otherwise with its width and hash count set.
+ * @throw Exits with error if the memory budget does not give every transaction one word.
+ */
+SignatureScheme resolve_signature_scheme(const SignatureScheme& requested, const ItemSets& transactions) {
+    if (requested.width_bits == 0 && requested.memory_bytes == 0) return EXACT_SIGNATURES;
+
+    SignatureScheme scheme = requested;
+    if (scheme.memory_bytes != 0) {
+        const size_t signatures = std::max<size_t>(transactions.size(), 1);
+        const size_t words = scheme.memory_bytes / sizeof(uint64_t) / signatures;
+        if (words == 0) {
+            std::cerr << "--signature-memory=" << scheme.memory_bytes << " is below one word per transaction: give at least "
+                      << signatures * sizeof(uint64_t) << " bytes for " << signatures << " transactions" << std::endl;
+            exit(-1);
+        }
+        scheme.width_bits = words * 64;
+    }
 
-    for (size_t i = 0; i < query_sig.size(); ++i)
-        if ((transaction_sig[i] & query_sig[i]) != query_sig[i]) return false;
+    if (scheme.hashes == 0) {
+        double best_rate = 2.0;
+        for (size_t hashes = 1; hashes <= MAX_SIGNATURE_HASHES; hashes++) {
+            const double rate = estimated_false_drop_rate(scheme.width_bits, hashes, transactions);
+            if (rate < best_rate) {
+                best_rate = rate;
+                scheme.hashes = hashes;
+            }
+        }
+    }
+    return scheme;
+}
 
-    return true;
+/**
+ * Removes the candidates of a superimposed signature scan that do not contain every query item.
+ *
+ * @param transactions The transactions.
+ * @param query The query items.
+ * @param candidates The transaction IDs whose signature covers the query signature; the false drops are removed.
+ * @return The number of false drops removed.
+ */
+size_t remove_false_drops(const ItemSets& transactions, const std::vector<int>& query, std::vector<int>& candidates) {
+    const size_t candidate_count = candidates.size();
+    std::erase_if(candidates, [&](const int t_id) { return !transaction_contains_query(transactions[t_id], query); });
+    return candidate_count - candidates.size();
 }
 
 /**
  * Processes a single query using the signature file approach.
  *
  * The method compares the query signature against each transaction signature
- * in the provided list of transaction signatures. For each transaction that
- * satisfies the query (i.e., its signature covers the query signature), the
- * transaction ID is added to the result set for the specified query.
+ * in the packed signature matrix. For each transaction that satisfies the query
+ * (i.e., all bits set in the query signature are also set in the transaction
+ * signature), the transaction ID is added to the result set for the specified query.
  *
- * @param transaction_signatures A vector of signatures representing transactions.
+ * @param transaction_signatures The packed signatures of the transactions.
  * @param query_signature The signature of the query to be processed.
  * @param query_number The index of the query being processed in the result set.
  * @param query_results A reference to the data structure storing the query results.
@@ -373,76 +773,159 @@ bool transaction_signature_covers_query(const Signature& transaction_sig, const
  *                      the transactions that match the query.
  */
 inline void process_single_query_signature_file(
-    const std::vector<Signature> &transaction_signatures,
+    const SignatureMatrix& transaction_signatures,
     const Signature& query_signature,
     const int query_number,
     QueryResult& query_results) {
-    for(int t_id = 0 ; t_id < transaction_signatures.size(); t_id++) {
-        if(transaction_signature_covers_query(transaction_signatures[t_id], query_signature))
-            query_results[query_number].insert(t_id);
+    transaction_signatures.for_each_covering(query_signature, [&](const int t_id) {
+        query_results[query_number].insert(t_id);
+    });
+}
+
+/**
+ * Processes a batch of queries using the signature file approach.
+ *
+ * The signature matrix is scanned in blocks of TRANSACTION_BLOCK_SIZE transactions, and every
+ * query of the batch is tested against a block before moving on to the next one, so each block
+ * is read from memory once per batch instead of once per query.
+ *
+ * @param transaction_signatures The packed signatures of the transactions.
+ * @param query_signatures The signatures of all the queries.
+ * @param first_query Index of the first query of the batch.
+ * @param last_query One past the index of the last query of the batch.
+ * @param matches Receives, for every query of the batch, the matching transaction IDs in ascending order.
+ */
+void process_query_batch_signature_file(
+    const SignatureMatrix& transaction_signatures,
+    const std::vector<Signature>& query_signatures,
+    const size_t first_query,
+    const size_t last_query,
+    QueryMatches& matches) {
+
+    std::vector<SignatureMatrix::Query> prepared_queries;
+    for (size_t q = first_query; q < last_query; q++)
+        prepared_queries.push_back(transaction_signatures.prepare(query_signatures[q]));
+
+    constexpr size_t blocks_per_step = TRANSACTION_BLOCK_SIZE / SignatureMatrix::BLOCK_ROWS;
+    for (size_t first_block = 0; first_block < transaction_signatures.blocks(); first_block += blocks_per_step) {
+        const size_t last_block = std::min(first_block + blocks_per_step, transaction_signatures.blocks());
+
+        for (size_t q = first_query; q < last_query; q++) {
+            transaction_signatures.for_each_covering(prepared_queries[q - first_query], first_block, last_block, [&](const int t_id) {
+                matches[q].push_back(t_id);
+            });
+        }
     }
 }
 
+/**
+ * Generates the signatures of all transactions and packs them into a signature matrix.
+ *
+ * @param transactions The transactions, each a list of item IDs.
+ * @param write_signature_file If true, the signatures are also written to sigfile.txt.
+ * @param scheme Exact signatures, or the width and hash count of superimposed ones (see resolve_signature_scheme).
+ * @return The packed signatures.
+ */
+SignatureMatrix build_signature_matrix(const ItemSets& transactions, const bool write_signature_file, const SignatureScheme& scheme) {
+    //Generate signatures for transactions.
+    std::vector<Signature> transaction_signatures;
+    transaction_signatures.reserve(transactions.size());
+    for (const std::span<const int> transaction : transactions)
+        transaction_signatures.push_back(scheme.width_bits == 0
+            ? compute_signature(transaction)
+            : compute_superimposed_signature(transaction, scheme));
+
+    if (write_signature_file) {
+        //Write signatures to the file.
+        std::ofstream signatures_file("sigfile.txt");
+        if(!signatures_file) {
+            std::cerr << "Could not open file sigfile.txt" << std::endl;
+            std::exit(-1);
+        }
+
+        for(const Signature& signature : transaction_signatures) {
+            for (uint64_t word : signature)
+                signatures_file << word;
+            signatures_file << std::endl;
+        }
+    }
+
+    //Pack the signatures into one contiguous, padded matrix for the scans.
+    return SignatureMatrix(transaction_signatures);
+}
+
 /**
  * Processes queries against a transaction file using the signature file method.
  *
  * This method generates signatures for transactions and queries, writes the
  * transaction signatures to a file, and matches the queries against the
- * transaction signatures using the signature file method. If the query_number
+ * transaction signatures using the signature file method. Given an index file,
+ * the transaction signatures are mapped from it instead, and no file is written. If the query_number
  * is -1, all queries are processed; otherwise, only the specified query is
  * processed.
  *
+ * With superimposed signatures (options.signature), the signatures are generated from the transactions
+ * even given an index file, whose signatures are exact, and every covering transaction is checked against
+ * the query items; the number of false drops removed is printed along with the timing.
+ *
  * Additionally, the method performs timing measurement and prints the
  * total computation time required to process the query or queries.
  *
- * @param transactions_file The file path containing transaction data.
+ * @param transactions_file The file path containing transaction data, or an index file.
  * @param queries_file The file path containing query data.
  * @param query_number The query identifier to process. If -1, all queries are processed.
+ * @param options How the queries are batched and threaded when all of them are processed, and the signature scheme.
  * @return The results of the query processing as a QueryResult unordered map,
  *         where the key represents the query identifier and the value is a set
  *         of matching transaction identifiers.
  */
-QueryResult signature_file_method(const std::string& transactions_file, const std::string& queries_file, int query_number) {
-    const std::vector<std::vector<int>> transactions = load_item_sets_from_file(transactions_file);
+QueryResult signature_file_method(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options) {
     const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
     QueryResult query_results;
 
-
-    //Generate signatures for transactions.
-    std::vector<Signature> transaction_signatures;
-    for (const std::vector<int>& transaction : transactions)
-        transaction_signatures.push_back(compute_signature(transaction));
+    //Map the packed signatures of a prebuilt index, or generate them (and sigfile.txt) for the transactions.
+    //Superimposed signatures are always generated, and need the transactions to check the candidates.
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    const bool superimposed = options.signature.width_bits != 0 || options.signature.memory_bytes != 0;
+    const bool map_signatures = index_file && !superimposed;
+    const ItemSets transactions = map_signatures ? ItemSets() : load_transactions(transactions_file, index_file);
+    const SignatureScheme scheme = resolve_signature_scheme(options.signature, transactions);
+    const SignatureMatrix signature_matrix = map_signatures
+        ? signature_matrix_from_index(*index_file)
+        : build_signature_matrix(transactions, !index_file, scheme);
+
+    if (superimposed) {
+        std::cout << "Superimposed signatures: " << scheme.width_bits << " bits, " << scheme.hashes << " bits per item, "
+                  << signature_matrix.packed_words().size_bytes() << " bytes, estimated false drop rate per query item "
+                  << estimated_false_drop_rate(scheme.width_bits, scheme.hashes, transactions) << std::endl;
+    }
 
     //Generate signatures for queries.
     std::vector<Signature> query_signatures;
     for(const std::vector<int>& query : queries)
-        query_signatures.push_back(compute_signature(query));
-
-
-    //Write signatures to the file.
-    std::ofstream signatures_file("sigfile.txt");
-    if(!signatures_file) {
-        std::cerr << "Could not open file sigfile.txt" << std::endl;
-        std::exit(-1);
-    }
-
-    for(const Signature& signature : transaction_signatures) {
-        for (uint64_t word : signature)
-            signatures_file << word;
-        signatures_file << std::endl;
-    }
-
-
+        query_signatures.push_back(superimposed ? compute_superimposed_signature(query, scheme) : compute_signature(query));
 
 
     const auto start = std::chrono::high_resolution_clock::now();
+    std::atomic<size_t> false_drops{0};
 
     if(query_number == -1) {
-       for(int i = 0; i < query_signatures.size(); i ++)
-           process_single_query_signature_file(transaction_signatures,query_signatures[i],i,query_results);
+        QueryMatches matches(query_signatures.size());
+        for_each_query_batch(query_signatures.size(), options, [&](const size_t first_query, const size_t last_query) {
+            process_query_batch_signature_file(signature_matrix, query_signatures, first_query, last_query, matches);
+            if (superimposed)
+                for (size_t q = first_query; q < last_query; q++)
+                    false_drops += remove_false_drops(transactions, queries[q], matches[q]);
+        });
+        store_query_matches(matches, query_results);
 
     }else {
-        process_single_query_signature_file(transaction_signatures,query_signatures[query_number], query_number,query_results);
+        process_single_query_signature_file(signature_matrix,query_signatures[query_number], query_number,query_results);
+        if (superimposed) {
+            false_drops += std::erase_if(query_results[query_number], [&](const int t_id) {
+                return !transaction_contains_query(transactions[t_id], queries[query_number]);
+            });
+        }
         print_query_resulted_item_ids("Signature File",query_results[query_number]);
     }
 
@@ -450,6 +933,7 @@ QueryResult signature_file_method(const std::string& transactions_file, const st
 
 
     const std::chrono::duration<double> duration = end - start;
+    if (superimposed) std::cout << "Signature File false drops removed = " << false_drops << std::endl;
     std::cout << "Signature File computation time = " << duration.count() << " seconds\n";
     return query_results;
 }
@@ -463,24 +947,20 @@ QueryResult signature_file_method(const std::string& transactions_file, const st
  * Constructs a mapping between each unique item and a bit-encoded representation
  * of the transactions that contain the item.
  *
- * Each transaction is represented by a bit in a large integer (boost::multiprecision::cpp_int).
- * For a given item, the bits in its associated integer mark the indices of the transactions
- * where the item appears.
+ * Each transaction is represented by a bit in a compressed bitmap (TransactionBitmap).
+ * For a given item, the bits in its associated bitmap mark the indices of the transactions
+ * where the item appears. Transactions are scanned in order, so ids are only ever appended.
  *
- * @param transactions A vector of transactions, where each transaction is represented
- *                     as a vector of integers (item identifiers).
+ * @param transactions The transactions, each a list of integers (item identifiers).
  * @return A map where the key is an item identifier (int) and the value is a
- *         boost::multiprecision::cpp_int, with bits set to indicate the transaction
- *         indices where the item is present.
+ *         TransactionBitmap holding the transaction indices where the item is present.
  */
-std::map<int, boost::multiprecision::cpp_int> build_item_transactions_bit_map(const std::vector<std::vector<int>>& transactions) {
-    std::map<int, boost::multiprecision::cpp_int> item_transactions_bit_map;
+ItemToTransactionBitmap build_item_transactions_bit_map(const ItemSets& transactions) {
+    ItemToTransactionBitmap item_transactions_bit_map;
 
     for (int i = 0; i < transactions.size(); ++i) {
         for (int item : transactions[i]) {
-            // Create a big integer with only the i-th bit set (used to mark transaction i).
-            const boost::multiprecision::cpp_int bit = boost::multiprecision::cpp_int(1) << i;
-            item_transactions_bit_map[item] |= bit; // BitWise OR
+            item_transactions_bit_map[item].append(i); // Set the i-th bit (marks transaction i).
         }
     }
     return item_transactions_bit_map;
@@ -491,16 +971,19 @@ std::map<int, boost::multiprecision::cpp_int> build_item_transactions_bit_map(co
  *
  * This function iterates over a map of item transactions and their corresponding
  * bit-slice signatures, and writes the item ID along with its signature to
- * the provided file stream.
+ * the provided file stream. Each signature is written as the decimal value of the
+ * integer whose i-th bit marks transaction i.
  *
  * @param item_transactions_bit_map A map where the key is the item ID and
- *                                  the value is the bit-slice signature
- *                                  (represented as a boost::multiprecision::cpp_int).
+ *                                  the value is the bit-slice signature.
  * @param bitslice_file The output file stream where the item ID and its
  *                      signature will be written.
  */
-void write_bitslice_signatures(const std::map<int, boost::multiprecision::cpp_int>& item_transactions_bit_map,std::ofstream& bitslice_file){
-    for (const auto& [item, signature] : item_transactions_bit_map) {
+void write_bitslice_signatures(const ItemToTransactionBitmap& item_transactions_bit_map,std::ofstream& bitslice_file){
+    for (const auto& [item, bitmap] : item_transactions_bit_map) {
+        const std::vector<uint64_t> words = bitmap.to_words();
+        boost::multiprecision::cpp_int signature;
+        boost::multiprecision::import_bits(signature, words.begin(), words.end(), 64, false);
         bitslice_file << item << ": " << signature << '\n';
     }
 }
@@ -509,9 +992,9 @@ void write_bitslice_signatures(const std::map<int, boost::multiprecision::cpp_in
  * Processes a single query against transaction data using the exact bitslice signature method.
  *
  * This method takes a query represented as a set of items and determines which transactions
- * contain all the items in the query. It uses bitwise operations on bitmaps representing
- * item-to-transaction mappings to efficiently compute the results. The resulting transaction
- * IDs are stored in the specified QueryResult object for the given query.
+ * contain all the items in the query. It intersects the bitmaps of the query items, smallest
+ * first so that the intermediate result shrinks as fast as possible, and stores the resulting
+ * transaction IDs in the specified QueryResult object for the given query.
  *
  * @param item_transactions_bit_map A mapping of item identifiers to bitmaps where each bit
  *                                  represents the presence or absence of the item in a transaction.
@@ -521,8 +1004,7 @@ void write_bitslice_signatures(const std::map<int, boost::multiprecision::cpp_in
  *                      query are stored.
  */
 inline void process_single_query_exact_bitslice(
-    const std::map<int,
-    boost::multiprecision::cpp_int>& item_transactions_bit_map,
+    const ItemToTransactionBitmap& item_transactions_bit_map,
     const std::vector<int>& query_items_set,
     const int query_number,
     QueryResult& query_results){
@@ -530,35 +1012,72 @@ inline void process_single_query_exact_bitslice(
     //Query is empty, just in case ;)
     if (query_items_set.empty()) return;
 
-    // Initialize the result with the bitmap of the first item
-    const int query_first_item = query_items_set[0];
-    auto it = item_transactions_bit_map.find(query_first_item);
+    // Extract transaction ids from the result bitmap, in ascending order
+    intersect_query_bitmaps(item_transactions_bit_map, query_items_set).for_each([&](const int t_id) {
+        query_results[query_number].insert(t_id);
+    });
+}
+
+/**
+ * Intersects the bitmaps of the items of a query, smallest first so that the
+ * intermediate result shrinks as fast as possible.
+ *
+ * @param item_transactions_bit_map A mapping of item identifiers to their transaction bitmaps.
+ * @param query_items_set A vector of item identifiers representing the items in the query.
+ * @return The transactions containing every query item (empty if an item appears nowhere).
+ */
+TransactionBitmap intersect_query_bitmaps(
+    const ItemToTransactionBitmap& item_transactions_bit_map,
+    const std::vector<int>& query_items_set) {
+
+    std::vector<const TransactionBitmap*> item_bitmaps;
+    item_bitmaps.reserve(query_items_set.size());
+    for (const int item : query_items_set) {
+        const auto it = item_transactions_bit_map.find(item);
+
+        //Item doesnt exist at any transaction, so no transaction contains all query items.
+        if (it == item_transactions_bit_map.end()) return {};
+        item_bitmaps.push_back(&it->second);
+    }
+    if (item_bitmaps.empty()) return {};
 
-    //Item doesnt exist at any transaction
-    if (it == item_transactions_bit_map.end()) return;
+    std::sort(item_bitmaps.begin(), item_bitmaps.end(), [](const TransactionBitmap* a, const TransactionBitmap* b) {
+        return a->cardinality() < b->cardinality();
+    });
 
 
-    //Begin with the bitmap of the first item of the query.
-    boost::multiprecision::cpp_int result_bitmap = it->second;
+    //Begin with the smallest bitmap of the query.
+    TransactionBitmap result_bitmap = *item_bitmaps[0];
 
     //for the rest of the query items.
-    for (size_t i = 1; i < query_items_set.size(); ++i) {
-        it = item_transactions_bit_map.find(query_items_set[i]);
-        if (it == item_transactions_bit_map.end()) {
-            result_bitmap = 0;  // If any item not found, there is no transaction that exists all query items.
-            break;
-        }
-
-        result_bitmap &= it->second;
-    }
+    for (size_t i = 1; i < item_bitmaps.size() && !result_bitmap.empty(); ++i)
+        result_bitmap.intersect_with(*item_bitmaps[i]);
 
+    return result_bitmap;
+}
 
-    // Extract transaction ids from result_bitmap
-    for (int t_id = 0; result_bitmap != 0; ++t_id) {
-        if ((result_bitmap & 1) != 0) {
-            query_results[query_number].insert(t_id);
-        }
-        result_bitmap >>= 1;
+/**
+ * Processes a batch of queries using the exact bitslice signature method.
+ *
+ * The bitmaps are only read, so the batches of different threads share them.
+ *
+ * @param item_transactions_bit_map A mapping of item identifiers to their transaction bitmaps.
+ * @param queries All the queries.
+ * @param first_query Index of the first query of the batch.
+ * @param last_query One past the index of the last query of the batch.
+ * @param matches Receives, for every query of the batch, the matching transaction IDs in ascending order.
+ */
+void process_query_batch_exact_bitslice(
+    const ItemToTransactionBitmap& item_transactions_bit_map,
+    const std::vector<std::vector<int>>& queries,
+    const size_t first_query,
+    const size_t last_query,
+    QueryMatches& matches) {
+
+    for (size_t q = first_query; q < last_query; q++) {
+        intersect_query_bitmaps(item_transactions_bit_map, queries[q]).for_each([&](const int t_id) {
+            matches[q].push_back(t_id);
+        });
     }
 }
 
@@ -566,7 +1085,8 @@ inline void process_single_query_exact_bitslice(
  * Processes a query using the exact bitslice signature file method.
  *
  * This method reads transaction and query datasets from their respective
- * files, builds a bitslice signature representation for the transactions,
+ * files, builds a bitslice signature representation for the transactions
+ * (or reads it from an index file, without writing bitslice.txt),
  * and processes the specified query or all queries, depending on the input.
  * The results are computed and stored in a QueryResult data structure.
  *
@@ -577,30 +1097,38 @@ inline void process_single_query_exact_bitslice(
  * @param queries_file The file path containing the queries data.
  * @param query_number The identifier for the specific query to process.
  *                     If -1, all queries are processed.
+ * @param options How the queries are batched and threaded when all of them are processed.
  * @return A QueryResult object containing the results of the processed
  *         query or queries.
  */
-QueryResult exact_bitslice_signature_file(const std::string& transactions_file, const std::string& queries_file, int query_number) {
-    const std::vector<std::vector<int>> transactions = load_item_sets_from_file(transactions_file);
+QueryResult exact_bitslice_signature_file(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options) {
     const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
     QueryResult query_results;
 
-    const auto item_transactions_bit_map = build_item_transactions_bit_map(transactions);
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    const auto item_transactions_bit_map = index_file
+        ? bit_map_from_index(*index_file)
+        : build_item_transactions_bit_map(load_item_sets(transactions_file));
 
-    std::ofstream bitslice_file("bitslice.txt");
-    if (!bitslice_file) {
-        std::cerr << "Could not open bitslice.txt for writing\n";
-        std::exit(-1);
-    }
+    if (!index_file) {
+        std::ofstream bitslice_file("bitslice.txt");
+        if (!bitslice_file) {
+            std::cerr << "Could not open bitslice.txt for writing\n";
+            std::exit(-1);
+        }
 
-    write_bitslice_signatures(item_transactions_bit_map, bitslice_file);
+        write_bitslice_signatures(item_transactions_bit_map, bitslice_file);
+    }
 
 
     const auto start = std::chrono::high_resolution_clock::now();
 
     if (query_number == -1) {
-        for (int i = 0; i < queries.size(); i++)
-            process_single_query_exact_bitslice(item_transactions_bit_map, queries[i], i, query_results);
+        QueryMatches matches(queries.size());
+        for_each_query_batch(queries.size(), options, [&](const size_t first_query, const size_t last_query) {
+            process_query_batch_exact_bitslice(item_transactions_bit_map, queries, first_query, last_query, matches);
+        });
+        store_query_matches(matches, query_results);
     } else {
         process_single_query_exact_bitslice(item_transactions_bit_map, queries[query_number], query_number, query_results);
         print_query_resulted_item_ids("Exact Bitslice Signature", query_results[query_number]);
@@ -621,23 +1149,16 @@ QueryResult exact_bitslice_signature_file(const std::string& transactions_file,
  * Constructs an inverted index from a given list of transactions.
  *
  * The method processes a collection of transactions and builds an inverted
- * index mapping each item to the set of transaction indices where the item
- * is present. This index is useful for efficiently processing queries.
+ * index mapping each item to the sorted list of transaction indices where the
+ * item is present. This index is useful for efficiently processing queries.
+ * The lists are stored back to back in one array (see InvertedIndex).
  *
- * @param transactions A vector of vectors where each inner vector represents
- *                      a transaction containing a list of items.
- * @return A map where each key is an item from the transactions, and the
- *         corresponding value is a set of transaction indices in which the
- *         item appears.
+ * @param transactions The transactions, each a list of items.
+ * @return An index where each item from the transactions is mapped to the
+ *         ascending transaction indices in which the item appears.
  */
-std::map<int, std::set<int>> build_inverted_index(const std::vector<std::vector<int>>& transactions) {
-    std::map<int, std::set<int>> inverted_index;
-
-    for (int i = 0; i < transactions.size(); i++)
-        for (int item : transactions[i])
-            inverted_index[item].insert(i);
-
-    return inverted_index;
+InvertedIndex build_inverted_index(const ItemSets& transactions) {
+    return InvertedIndex(transactions);
 }
 
 /**
@@ -648,20 +1169,19 @@ std::map<int, std::set<int>> build_inverted_index(const std::vector<std::vector<
  * The results are written to the file in a human-readable format, with each
  * line representing an item and the list of transaction IDs.
  *
- * @param inverted_index A map representing the inverted index, where each key is
- *                       an item, and the value is a set of transaction IDs
- *                       associated with that item. Each item is mapped to
+ * @param inverted_index The inverted index, where each item is mapped to
  *                       all transactions in which it appears.
  */
-void write_inverted_index_to_file(const std::map<int, std::set<int>>& inverted_index) {
+void write_inverted_index_to_file(const InvertedIndex& inverted_index) {
     std::ofstream outfile("invfile.txt");
     if (!outfile) {
         std::cerr << "Could not open " << "invfile.txt" << " for writing\n";
         std::exit(-1);
     }
 
-    for (const auto& [item, txn_ids] : inverted_index) {
-        outfile << item << ": [";
+    for (size_t slot = 0; slot < inverted_index.item_count(); slot++) {
+        const std::span<const int> txn_ids = inverted_index.postings_of_slot(slot);
+        outfile << inverted_index.item(slot) << ": [";
         for (auto it = txn_ids.begin(); it != txn_ids.end(); ++it) {
             outfile << *it;
             if (std::next(it) != txn_ids.end()) outfile << ", ";
@@ -676,31 +1196,38 @@ void write_inverted_index_to_file(const std::map<int, std::set<int>>& inverted_i
  * This method builds an inverted index from the given transactions file and
  * processes queries from the queries file. It either processes a single query
  * identified by the `query_number` or processes all queries if `query_number`
- * is -1. The inverted index is stored in a file for inspection, and the
- * computation time for processing is logged.
+ * is -1. The inverted index is stored in a file for inspection (unless it is
+ * read from an index file), and the computation time for processing is logged.
  *
  * @param transactions_file The file path containing the transactions data.
  * @param queries_file The file path containing the queries data.
  * @param query_number The identifier for the specific query to process.
  *                     Use -1 to process all queries.
+ * @param options How the queries are batched and threaded when all of them are processed.
  * @return A QueryResult object containing query result sets, where each
  *         key corresponds to a query ID and values are the sets of
  *         transaction IDs resulting from the query.
  */
-QueryResult inverted_file_with_intersection(const std::string& transactions_file, const std::string& queries_file, int query_number) {
-    const std::vector<std::vector<int>> transactions = load_item_sets_from_file(transactions_file);
+QueryResult inverted_file_with_intersection(const std::string& transactions_file, const std::string& queries_file, int query_number, const MethodOptions& options) {
     const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
-    const std::map<int, std::set<int>> inverted_index = build_inverted_index(transactions);
 
-    write_inverted_index_to_file(inverted_index);
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    const InvertedIndex inverted_index = index_file
+        ? inverted_index_from_index(*index_file)
+        : build_inverted_index(load_item_sets(transactions_file));
+
+    if (!index_file) write_inverted_index_to_file(inverted_index);
 
     QueryResult query_results;
 
     const auto start = std::chrono::high_resolution_clock::now();
 
     if (query_number == -1) {
-        for (int i = 0; i < queries.size(); i++)
-            process_single_query_inverted_index(inverted_index, queries[i], i, query_results);
+        QueryMatches matches(queries.size());
+        for_each_query_batch(queries.size(), options, [&](const size_t first_query, const size_t last_query) {
+            process_query_batch_inverted_index(inverted_index, queries, first_query, last_query, matches);
+        });
+        store_query_matches(matches, query_results);
     } else {
         process_single_query_inverted_index(inverted_index, queries[query_number], query_number, query_results);
         print_query_resulted_item_ids("Inverted File", query_results[query_number]);
@@ -717,11 +1244,12 @@ QueryResult inverted_file_with_intersection(const std::string& transactions_file
  * Processes a single query using an inverted index to find matching transactions.
  *
  * This method checks for transactions that contain all items in the given query
- * using the inverted index. It uses a sorted intersection algorithm to efficiently
- * identify the transactions that satisfy the query. The results are stored in the
- * provided query results structure for the given query number.
+ * using the inverted index. The posting lists of the query items are intersected
+ * in place, shortest first, galloping through lists much longer than the current
+ * result. The results are stored in the provided query results structure for the
+ * given query number.
  *
- * @param inverted_index The pre-built inverted index mapping item IDs to sets of
+ * @param inverted_index The pre-built inverted index mapping item IDs to the sorted
  *                       transaction IDs that contain these items.
  * @param query_items_set A vector containing the item IDs specified in the query.
  *                        These items are processed to find intersections.
@@ -731,65 +1259,480 @@ QueryResult inverted_file_with_intersection(const std::string& transactions_file
  *                      the query are stored. Results are indexed by query number.
  */
 inline void process_single_query_inverted_index(
-    const std::map<int, std::set<int>>& inverted_index,
+    const InvertedIndex& inverted_index,
     const std::vector<int>& query_items_set,
     const int query_number,
     QueryResult& query_results){
 
-    //Edge case, a query is empty.
-    if (query_items_set.empty()) return;
+    std::vector<int> current, scratch;
+    intersect_query_postings(inverted_index, query_items_set, current, scratch);
+
+    for (int transaction_id : current) {
+        query_results[query_number].insert(transaction_id);
+    }
+}
+
+/**
+ * Processes a batch of queries using the inverted index.
+ *
+ * Posting lists are read in place from the shared index, and the intersection
+ * buffers are reused by all the queries of the batch.
+ *
+ * @param inverted_index The pre-built inverted index mapping item IDs to the sorted transaction IDs.
+ * @param queries All the queries.
+ * @param first_query Index of the first query of the batch.
+ * @param last_query One past the index of the last query of the batch.
+ * @param matches Receives, for every query of the batch, the matching transaction IDs in ascending order.
+ */
+void process_query_batch_inverted_index(
+    const InvertedIndex& inverted_index,
+    const std::vector<std::vector<int>>& queries,
+    const size_t first_query,
+    const size_t last_query,
+    QueryMatches& matches) {
+
+    std::vector<int> current, scratch;
+    for (size_t q = first_query; q < last_query; q++) {
+        intersect_query_postings(inverted_index, queries[q], current, scratch);
+        matches[q].assign(current.begin(), current.end());
+    }
+}
+
 
 
-    const int query_first_item_id = query_items_set[0];
-    auto it = inverted_index.find(query_first_item_id);
-    if (it == inverted_index.end()) return;//If it doesn't exist means no transaction exists with this item id.
+//
+//Index File
 
+/**
+ * Builds every index of the four methods from a transactions file and writes them to one binary index file.
+ *
+ * The index file can then be passed instead of the transactions file: each method maps the sections
+ * it needs instead of parsing the transactions and rebuilding its index.
+ *
+ * @param transactions_file The transactions text file.
+ * @param index_file The index file to write.
+ */
+void build_index_file(const std::string& transactions_file, const std::string& index_file) {
+    const ItemSets transactions = load_item_sets(transactions_file);
+    IndexFileWriter writer(CONTAINMENT_INDEX_KIND);
+
+    //Transactions, for the naive method: the CSR arrays they are loaded into.
+    writer.add(TRANSACTION_OFFSETS_SECTION, transactions.offset_array());
+    writer.add(TRANSACTION_ITEMS_SECTION, transactions.item_array());
+
+    const SignatureMatrix signature_matrix = build_signature_matrix(transactions, false);
+    const std::vector<uint64_t> signature_shape{signature_matrix.rows(), signature_matrix.width()};
+    writer.add(SIGNATURE_SHAPE_SECTION, signature_shape);
+    writer.add(SIGNATURE_WORDS_SECTION, signature_matrix.packed_words());
+
+    const ItemToTransactionBitmap item_transactions_bit_map = build_item_transactions_bit_map(transactions);
+    std::vector<int> bitslice_items;
+    std::vector<uint64_t> bitslice_container_offsets{0};
+    std::vector<TransactionBitmap::SerializedContainer> bitslice_containers;
+    std::vector<uint64_t> bitslice_data;
+    for (const auto& [item, bitmap] : item_transactions_bit_map) {
+        bitslice_items.push_back(item);
+        bitmap.serialize(bitslice_containers, bitslice_data);
+        bitslice_container_offsets.push_back(bitslice_containers.size());
+    }
+    writer.add(BITSLICE_ITEMS_SECTION, bitslice_items);
+    writer.add(BITSLICE_CONTAINER_OFFSETS_SECTION, bitslice_container_offsets);
+    writer.add(BITSLICE_CONTAINERS_SECTION, bitslice_containers);
+    writer.add(BITSLICE_DATA_SECTION, bitslice_data);
+
+    const InvertedIndex inverted_index = build_inverted_index(transactions);
+    writer.add(INVERTED_ITEMS_SECTION, inverted_index.item_array());
+    writer.add(INVERTED_OFFSETS_SECTION, inverted_index.offset_array());
+    writer.add(INVERTED_POSTINGS_SECTION, inverted_index.posting_array());
+
+    writer.write(index_file);
+    std::cout << "Index of " << transactions.size() << " transactions (" << inverted_index.item_count()
+              << " distinct items) written to " << index_file << std::endl;
+}
 
-    // Sets in C++ are implemented as red-black trees, so their elements are always sorted.
-    // Copying them to vectors preserves the sorted order.
-    // This allows us to run the sorted input lists intersection algorithm from exercise 1.
+/**
+ * Opens a containment index file if the given file is one.
+ *
+ * @param transactions_file A transactions text file or an index file.
+ * @return The mapped index file, or nothing if the file is not an index file.
+ */
+std::optional<IndexFile> open_index_file(const std::string& transactions_file) {
+    if (!IndexFile::is_index_file(transactions_file)) return std::nullopt;
+    return IndexFile(transactions_file, CONTAINMENT_INDEX_KIND);
+}
 
+/**
+ * Views the transactions of an index file. The sets read the mapping directly, until one is appended.
+ *
+ * @param index_file The mapped index file, which must outlive the transactions.
+ * @return The transactions, in CSR layout.
+ */
+ItemSets transactions_from_index(const IndexFile& index_file) {
+    ItemSets transactions(index_file.section<uint64_t>(TRANSACTION_OFFSETS_SECTION),
+                          index_file.section<int>(TRANSACTION_ITEMS_SECTION));
+    if (!transactions.valid()) {
+        std::cerr << "Corrupt transactions in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return transactions;
+}
 
-    //Current vector = transaction id list of the first query item.
-    std::vector current(it->second.begin(), it->second.end());
+/**
+ * Views the packed transaction signatures of an index file. The matrix reads the mapping directly.
+ *
+ * @param index_file The mapped index file, which must outlive the matrix.
+ * @return The packed signatures.
+ */
+SignatureMatrix signature_matrix_from_index(const IndexFile& index_file) {
+    const auto shape = index_file.section<uint64_t>(SIGNATURE_SHAPE_SECTION);
+    const auto words = index_file.section<uint64_t>(SIGNATURE_WORDS_SECTION);
+    if (shape.size() != 2 || words.size() != SignatureMatrix::packed_size(shape[0], shape[1])) {
+        std::cerr << "Corrupt signatures in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return SignatureMatrix(words.data(), shape[0], shape[1]);
+}
 
+/**
+ * Reads the item bitslices back from an index file.
+ *
+ * @param index_file The mapped index file.
+ * @return A map where the key is an item identifier and the value its transaction bitmap.
+ */
+ItemToTransactionBitmap bit_map_from_index(const IndexFile& index_file) {
+    const auto items = index_file.section<int>(BITSLICE_ITEMS_SECTION);
+    const auto container_offsets = index_file.section<uint64_t>(BITSLICE_CONTAINER_OFFSETS_SECTION);
+    const auto containers = index_file.section<TransactionBitmap::SerializedContainer>(BITSLICE_CONTAINERS_SECTION);
+    const auto data = index_file.section<uint64_t>(BITSLICE_DATA_SECTION);
+
+    bool valid = container_offsets.size() == items.size() + 1 && container_offsets.back() == containers.size()
+              && std::ranges::is_sorted(container_offsets);
+    ItemToTransactionBitmap item_transactions_bit_map;
+    for (size_t i = 0; valid && i < items.size(); i++) {
+        TransactionBitmap bitmap;
+        const auto item_containers = containers.subspan(container_offsets[i], container_offsets[i + 1] - container_offsets[i]);
+        valid = TransactionBitmap::deserialize(item_containers, data, bitmap);
+        item_transactions_bit_map.emplace_hint(item_transactions_bit_map.end(), items[i], std::move(bitmap));
+    }
+    if (!valid) {
+        std::cerr << "Corrupt bitslices in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return item_transactions_bit_map;
+}
 
-    //for the rest of the query items.
-    for (size_t i = 1; i < query_items_set.size(); ++i) {
-        it = inverted_index.find(query_items_set[i]);
-        if (it == inverted_index.end()) {
-            current.clear();
-            break;//Same as before. If it doesn't exist means no transaction exists with this item id.
+/**
+ * Views the inverted index of an index file. The index reads the mapping directly.
+ *
+ * @param index_file The mapped index file, which must outlive the inverted index.
+ * @return The inverted index.
+ */
+InvertedIndex inverted_index_from_index(const IndexFile& index_file) {
+    InvertedIndex inverted_index(index_file.section<int>(INVERTED_ITEMS_SECTION),
+                                 index_file.section<uint64_t>(INVERTED_OFFSETS_SECTION),
+                                 index_file.section<int>(INVERTED_POSTINGS_SECTION));
+    if (!inverted_index.valid()) {
+        std::cerr << "Corrupt inverted index in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return inverted_index;
+}
+
+
+
+//
+//Server
+
+/**
+ * Builds the indexes of all four methods from a transactions file, or maps them from an index file.
+ *
+ * @param transactions_file The transactions text file, or an index file.
+ * @param index_file The mapped index file if transactions_file is one; it must outlive the indexes.
+ * @return The indexes, with no appended transactions.
+ */
+ServedIndexes load_served_indexes(const std::string& transactions_file, const std::optional<IndexFile>& index_file) {
+    ServedIndexes indexes{
+        index_file ? transactions_from_index(*index_file) : load_item_sets(transactions_file),
+        std::nullopt, {}, {}, std::nullopt, {}, 0};
+    indexes.signature_matrix.emplace(index_file
+        ? signature_matrix_from_index(*index_file)
+        : build_signature_matrix(indexes.transactions, false));
+    indexes.item_transactions_bit_map = index_file
+        ? bit_map_from_index(*index_file)
+        : build_item_transactions_bit_map(indexes.transactions);
+    indexes.inverted_index.emplace(index_file
+        ? inverted_index_from_index(*index_file)
+        : build_inverted_index(indexes.transactions));
+    indexes.base_transaction_count = indexes.transactions.size();
+    return indexes;
+}
+
+/**
+ * Builds (or maps from an index file) the indexes of all four methods once, then answers containment
+ * queries until the input is closed, or forever when listening on a port.
+ *
+ * A request is a method number followed by the query items, in the format of queries.txt:
+ *
+ *     3 [10, 24, 73, 1]
+ *
+ * and is answered with the number of matching transactions followed by their IDs, ascending:
+ *
+ *     ok 3 462 702 8990
+ *
+ * "append" followed by items adds a transaction, answered with its ID ("ok 10000") (see append_transaction).
+ * Appends of a client are applied in its request order, after its earlier queries and before its later ones,
+ * which see the transaction; appends of other clients may interleave with them. A malformed request is
+ * answered with "error <reason>". No output file is written.
+ *
+ * Queries hold a shared lock on the indexes and run concurrently; an append holds it exclusively.
+ *
+ * @param transactions_file The transactions text file, or an index file.
+ * @param options Worker threads and port.
+ */
+void serve_queries(const std::string& transactions_file, const ServerOptions& options) {
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    ServedIndexes indexes = load_served_indexes(transactions_file, index_file);
+    std::shared_mutex indexes_mutex;
+
+    const auto is_append = [](const std::string& request) {
+        return request.compare(0, std::min(request.find(' '), request.size()), "append") == 0;
+    };
+    const auto answer = [&](const std::string& request) -> ServerResponse {
+        const size_t split = std::min(request.find(' '), request.size());
+        if (is_append(request)) {
+            std::unique_lock<std::shared_mutex> lock(indexes_mutex);
+            const int t_id = append_transaction(indexes, parse_item_set(request.substr(split)));
+            return {APPEND_REQUEST_KIND, "ok " + std::to_string(t_id)};
         }
 
-        //Candidate vector = transaction id list of the ith query item
-        std::vector candidate(it->second.begin(), it->second.end());
+        int method_number = -1;
+        const auto [end, error] = std::from_chars(request.data(), request.data() + split, method_number);
+        if (error != std::errc() || end != request.data() + split || method_number < NAIVE || method_number > INVERTED_FILE)
+            return {ServerResponse::UNTIMED, "error expected a method (0-3) followed by the query items, or append and the transaction items"};
 
+        const std::shared_lock<std::shared_mutex> lock(indexes_mutex);
+        const std::vector<int> matches = answer_served_query(indexes, method_number, parse_item_set(request.substr(split)));
 
-        std::vector<int> temp;
-        size_t v1_pointer = 0;
-        size_t v2_pointer = 0;
+        std::string text = "ok " + std::to_string(matches.size());
+        for (const int t_id : matches) text += " " + std::to_string(t_id);
+        return {static_cast<size_t>(method_number), std::move(text)};
+    };
 
-        while (v1_pointer < current.size() && v2_pointer < candidate.size()) {
-            if (current[v1_pointer] < candidate[v2_pointer]) {
-                ++v1_pointer;
-            } else if (current[v1_pointer] > candidate[v2_pointer]) {
-                ++v2_pointer;
-            } else {
-                temp.push_back(current[v1_pointer]); //No duplicates because of the set. No extra actions are needed.
-                ++v1_pointer;
-                ++v2_pointer;
-            }
+    std::cerr << "Loaded " << indexes.transactions.size() << " transactions (" << indexes.inverted_index->item_count() << " distinct items)" << std::endl;
+    QueryServer server({"naive", "signature_file", "exact_bitslice_signature_file", "inverted_file", "append"}, options, answer, is_append);
+    server.run();
+}
+
+/**
+ * Runs one query against the served indexes: the base indexes and the transactions appended since they were built.
+ *
+ * @param indexes The served indexes.
+ * @param method_number The method to use (0 to 3).
+ * @param query The query items.
+ * @return The IDs of the transactions containing every query item, ascending.
+ */
+std::vector<int> answer_served_query(const ServedIndexes& indexes, const int method_number, const std::vector<int>& query) {
+    //The batch functions answer the one query of the request as a batch of one.
+    const std::vector<std::vector<int>> queries{query};
+    QueryMatches matches(1);
+    switch (method_number) {
+        case NAIVE:
+            process_query_batch_naive(indexes.transactions, queries, 0, 1, matches);
+            break;
+
+        case SIGNATURE_FILE: {
+            const Signature query_signature = compute_signature(query);
+            process_query_batch_signature_file(*indexes.signature_matrix, {query_signature}, 0, 1, matches);
+            for (size_t i = 0; i < indexes.delta_signatures.size(); i++)
+                if (signature_covers_query(indexes.delta_signatures[i], query_signature))
+                    matches[0].push_back(static_cast<int>(indexes.base_transaction_count + i));
+            break;
         }
 
-        current = std::move(temp);
-        if (current.empty()) break; //Intersection is empty
+        case EXACT_BITSLICE_SIGNATURE_FILE:
+            //Appended transactions are set in the bitmaps themselves.
+            process_query_batch_exact_bitslice(indexes.item_transactions_bit_map, queries, 0, 1, matches);
+            break;
+
+        default: {
+            //A transaction is either in the base index or in the delta, and delta ids come after base ids.
+            process_query_batch_inverted_index(*indexes.inverted_index, queries, 0, 1, matches);
+            std::vector<int> delta_matches, scratch;
+            intersect_query_postings(indexes.inverted_delta, query, delta_matches, scratch);
+            matches[0].insert(matches[0].end(), delta_matches.begin(), delta_matches.end());
+            break;
+        }
     }
+    return std::move(matches[0]);
+}
 
-    for (int transaction_id : current) {
-        query_results[query_number].insert(transaction_id);
+/**
+ * Checks whether a signature has every bit of a query signature set.
+ *
+ * @param signature The signature of a transaction.
+ * @param query_signature The signature of the query.
+ * @return True if the transaction may contain the query (it does, as the signatures are exact).
+ */
+bool signature_covers_query(const Signature& signature, const Signature& query_signature) {
+    for (size_t w = 0; w < query_signature.size(); w++) {
+        const uint64_t word = w < signature.size() ? signature[w] : 0;
+        if ((word & query_signature[w]) != query_signature[w]) return false;
     }
+    return true;
+}
+
+/**
+ * Adds a transaction to the served indexes without rebuilding them.
+ *
+ * The transaction is appended to the transactions (naive method) and set in the bitmaps of its items
+ * (exact bitslice signature method), which both grow in place. Its signature and its postings go to a
+ * delta segment, scanned after the packed signatures and the inverted index. Once the delta holds
+ * 1 / DELTA_MERGE_FRACTION as many transactions as the base (and at least DELTA_MERGE_MIN_TRANSACTIONS),
+ * the signature matrix and the inverted index are rebuilt over all transactions and the delta is emptied,
+ * so that the rebuilds cost a constant amount of work per appended transaction.
+ *
+ * @param indexes The served indexes, locked exclusively by the caller.
+ * @param transaction The items of the new transaction.
+ * @return The ID of the new transaction.
+ */
+int append_transaction(ServedIndexes& indexes, const std::vector<int>& transaction) {
+    const int t_id = static_cast<int>(indexes.transactions.size());
+    indexes.transactions.push_back(transaction);
+
+    for (const int item : transaction)
+        indexes.item_transactions_bit_map[item].append(t_id);
+
+    indexes.delta_signatures.push_back(compute_signature(transaction));
+    indexes.inverted_delta.append(t_id, transaction);
+
+    const size_t delta_size = indexes.transactions.size() - indexes.base_transaction_count;
+    if (delta_size >= std::max(DELTA_MERGE_MIN_TRANSACTIONS, indexes.base_transaction_count / DELTA_MERGE_FRACTION)) {
+        indexes.signature_matrix.emplace(build_signature_matrix(indexes.transactions, false));
+        indexes.inverted_index.emplace(build_inverted_index(indexes.transactions));
+        indexes.delta_signatures.clear();
+        indexes.inverted_delta.clear();
+        indexes.base_transaction_count = indexes.transactions.size();
+    }
+    return t_id;
 }
 
 
 
+//
+//Benchmark
+
+/**
+ * Benchmarks the four methods on every query of a file, one query at a time, and writes a JSON report
+ * (see Benchmark.h). The indexes are built, or mapped from an index file, once for all the methods, as the
+ * server does; their building is not timed.
+ *
+ * Work counters of the methods:
+ * - naive: transactions_scanned, the transactions checked against the query.
+ * - signature_file: candidates, the transactions whose signature covers the query's.
+ * - superimposed_signature_file (with --signature-bits or --signature-memory): candidates, and the false_drops
+ *   among them, removed by checking the transaction items.
+ * - exact_bitslice_signature_file: bitmaps, the item bitmaps intersected.
+ * - inverted_file: postings, the total length of the posting lists intersected; galloping reads only some of them.
+ * All of them count the matches.
+ *
+ * @param transactions_file The transactions text file, or an index file.
+ * @param queries_file The file path containing query data.
+ * @param options The superimposed signature scheme, if any; the queries run on the calling thread.
+ * @param benchmark Passes and report file.
+ */
+void benchmark_methods(const std::string& transactions_file, const std::string& queries_file, const MethodOptions& options, const BenchmarkOptions& benchmark) {
+    const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
+    const std::optional<IndexFile> index_file = open_index_file(transactions_file);
+    const ServedIndexes indexes = load_served_indexes(transactions_file, index_file);
+    const ItemSets& transactions = indexes.transactions;
+
+    std::vector<Signature> query_signatures;
+    for (const std::vector<int>& query : queries)
+        query_signatures.push_back(compute_signature(query));
+
+    const bool superimposed = options.signature.width_bits != 0 || options.signature.memory_bytes != 0;
+    const SignatureScheme scheme = resolve_signature_scheme(options.signature, transactions);
+    std::optional<SignatureMatrix> superimposed_matrix;
+    std::vector<Signature> superimposed_query_signatures;
+    if (superimposed) {
+        superimposed_matrix.emplace(build_signature_matrix(transactions, false, scheme));
+        for (const std::vector<int>& query : queries)
+            superimposed_query_signatures.push_back(compute_superimposed_signature(query, scheme));
+    }
+
+    const PerfCounters perf;
+    QueryMatches matches(queries.size());
+    std::vector<MethodReport> reports;
+
+    reports.push_back(benchmark_method("naive", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        matches[q].clear();
+        process_query_batch_naive(transactions, queries, q, q + 1, matches);
+        if (counters != nullptr) {
+            counters->add("transactions_scanned", transactions.size());
+            counters->add("matches", matches[q].size());
+        }
+    }));
+
+    reports.push_back(benchmark_method("signature_file", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        matches[q].clear();
+        process_query_batch_signature_file(*indexes.signature_matrix, query_signatures, q, q + 1, matches);
+        if (counters != nullptr) {
+            counters->add("candidates", matches[q].size());
+            counters->add("matches", matches[q].size());
+        }
+    }));
+
+    if (superimposed) {
+        reports.push_back(benchmark_method("superimposed_signature_file", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+            matches[q].clear();
+            process_query_batch_signature_file(*superimposed_matrix, superimposed_query_signatures, q, q + 1, matches);
+            const size_t candidates = matches[q].size();
+            const size_t false_drops = remove_false_drops(transactions, queries[q], matches[q]);
+            if (counters != nullptr) {
+                counters->add("candidates", candidates);
+                counters->add("false_drops", false_drops);
+                counters->add("matches", matches[q].size());
+            }
+        }));
+    }
+
+    reports.push_back(benchmark_method("exact_bitslice_signature_file", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        matches[q].clear();
+        process_query_batch_exact_bitslice(indexes.item_transactions_bit_map, queries, q, q + 1, matches);
+        if (counters != nullptr) {
+            //The intersection stops at the first item without a bitmap.
+            size_t bitmaps = 0;
+            while (bitmaps < queries[q].size() && indexes.item_transactions_bit_map.contains(queries[q][bitmaps])) bitmaps++;
+            counters->add("bitmaps", bitmaps == queries[q].size() ? bitmaps : 0);
+            counters->add("matches", matches[q].size());
+        }
+    }));
+
+    reports.push_back(benchmark_method("inverted_file", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        process_query_batch_inverted_index(*indexes.inverted_index, queries, q, q + 1, matches);
+        if (counters != nullptr) {
+            //As in intersect_query_postings, a query with an item that appears nowhere reads no list.
+            size_t postings = 0;
+            bool all_found = true;
+            for (const int item : queries[q]) {
+                const size_t length = indexes.inverted_index->find(item).size();
+                all_found = all_found && length != 0;
+                postings += length;
+            }
+            counters->add("postings", all_found ? postings : 0);
+            counters->add("matches", matches[q].size());
+        }
+    }));
+
+    BenchmarkDataset dataset;
+    dataset.add("transactions_file", transactions_file);
+    dataset.add("queries_file", queries_file);
+    dataset.add("transactions", transactions.size());
+    dataset.add("queries", queries.size());
+    dataset.add("distinct_items", indexes.inverted_index->item_count());
+    if (superimposed) {
+        dataset.add("signature_bits", scheme.width_bits);
+        dataset.add("signature_hashes", scheme.hashes);
+    }
+    write_benchmark_report("containment", dataset, reports, benchmark, perf);
+}
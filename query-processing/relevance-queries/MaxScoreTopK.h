@@ -0,0 +1,158 @@
+#ifndef MAX_SCORE_TOP_K_H
+#define MAX_SCORE_TOP_K_H
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+#include "RelevanceIndex.h"
+
+// Upper bounds are inflated by this factor, so that rounding in the partial sums never prunes a transaction that qualifies.
+constexpr double UPPER_BOUND_SLACK = 1.0 + 1e-9;
+
+/**
+ * Position of the first posting at or after position whose transaction id is at least t_id,
+ * found by galloping (exponential then binary search) from position.
+ * @param postings A posting list, by ascending transaction id
+ * @param position Where to start
+ * @param t_id The transaction id to reach
+ * @return The position, postings.size() if every remaining posting is before t_id
+ */
+inline size_t seek_posting(const std::span<const Posting> postings, const size_t position, const int t_id) {
+    if (position >= postings.size() || postings[position].transaction_id >= t_id) return position;
+
+    size_t step = 1;
+    while (position + step < postings.size() && postings[position + step].transaction_id < t_id) step *= 2;
+    const auto first = postings.begin() + static_cast<std::ptrdiff_t>(position + step / 2);
+    const auto last = postings.begin() + static_cast<std::ptrdiff_t>(std::min(position + step + 1, postings.size()));
+    return std::lower_bound(first, last, t_id, [](const Posting& posting, const int id) {
+        return posting.transaction_id < id;
+    }) - postings.begin();
+}
+
+/**
+ * What max_score_top_k() did for one query, to measure how much it pruned.
+ */
+struct MaxScoreStats {
+    size_t candidates = 0;        // Transactions drawn from the essential lists
+    size_t scored_postings = 0;   // Postings whose contribution was added, in essential and non-essential lists
+};
+
+/**
+ * The k most relevant transactions of a query, found with MaxScore dynamic pruning.
+ *
+ * The posting lists of the query items are walked together, transaction by transaction. The score an item can
+ * add is at most (occurrences in the query) * max_occurrences * TRF, so once k transactions are held (in a min-heap)
+ * the lists with the smallest bounds whose bounds sum below the k-th score are non-essential: a transaction found
+ * only in them cannot enter the top-k. Candidates are drawn from the essential lists only, and the non-essential
+ * ones are skipped ahead to a candidate (galloping) only while it can still reach the k-th score.
+ *
+ * Scores are the same as those of the exhaustive inverted method: a query item given twice counts its
+ * occurrences twice, and contributions are summed in the order of query_lists() for every transaction.
+ *
+ * @param lists The posting lists of the query, from query_lists()
+ * @param k Number of results, at least 1
+ * @param stats If given, receives the candidates and scored postings of the query
+ * @return Up to k (relevance, transaction id) pairs of positive relevance, in descending order
+ */
+inline std::vector<std::pair<double, int>> max_score_top_k(const std::vector<QueryList>& lists, const size_t k,
+                                                           MaxScoreStats* stats = nullptr) {
+    struct Cursor {
+        QueryList list;
+        size_t position;
+    };
+
+    std::vector<Cursor> cursors;
+    for (const QueryList& list : lists) cursors.push_back({list, 0});
+
+    //bound_prefix[i]: most a transaction can score from lists 0..i.
+    const size_t n = cursors.size();
+    std::vector<double> bound_prefix(n);
+    double bound_sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        bound_sum += cursors[i].list.upper_bound;
+        bound_prefix[i] = bound_sum * UPPER_BOUND_SLACK;
+    }
+
+    const auto current = [&](const Cursor& cursor) {
+        return cursor.position < cursor.list.postings.size() ? cursor.list.postings[cursor.position].transaction_id : INT_MAX;
+    };
+    const auto contribution = [](const Cursor& cursor) { return cursor.list.contribution(cursor.position); };
+
+    //Min-heap on (relevance, transaction id): the top is the k-th result, the first to be displaced.
+    std::vector<std::pair<double, int>> heap;
+    std::vector<double> contributions(n, 0.0);
+    double threshold = 0.0;
+    size_t first_essential = 0;   // Lists [0, first_essential) are non-essential
+    MaxScoreStats counts;
+
+    while (first_essential < n) {
+        int t_id = INT_MAX;
+        for (size_t i = first_essential; i < n; i++) t_id = std::min(t_id, current(cursors[i]));
+        if (t_id == INT_MAX) break;
+        counts.candidates++;
+
+        double partial = 0.0;
+        for (size_t i = first_essential; i < n; i++) {
+            if (current(cursors[i]) != t_id) continue;
+            contributions[i] = contribution(cursors[i]);
+            partial += contributions[i];
+            cursors[i].position++;
+            counts.scored_postings++;
+        }
+
+        //Non-essential lists, largest bound first, while the candidate can still make it.
+        bool pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (heap.size() == k && partial + bound_prefix[i] < threshold) {
+                pruned = true;
+                break;
+            }
+            Cursor& cursor = cursors[i];
+            cursor.position = seek_posting(cursor.list.postings, cursor.position, t_id);
+            if (current(cursor) != t_id) continue;
+            contributions[i] = contribution(cursor);
+            partial += contributions[i];
+            cursor.position++;
+            counts.scored_postings++;
+        }
+
+        if (!pruned) {
+            double relevance = 0.0;
+            for (size_t i = 0; i < n; i++) relevance += contributions[i];
+
+            //Candidates come by ascending id, so one scoring as much as the k-th result outranks it.
+            if (relevance > 0.0 && (heap.size() < k || relevance >= threshold)) {
+                heap.emplace_back(relevance, t_id);
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+                if (heap.size() > k) {
+                    std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+                    heap.pop_back();
+                }
+                if (heap.size() == k) {
+                    threshold = heap.front().first;
+                    while (first_essential < n && bound_prefix[first_essential] < threshold) first_essential++;
+                }
+            }
+        }
+        std::fill(contributions.begin(), contributions.end(), 0.0);
+    }
+
+    if (stats != nullptr) *stats = counts;
+    std::sort(heap.begin(), heap.end(), std::greater<>());
+    return heap;
+}
+
+/**
+ * @param index The relevance inverted index
+ * @param query The query items
+ * @param k Number of results, at least 1
+ * @return Up to k (relevance, transaction id) pairs of positive relevance, in descending order
+ */
+inline std::vector<std::pair<double, int>> max_score_top_k(const RelevanceIndex& index, const std::vector<int>& query, const size_t k) {
+    return max_score_top_k(query_lists(index, query), k);
+}
+
+#endif //MAX_SCORE_TOP_K_H
@@ -0,0 +1,380 @@
+#ifndef RELEVANCE_INDEX_H
+#define RELEVANCE_INDEX_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "../common/ItemSets.h"
+
+/**
+ * One entry of a posting list: a transaction containing the item, and how many times it contains it.
+ */
+struct Posting {
+    int transaction_id;
+    int occurrences;
+};
+
+/**
+ * Inverted index with occurrence counts and TRF weights, in compressed sparse row (CSR) layout.
+ *
+ *   items        the distinct items, ascending
+ *   trf_weights  the TRF weight of every item: total_transactions / number_of_transactions_containing_the_item
+ *   max_occurrences  the largest occurrence count in the postings of every item, which bounds its score contribution
+ *   offsets      items.size() + 1 entries, the postings of items[i] are postings[offsets[i] .. offsets[i + 1])
+ *   postings     the postings of every item, by ascending transaction id, back to back in one array
+ *   posting_scores  occurrences * TRF weight of every posting, parallel to postings
+ *
+ * An index either owns its arrays or views arrays stored elsewhere (e.g. a mapped index file).
+ */
+class RelevanceIndex {
+public:
+    explicit RelevanceIndex(const ItemSets& transactions) {
+        //Pass 1: distinct items and the number of transactions containing each of them.
+        std::unordered_map<int, std::pair<size_t, int>> counts;   // item -> (transactions, last transaction)
+        for (int t_id = 0; t_id < static_cast<int>(transactions.size()); t_id++) {
+            for (const int item : transactions[t_id]) {
+                auto [it, inserted] = counts.try_emplace(item, 0, -1);
+                if (it->second.second == t_id) continue;
+                it->second = {it->second.first + 1, t_id};
+            }
+        }
+
+        owned_items.reserve(counts.size());
+        for (const auto& [item, count] : counts) owned_items.push_back(item);
+        std::sort(owned_items.begin(), owned_items.end());
+
+        owned_offsets.resize(owned_items.size() + 1);
+        owned_trf_weights.resize(owned_items.size());
+        owned_max_occurrences.resize(owned_items.size());
+        std::unordered_map<int, size_t> slots;
+        slots.reserve(owned_items.size());
+        for (size_t slot = 0; slot < owned_items.size(); slot++) {
+            const size_t count = counts[owned_items[slot]].first;
+            owned_offsets[slot + 1] = owned_offsets[slot] + count;
+            // Items that appear in fewer transactions get higher weight
+            owned_trf_weights[slot] = static_cast<double>(transactions.size()) / static_cast<double>(count);
+            slots.emplace(owned_items[slot], slot);
+        }
+
+        //Pass 2: transactions are visited in order, so an item seen again in the same transaction
+        //is always at the end of its list.
+        owned_postings.resize(owned_offsets.back());
+        std::vector<uint64_t> fill(owned_offsets.begin(), owned_offsets.end() - 1);
+        for (int t_id = 0; t_id < static_cast<int>(transactions.size()); t_id++) {
+            for (const int item : transactions[t_id]) {
+                const size_t slot = slots[item];
+                if (fill[slot] > owned_offsets[slot] && owned_postings[fill[slot] - 1].transaction_id == t_id) {
+                    owned_postings[fill[slot] - 1].occurrences++;
+                    continue;
+                }
+                owned_postings[fill[slot]++] = {t_id, 1};
+            }
+        }
+        owned_posting_scores.resize(owned_postings.size());
+        for (size_t slot = 0; slot < owned_items.size(); slot++) {
+            for (uint64_t p = owned_offsets[slot]; p < owned_offsets[slot + 1]; p++) {
+                owned_max_occurrences[slot] = std::max(owned_max_occurrences[slot], owned_postings[p].occurrences);
+                owned_posting_scores[p] = owned_postings[p].occurrences * owned_trf_weights[slot];
+            }
+        }
+
+        items = owned_items;
+        trf_weights = owned_trf_weights;
+        max_occurrences = owned_max_occurrences;
+        offsets = owned_offsets;
+        postings = owned_postings;
+        posting_scores = owned_posting_scores;
+    }
+
+    /**
+     * View of arrays laid out like those of a built index (see item_array(), trf_weight_array(),
+     * max_occurrence_array(), offset_array(), posting_array() and posting_score_array()).
+     * Check valid() before querying a view of untrusted data.
+     */
+    RelevanceIndex(const std::span<const int> items, const std::span<const double> trf_weights,
+                   const std::span<const int> max_occurrences, const std::span<const uint64_t> offsets,
+                   const std::span<const Posting> postings, const std::span<const double> posting_scores)
+        : items(items), trf_weights(trf_weights), max_occurrences(max_occurrences), offsets(offsets),
+          postings(postings), posting_scores(posting_scores) {}
+
+    RelevanceIndex(const RelevanceIndex&) = delete;
+    RelevanceIndex& operator=(const RelevanceIndex&) = delete;
+    RelevanceIndex(RelevanceIndex&&) = default;
+    RelevanceIndex& operator=(RelevanceIndex&&) = default;
+
+    /**
+     * @return True if the arrays are consistent: sorted items, one weight and maximum per item, one offset more
+     *         than items, increasing offsets within postings, one score per posting
+     */
+    [[nodiscard]] bool valid() const {
+        if (trf_weights.size() != items.size() || max_occurrences.size() != items.size()
+            || offsets.size() != items.size() + 1 || offsets.front() != 0
+            || offsets.back() != postings.size() || posting_scores.size() != postings.size())
+            return false;
+        for (size_t slot = 0; slot < items.size(); slot++) {
+            if (offsets[slot] > offsets[slot + 1] || (slot > 0 && items[slot - 1] >= items[slot])) return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] std::span<const int> item_array() const { return items; }
+
+    [[nodiscard]] std::span<const double> trf_weight_array() const { return trf_weights; }
+
+    [[nodiscard]] std::span<const int> max_occurrence_array() const { return max_occurrences; }
+
+    [[nodiscard]] std::span<const uint64_t> offset_array() const { return offsets; }
+
+    [[nodiscard]] std::span<const Posting> posting_array() const { return postings; }
+
+    [[nodiscard]] std::span<const double> posting_score_array() const { return posting_scores; }
+
+    /**
+     * @return Number of distinct items
+     */
+    [[nodiscard]] size_t item_count() const { return items.size(); }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The item id
+     */
+    [[nodiscard]] int item(const size_t slot) const { return items[slot]; }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The TRF weight of the item
+     */
+    [[nodiscard]] double trf_weight_of_slot(const size_t slot) const { return trf_weights[slot]; }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The largest number of times the item occurs in one transaction
+     */
+    [[nodiscard]] int max_occurrences_of_slot(const size_t slot) const { return max_occurrences[slot]; }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return The postings of the item, by ascending transaction id
+     */
+    [[nodiscard]] std::span<const Posting> postings_of_slot(const size_t slot) const {
+        return {postings.data() + offsets[slot], offsets[slot + 1] - offsets[slot]};
+    }
+
+    /**
+     * @param slot Index of the item, in [0, item_count())
+     * @return occurrences * TRF weight of every posting of the item, parallel to postings_of_slot(slot)
+     */
+    [[nodiscard]] std::span<const double> posting_scores_of_slot(const size_t slot) const {
+        return {posting_scores.data() + offsets[slot], offsets[slot + 1] - offsets[slot]};
+    }
+
+    /**
+     * @param item Any item id
+     * @return Index of the item, or item_count() if it appears in no transaction
+     */
+    [[nodiscard]] size_t find_slot(const int item) const {
+        const auto it = std::lower_bound(items.begin(), items.end(), item);
+        return it != items.end() && *it == item ? static_cast<size_t>(it - items.begin()) : items.size();
+    }
+
+    /**
+     * @param item Any item id
+     * @return The postings of the item, empty if it appears in no transaction
+     */
+    [[nodiscard]] std::span<const Posting> find(const int item) const {
+        const size_t slot = find_slot(item);
+        return slot == items.size() ? std::span<const Posting>{} : postings_of_slot(slot);
+    }
+
+private:
+    std::vector<int> owned_items;
+    std::vector<double> owned_trf_weights;
+    std::vector<int> owned_max_occurrences;
+    std::vector<uint64_t> owned_offsets;
+    std::vector<Posting> owned_postings;
+    std::vector<double> owned_posting_scores;
+    std::span<const int> items;
+    std::span<const double> trf_weights;
+    std::span<const int> max_occurrences;
+    std::span<const uint64_t> offsets;
+    std::span<const Posting> postings;
+    std::span<const double> posting_scores;
+};
+
+/**
+ * Postings of the transactions appended after a RelevanceIndex was built, kept apart until they are merged
+ * into a rebuilt index. Appending a transaction costs one hash lookup per item.
+ *
+ * Appending changes the TRF weight of every item, since it divides the total number of transactions.
+ * Rather than updating all the weights, the weights of the query items are recomputed from the counts
+ * when queried (see query_lists()).
+ */
+class RelevanceDelta {
+public:
+    /**
+     * @param base_transactions Number of transactions in the index the transactions are appended to
+     */
+    explicit RelevanceDelta(const size_t base_transactions) : base_transactions(base_transactions) {}
+
+    /**
+     * @param transaction Items of the transaction, which gets id total_transactions()
+     */
+    void append(const std::vector<int>& transaction) {
+        const int t_id = static_cast<int>(total_transactions());
+        for (const int item : transaction) {
+            List& list = lists[item];
+            if (list.postings.empty() || list.postings.back().transaction_id != t_id) list.postings.push_back({t_id, 0});
+            list.max_occurrences = std::max(list.max_occurrences, ++list.postings.back().occurrences);
+        }
+        appended++;
+    }
+
+    /**
+     * @return Number of transactions of the index and of the delta
+     */
+    [[nodiscard]] size_t total_transactions() const { return base_transactions + appended; }
+
+    /**
+     * @return Number of transactions appended
+     */
+    [[nodiscard]] size_t appended_transactions() const { return appended; }
+
+    /**
+     * @param item Any item id
+     * @return The postings of the item in the appended transactions, by ascending transaction id
+     */
+    [[nodiscard]] std::span<const Posting> find(const int item) const {
+        const auto it = lists.find(item);
+        return it == lists.end() ? std::span<const Posting>{} : it->second.postings;
+    }
+
+    /**
+     * @param item Any item id
+     * @return The largest number of times the item occurs in one appended transaction, 0 if in none
+     */
+    [[nodiscard]] int max_occurrences(const int item) const {
+        const auto it = lists.find(item);
+        return it == lists.end() ? 0 : it->second.max_occurrences;
+    }
+
+private:
+    struct List {
+        std::vector<Posting> postings;
+        int max_occurrences = 0;
+    };
+
+    size_t base_transactions;
+    size_t appended = 0;
+    std::unordered_map<int, List> lists;
+};
+
+/**
+ * The posting list of one distinct query item, with what it adds to the relevance of a transaction.
+ */
+struct QueryList {
+    std::span<const Posting> postings;
+    std::span<const double> posting_scores;   // Empty when trf_weight is not the one the scores were computed with
+    int multiplicity;       // Times the item is given in the query, each counting its occurrences again
+    double trf_weight;
+    double upper_bound;     // Most the item adds to one transaction
+
+    /**
+     * @param position Index of a posting
+     * @return What the item adds to the relevance of the transaction of that posting
+     */
+    [[nodiscard]] double contribution(const size_t position) const {
+        if (multiplicity == 1 && !posting_scores.empty()) return posting_scores[position];
+        return (multiplicity * postings[position].occurrences) * trf_weight;
+    }
+};
+
+/**
+ * The posting lists of a query in an index and in the transactions appended to it.
+ */
+struct SegmentedQueryLists {
+    std::vector<QueryList> base;
+    std::vector<QueryList> appended;
+};
+
+/**
+ * Gathers the posting lists of the distinct items of a query, in an index and in the transactions appended
+ * to it, ordered by increasing upper bound (then item) in both. A transaction is in one of the two, and its
+ * contributions are added in the order a rebuilt index would give, so the relevances are bit-identical to
+ * those of an index built over all the transactions.
+ *
+ * TRF weights and upper bounds are those of the whole collection: total_transactions over the number of
+ * transactions containing the item, in the index and among the appended ones.
+ *
+ * @param index The relevance inverted index
+ * @param delta The transactions appended to the index
+ * @param query The query items; items appearing in no transaction are left out
+ * @return One list per distinct query item contained by a transaction of the segment, in both segments
+ */
+inline SegmentedQueryLists query_lists(const RelevanceIndex& index, const RelevanceDelta& delta, const std::vector<int>& query) {
+    std::vector<int> items(query);
+    std::sort(items.begin(), items.end());
+
+    std::vector<std::pair<QueryList, QueryList>> lists;   // (base, appended) per item
+    for (size_t i = 0; i < items.size();) {
+        size_t j = i;
+        while (j < items.size() && items[j] == items[i]) j++;
+        const size_t slot = index.find_slot(items[i]);
+        const bool in_base = slot != index.item_count();
+        const std::span<const Posting> base_postings = in_base ? index.postings_of_slot(slot) : std::span<const Posting>{};
+        const std::span<const Posting> appended_postings = delta.find(items[i]);
+        if (!base_postings.empty() || !appended_postings.empty()) {
+            const int multiplicity = static_cast<int>(j - i);
+            const double trf_weight = delta.appended_transactions() == 0
+                ? index.trf_weight_of_slot(slot)
+                : static_cast<double>(delta.total_transactions()) / static_cast<double>(base_postings.size() + appended_postings.size());
+            const int max_occurrences = std::max(in_base ? index.max_occurrences_of_slot(slot) : 0, delta.max_occurrences(items[i]));
+            const double upper_bound = (multiplicity * max_occurrences) * trf_weight;
+            const bool stored_scores = in_base && trf_weight == index.trf_weight_of_slot(slot);
+            lists.emplace_back(
+                QueryList{base_postings, stored_scores ? index.posting_scores_of_slot(slot) : std::span<const double>{},
+                          multiplicity, trf_weight, upper_bound},
+                QueryList{appended_postings, {}, multiplicity, trf_weight, upper_bound});
+        }
+        i = j;
+    }
+    //Items are distinct and were gathered in ascending order, so a stable sort breaks ties by item.
+    std::stable_sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+        return a.first.upper_bound < b.first.upper_bound;
+    });
+
+    SegmentedQueryLists segments;
+    for (const auto& [base, appended] : lists) {
+        if (!base.postings.empty()) segments.base.push_back(base);
+        if (!appended.postings.empty()) segments.appended.push_back(appended);
+    }
+    return segments;
+}
+
+/**
+ * Gathers the posting lists of the distinct items of a query, ordered by increasing upper bound (then item).
+ * Both scoring paths add contributions in this order, so they compute bit-identical relevances.
+ * @param index The relevance inverted index
+ * @param query The query items; items appearing in no transaction are left out
+ * @return One list per distinct query item
+ */
+inline std::vector<QueryList> query_lists(const RelevanceIndex& index, const std::vector<int>& query) {
+    return query_lists(index, RelevanceDelta(0), query).base;
+}
+
+/**
+ * @param index The relevance inverted index
+ * @param delta The transactions appended to the index
+ * @param item Any item id
+ * @return The TRF weight of the item over the index and the appended transactions, 0 if it appears in none
+ */
+inline double trf_weight(const RelevanceIndex& index, const RelevanceDelta& delta, const int item) {
+    const size_t slot = index.find_slot(item);
+    if (delta.appended_transactions() == 0) return slot == index.item_count() ? 0.0 : index.trf_weight_of_slot(slot);
+
+    const size_t containing = (slot == index.item_count() ? 0 : index.postings_of_slot(slot).size()) + delta.find(item).size();
+    return containing == 0 ? 0.0 : static_cast<double>(delta.total_transactions()) / static_cast<double>(containing);
+}
+
+#endif //RELEVANCE_INDEX_H
@@ -0,0 +1,61 @@
+#ifndef SCORE_ACCUMULATOR_H
+#define SCORE_ACCUMULATOR_H
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "RelevanceIndex.h"
+
+/**
+ * Term-at-a-time scoring of every transaction matching a query, into a dense array of scores.
+ *
+ * The posting lists of the query items are added one after the other into scores[transaction_id], using the
+ * scores premultiplied by TRF in the index. The transactions touched by a query are listed as they are first
+ * reached, so that collecting the results and clearing the array for the next query costs one pass over them,
+ * not over all transactions. The array is kept between queries: keep one accumulator per thread.
+ */
+class ScoreAccumulator {
+public:
+    /**
+     * @param index The relevance inverted index
+     * @param query The query items
+     * @return A (relevance, transaction id) pair for every transaction containing a query item, in no particular order
+     */
+    std::vector<std::pair<double, int>> score(const RelevanceIndex& index, const std::vector<int>& query) {
+        return score(query_lists(index, query));
+    }
+
+    /**
+     * @param lists The posting lists of the query, from query_lists()
+     * @return A (relevance, transaction id) pair for every transaction in the lists, in no particular order
+     */
+    std::vector<std::pair<double, int>> score(const std::vector<QueryList>& lists) {
+        for (const QueryList& list : lists) {
+            if (!list.postings.empty() && scores.size() <= static_cast<size_t>(list.postings.back().transaction_id))
+                scores.resize(static_cast<size_t>(list.postings.back().transaction_id) + 1, 0.0);
+        }
+
+        //Every contribution is positive, so a zero score marks a transaction not reached yet.
+        for (const QueryList& list : lists) {
+            for (size_t p = 0; p < list.postings.size(); p++) {
+                const int t_id = list.postings[p].transaction_id;
+                if (scores[t_id] == 0.0) touched.push_back(t_id);
+                scores[t_id] += list.contribution(p);
+            }
+        }
+
+        std::vector<std::pair<double, int>> results;
+        results.reserve(touched.size());
+        for (const int t_id : touched) {
+            results.emplace_back(scores[t_id], t_id);
+            scores[t_id] = 0.0;
+        }
+        touched.clear();
+        return results;
+    }
+
+private:
+    std::vector<double> scores;
+    std::vector<int> touched;
+};
+
+#endif //SCORE_ACCUMULATOR_H
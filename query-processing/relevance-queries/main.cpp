@@ -1,12 +1,22 @@
+#include <charconv>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <map>
+#include <optional>
 #include <set>
+#include <shared_mutex>
 #include <ranges>
 #include <unordered_map>
 #include <boost/multiprecision/cpp_int.hpp>
+#include "../common/IndexFile.h"
+#include "../common/ItemSets.h"
+#include "../common/QueryServer.h"
+#include "../../benchmarks/Benchmark.h"
+#include "MaxScoreTopK.h"
+#include "RelevanceIndex.h"
+#include "ScoreAccumulator.h"
 
 /**
  * @file main.cpp
@@ -33,17 +43,10 @@
  **/
 
 
-// Inverted Index: maps each item_id to a list of (transaction_id, occurrence_count).
-// Enables efficient lookup of all transactions containing a given item.
-using InvertedIndex = std::map<int, std::vector<std::pair<int, int>>>;
-
-// TRF Weights: maps each item_id to its Transaction Rarity Factor (TRF).
-// Computed as: total_transactions / number_of_transactions_containing_the_item.
-using TRFWeights = std::map<int, double>;
-
-// Relevance Inverted Index: pairs the inverted index with TRF weights.
+// Relevance Inverted Index (RelevanceIndex.h): maps each item_id to its list of
+// (transaction_id, occurrence_count) postings and to its Transaction Rarity Factor (TRF),
+// computed as: total_transactions / number_of_transactions_containing_the_item.
 // Used for scoring transactions based on query relevance.
-using RelevanceInvertedIndex = std::pair<InvertedIndex, TRFWeights>;
 
 // RelevanceScoreList: a list of (relevance_score, transaction_id) pairs,
 // sorted in descending order of relevance.
@@ -60,33 +63,88 @@ using TransactionOccurrencesList = std::vector<std::pair<int, int>>;
 constexpr int NAIVE_INDEX = 0;
 constexpr int INVERTED_INDEX = 1;
 
+// Binary index file (see IndexFile.h) written by build-index: its kind and the ids of its sections.
+constexpr uint32_t RELEVANCE_INDEX_KIND = 2;
+constexpr uint32_t TRANSACTION_OFFSETS_SECTION = 1;        // uint64_t, transactions + 1
+constexpr uint32_t TRANSACTION_ITEMS_SECTION = 2;          // int
+constexpr uint32_t RELEVANCE_ITEMS_SECTION = 3;            // int, ascending
+constexpr uint32_t RELEVANCE_TRF_SECTION = 4;              // double, one per item
+constexpr uint32_t RELEVANCE_OFFSETS_SECTION = 5;          // uint64_t, items + 1
+constexpr uint32_t RELEVANCE_POSTINGS_SECTION = 6;         // Posting
+constexpr uint32_t RELEVANCE_MAX_OCCURRENCES_SECTION = 7;  // int, one per item
+constexpr uint32_t RELEVANCE_POSTING_SCORES_SECTION = 8;   // double, one per posting
+
+// The server's appended transactions are merged into a rebuilt index once they are this fraction of the index, and this many.
+constexpr size_t DELTA_MERGE_FRACTION = 4;
+constexpr size_t DELTA_MERGE_MIN_TRANSACTIONS = 1024;
+constexpr size_t APPEND_REQUEST_KIND = 2;   // Histogram of the append requests, after the two methods
+
 std::vector<std::vector<int>> load_item_sets_from_file(const std::string& item_sets_file);
-RelevanceInvertedIndex build_relevance_inverted_index(const std::vector<std::vector<int>>& transactions, size_t total_transactions);
-void write_inverted_file_occ(const std::string& filename, const InvertedIndex& index, const TRFWeights& trf_weights);
+std::vector<int> parse_item_set(const std::string& line);
+RelevanceIndex build_relevance_inverted_index(const ItemSets& transactions);
+void write_inverted_file_occ(const std::string& filename, const RelevanceIndex& index);
 
-QueryResult run_inverted_method(const std::vector<std::vector<int>>& queries, const InvertedIndex& inverted_index, const TRFWeights& trf_weights, int query_number,int top_k);
-RelevanceScoreList run_inverted_single(const std::vector<int>& query, const InvertedIndex& inverted_index, const TRFWeights& trf_weights, int top_k);
+void build_index_file(const std::string& transactions_file, const std::string& index_file);
+ItemSets transactions_from_index(const IndexFile& index_file);
+RelevanceIndex relevance_index_from_index(const IndexFile& index_file);
+
+/**
+ * What the server answers queries from: the index, the transactions appended since it was built, and all the transactions.
+ */
+struct ServedIndex {
+    RelevanceIndex index;
+    RelevanceDelta appended;
+    ItemSets transactions;
+};
+
+void serve_queries(const std::string& transactions_file, const ServerOptions& options);
+RelevanceScoreList run_served_inverted(const std::vector<int>& query, const ServedIndex& served, int top_k);
+int append_transaction(ServedIndex& served, const std::vector<int>& transaction);
+
+QueryResult run_inverted_method(const std::vector<std::vector<int>>& queries, const RelevanceIndex& inverted_index, int query_number,int top_k);
+RelevanceScoreList run_inverted_single(const std::vector<int>& query, const RelevanceIndex& inverted_index, int top_k);
 void print_query_result(const std::string& method_name, const RelevanceScoreList& result);
 
 std::vector<QueryResult> run_method(const std::string& transactions_file, const std::string& queries_file, int query_number , int method_number, int top_k);
 
 
 TransactionOccurrencesList union_two_transaction_occurrence_lists(const TransactionOccurrencesList& list_a, const TransactionOccurrencesList& list_b);
-std::map<int, std::unordered_map<int, int>> build_detailed_map_from_union(const std::vector<int>& query_items,const InvertedIndex& index);
+void rank_scores(RelevanceScoreList& scores, int top_k);
+
 
 
+QueryResult run_naive_method(const std::vector<std::vector<int>>& queries,const ItemSets& transactions,const RelevanceIndex& relevance_index,int query_number,int top_k);
+RelevanceScoreList run_naive_single(const std::vector<int>& query,const ItemSets& transactions,const RelevanceIndex& relevance_index,const RelevanceDelta& appended,int top_k);
 
-QueryResult run_naive_method(const std::vector<std::vector<int>>& queries,const std::vector<std::vector<int>>& transactions,const TRFWeights& trf_weights,int query_number,int top_k);
-RelevanceScoreList run_naive_single(const std::vector<int>& query,const std::vector<std::vector<int>>& transactions,const TRFWeights& trf_weights,int top_k);
+BenchmarkOptions parse_benchmark_options(int argc, char* argv[], int first_option);
+void benchmark_methods(const std::string& transactions_file, const std::string& queries_file, int top_k, const BenchmarkOptions& benchmark);
 
 
 
 
 
 int main(const int argc, char* argv[]) {
+    if (argc == 4 && std::string(argv[1]) == "build-index") {
+        build_index_file(argv[2], argv[3]);
+        return 0;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "serve") {
+        serve_queries(argv[2], parse_server_options(argc, argv, 3));
+        return 0;
+    }
+
+    if (argc >= 5 && std::string(argv[1]) == "bench") {
+        benchmark_methods(argv[2], argv[3], std::stoi(argv[4]), parse_benchmark_options(argc, argv, 5));
+        return 0;
+    }
+
     if (argc < 6) {
         std::cerr << "Invalid number of arguments" << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <transactions.txt> <queries.txt> <qnum> <method> <k> " << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <transactions.txt|index file> <queries.txt> <qnum> <method> <k> " << std::endl;
+        std::cerr << "       " << argv[0] << " build-index <transactions.txt> <index file>" << std::endl;
+        std::cerr << "       " << argv[0] << " serve <transactions.txt|index file> [--threads=<N>] [--port=<N>]" << std::endl;
+        std::cerr << "       " << argv[0] << " bench <transactions.txt|index file> <queries.txt> <k> [--warmup=<N>] [--repeat=<N>] [--json=<file>]" << std::endl;
         return 1;
     }
 
@@ -96,69 +154,73 @@ int main(const int argc, char* argv[]) {
 
 
 /**
- * @brief Loads item sets from a file and parses them into a nested vector of integers.
+ * @brief Loads item sets (the queries) from a file and parses them into a nested vector of integers.
  *
- * The function reads a file specified by the input parameter `item_sets_file`, where
- * each line in the file represents a transaction defined by a list of integers. Line by
- * line, the function parses the integers from the input file, ignoring non-numeric
- * characters (e.g., '[', ']', ',', and spaces), and constructs a vector representing
- * the items in that transaction. The resulting set of transactions is stored in a
- * nested vector and returned.
+ * The file is parsed by load_item_sets (see ItemSets.h): each line represents an item set
+ * defined by a list of integers, and non-numeric characters (e.g., '[', ']', ',', and spaces)
+ * are ignored. Queries are few, so they are then copied out of its CSR arrays into one vector
+ * each; transactions are kept in the CSR arrays.
  *
  * @param item_sets_file The file path of the input file containing item sets as lines of integers.
- * @return A vector of transactions, where each transaction is itself represented as
+ * @return A vector of item sets, where each item set is itself represented as
  *         a vector of integers.
  *
  * @throws If the file cannot be opened, the function writes an error message to
  *         `std::cerr` and terminates the program with an exit code -1.
  */
 std::vector<std::vector<int>> load_item_sets_from_file(const std::string& item_sets_file) {
-    std::ifstream file(item_sets_file);
-    if (!file) {
-        std::cerr << "Could not open file " << item_sets_file << std::endl;
-        std::exit(-1);
-    }
+    const ItemSets item_sets = load_item_sets(item_sets_file);
 
-    std::vector<std::vector<int>> transactions;
-    std::string line;
-
-    while (std::getline(file, line)) {
-        std::vector<int> transaction;
-        int number = 0;
-        bool building = false;
-
-        for (char c : line) {
-            if (c >= '0' && c <= '9') {
-                number = number * 10 + (c - '0');   // Convert digit character to int
-                building = true;
-            } else if (building) {
-                transaction.push_back(number);
-                number = 0;
-                building = false;
-            }
-            // ignore anything else: '[', ']', ',', ' '
-        }
+    std::vector<std::vector<int>> sets;
+    sets.reserve(item_sets.size());
+    for (const std::span<const int> set : item_sets)
+        sets.emplace_back(set.begin(), set.end());
+    return sets;
+}
 
-        if (building) {
+/**
+ * @brief Parses one line of an item sets file, e.g. "[1, 5, 9]", into its item IDs.
+ *
+ * Non-numeric characters (e.g., '[', ']', ',', and spaces) separate the items and are otherwise ignored.
+ *
+ * @param line The line, without its line break.
+ * @return The items, in the order they appear on the line.
+ */
+std::vector<int> parse_item_set(const std::string& line) {
+    std::vector<int> transaction;
+    int number = 0;
+    bool building = false;
+
+    for (char c : line) {
+        if (c >= '0' && c <= '9') {
+            number = number * 10 + (c - '0');   // Convert digit character to int
+            building = true;
+        } else if (building) {
             transaction.push_back(number);
+            number = 0;
+            building = false;
         }
+        // ignore anything else: '[', ']', ',', ' '
+    }
 
-        transactions.push_back(transaction);
+    if (building) {
+        transaction.push_back(number);
     }
 
-    return transactions;
+    return transaction;
 }
 
 /**
  * @brief Executes a specific method to process queries over transactions and calculates relevance scores.
  *
  * The function orchestrates the loading of transaction and query data from files, builds an
- * inverted index from the transactions, and processes the specified query or queries using
+ * inverted index from the transactions (or maps it from an index file written by build-index),
+ * and processes the specified query or queries using
  * a chosen method (either naive or inverted index). The relevance scores for the queries are
  * calculated and stored in a structured result set. The choice of method is determined by
  * the parameter `method_number`, which can execute the naive method, inverted method, or both.
  *
- * @param transactions_file The file path for the input file containing the transactions.
+ * @param transactions_file The file path for the input file containing the transactions, or an index file.
  * @param queries_file The file path for the input file containing the queries.
  * @param query_number The index of the query to execute.
  * @param method_number Specifies the method to use:
@@ -171,7 +233,7 @@ std::vector<std::vector<int>> load_item_sets_from_file(const std::string& item_s
  * @throws If the specified method number is invalid, the function prints an error message
  *         to `std::cerr` and terminates the program with an exit code -1.
  * @note The function writes the inverted index data and term relevance factor (TRF) weights
- *       to an output file named "invfileocc.txt".
+ *       to an output file named "invfileocc.txt", unless they are read from an index file.
  */
 std::vector<QueryResult> run_method(
     const std::string& transactions_file,
@@ -180,30 +242,36 @@ std::vector<QueryResult> run_method(
     const int method_number,
     const int top_k) {
 
-    const std::vector<std::vector<int>> transactions = load_item_sets_from_file(transactions_file);
     const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
-    const size_t total_transactions = transactions.size();
 
-    auto [relevance_inverted_index, trf_weights] =
-        build_relevance_inverted_index(transactions, total_transactions);
+    std::optional<IndexFile> index_file;
+    if (IndexFile::is_index_file(transactions_file)) index_file.emplace(transactions_file, RELEVANCE_INDEX_KIND);
+
+    const ItemSets transactions = index_file
+        ? transactions_from_index(*index_file)
+        : load_item_sets(transactions_file);
 
-    write_inverted_file_occ("invfileocc.txt", relevance_inverted_index, trf_weights);
+    const RelevanceIndex relevance_inverted_index = index_file
+        ? relevance_index_from_index(*index_file)
+        : build_relevance_inverted_index(transactions);
+
+    if (!index_file) write_inverted_file_occ("invfileocc.txt", relevance_inverted_index);
 
 
     std::vector<QueryResult> results(2);
 
     switch (method_number) {
         case 0:
-            results[NAIVE_INDEX] = run_naive_method(queries, transactions, trf_weights, query_number, top_k);
+            results[NAIVE_INDEX] = run_naive_method(queries, transactions, relevance_inverted_index, query_number, top_k);
             break;
 
         case 1:
-            results[INVERTED_INDEX] = run_inverted_method(queries, relevance_inverted_index, trf_weights, query_number, top_k);
+            results[INVERTED_INDEX] = run_inverted_method(queries, relevance_inverted_index, query_number, top_k);
             break;
 
         case -1:
-            results[NAIVE_INDEX] = run_naive_method(queries, transactions, trf_weights, query_number, top_k);;
-            results[INVERTED_INDEX] = run_inverted_method(queries, relevance_inverted_index, trf_weights, query_number, top_k);
+            results[NAIVE_INDEX] = run_naive_method(queries, transactions, relevance_inverted_index, query_number, top_k);;
+            results[INVERTED_INDEX] = run_inverted_method(queries, relevance_inverted_index, query_number, top_k);
             break;
 
         default:
@@ -228,53 +296,14 @@ std::vector<QueryResult> run_method(
  * transaction IDs and the corresponding frequency of the item within those transactions. TRF weights are
  * calculated as the ratio of the total number of transactions to the number of transactions containing the item.
  *
- * @param transactions A nested vector representing the list of transactions, where each transaction is a vector of item IDs.
- * @param total_transactions The total number of transactions in the dataset.
- * @return A pair consisting of:
- *      - An inverted index that maps each item ID to a vector of pairs (transaction ID, item frequency).
- *      - A map of TRF weights, where each item ID is associated with its computed TRF weight.
+ * The posting lists of all items are stored back to back in one array, sorted by transaction ID (see RelevanceIndex).
+ *
+ * @param transactions The transactions, in CSR layout, each a list of item IDs.
+ * @return An inverted index that maps each item ID to its postings (transaction ID, item frequency)
+ *         and to its computed TRF weight.
  */
-RelevanceInvertedIndex build_relevance_inverted_index(
-    const std::vector<std::vector<int>>& transactions,
-    const size_t total_transactions) {
-
-    InvertedIndex inverted_index;
-    TRFWeights trf_weights;
-
-    // Stores how many distinct transactions each item appears in
-    std::unordered_map<int, int> transactions_per_item;
-
-
-    // Iterate over each transaction.
-    for (int tid = 0; tid < transactions.size(); tid++) {
-        // Count the frequency of each item within the current transaction
-        std::unordered_map<int, int> item_frequency_in_transaction;
-        for (int item : transactions[tid])
-            item_frequency_in_transaction[item]++;
-
-        // Update the inverted index and transaction count for each unique item
-        for (const auto& [item_id, frequency] : item_frequency_in_transaction) {
-            // Add (transaction_id, frequency) to the posting list of the item
-            inverted_index[item_id].emplace_back(tid, frequency);
-            // Increment the number of transactions in which this item appears
-            transactions_per_item[item_id]++;
-        }
-    }
-
-
-    // Compute TRF (Transaction Rarity Factor) weights for each item:
-    // TRF = total_transactions / number_of_transactions_containing_the_item
-    // Items that appear in fewer transactions get higher weight
-    for (const auto& [item, count] : transactions_per_item) {
-        trf_weights[item] = static_cast<double>(total_transactions) / count;
-    }
-
-    // Sort each posting list by transaction ID
-    for (auto &postings: inverted_index | std::views::values) {
-        std::ranges::sort(postings);
-    }
-
-    return {inverted_index, trf_weights};
+RelevanceIndex build_relevance_inverted_index(const ItemSets& transactions) {
+    return RelevanceIndex(transactions);
 }
 
 /**
@@ -287,11 +316,10 @@ RelevanceInvertedIndex build_relevance_inverted_index(
  * and associated scores.
  *
  * @param filename The name of the file to write the inverted index and TRF weights to.
- * @param index The inverted index, where the key is an item ID, and the value is
- *              a vector of document ID and score pairs.
- * @param trf_weights A mapping of item IDs to their corresponding TRF weights.
+ * @param index The inverted index, mapping every item ID to its TRF weight and
+ *              its (transaction ID, occurrences) postings.
  */
-void write_inverted_file_occ(const std::string& filename, const InvertedIndex& index, const TRFWeights& trf_weights) {
+void write_inverted_file_occ(const std::string& filename, const RelevanceIndex& index) {
     std::ofstream out(filename);
     if (!out) {
         std::cerr << "Failed to open " << filename << " for writing.\n";
@@ -300,10 +328,11 @@ void write_inverted_file_occ(const std::string& filename, const InvertedIndex& i
 
 
     out << std::fixed << std::setprecision(16);
-    for (const auto& [item_id, postings] : index) {
-        out << item_id << ": " << trf_weights.at(item_id) << ", [";
+    for (size_t slot = 0; slot < index.item_count(); slot++) {
+        const std::span<const Posting> postings = index.postings_of_slot(slot);
+        out << index.item(slot) << ": " << index.trf_weight_of_slot(slot) << ", [";
         for (size_t i = 0; i < postings.size(); i++) {
-            out << "[" << postings[i].first << ", " << postings[i].second << "]";
+            out << "[" << postings[i].transaction_id << ", " << postings[i].occurrences << "]";
             if (i != postings.size() - 1) out << ", ";
         }
         out << "]\n";
@@ -348,8 +377,8 @@ void print_query_result(const std::string& method_name, const RelevanceScoreList
  * for each query.
  *
  * @param queries A vector of queries, where each query is represented as a vector of integers.
- * @param transactions A vector of transactions, where each transaction is represented as a vector of integers.
- * @param trf_weights A map of transaction relevance factor (TRF) weights used to adjust the relevance scores of items.
+ * @param transactions The transactions, each a list of integers.
+ * @param relevance_index The relevance inverted index, whose transaction relevance factor (TRF) weights adjust the relevance scores of items.
  * @param query_number The index of the query to process. If set to -1, all queries are processed. Otherwise, only the query at `query_number` is processed.
  * @param top_k The number of top relevant transactions to return per query. If set to 0 or a negative value, all results are returned.
  * @return A map where the key is the query index, and the value is a vector of pairs representing the relevance score
@@ -357,12 +386,13 @@ void print_query_result(const std::string& method_name, const RelevanceScoreList
  */
 QueryResult run_naive_method(
     const std::vector<std::vector<int>>& queries,
-    const std::vector<std::vector<int>>& transactions,
-    const TRFWeights& trf_weights,
+    const ItemSets& transactions,
+    const RelevanceIndex& relevance_index,
     const int query_number,
     const int top_k) {
 
     QueryResult results;
+    const RelevanceDelta no_appends(transactions.size());
 
 
     const auto start = std::chrono::high_resolution_clock::now();
@@ -370,10 +400,10 @@ QueryResult run_naive_method(
 
     if (query_number == -1) {
         for (int i = 0; i < queries.size(); ++i) {
-            results[i] = run_naive_single(queries[i], transactions, trf_weights, top_k);
+            results[i] = run_naive_single(queries[i], transactions, relevance_index, no_appends, top_k);
         }
     } else {
-        results[query_number] = run_naive_single(queries[query_number], transactions, trf_weights, top_k);
+        results[query_number] = run_naive_single(queries[query_number], transactions, relevance_index, no_appends, top_k);
         print_query_result("Naive Method", results[query_number]);
     }
 
@@ -398,10 +428,12 @@ QueryResult run_naive_method(
  *
  * @param query The query, represented as a vector of integers, where each integer
  *              corresponds to an item being searched for in the transactions.
- * @param transactions A collection of transactions, each represented as a vector
+ * @param transactions A collection of transactions, each represented as a list
  *                     of integers.
- * @param trf_weights A map containing TRF weights for individual items. Keys are
- *                    item identifiers, and values are the associated weights.
+ * @param relevance_index The relevance inverted index, holding the TRF weight of
+ *                        every item.
+ * @param appended The transactions appended to the index since it was built, which
+ *                 change the TRF weights.
  * @param top_k The maximum number of results to return. If set to a positive
  *              number, only the top `top_k` results are included in the output.
  *              If set to 0 or a negative number, all matching transactions are
@@ -411,8 +443,9 @@ QueryResult run_naive_method(
  */
 RelevanceScoreList run_naive_single(
     const std::vector<int>& query,
-    const std::vector<std::vector<int>>& transactions,
-    const TRFWeights& trf_weights,
+    const ItemSets& transactions,
+    const RelevanceIndex& relevance_index,
+    const RelevanceDelta& appended,
     const int top_k){
 
     RelevanceScoreList scores;
@@ -432,8 +465,7 @@ RelevanceScoreList run_naive_single(
        // Compute the relevance score for this transaction.
         double relevance = 0.0;
         for (const auto& [item, count] : occ) {
-            if (auto it = trf_weights.find(item); it != trf_weights.end())
-                relevance += count * it->second;
+            relevance += count * trf_weight(relevance_index, appended, item);
         }
 
 
@@ -443,13 +475,8 @@ RelevanceScoreList run_naive_single(
     }
 
 
-    // Sort the list of relevance scores in descending order.
-    std::ranges::sort(scores, std::greater<>());
-
-
-    //Limit the number of results to top_k.
-    if (top_k > 0 && scores.size() > static_cast<size_t>(top_k))
-        scores.resize(top_k);
+    // Sort the list of relevance scores in descending order, limited to the top_k.
+    rank_scores(scores, top_k);
 
     return scores;
 }
@@ -467,8 +494,7 @@ RelevanceScoreList run_naive_single(
  *
  * @param queries A vector of queries, where each query is itself represented as a vector of integers.
  * @param inverted_index A relevance inverted index mapping item IDs to a list of document IDs
- *                       with relevance scores.
- * @param trf_weights A map storing term-relevance-frequency weights for each item.
+ *                       with relevance scores, and to their term-relevance-frequency weights.
  * @param query_number The index of the query to process. If set to -1, all queries are processed.
  * @param top_k The maximum number of top results to retrieve for each query.
  * @return A QueryResult object, which maps each query index to a list of relevance scores,
@@ -476,8 +502,7 @@ RelevanceScoreList run_naive_single(
  */
 QueryResult run_inverted_method(
     const std::vector<std::vector<int>>& queries,
-    const InvertedIndex& inverted_index,
-    const TRFWeights& trf_weights,
+    const RelevanceIndex& inverted_index,
     const int query_number,
     const int top_k) {
 
@@ -486,10 +511,10 @@ QueryResult run_inverted_method(
 
     if (query_number == -1) {
         for (int i = 0; i < queries.size(); i++) {
-            results[i] = run_inverted_single(queries[i], inverted_index, trf_weights, top_k);
+            results[i] = run_inverted_single(queries[i], inverted_index, top_k);
         }
     } else {
-        results[query_number] = run_inverted_single(queries[query_number], inverted_index, trf_weights, top_k);
+        results[query_number] = run_inverted_single(queries[query_number], inverted_index, top_k);
         print_query_result("Inverted File", results[query_number]);
     }
 
@@ -541,49 +566,21 @@ TransactionOccurrencesList union_two_transaction_occurrence_lists(
     return result;
 }
 
-/**
- * @brief Constructs a detailed map of transaction IDs to item occurrences based on query items.
- *
- * This function processes a query consisting of item IDs and retrieves their associated data
- * from the provided inverted index. For each item in the query, it identifies the transactions
- * in which the item occurs, combines these transactions, and constructs a nested map where
- * transaction IDs map to another map of item IDs with their occurrence counts within the transaction.
- *
- * @param query_items A vector of integers representing the query items to retrieve data for.
- * @param index The inverted index mapping item IDs to a vector of pairs, where each pair
- *              consists of a transaction ID and the occurrence count of the item within that transaction.
- * @return A map where each key is a transaction ID and each value is an unordered map of item IDs
- *         with their respective occurrence counts in that transaction.
- */
-std::map<int, std::unordered_map<int, int>> build_detailed_map_from_union(
-    const std::vector<int>& query_items,
-    const InvertedIndex& index) {
-
-    std::map<int, std::unordered_map<int, int>> result;
-
-    for (int item : query_items) {
-        auto it = index.find(item);
-        if (it == index.end()) continue;
-
-        for (const auto& [tid, occ] : it->second) {
-            result[tid][item] += occ;
-        }
-    }
-    return result;
-}
-
 /**
  * @brief Computes relevance scores for a single query using an inverted index.
  *
  * The function processes a query by retrieving occurrences of query items from the
  * provided inverted index, accumulating weights based on their occurrences and
- * predefined weights. The resulting relevance scores are sorted in descending order,
- * and optionally trimmed to only include the top_k results.
+ * predefined weights. The posting lists are added term at a time into a dense array
+ * of scores (see ScoreAccumulator), reused by all the queries of a thread. The
+ * resulting relevance scores are sorted in descending order.
+ *
+ * With a positive top_k, the posting lists are instead walked with MaxScore pruning
+ * (see max_score_top_k), which skips the transactions that cannot enter the top_k.
  *
  * @param query A vector of integers representing the query items.
- * @param inverted_index The inverted index mapping item IDs to transaction occurrences
- *        and their occurrence counts.
- * @param trf_weights A mapping of item IDs to their associated weights.
+ * @param inverted_index The inverted index mapping item IDs to transaction occurrences,
+ *        their occurrence counts and their associated weights.
  * @param top_k The maximum number of most relevant results to return. If top_k <= 0,
  *        all results are returned.
  * @return A vector of pairs where each pair consists of a relevance score (double)
@@ -591,39 +588,352 @@ std::map<int, std::unordered_map<int, int>> build_detailed_map_from_union(
  *         relevance score.
  */
 RelevanceScoreList run_inverted_single(const std::vector<int>& query,
-    const InvertedIndex& inverted_index,
-    const TRFWeights& trf_weights,
+    const RelevanceIndex& inverted_index,
     const int top_k) {
 
-    // For all query items, retrieve their occurrences lists from the inverted index,
-    // and union merge them into a map: transaction_id -> (item_id -> occurrence count).
-    auto merged = build_detailed_map_from_union(query, inverted_index);
+    if (top_k > 0)
+        return max_score_top_k(inverted_index, query, static_cast<size_t>(top_k));
+
+    // For all query items, add the occurrence count of every posting, multiplied by the item's
+    // weight, to the relevance score of its transaction.
+    thread_local ScoreAccumulator accumulator;
+    RelevanceScoreList scores = accumulator.score(inverted_index, query);
+
+    // Sort transactions by decreasing relevance score
+    rank_scores(scores, top_k);
+
+    return scores;
+}
+
+/**
+ * @brief Sorts relevance scores in descending order, keeping only the top_k if top_k is positive.
+ *
+ * With a positive top_k smaller than the number of scores, the top_k are first separated from the
+ * rest with std::nth_element, and only they are sorted.
+ *
+ * @param scores The (relevance, transaction ID) pairs to rank, in any order.
+ * @param top_k The number of results to keep. If set to 0 or a negative value, all are kept.
+ */
+void rank_scores(RelevanceScoreList& scores, const int top_k) {
+    if (top_k > 0 && scores.size() > static_cast<size_t>(top_k)) {
+        std::nth_element(scores.begin(), scores.begin() + top_k, scores.end(), std::greater<>());
+        scores.resize(top_k);
+    }
+    std::ranges::sort(scores, std::greater<>());
+}
+
+
+
+
+//
+//Index File
+
+/**
+ * Builds the relevance inverted index from a transactions file and writes it, along with the
+ * transactions, to one binary index file.
+ *
+ * The index file can then be passed instead of the transactions file: both methods map the sections
+ * they need instead of parsing the transactions and rebuilding the index.
+ *
+ * @param transactions_file The transactions text file.
+ * @param index_file The index file to write.
+ */
+void build_index_file(const std::string& transactions_file, const std::string& index_file) {
+    const ItemSets transactions = load_item_sets(transactions_file);
+    IndexFileWriter writer(RELEVANCE_INDEX_KIND);
+
+    //Transactions, for the naive method: the CSR arrays they are loaded into.
+    writer.add(TRANSACTION_OFFSETS_SECTION, transactions.offset_array());
+    writer.add(TRANSACTION_ITEMS_SECTION, transactions.item_array());
+
+    const RelevanceIndex relevance_index = build_relevance_inverted_index(transactions);
+    writer.add(RELEVANCE_ITEMS_SECTION, relevance_index.item_array());
+    writer.add(RELEVANCE_TRF_SECTION, relevance_index.trf_weight_array());
+    writer.add(RELEVANCE_OFFSETS_SECTION, relevance_index.offset_array());
+    writer.add(RELEVANCE_POSTINGS_SECTION, relevance_index.posting_array());
+    writer.add(RELEVANCE_MAX_OCCURRENCES_SECTION, relevance_index.max_occurrence_array());
+    writer.add(RELEVANCE_POSTING_SCORES_SECTION, relevance_index.posting_score_array());
+
+    writer.write(index_file);
+    std::cout << "Index of " << transactions.size() << " transactions (" << relevance_index.item_count()
+              << " distinct items) written to " << index_file << std::endl;
+}
+
+/**
+ * Views the transactions of an index file. The sets read the mapping directly, until one is appended.
+ *
+ * @param index_file The mapped index file, which must outlive the transactions.
+ * @return The transactions, in CSR layout.
+ */
+ItemSets transactions_from_index(const IndexFile& index_file) {
+    ItemSets transactions(index_file.section<uint64_t>(TRANSACTION_OFFSETS_SECTION),
+                          index_file.section<int>(TRANSACTION_ITEMS_SECTION));
+    if (!transactions.valid()) {
+        std::cerr << "Corrupt transactions in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return transactions;
+}
+
+/**
+ * Views the relevance inverted index of an index file. The index reads the mapping directly.
+ *
+ * @param index_file The mapped index file, which must outlive the inverted index.
+ * @return The inverted index, with its TRF weights.
+ */
+RelevanceIndex relevance_index_from_index(const IndexFile& index_file) {
+    RelevanceIndex relevance_index(index_file.section<int>(RELEVANCE_ITEMS_SECTION),
+                                   index_file.section<double>(RELEVANCE_TRF_SECTION),
+                                   index_file.section<int>(RELEVANCE_MAX_OCCURRENCES_SECTION),
+                                   index_file.section<uint64_t>(RELEVANCE_OFFSETS_SECTION),
+                                   index_file.section<Posting>(RELEVANCE_POSTINGS_SECTION),
+                                   index_file.section<double>(RELEVANCE_POSTING_SCORES_SECTION));
+    if (!relevance_index.valid()) {
+        std::cerr << "Corrupt relevance index in the index file" << std::endl;
+        std::exit(-1);
+    }
+    return relevance_index;
+}
+
+
+
+
+//
+//Server
+
+/**
+ * @brief Builds (or maps from an index file) the relevance inverted index once, then answers top-k
+ *        relevance queries until the input is closed, or forever when listening on a port.
+ *
+ * A request is a method number, k (0 or less for all results) and the query items, in the format of queries.txt:
+ *
+ *     1 2 [86, 23]
+ *
+ * and is answered with the number of results followed by "transaction_id:relevance" pairs, most relevant first:
+ *
+ *     ok 2 8346:263.1578947368421 7641:145.0651240373354
+ *
+ * "append" followed by items adds a transaction, answered with its ID ("ok 10000") (see append_transaction).
+ * Appends of a client are applied in its request order, after its earlier queries and before its later ones,
+ * which see the transaction; appends of other clients may interleave with them. A malformed request is
+ * answered with "error <reason>". No output file is written.
+ *
+ * Queries hold a shared lock on the index and run concurrently; an append holds it exclusively.
+ *
+ * @param transactions_file The transactions text file, or an index file.
+ * @param options Worker threads and port.
+ */
+void serve_queries(const std::string& transactions_file, const ServerOptions& options) {
+    std::optional<IndexFile> index_file;
+    if (IndexFile::is_index_file(transactions_file)) index_file.emplace(transactions_file, RELEVANCE_INDEX_KIND);
+
+    ItemSets transactions = index_file
+        ? transactions_from_index(*index_file)
+        : load_item_sets(transactions_file);
+    ServedIndex served{
+        index_file ? relevance_index_from_index(*index_file) : build_relevance_inverted_index(transactions),
+        RelevanceDelta(transactions.size()), std::move(transactions)};
+    std::shared_mutex served_mutex;
+
+    const auto is_append = [](const std::string& request) {
+        return request.compare(0, std::min(request.find(' '), request.size()), "append") == 0;
+    };
+    const auto answer = [&](const std::string& request) -> ServerResponse {
+        const size_t split = std::min(request.find(' '), request.size());
+        if (is_append(request)) {
+            std::unique_lock<std::shared_mutex> lock(served_mutex);
+            const int tid = append_transaction(served, parse_item_set(request.substr(split)));
+            return {APPEND_REQUEST_KIND, "ok " + std::to_string(tid)};
+        }
+
+        const char* position = request.data();
+        const char* const end = request.data() + request.size();
+        int method_number = -1, top_k = 0;
+        auto parsed = std::from_chars(position, end, method_number);
+        const bool has_k = parsed.ec == std::errc() && parsed.ptr < end && *parsed.ptr == ' ';
+        if (has_k) parsed = std::from_chars(parsed.ptr + 1, end, top_k);
+        if (!has_k || parsed.ec != std::errc() || (parsed.ptr != end && *parsed.ptr != ' ')
+            || (method_number != NAIVE_INDEX && method_number != INVERTED_INDEX))
+            return {ServerResponse::UNTIMED, "error expected a method (0-1), k and the query items, or append and the transaction items"};
+
+        const std::vector<int> query = parse_item_set(std::string(parsed.ptr, end));
+        const std::shared_lock<std::shared_mutex> lock(served_mutex);
+        const RelevanceScoreList scores = method_number == NAIVE_INDEX
+            ? run_naive_single(query, served.transactions, served.index, served.appended, top_k)
+            : run_served_inverted(query, served, top_k);
+
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(13) << "ok " << scores.size();
+        for (const auto& [relevance, tid] : scores) text << " " << tid << ":" << relevance;
+        return {static_cast<size_t>(method_number), text.str()};
+    };
+
+    std::cerr << "Loaded " << served.transactions.size() << " transactions (" << served.index.item_count() << " distinct items)" << std::endl;
+    QueryServer server({"naive", "inverted_file", "append"}, options, answer, is_append);
+    server.run();
+}
+
+/**
+ * @brief Runs the inverted method on the index and on the transactions appended to it, then merges the results.
+ *
+ * A transaction is in one of the two, so the top_k of all transactions are among the top_k of each.
+ *
+ * @param query The query items.
+ * @param served The served index.
+ * @param top_k The maximum number of most relevant results to return. If top_k <= 0, all results are returned.
+ * @return The (relevance, transaction ID) pairs, sorted in descending order by relevance score.
+ */
+RelevanceScoreList run_served_inverted(const std::vector<int>& query, const ServedIndex& served, const int top_k) {
+    const SegmentedQueryLists lists = query_lists(served.index, served.appended, query);
 
     RelevanceScoreList scores;
+    if (top_k > 0) {
+        scores = max_score_top_k(lists.base, static_cast<size_t>(top_k));
+        const RelevanceScoreList appended_scores = max_score_top_k(lists.appended, static_cast<size_t>(top_k));
+        scores.insert(scores.end(), appended_scores.begin(), appended_scores.end());
+    } else {
+        thread_local ScoreAccumulator accumulator;
+        scores = accumulator.score(lists.base);
+        const RelevanceScoreList appended_scores = accumulator.score(lists.appended);
+        scores.insert(scores.end(), appended_scores.begin(), appended_scores.end());
+    }
+
+    rank_scores(scores, top_k);
+    return scores;
+}
+
+/**
+ * @brief Adds a transaction to the served index without rebuilding it.
+ *
+ * The transaction goes to the delta of appended transactions. Once the delta holds 1 / DELTA_MERGE_FRACTION
+ * as many transactions as the index (and at least DELTA_MERGE_MIN_TRANSACTIONS), the index is rebuilt over
+ * all transactions and the delta is emptied, so that the rebuilds cost a constant amount of work per append.
+ *
+ * @param served The served index, locked exclusively by the caller.
+ * @param transaction The items of the new transaction.
+ * @return The ID of the new transaction.
+ */
+int append_transaction(ServedIndex& served, const std::vector<int>& transaction) {
+    const int tid = static_cast<int>(served.transactions.size());
+    served.transactions.push_back(transaction);
+    served.appended.append(transaction);
+
+    const size_t base_transactions = served.transactions.size() - served.appended.appended_transactions();
+    if (served.appended.appended_transactions() >= std::max(DELTA_MERGE_MIN_TRANSACTIONS, base_transactions / DELTA_MERGE_FRACTION)) {
+        served.index = build_relevance_inverted_index(served.transactions);
+        served.appended = RelevanceDelta(served.transactions.size());
+    }
+    return tid;
+}
 
 
-    // For each item in this transaction that also appears in the query,
-    // multiply its occurrence count by its weight and add to the relevance score
-    for (const auto& [tid, item_map] : merged) {
-        double relevance = 0.0;
 
-        for (const auto& [item_id, occ] : item_map) {
-            auto it = trf_weights.find(item_id);
-            if (it != trf_weights.end())
-                relevance += occ * it->second;
+//
+//Benchmark
+
+/**
+ * @brief Parses the "--name=value" arguments of the bench mode: --warmup, --repeat and --json (see Benchmark.h).
+ *
+ * @param argc Argument count as received by main.
+ * @param argv Argument vector as received by main.
+ * @param first_option Index of the first optional argument.
+ * @return The parsed options, with defaults for everything not given.
+ *
+ * @throws Exits with an error message on an unknown option or a malformed value.
+ */
+BenchmarkOptions parse_benchmark_options(const int argc, char* argv[], const int first_option) {
+    BenchmarkOptions options = DEFAULT_BENCHMARK_OPTIONS;
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (parse_benchmark_option(name, value, options)) continue;
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            exit(-1);
         }
 
-        //Keep only relevance ones.
-        if (relevance > 0.0)
-            scores.emplace_back(relevance, tid);
+        std::cerr << "Unknown option: " << argument << std::endl;
+        exit(-1);
     }
+    return options;
+}
 
-    // Sort transactions by decreasing relevance score
-    std::ranges::sort(scores, std::greater<>());
+/**
+ * @brief Benchmarks the naive and the inverted method on every query of a file, one query at a time, and writes a JSON report.
+ *
+ * The transactions and the index are loaded (or mapped from an index file) once, and no file is written but the report.
+ * The inverted method is reported as inverted_max_score with a positive top_k and as inverted_exhaustive otherwise,
+ * the two ways run_inverted_single() answers.
+ *
+ * Work counters, from the counting pass:
+ * - naive: transactions_scanned, and results.
+ * - inverted: postings, the total length of the posting lists of the query; scored_postings, those whose contribution was
+ *   added (all of them when exhaustive); candidates, the transactions MaxScore drew from its essential lists; and results.
+ *
+ * @param transactions_file The transactions text file, or an index file.
+ * @param queries_file The queries file.
+ * @param top_k The number of results of every query; 0 or a negative number for all of them.
+ * @param benchmark Passes and report file.
+ */
+void benchmark_methods(const std::string& transactions_file, const std::string& queries_file, const int top_k, const BenchmarkOptions& benchmark) {
+    const std::vector<std::vector<int>> queries = load_item_sets_from_file(queries_file);
 
-    // Keep only top_k results if required
-    if (top_k > 0 && scores.size() > static_cast<size_t>(top_k))
-        scores.resize(top_k);
+    std::optional<IndexFile> index_file;
+    if (IndexFile::is_index_file(transactions_file)) index_file.emplace(transactions_file, RELEVANCE_INDEX_KIND);
 
-    return scores;
-}
\ No newline at end of file
+    const ItemSets transactions = index_file
+        ? transactions_from_index(*index_file)
+        : load_item_sets(transactions_file);
+
+    const RelevanceIndex relevance_inverted_index = index_file
+        ? relevance_index_from_index(*index_file)
+        : build_relevance_inverted_index(transactions);
+
+    const RelevanceDelta no_appends(transactions.size());
+    const PerfCounters perf;
+    RelevanceScoreList results;
+    std::vector<MethodReport> reports;
+
+    reports.push_back(benchmark_method("naive", queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        results = run_naive_single(queries[q], transactions, relevance_inverted_index, no_appends, top_k);
+        if (counters != nullptr) {
+            counters->add("transactions_scanned", transactions.size());
+            counters->add("results", results.size());
+        }
+    }));
+
+    const std::string inverted_name = top_k > 0 ? "inverted_max_score" : "inverted_exhaustive";
+    reports.push_back(benchmark_method(inverted_name, queries.size(), benchmark, perf, [&](const size_t q, WorkCounters* counters) {
+        if (counters == nullptr) {
+            results = run_inverted_single(queries[q], relevance_inverted_index, top_k);
+            return;
+        }
+
+        //The counting pass runs the same search, with its statistics.
+        const std::vector<QueryList> lists = query_lists(relevance_inverted_index, queries[q]);
+        size_t postings = 0;
+        for (const QueryList& list : lists) postings += list.postings.size();
+        MaxScoreStats stats{0, postings};
+        results = top_k > 0
+            ? max_score_top_k(lists, static_cast<size_t>(top_k), &stats)
+            : run_inverted_single(queries[q], relevance_inverted_index, top_k);
+
+        counters->add("postings", postings);
+        counters->add("scored_postings", stats.scored_postings);
+        if (top_k > 0) counters->add("candidates", stats.candidates);
+        counters->add("results", results.size());
+    }));
+
+    BenchmarkDataset dataset;
+    dataset.add("transactions_file", transactions_file);
+    dataset.add("queries_file", queries_file);
+    dataset.add("transactions", transactions.size());
+    dataset.add("queries", queries.size());
+    dataset.add("top_k", static_cast<uint64_t>(std::max(top_k, 0)));
+    write_benchmark_report("relevance", dataset, reports, benchmark, perf);
+}
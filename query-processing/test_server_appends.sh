@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Checks the appends of the serve mode of both query programs, on several worker threads: one client pipelines
+# appends interleaved with queries, then queries again. The appends must get consecutive IDs in request order,
+# every query must see the appends sent before it, and the final answers must be those of a server started on
+# the transactions file with the appended transactions added at its end.
+#
+# Usage: query-processing/test_server_appends.sh [appends (default 3000)] [threads (default 4)]
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+APPENDS="${1:-3000}"
+THREADS="${2:-4}"
+CXX="${CXX:-g++}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+"$CXX" -std=c++20 -O2 -pthread "$ROOT/containment-queries/main.cpp" -o "$WORK/containment"
+"$CXX" -std=c++20 -O2 -pthread "$ROOT/relevance-queries/main.cpp" -o "$WORK/relevance"
+
+failures=0
+fail() {
+    echo "FAIL $1: $2"
+    failures=$((failures + 1))
+}
+
+# check <name> <program> <data directory> <query prefix of the methods...>
+check() {
+    local name="$1" program="$2" data="$3"
+    shift 3
+    local methods=("$@")
+    local base
+    base="$(awk 'END { print NR }' "$data/transactions.txt")"
+
+    # The appended transactions are the first ones of the data set, in reverse order: they have answers to check.
+    awk -v appends="$APPENDS" 'NR <= appends' "$data/transactions.txt" | tac > "$WORK/appended.txt"
+    awk '1' "$data/transactions.txt" "$WORK/appended.txt" > "$WORK/combined.txt"
+
+    # Each append is followed by a query of its own items, answered with all results, which must include it.
+    awk -v methods="$(IFS='|'; echo "${methods[*]}")" '
+        BEGIN { count = split(methods, method, "|") }
+        { print "append " $0; print method[NR % count + 1] " " $0 }' "$WORK/appended.txt" > "$WORK/requests.txt"
+    local final=()
+    for method in "${methods[@]}"; do
+        while IFS= read -r query; do final+=("$method $query"); done < "$data/queries.txt"
+    done
+    printf '%s\n' "${final[@]}" > "$WORK/final.txt"
+    cat "$WORK/final.txt" >> "$WORK/requests.txt"
+
+    "$WORK/$program" serve "$data/transactions.txt" --threads="$THREADS" < "$WORK/requests.txt" > "$WORK/responses.txt" 2> /dev/null
+    "$WORK/$program" serve "$WORK/combined.txt" --threads="$THREADS" < "$WORK/final.txt" > "$WORK/rebuilt.txt" 2> /dev/null
+
+    # Appends answer "ok <ID>"; the query after one must list that ID (as "<ID>" or "<ID>:<relevance>").
+    if ! awk -v base="$base" -v appends="$APPENDS" '
+        NR > 2 * appends { exit }
+        NR % 2 == 1 { id = base + (NR - 1) / 2; if ($0 != "ok " id) { print "append " (NR + 1) / 2 ": " $0; bad = 1 }; next }
+        { found = 0; for (i = 3; i <= NF; i++) { split($i, field, ":"); if (field[1] == id) found = 1 }
+          if (!found) { print "query after append " NR / 2 " misses " id; bad = 1 } }
+        END { exit bad }' "$WORK/responses.txt" > "$WORK/errors.txt"; then
+        head -n 5 "$WORK/errors.txt"
+        fail "$name" "appends out of order or not seen by the queries after them"
+    fi
+    if ! cmp -s <(tail -n +"$((2 * APPENDS + 1))" "$WORK/responses.txt") "$WORK/rebuilt.txt"; then
+        fail "$name" "answers after the appends differ from those over the combined transactions"
+    fi
+    echo "$name: $APPENDS appends on $THREADS threads checked"
+}
+
+check containment containment "$ROOT/containment-queries" 0 1 2 3
+check relevance relevance "$ROOT/relevance-queries" "0 0" "1 0"
+
+[ "$failures" = 0 ] && echo "All checks passed" || exit 1
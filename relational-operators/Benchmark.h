@@ -0,0 +1,185 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Allocations made through operator new, counted by the replacement operators in main.cpp.
+ */
+inline std::atomic<uint64_t> allocation_count{0};
+inline std::atomic<uint64_t> allocated_bytes{0};
+
+/**
+ * What one measured run cost. Memory and allocations are those of the process that ran the operator.
+ */
+struct BenchmarkMeasurement {
+    double wall_seconds = 0;
+    long peak_rss_kib = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    int exit_status = 0;
+};
+
+/**
+ * Runs an operation in a forked child process and measures it.
+ * Every run starts from the same small process, so peak RSS and allocation counts are not polluted by
+ * earlier runs. The child works in work_directory with its standard output discarded.
+ * @param operation What to measure
+ * @param work_directory Working directory of the child, receives the output files
+ * @return The measurement, exit_status is non-zero if the child failed
+ */
+inline BenchmarkMeasurement measure_in_child(const std::function<void()>& operation, const std::string& work_directory) {
+    int result_pipe[2];
+    if (::pipe(result_pipe) != 0) {
+        std::cerr << "Failed to create a pipe" << std::endl;
+        exit(-1);
+    }
+    std::cout.flush();
+
+    const pid_t child = ::fork();
+    if (child == 0) {
+        ::close(result_pipe[0]);
+        const int null_output = ::open("/dev/null", O_WRONLY);
+        ::dup2(null_output, STDOUT_FILENO);
+        if (::chdir(work_directory.c_str()) != 0) _exit(1);
+
+        BenchmarkMeasurement measurement;
+        const uint64_t allocations_before = allocation_count.load();
+        const uint64_t allocated_bytes_before = allocated_bytes.load();
+        const auto start = std::chrono::steady_clock::now();
+        operation();
+        std::cout.flush();
+        measurement.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        measurement.allocations = allocation_count.load() - allocations_before;
+        measurement.allocated_bytes = allocated_bytes.load() - allocated_bytes_before;
+
+        rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        measurement.peak_rss_kib = usage.ru_maxrss;
+
+        const bool written = ::write(result_pipe[1], &measurement, sizeof(measurement)) == sizeof(measurement);
+        _exit(written ? 0 : 1);
+    }
+
+    ::close(result_pipe[1]);
+    BenchmarkMeasurement measurement;
+    const bool received = child > 0 && ::read(result_pipe[0], &measurement, sizeof(measurement)) == sizeof(measurement);
+    ::close(result_pipe[0]);
+
+    int status = 0;
+    if (child > 0) ::waitpid(child, &status, 0);
+    if (!received) {
+        measurement = BenchmarkMeasurement{};
+        measurement.exit_status = status == 0 ? -1 : status;
+    }
+    return measurement;
+}
+
+/**
+ * Draws key ranks in [0, key_count) from a Zipf distribution, rank 0 being the most frequent key.
+ * A skew of 0 gives the uniform distribution, 1 and more give a few very hot keys.
+ */
+class ZipfKeyGenerator {
+public:
+    ZipfKeyGenerator(const size_t key_count, const double skew) : cumulative(std::max<size_t>(key_count, 1)) {
+        double total = 0;
+        for (size_t rank = 0; rank < cumulative.size(); rank++) {
+            total += 1.0 / std::pow(static_cast<double>(rank + 1), skew);
+            cumulative[rank] = total;
+        }
+        for (double& weight : cumulative) weight /= total;
+    }
+
+    template<typename Random>
+    size_t operator()(Random& random) {
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        const auto rank = std::lower_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+        return std::min<size_t>(rank, cumulative.size() - 1);
+    }
+
+private:
+    std::vector<double> cumulative;
+};
+
+/**
+ * Minimal JSON writer: objects and arrays are opened and closed explicitly, commas are inserted automatically.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream& out) : out(out) {}
+
+    void begin_object(const std::string& name = "") { open(name, '{'); }
+    void end_object() { close('}'); }
+    void begin_array(const std::string& name = "") { open(name, '['); }
+    void end_array() { close(']'); }
+
+    void field(const std::string& name, const std::string& value) {
+        separate();
+        out << quoted(name) << ": " << quoted(value);
+    }
+
+    void field(const std::string& name, const double value) {
+        separate();
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", std::isfinite(value) ? value : 0.0);
+        out << quoted(name) << ": " << text;
+    }
+
+    template<typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    void field(const std::string& name, const Integer value) {
+        separate();
+        out << quoted(name) << ": " << value;
+    }
+
+private:
+    std::ostream& out;
+    std::vector<bool> has_elements;
+
+    void separate() {
+        if (!has_elements.empty()) {
+            if (has_elements.back()) out << ",";
+            out << "\n" << std::string(has_elements.size() * 2, ' ');
+            has_elements.back() = true;
+        }
+    }
+
+    void open(const std::string& name, const char bracket) {
+        separate();
+        if (!name.empty()) out << quoted(name) << ": ";
+        out << bracket;
+        has_elements.push_back(false);
+    }
+
+    void close(const char bracket) {
+        const bool had_elements = has_elements.back();
+        has_elements.pop_back();
+        if (had_elements) out << "\n" << std::string(has_elements.size() * 2, ' ');
+        out << bracket;
+        if (has_elements.empty()) out << "\n";
+    }
+
+    static std::string quoted(const std::string& text) {
+        std::string result = "\"";
+        for (const char c : text) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result + "\"";
+    }
+};
+
+#endif //BENCHMARK_H
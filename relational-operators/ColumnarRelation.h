@@ -0,0 +1,192 @@
+#ifndef COLUMNAR_RELATION_H
+#define COLUMNAR_RELATION_H
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "RecordCursor.h"
+
+/**
+ * Binary, sorted, columnar layout of a "key<TAB>int32" relation, written by the ingest mode of main.cpp.
+ *
+ *   ColumnarHeader
+ *   uint64_t key_offsets[key_count + 1]   dictionary: offsets of every distinct key into key_bytes
+ *   char     key_bytes[]                  dictionary: the distinct keys, in ascending order (padded to 8 bytes)
+ *   uint32_t key_ids[row_count]           key column, as dictionary indices
+ *   int32_t  values[row_count]            value column
+ *   ColumnarBlock blocks[block_count]     block headers, COLUMNAR_BLOCK_ROWS rows each (the last one may be shorter)
+ *
+ * Every section starts at a multiple of 8 bytes.
+ *
+ * Rows are sorted like the lines of the TSV file (by key, then by the text of the value). Dictionary indices
+ * follow the key order, so comparing the keys of one relation is comparing their indices.
+ */
+constexpr char COLUMNAR_MAGIC[8] = {'R', 'E', 'L', 'C', 'O', 'L', '0', '1'};
+constexpr uint32_t COLUMNAR_BLOCK_ROWS = 4096;
+
+struct ColumnarHeader {
+    char magic[8];
+    uint64_t row_count;
+    uint64_t key_count;
+    uint64_t block_count;
+    uint64_t key_offsets_offset;
+    uint64_t key_bytes_offset;
+    uint64_t key_ids_offset;
+    uint64_t values_offset;
+    uint64_t blocks_offset;
+    uint64_t file_size;
+};
+
+/**
+ * Min/max header of a block of rows. Since rows are sorted, every key of the block lies in [min_key_id, max_key_id].
+ */
+struct ColumnarBlock {
+    uint64_t first_row;
+    uint32_t row_count;
+    uint32_t min_key_id;
+    uint32_t max_key_id;
+    int32_t min_value;
+    int32_t max_value;
+    uint32_t padding;
+};
+
+/**
+ * Read-only, memory-mapped columnar relation.
+ * Keys are views into the mapping and stay valid as long as the relation lives.
+ */
+class ColumnarRelation {
+public:
+    explicit ColumnarRelation(const std::string& file_name) : file(file_name) {
+        const std::string_view contents = file.contents();
+        if (!file.is_open() || contents.size() < sizeof(ColumnarHeader)) return;
+
+        std::memcpy(&header, contents.data(), sizeof(ColumnarHeader));
+        if (std::memcmp(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 || header.file_size != contents.size())
+            return;
+        if (header.blocks_offset + header.block_count * sizeof(ColumnarBlock) > contents.size()
+            || header.values_offset + header.row_count * sizeof(int32_t) > header.blocks_offset
+            || header.key_ids_offset + header.row_count * sizeof(uint32_t) > header.values_offset
+            || header.key_offsets_offset + (header.key_count + 1) * sizeof(uint64_t) > header.key_bytes_offset)
+            return;
+
+        key_offsets = reinterpret_cast<const uint64_t*>(contents.data() + header.key_offsets_offset);
+        key_bytes = contents.data() + header.key_bytes_offset;
+        key_ids = reinterpret_cast<const uint32_t*>(contents.data() + header.key_ids_offset);
+        values = reinterpret_cast<const int32_t*>(contents.data() + header.values_offset);
+        blocks = reinterpret_cast<const ColumnarBlock*>(contents.data() + header.blocks_offset);
+        valid_format = true;
+    }
+
+    /**
+     * @return False if the file could not be opened or is not a columnar relation
+     */
+    [[nodiscard]] bool is_open() const { return valid_format; }
+
+    [[nodiscard]] size_t row_count() const { return header.row_count; }
+
+    [[nodiscard]] size_t key_count() const { return header.key_count; }
+
+    [[nodiscard]] size_t block_count() const { return header.block_count; }
+
+    [[nodiscard]] std::string_view key(const uint32_t key_id) const {
+        return {key_bytes + key_offsets[key_id], key_offsets[key_id + 1] - key_offsets[key_id]};
+    }
+
+    [[nodiscard]] uint32_t key_id(const size_t row) const { return key_ids[row]; }
+
+    [[nodiscard]] int32_t value(const size_t row) const { return values[row]; }
+
+    [[nodiscard]] const ColumnarBlock& block(const size_t block_index) const { return blocks[block_index]; }
+
+    /**
+     * Binary search in the dictionary.
+     * @param search_key Any key, not necessarily in the relation
+     * @return Index of the first dictionary key not less than search_key (key_count() if there is none)
+     */
+    [[nodiscard]] uint32_t lower_bound_key_id(const std::string_view search_key) const {
+        uint32_t low = 0, high = static_cast<uint32_t>(header.key_count);
+        while (low < high) {
+            const uint32_t middle = low + (high - low) / 2;
+            if (key(middle) < search_key) low = middle + 1;
+            else high = middle;
+        }
+        return low;
+    }
+
+private:
+    MappedFile file;
+    ColumnarHeader header{};
+    const uint64_t* key_offsets = nullptr;
+    const char* key_bytes = nullptr;
+    const uint32_t* key_ids = nullptr;
+    const int32_t* values = nullptr;
+    const ColumnarBlock* blocks = nullptr;
+    bool valid_format = false;
+};
+
+/**
+ * Forward cursor over the rows of a ColumnarRelation.
+ * skip_to() uses the block headers to jump over whole blocks of smaller keys without touching their rows.
+ */
+class ColumnarCursor {
+public:
+    explicit ColumnarCursor(const ColumnarRelation& relation) : relation(relation) {}
+
+    [[nodiscard]] bool valid() const { return row < relation.row_count(); }
+
+    bool advance() { return ++row < relation.row_count(); }
+
+    [[nodiscard]] size_t position() const { return row; }
+
+    /**
+     * Moves back to a row visited before (e.g. to re-scan a key group).
+     * @param target_row The row
+     */
+    void seek(const size_t target_row) { row = target_row; }
+
+    [[nodiscard]] uint32_t key_id() const { return relation.key_id(row); }
+
+    [[nodiscard]] std::string_view key() const { return relation.key(relation.key_id(row)); }
+
+    [[nodiscard]] int32_t value() const { return relation.value(row); }
+
+    /**
+     * Moves forward to the first row whose key is not less than search_key. Never moves backwards.
+     * @param search_key The key to move to
+     * @return Number of whole blocks skipped
+     */
+    size_t skip_to(const std::string_view search_key) {
+        if (!valid() || key() >= search_key) return 0;
+
+        const uint32_t target_id = relation.lower_bound_key_id(search_key);
+        size_t block_index = row / COLUMNAR_BLOCK_ROWS;
+        size_t skipped_blocks = 0;
+
+        //Blocks whose keys are all smaller are jumped over. Only blocks not entered yet count as skipped.
+        while (block_index < relation.block_count() && relation.block(block_index).max_key_id < target_id) {
+            if (relation.block(block_index).first_row >= row) skipped_blocks++;
+            block_index++;
+        }
+        if (block_index == relation.block_count()) {
+            row = relation.row_count();
+            return skipped_blocks;
+        }
+
+        const ColumnarBlock& block = relation.block(block_index);
+        size_t low = std::max<size_t>(row, block.first_row), high = block.first_row + block.row_count;
+        while (low < high) {
+            const size_t middle = low + (high - low) / 2;
+            if (relation.key_id(middle) < target_id) low = middle + 1;
+            else high = middle;
+        }
+        row = low;
+        return skipped_blocks;
+    }
+
+private:
+    const ColumnarRelation& relation;
+    size_t row = 0;
+};
+
+#endif //COLUMNAR_RELATION_H
@@ -0,0 +1,148 @@
+#ifndef HASH_AGGREGATION_TABLE_H
+#define HASH_AGGREGATION_TABLE_H
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Seeded 64-bit FNV-1a hash of a key.
+ * Different seeds give independent hash functions, which the Grace-style partitioning uses
+ * to re-split a partition that is still too large for the memory budget.
+ * @param key The key to hash
+ * @param seed Selects the hash function
+ * @return The 64-bit hash value
+ */
+inline uint64_t hash_key(const std::string_view key, const uint64_t seed) {
+    uint64_t hash = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+    for (const char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    // Final avalanche, so that both the low bits (slot) and the high bits (partition) are well mixed.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Open-addressing (linear probing) hash table that sums integer values per key.
+ *
+ * Keys are copied once into a contiguous arena, slots only hold offsets into it,
+ * so aggregating a row whose key is already present does not allocate.
+ */
+class HashAggregationTable {
+public:
+    explicit HashAggregationTable(const uint64_t seed, const size_t initial_capacity = 1024)
+        : seed(seed), slots(std::bit_ceil(std::max<size_t>(initial_capacity, 16))) {}
+
+    /**
+     * Adds value to the sum of key.
+     * @param key The group-by key
+     * @param hash hash_key(key, seed) of this table
+     * @param value The value to add
+     * @param allow_insert If false, keys that are not in the table yet are rejected
+     * @return False if the key was absent and allow_insert was false, true otherwise
+     */
+    bool add(const std::string_view key, const uint64_t hash, const int value, const bool allow_insert) {
+        size_t index = hash & (slots.size() - 1);
+        while (slots[index].used) {
+            Slot& slot = slots[index];
+            if (slot.hash == hash && key_of(slot) == key) {
+                slot.sum += value;
+                return true;
+            }
+            index = (index + 1) & (slots.size() - 1);
+        }
+
+        if (!allow_insert) return false;
+
+        if ((entries + 1) * 10 > slots.size() * 7) {
+            grow();
+            return add(key, hash, value, true);
+        }
+
+        slots[index] = Slot{hash, keys.size(), static_cast<uint32_t>(key.size()), value, true};
+        keys.append(key);
+        entries++;
+        return true;
+    }
+
+    /**
+     * @return Bytes currently allocated by the table (slots plus key arena)
+     */
+    [[nodiscard]] size_t memory_footprint() const {
+        return slots.capacity() * sizeof(Slot) + keys.capacity();
+    }
+
+    /**
+     * Bytes the table would allocate after inserting one more key of the given length.
+     * Accounts for the slot array doubling and for the arena growing geometrically.
+     * @param key_length Length of the key about to be inserted
+     * @return Projected memory footprint in bytes
+     */
+    [[nodiscard]] size_t memory_footprint_after_insert(const size_t key_length) const {
+        const size_t slot_bytes = ((entries + 1) * 10 > slots.size() * 7 ? 2 : 1) * slots.size() * sizeof(Slot);
+        const size_t key_bytes = keys.size() + key_length > keys.capacity()
+                                 ? std::max(keys.capacity() * 2, keys.size() + key_length)
+                                 : keys.capacity();
+        return slot_bytes + key_bytes;
+    }
+
+    [[nodiscard]] size_t size() const { return entries; }
+
+    /**
+     * Writes every (key, sum) pair as "key<TAB>sum" lines in ascending key order.
+     * @param out Stream that receives the records
+     */
+    void write_sorted(std::ostream& out) const {
+        std::vector<const Slot*> used_slots;
+        used_slots.reserve(entries);
+        for (const Slot& slot : slots)
+            if (slot.used) used_slots.push_back(&slot);
+
+        std::sort(used_slots.begin(), used_slots.end(), [this](const Slot* a, const Slot* b) {
+            return key_of(*a) < key_of(*b);
+        });
+
+        for (const Slot* slot : used_slots)
+            out << key_of(*slot) << "\t" << slot->sum << "\n";
+    }
+
+private:
+    struct Slot {
+        uint64_t hash;
+        size_t key_offset;
+        uint32_t key_length;
+        int sum;
+        bool used;
+    };
+
+    uint64_t seed;
+    std::vector<Slot> slots;
+    std::string keys;
+    size_t entries = 0;
+
+    [[nodiscard]] std::string_view key_of(const Slot& slot) const {
+        return std::string_view(keys).substr(slot.key_offset, slot.key_length);
+    }
+
+    void grow() {
+        std::vector<Slot> old_slots(slots.size() * 2);
+        old_slots.swap(slots);
+
+        for (const Slot& slot : old_slots) {
+            if (!slot.used) continue;
+            size_t index = slot.hash & (slots.size() - 1);
+            while (slots[index].used)
+                index = (index + 1) & (slots.size() - 1);
+            slots[index] = slot;
+        }
+    }
+};
+
+#endif //HASH_AGGREGATION_TABLE_H
@@ -0,0 +1,197 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * Write-only output file with a large user-space buffer.
+ *
+ * Rows are appended with memcpy and reach the kernel only when the buffer is full, so a sink
+ * issues one write per buffer instead of one per row. A piece that does not fit is handed to
+ * writev together with the buffered bytes instead of being copied.
+ * With direct I/O the file is opened with O_DIRECT and written from an aligned buffer in whole
+ * blocks, bypassing the page cache. Filesystems that reject O_DIRECT fall back to buffered writes.
+ *
+ * Write errors are fatal. The destructor flushes whatever is left.
+ */
+class OutputSink {
+public:
+    // O_DIRECT requires the buffer address, the file offset and the write length to be multiples of this.
+    static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+    OutputSink(const std::string& file_name, const size_t buffer_size, const bool direct_io)
+        : file_name(file_name) {
+        constexpr int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        if (direct_io) {
+            fd = ::open(file_name.c_str(), flags | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+        if (fd < 0) fd = ::open(file_name.c_str(), flags, 0644);
+        if (fd < 0) return;
+
+        capacity = round_up(std::max(buffer_size, DIRECT_IO_ALIGNMENT), DIRECT_IO_ALIGNMENT);
+        buffer = static_cast<char*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, capacity));
+    }
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    ~OutputSink() {
+        close();
+        std::free(buffer);
+    }
+
+    [[nodiscard]] bool is_open() const { return fd >= 0; }
+
+    /**
+     * Appends raw bytes to the output.
+     * @param piece The bytes to append
+     */
+    void append(const std::string_view piece) {
+        if (piece.size() <= capacity - used) {
+            std::memcpy(buffer + used, piece.data(), piece.size());
+            used += piece.size();
+            return;
+        }
+
+        if (direct) {
+            // Direct writes must come from the aligned buffer, so large pieces are copied through it.
+            size_t copied = 0;
+            while (copied < piece.size()) {
+                const size_t chunk = std::min(capacity - used, piece.size() - copied);
+                std::memcpy(buffer + used, piece.data() + copied, chunk);
+                used += chunk;
+                copied += chunk;
+                if (used == capacity) flush_blocks();
+            }
+            return;
+        }
+
+        iovec pieces[2] = {{buffer, used}, {const_cast<char*>(piece.data()), piece.size()}};
+        write_all(pieces, 2);
+        used = 0;
+    }
+
+    /**
+     * Appends the decimal representation of value.
+     * @param value The integer to append
+     */
+    void append(const int value) {
+        char digits[16];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(std::string_view(digits, result.ptr - digits));
+    }
+
+    /**
+     * Appends every piece, in order.
+     * Emitting a whole row with one call keeps the fast path to a single capacity check per piece.
+     */
+    template<typename... Pieces>
+    void append_all(const Pieces&... pieces) {
+        (append(pieces), ...);
+    }
+
+    /**
+     * Writes out the buffered bytes and closes the file. Called by the destructor if not called before.
+     */
+    void close() {
+        if (fd < 0) return;
+
+        if (direct) {
+            flush_blocks();
+            // The tail is shorter than a block. Drop O_DIRECT for it, the offset is still block-aligned.
+            if (used > 0) ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+        }
+        if (used > 0) {
+            iovec tail = {buffer, used};
+            write_all(&tail, 1);
+            used = 0;
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+
+    /**
+     * @return Bytes handed to the kernel so far
+     */
+    [[nodiscard]] size_t bytes_written() const { return written; }
+
+    /**
+     * @return Number of write/writev system calls issued so far
+     */
+    [[nodiscard]] size_t flush_count() const { return flushes; }
+
+    /**
+     * @return True if the file is written with O_DIRECT
+     */
+    [[nodiscard]] bool direct_io() const { return direct; }
+
+private:
+    std::string file_name;
+    int fd = -1;
+    bool direct = false;
+    char* buffer = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t written = 0;
+    size_t flushes = 0;
+
+    static size_t round_up(const size_t value, const size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    /**
+     * Direct mode only: writes the whole blocks of the buffer and moves the partial block to its front.
+     */
+    void flush_blocks() {
+        const size_t aligned = used / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+        if (aligned == 0) return;
+
+        iovec blocks = {buffer, aligned};
+        write_all(&blocks, 1);
+        std::memmove(buffer, buffer + aligned, used - aligned);
+        used -= aligned;
+    }
+
+    /**
+     * Writes all bytes of the given pieces, retrying on short writes.
+     * @param pieces The pieces to write (modified while retrying)
+     * @param count Number of pieces
+     */
+    void write_all(iovec* pieces, int count) {
+        while (count > 0) {
+            const ssize_t result = ::writev(fd, pieces, count);
+            flushes++;
+            if (result < 0) {
+                std::cerr << "Failed to write " << file_name << ": " << std::strerror(errno) << std::endl;
+                exit(-1);
+            }
+
+            auto remaining = static_cast<size_t>(result);
+            written += remaining;
+            while (count > 0 && remaining >= pieces->iov_len) {
+                remaining -= pieces->iov_len;
+                pieces++;
+                count--;
+            }
+            if (count > 0) {
+                pieces->iov_base = static_cast<char*>(pieces->iov_base) + remaining;
+                pieces->iov_len -= remaining;
+            }
+        }
+    }
+};
+
+#endif //OUTPUT_SINK_H
@@ -0,0 +1,133 @@
+#ifndef RECORD_CURSOR_H
+#define RECORD_CURSOR_H
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Read-only memory mapping of a whole file.
+ * The mapping lives as long as the object, so views into contents() stay valid until it is destroyed.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& file_name) {
+        const int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat file_stat{};
+        if (::fstat(fd, &file_stat) == 0) {
+            length = static_cast<size_t>(file_stat.st_size);
+            if (length == 0) {
+                opened = true;
+            } else if (void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0); mapping != MAP_FAILED) {
+                data = static_cast<const char*>(mapping);
+                ::madvise(mapping, length, MADV_SEQUENTIAL);
+                opened = true;
+            }
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : data(std::exchange(other.data, nullptr)), length(std::exchange(other.length, 0)), opened(std::exchange(other.opened, false)) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            data = std::exchange(other.data, nullptr);
+            length = std::exchange(other.length, 0);
+            opened = std::exchange(other.opened, false);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { unmap(); }
+
+    [[nodiscard]] bool is_open() const { return opened; }
+
+    [[nodiscard]] std::string_view contents() const { return {data, length}; }
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    bool opened = false;
+
+    void unmap() {
+        if (data != nullptr) ::munmap(const_cast<char*>(data), length);
+        data = nullptr;
+    }
+};
+
+/**
+ * Forward cursor over the "key<TAB>payload" lines of a TSV buffer (usually a MappedFile).
+ *
+ * line(), key() and payload() are views into the buffer, nothing is copied or allocated.
+ * The key is located once when the cursor moves, so comparing keys repeatedly is free.
+ */
+class RecordCursor {
+public:
+    explicit RecordCursor(const std::string_view buffer) : buffer(buffer) { advance(); }
+
+    /**
+     * Moves to the next line.
+     * @return False if the end of the buffer was reached
+     */
+    bool advance() {
+        if (next_offset >= buffer.size()) {
+            line_offset = buffer.size();
+            has_record = false;
+            return false;
+        }
+
+        line_offset = next_offset;
+        size_t line_end = buffer.find('\n', line_offset);
+        if (line_end == std::string_view::npos) line_end = buffer.size();
+        next_offset = line_end + 1;
+
+        current_line = buffer.substr(line_offset, line_end - line_offset);
+        const size_t tab = current_line.find('\t');
+        current_key = current_line.substr(0, tab);
+        // Without a tab the whole line is both key and payload, as substr(find('\t') + 1) would give.
+        current_payload = tab == std::string_view::npos ? current_line : current_line.substr(tab + 1);
+        has_record = true;
+        return true;
+    }
+
+    [[nodiscard]] bool valid() const { return has_record; }
+
+    [[nodiscard]] std::string_view line() const { return current_line; }
+
+    [[nodiscard]] std::string_view key() const { return current_key; }
+
+    [[nodiscard]] std::string_view payload() const { return current_payload; }
+
+    /**
+     * @return Byte offset of the current line within the buffer, or the buffer size once the cursor is exhausted
+     */
+    [[nodiscard]] size_t offset() const { return line_offset; }
+
+    /**
+     * @return The whole buffer the cursor walks over
+     */
+    [[nodiscard]] std::string_view buffer_contents() const { return buffer; }
+
+private:
+    std::string_view buffer;
+    size_t line_offset = 0;
+    size_t next_offset = 0;
+    std::string_view current_line;
+    std::string_view current_key;
+    std::string_view current_payload;
+    bool has_record = false;
+};
+
+#endif //RECORD_CURSOR_H
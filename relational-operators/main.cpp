@@ -4,14 +4,25 @@
  * (first column). Outputs are written to new TSV files.
  *
  * Usage:
- *   ./a.out <R_sorted.tsv> <S_sorted.tsv> <R.tsv>
+ *   ./a.out <R_sorted.tsv> <S_sorted.tsv> <R.tsv> [--memory-budget=<MiB>] [--group-by=sort|hash|auto]
+ *           [--output-buffer=<KiB>] [--direct-io] [--operators=join,union,intersection,difference,group-by] [--fused]
+ *           [--threads=<N>] [--join-buffer-rows=<N>] [--columnar=auto|off]
+ *   ./a.out ingest <file.tsv> [<file.tsv.col>]
+ *   ./a.out bench [--r-rows=<N>] [--s-rows=<N>] [--keys=<N>] [--skew=<Zipf exponent>] [--seed=<N>] [--threads=<N>]
+ *                 [--memory-budget=<MiB>] [--directory=<path>] [--json=<file>]
  *
  * The operations performed:
  *   - Merge Join: Joins R and S on the key.
  *   - Union: Produces the union of R and S without duplicates.
  *   - Intersection: Finds common rows between R and S.
  *   - Difference: Computes R - S.
- *   - Group-By: Groups R by key and sums the integer values.
+ * Each of them scans R and S on its own, unless --fused is given: then all of them share a single scan.
+ * The ingest mode converts a TSV file into a sorted, columnar binary copy (ColumnarRelation.h). When such a copy
+ * ("<file>.col", not older than the file) exists for the inputs, the operators read it instead of the TSV file.
+ * The bench mode generates synthetic inputs, runs every operator variant on them and reports JSON measurements.
+ *   - Group-By: Groups R by key and sums the integer values, either with an external merge sort
+ *     or with hash aggregation (Grace-style partitioning when the table outgrows the budget).
+ *     Only --memory-budget MiB are held in memory at any time, the rest is spilled to disk.
  *
  * The Record struct represents a row with:
  *   - column_1: key (std::string)
@@ -21,10 +32,35 @@
 
 
 #include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <optional>
+#include <thread>
 #include <array>
+#include <queue>
+#include <string>
+#include <unordered_set>
 #include <vector>
+#include "Benchmark.h"
+#include "ColumnarRelation.h"
+#include "HashAggregationTable.h"
+#include "OutputSink.h"
+#include "RecordCursor.h"
+#include "ThreadPool.h"
+
+
+// Replacement allocation functions, so that the bench mode can report allocation counts.
+// They are kept out of line, like the library versions they replace.
+__attribute__((noinline)) void* operator new(const size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if(void* pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* pointer) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
 
 
 struct Record {
@@ -32,125 +68,575 @@ struct Record {
     int column_2;
 };
 
+enum class GroupByStrategy { Sort, Hash, Auto };
+
+/**
+ * Options that can be appended after the three positional file arguments.
+ *   --memory-budget=<MiB>       : memory the group-by may use before spilling to disk.
+ *   --group-by=sort|hash|auto   : grouping algorithm. auto samples R and picks hash for low key cardinality.
+ *   --output-buffer=<KiB>       : size of the user-space buffer of every operator output file.
+ *   --direct-io                 : write operator outputs with O_DIRECT, bypassing the page cache.
+ *   --operators=<list>          : comma-separated operators to run (join, union, intersection, difference, group-by).
+ *   --fused                     : run join, union, intersection and difference in a single scan of R and S.
+ *   --threads=<N>               : threads of the range-partitioned parallel merge join (1 = serial join).
+ *   --join-buffer-rows=<N>      : S rows of one key the merge join buffers before it spills the key group.
+ *   --columnar=auto|off         : read the columnar copies of the inputs when they exist (auto), or never (off).
+ */
+struct OperatorSelection {
+    bool join = true;
+    bool union_ = true;
+    bool intersection = true;
+    bool difference = true;
+    bool group_by = true;
+};
+
+struct ExecutionOptions {
+    size_t group_by_memory_budget;
+    GroupByStrategy group_by_strategy;
+    size_t output_buffer_size;
+    bool direct_io;
+    OperatorSelection operators;
+    bool fused;
+    size_t threads;
+    size_t join_buffer_rows;
+    bool columnar;
+};
+
+/**
+ * Counters of a merge join, summed over all key ranges of a parallel join.
+ *   buffer_max_size_reached : the largest number of S rows buffered for one key.
+ *   spilled_key_groups      : keys with more than join_buffer_rows S rows (R or S rows in the fused scan),
+ *                             re-scanned from the mapped file instead of buffered.
+ *   spilled_rows            : S rows of those keys.
+ */
+struct JoinStatistics {
+    size_t buffer_max_size_reached = 0;
+    size_t spilled_key_groups = 0;
+    size_t spilled_rows = 0;
+};
+
+constexpr const char* JOIN_FILE_NAME = "RjoinS.tsv";
+constexpr const char* UNION_FILE_NAME = "RunionS.tsv";
+constexpr const char* INTERSECTION_FILE_NAME = "RintersectionS.tsv";
+constexpr const char* DIFFERENCE_FILE_NAME = "RdifferenceS.tsv";
+constexpr const char* GROUP_BY_FILE_NAME = "Rgroupby.tsv";
+
+// Appended to a TSV file name to get the name of its columnar copy.
+constexpr const char* COLUMNAR_SUFFIX = ".col";
+
+/**
+ * A row of a columnar relation kept after its cursor moved on (the key is a view into the mapping).
+ */
+struct ColumnarRow {
+    std::string_view key;
+    int32_t value = 0;
+    bool present = false;
+};
+
+constexpr size_t DEFAULT_GROUP_BY_MEMORY_BUDGET_MIB = 256;
+constexpr size_t DEFAULT_OUTPUT_BUFFER_KIB = 1024;
+
+// Parallel merge join: key ranges per thread. More ranges than threads let threads that finish early
+// pick up more work when some key ranges are more expensive (skewed) than others.
+constexpr size_t JOIN_PARTITIONS_PER_THREAD = 4;
+
+// Merge join: S rows of one key buffered in memory (as 16-byte views) before the key group is spilled.
+constexpr size_t DEFAULT_JOIN_BUFFER_ROWS = 1 << 20;
+
+// Hash group-by: partitions created when the table is full, and how many times a partition may be
+// re-partitioned (with a new hash seed) before it falls back to the sort-based group-by.
+constexpr size_t GROUP_BY_PARTITIONS = 16;
+constexpr int MAX_PARTITIONING_DEPTH = 4;
+
+// Planner for --group-by=auto: rows sampled from the head of R, and the distinct keys / sampled rows
+// ratio up to which hash aggregation is chosen.
+constexpr size_t PLANNER_SAMPLE_ROWS = 100000;
+constexpr double PLANNER_MAX_DISTINCT_RATIO = 0.5;
+
+// Maximum number of sorted runs merged at once. Larger run counts are merged in several passes,
+// so the number of open files stays bounded no matter how big R is.
+constexpr size_t MAX_MERGE_FAN_IN = 64;
+
+/**
+ * Options of the bench mode.
+ *   --r-rows, --s-rows : rows of the generated R and S.
+ *   --keys             : distinct keys the rows are drawn from.
+ *   --skew             : Zipf exponent of the key distribution (0 = uniform).
+ *   --seed             : seed of the generator, the same seed gives the same inputs.
+ *   --threads          : threads of the parallel merge join variant.
+ *   --memory-budget    : group-by memory budget in MiB.
+ *   --directory        : where inputs and outputs are written.
+ *   --json             : file receiving the JSON report (standard output if not given).
+ */
+struct BenchmarkOptions {
+    size_t r_rows = 1000000;
+    size_t s_rows = 1000000;
+    size_t keys = 100000;
+    double skew = 0;
+    uint64_t seed = 42;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t memory_budget_mib = DEFAULT_GROUP_BY_MEMORY_BUDGET_MIB;
+    std::string directory = "relational-bench";
+    std::string json_file;
+};
+
 
-void merge_join(const std::string& r_file_name , const std::string& s_file_name, const std::string& join_file_name);
-void union_(const std::string& r_file_name , const std::string& s_file_name, const std::string& union_file_name);
-void intersection(const std::string& r_file_name , const std::string& s_file_name, const std::string& intersection_file_name);
-void R_difference_S(const std::string& r_file_name , const std::string& s_file_name, const std::string& difference_file_name);
-void groupBy_with_aggregation(const std::string& r_file_name , const std::string& groupBy_with_sum_file);
-std::vector<Record> merge_sort(std::vector<Record>::const_iterator begin, std::vector<Record>::const_iterator end);
-std::vector<Record> merge_with_aggregation(const std::vector<Record>& left, const std::vector<Record>& right);
+void merge_join(const std::string& r_file_name , const std::string& s_file_name, const std::string& join_file_name, const ExecutionOptions& options);
+JoinStatistics merge_join_range(RecordCursor& r, RecordCursor& s, OutputSink& out, size_t buffer_limit);
+void join_key_group(std::string_view key, RecordCursor& r, RecordCursor& s, size_t buffer_limit, std::vector<std::string_view>& buffer_s, OutputSink& out, JoinStatistics& statistics);
+void print_join_statistics(const JoinStatistics& statistics);
+JoinStatistics parallel_merge_join(std::string_view r_sorted, std::string_view s_sorted, const std::string& join_file_name, OutputSink& out, const ExecutionOptions& options);
+size_t next_line_start(std::string_view buffer, size_t offset);
+size_t key_range_start(std::string_view buffer, std::string_view key);
+void union_(const std::string& r_file_name , const std::string& s_file_name, const std::string& union_file_name, const ExecutionOptions& options);
+void intersection(const std::string& r_file_name , const std::string& s_file_name, const std::string& intersection_file_name, const ExecutionOptions& options);
+void R_difference_S(const std::string& r_file_name , const std::string& s_file_name, const std::string& difference_file_name, const ExecutionOptions& options);
+void fused_merge_operators(const std::string& r_file_name , const std::string& s_file_name, const ExecutionOptions& options);
+void groupBy_with_aggregation(const std::string& r_file_name , const std::string& groupBy_with_sum_file, const ExecutionOptions& options);
+int ingest_columnar(const std::string& tsv_file_name, const std::string& columnar_file_name);
+std::string find_columnar_copy(const std::string& tsv_file_name, const ExecutionOptions& options);
+int compare_lines(const ColumnarCursor& a, const ColumnarCursor& b);
+void write_distinct_row(OutputSink& out, const ColumnarCursor& row, ColumnarRow& last_written_row);
+void columnar_merge_join(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& join_file_name, const ExecutionOptions& options);
+void columnar_union(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& union_file_name, const ExecutionOptions& options);
+void columnar_intersection(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& intersection_file_name, const ExecutionOptions& options);
+void columnar_R_difference_S(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& difference_file_name, const ExecutionOptions& options);
+void columnar_groupBy(const ColumnarRelation& r_relation, const std::string& groupBy_with_sum_file, const ExecutionOptions& options);
+GroupByStrategy choose_group_by_strategy(const std::string& r_file_name);
+size_t sort_groupBy(RecordCursor& r, std::ostream& out, const std::string& run_file_prefix, size_t memory_budget);
+size_t hash_groupBy(RecordCursor& r, std::ostream& out, const std::string& run_file_prefix, size_t memory_budget);
+void hash_aggregate_partition(RecordCursor& partition, std::ostream* out, const std::string& run_file_prefix, int depth, size_t memory_budget, std::vector<std::string>& run_files, size_t& spilled_partitions);
+bool parse_value(std::string_view payload, int& value);
+void print_output_statistics(const OutputSink& sink);
+size_t key_heap_footprint(const Record& record);
+void sort_run_with_aggregation(std::vector<Record>& run);
+void write_records(const std::vector<Record>& records, std::ostream& out);
+void close_run_file(std::ofstream& run_file, const std::string& run_file_name);
+void merge_runs_with_aggregation(const std::vector<std::string>& run_files, std::ostream& out);
+std::vector<std::string> reduce_runs_to_fan_in(std::vector<std::string> run_files, const std::string& run_file_prefix);
+ExecutionOptions parse_execution_options(int argc, char *argv[], int first_option);
+void run_operators(const std::string& r_sorted, const std::string& s_sorted, const std::string& r, const ExecutionOptions& options);
+int run_benchmark(int argc, char *argv[]);
+void generate_relation(const std::string& unsorted_file_name, const std::string& sorted_file_name, size_t rows, const BenchmarkOptions& bench, uint64_t seed);
 
 
 
 int main(int argc, char *argv[]) {
-    if(argc != 4) {
+    if(argc >= 2 && std::string(argv[1]) == "ingest") {
+        if(argc < 3 || argc > 4) {
+            std::cerr << "Usage: ./a.out ingest <file.tsv> [<file.tsv" << COLUMNAR_SUFFIX << ">]" << std::endl;
+            return 1;
+        }
+        return ingest_columnar(argv[2], argc == 4 ? argv[3] : std::string(argv[2]) + COLUMNAR_SUFFIX);
+    }
+
+    if(argc >= 2 && std::string(argv[1]) == "bench")
+        return run_benchmark(argc, argv);
+
+    if(argc < 4) {
         std::cerr << "Error: Three TSV file paths must be provided as input.\n";
-        std::cerr << "Usage: ./a.out <R_sorted_path> <S_sorted_path> <R_path>" << std::endl;
+        std::cerr << "Usage: ./a.out <R_sorted_path> <S_sorted_path> <R_path> [--memory-budget=<MiB>] [--group-by=sort|hash|auto] [--output-buffer=<KiB>] [--direct-io] [--operators=<list>] [--fused] [--threads=<N>] [--join-buffer-rows=<N>] [--columnar=auto|off]" << std::endl;
+        std::cerr << "       ./a.out ingest <file.tsv> [<file.tsv" << COLUMNAR_SUFFIX << ">]" << std::endl;
+        std::cerr << "       ./a.out bench [--r-rows=<N>] [--s-rows=<N>] [--keys=<N>] [--skew=<Zipf exponent>] [--seed=<N>] [--threads=<N>] [--memory-budget=<MiB>] [--directory=<path>] [--json=<file>]" << std::endl;
         return 1;
     }
 
     const std::string r_sorted = argv[1];
     const std::string s_sorted = argv[2];
     const std::string r = argv[3];
+    const ExecutionOptions options = parse_execution_options(argc, argv, 4);
 
-    merge_join(r_sorted, s_sorted, "RjoinS.tsv");
-    union_(r_sorted, s_sorted, "RunionS.tsv");
-    intersection(r_sorted, s_sorted, "RintersectionS.tsv");
-    R_difference_S(r_sorted, s_sorted, "RdifferenceS.tsv");
-    groupBy_with_aggregation(r, "Rgroupby.tsv");
-
+    run_operators(r_sorted, s_sorted, r, options);
     return 0;
 }
 
+/**
+ * Runs every operator selected in options, writing their outputs into the working directory.
+ * @param r_sorted Path to the sorted R file
+ * @param s_sorted Path to the sorted S file
+ * @param r Path to the unsorted R file (group-by input)
+ * @param options Selected operators and how to run them
+ */
+void run_operators(const std::string& r_sorted, const std::string& s_sorted, const std::string& r, const ExecutionOptions& options) {
+    const OperatorSelection& operators = options.operators;
+
+    if(options.fused) {
+        if(operators.join || operators.union_ || operators.intersection || operators.difference)
+            fused_merge_operators(r_sorted, s_sorted, options);
+    }else {
+        //The columnar operators run when both inputs have a columnar copy (the parallel join reads TSV).
+        const bool merge_operators = operators.join || operators.union_ || operators.intersection || operators.difference;
+        const std::string r_columnar = options.threads > 1 || !merge_operators ? "" : find_columnar_copy(r_sorted, options);
+        const std::string s_columnar = r_columnar.empty() ? "" : find_columnar_copy(s_sorted, options);
+        const ColumnarRelation r_relation(r_columnar), s_relation(s_columnar);
+
+        if(r_relation.is_open() && s_relation.is_open()) {
+            std::cout << "Reading columnar " << r_columnar << " and " << s_columnar << std::endl;
+            if(operators.join) columnar_merge_join(r_relation, s_relation, JOIN_FILE_NAME, options);
+            if(operators.union_) columnar_union(r_relation, s_relation, UNION_FILE_NAME, options);
+            if(operators.intersection) columnar_intersection(r_relation, s_relation, INTERSECTION_FILE_NAME, options);
+            if(operators.difference) columnar_R_difference_S(r_relation, s_relation, DIFFERENCE_FILE_NAME, options);
+        }else {
+            if(operators.join) merge_join(r_sorted, s_sorted, JOIN_FILE_NAME, options);
+            if(operators.union_) union_(r_sorted, s_sorted, UNION_FILE_NAME, options);
+            if(operators.intersection) intersection(r_sorted, s_sorted, INTERSECTION_FILE_NAME, options);
+            if(operators.difference) R_difference_S(r_sorted, s_sorted, DIFFERENCE_FILE_NAME, options);
+        }
+    }
+
+    if(operators.group_by) {
+        const std::string r_columnar = find_columnar_copy(r, options);
+        const ColumnarRelation r_relation(r_columnar);
+        if(r_relation.is_open()) {
+            std::cout << "Reading columnar " << r_columnar << std::endl;
+            columnar_groupBy(r_relation, GROUP_BY_FILE_NAME, options);
+        }else {
+            groupBy_with_aggregation(r, GROUP_BY_FILE_NAME, options);
+        }
+    }
+}
+
+/**
+ * Parses the optional "--name=value" arguments that follow the positional file arguments.
+ * Exits with an error message on an unknown option or a malformed value.
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @return The parsed options, with defaults for everything not given
+ */
+ExecutionOptions parse_execution_options(const int argc, char *argv[], const int first_option) {
+    ExecutionOptions options{DEFAULT_GROUP_BY_MEMORY_BUDGET_MIB * 1024 * 1024, GroupByStrategy::Auto,
+                             DEFAULT_OUTPUT_BUFFER_KIB * 1024, false, OperatorSelection{}, false, 1, DEFAULT_JOIN_BUFFER_ROWS, true};
+
+    for(int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if(name == "--memory-budget") {
+                const size_t mib = std::stoull(value);
+                if(mib == 0) throw std::invalid_argument(value);
+                options.group_by_memory_budget = mib * 1024 * 1024;
+                continue;
+            }
+            if(name == "--group-by") {
+                if(value == "sort") options.group_by_strategy = GroupByStrategy::Sort;
+                else if(value == "hash") options.group_by_strategy = GroupByStrategy::Hash;
+                else if(value == "auto") options.group_by_strategy = GroupByStrategy::Auto;
+                else throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--output-buffer") {
+                const size_t kib = std::stoull(value);
+                if(kib == 0) throw std::invalid_argument(value);
+                options.output_buffer_size = kib * 1024;
+                continue;
+            }
+            if(name == "--direct-io") {
+                if(!value.empty()) throw std::invalid_argument(value);
+                options.direct_io = true;
+                continue;
+            }
+            if(name == "--operators") {
+                options.operators = OperatorSelection{false, false, false, false, false};
+                size_t begin = 0;
+                while(begin <= value.size()) {
+                    const size_t end = std::min(value.find(',', begin), value.size());
+                    const std::string operator_name = value.substr(begin, end - begin);
+                    if(operator_name == "join") options.operators.join = true;
+                    else if(operator_name == "union") options.operators.union_ = true;
+                    else if(operator_name == "intersection") options.operators.intersection = true;
+                    else if(operator_name == "difference") options.operators.difference = true;
+                    else if(operator_name == "group-by") options.operators.group_by = true;
+                    else throw std::invalid_argument(value);
+                    begin = end + 1;
+                }
+                continue;
+            }
+            if(name == "--threads") {
+                const size_t threads = std::stoull(value);
+                if(threads == 0) throw std::invalid_argument(value);
+                options.threads = threads;
+                continue;
+            }
+            if(name == "--join-buffer-rows") {
+                const size_t rows = std::stoull(value);
+                if(rows == 0) throw std::invalid_argument(value);
+                options.join_buffer_rows = rows;
+                continue;
+            }
+            if(name == "--columnar") {
+                if(value == "auto") options.columnar = true;
+                else if(value == "off") options.columnar = false;
+                else throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--fused") {
+                if(!value.empty()) throw std::invalid_argument(value);
+                options.fused = true;
+                continue;
+            }
+        }catch(const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
 
 
 
 /**
  * Performs a merge join operation between two sorted TSV files on their first column (key).
  * Creates all possible combinations of rows when multiple rows share the same key.
+ * Both files are memory-mapped. Keys and buffered S rows are views into the mappings, so no row is copied.
+ * With options.threads > 1 the join is range-partitioned and the ranges are joined in parallel (parallel_merge_join).
  * @param r_file_name Path to the first sorted TSV file (R)
  * @param s_file_name Path to the second sorted TSV file (S)
  * @param join_file_name Path where the join result will be saved
+ * @param options Thread count, S buffer limit, output buffer size and direct I/O
  */
-void merge_join(const std::string& r_file_name , const std::string& s_file_name, const std::string& join_file_name) {
-    std::ifstream r_sorted(r_file_name);
-    std::ifstream s_sorted(s_file_name);
-    std::ofstream r_join_s(join_file_name);
+void merge_join(const std::string& r_file_name , const std::string& s_file_name, const std::string& join_file_name, const ExecutionOptions& options) {
+    const MappedFile r_sorted(r_file_name);
+    const MappedFile s_sorted(s_file_name);
+    OutputSink r_join_s(join_file_name, options.output_buffer_size, options.direct_io);
 
     if(!r_sorted.is_open() || !s_sorted.is_open() || !r_join_s.is_open()) {
         std::cerr << "Failed to open one or more files!" << std::endl;
         return;
     }
 
-    std::string r_line, s_line;
-    std::string r_key, s_key;
-
-    std::vector<std::string> buffer_s;
-    size_t buffer_max_size_reached = 0;
+    JoinStatistics statistics;
+    if(options.threads > 1) {
+        statistics = parallel_merge_join(r_sorted.contents(), s_sorted.contents(), join_file_name, r_join_s, options);
+    }else {
+        RecordCursor r(r_sorted.contents());
+        RecordCursor s(s_sorted.contents());
+        statistics = merge_join_range(r, s, r_join_s, options.join_buffer_rows);
+    }
 
+    r_join_s.close();
+    std::cout << "Merge Join Completed." << std::endl;
+    print_join_statistics(statistics);
+    print_output_statistics(r_join_s);
+    std::cout << "--------" << std::endl;
+}
 
-    //Read first records
-    bool r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-    bool s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+/**
+ * Merge joins the records of two cursors into out.
+ * @param r Cursor over sorted R records
+ * @param s Cursor over sorted S records
+ * @param out Receives the joined tuples
+ * @param buffer_limit S rows of one key that may be buffered before the key group is spilled
+ * @return Buffer and spill counters
+ */
+JoinStatistics merge_join_range(RecordCursor& r, RecordCursor& s, OutputSink& out, const size_t buffer_limit) {
+    std::vector<std::string_view> buffer_s;
+    JoinStatistics statistics;
 
 
     //while r_file and s_file not empty
-    while(r_read_success && s_read_success) {
-        r_key = r_line.substr(0, r_line.find('\t'));
-        s_key = s_line.substr(0, s_line.find('\t'));
+    while(r.valid() && s.valid()) {
+        if(r.key() == s.key()) {
+            join_key_group(r.key(), r, s, buffer_limit, buffer_s, out, statistics);
+        }else if(r.key() < s.key()){
+            //advance r pointer.
+            r.advance();
+        }
+        else {
+            //advance s pointer.
+            s.advance();
+        }
+    }
 
-        std::string temp;
+    return statistics;
+}
 
-        if(r_key == s_key) {
-            do {
-                //save s columns to buffer (expect the key for memory efficiency , we already have it saved)
-                buffer_s.push_back(s_line.substr(s_line.find('\t') + 1));
+/**
+ * Joins every R row of one key with every S row of that key, and moves both cursors past the key.
+ * The S rows are buffered (as views into the mapping) while there are at most buffer_limit of them.
+ * A larger key group is spilled: the buffer is dropped and the group, which is contiguous in the mapped S file,
+ * is re-scanned for every matching R row. Memory then stays bounded, and the kernel may evict the re-scanned pages.
+ * @param key The key, both cursors must be positioned on its first row
+ * @param r Cursor over sorted R records
+ * @param s Cursor over sorted S records
+ * @param buffer_limit S rows that may be buffered
+ * @param buffer_s Empty buffer, reused across calls to avoid reallocating
+ * @param out Receives the joined tuples
+ * @param statistics Buffer and spill counters to update
+ */
+void join_key_group(const std::string_view key, RecordCursor& r, RecordCursor& s, const size_t buffer_limit,
+                    std::vector<std::string_view>& buffer_s, OutputSink& out, JoinStatistics& statistics) {
+    const size_t s_group_begin = s.offset();
+    size_t s_group_rows = 0;
+
+    do {
+        //save s columns to buffer (expect the key, we already have it), unless the buffer is full.
+        if(buffer_s.size() < buffer_limit) buffer_s.push_back(s.payload());
+        s_group_rows++;
+        //advance s pointer.
+        s.advance();
+    }//if next s record exists and s_key match again with r_key repeat.
+    while(s.valid() && s.key() == key);
+
+    //Keeping record of buffer max size.
+    statistics.buffer_max_size_reached = std::max(statistics.buffer_max_size_reached, buffer_s.size());
+
+    const bool spilled = s_group_rows > buffer_s.size();
+    const std::string_view s_group = s.buffer_contents().substr(s_group_begin, s.offset() - s_group_begin);
+    if(spilled) {
+        statistics.spilled_key_groups++;
+        statistics.spilled_rows += s_group_rows;
+        buffer_s.clear();
+    }
 
-                //advance s pointer.
-                s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
-                if(s_read_success)
-                    s_key = s_line.substr(0, s_line.find('\t'));
 
-            }//if next s record exists and s_key match again with r_key repeat.
-            while(s_read_success && s_key == r_key);
+    do {
+        if(!spilled) {
+            for(const auto &s_columns: buffer_s) {
+                out.append_all(key, "\t", r.payload(), "\t", s_columns, "\n");
+            }
+        }else {
+            for(RecordCursor s_row(s_group); s_row.valid(); s_row.advance()) {
+                out.append_all(key, "\t", r.payload(), "\t", s_row.payload(), "\n");
+            }
+        }
+    }// For each row in R that has again the same key, generate all possible combinations with the buffered rows from S
+    while(r.advance() && r.key() == key);
 
+    //Clearing the buffer after each use.
+    buffer_s.clear();
+}
 
-            temp = r_key;
-            do {
-                std::string r_column = r_line.substr(r_line.find('\t') + 1);
-                for(const auto &s_columns: buffer_s) {
-                    r_join_s << temp << "\t"
-                            << r_column << "\t"
-                            << s_columns
-                            << std::endl;
-                }
+/**
+ * Prints the buffer and spill counters of a merge join.
+ * @param statistics The counters
+ */
+void print_join_statistics(const JoinStatistics& statistics) {
+    std::cout << "Buffer max size reached: " << statistics.buffer_max_size_reached << std::endl;
+    std::cout << "Key groups spilled: " << statistics.spilled_key_groups
+              << " (" << statistics.spilled_rows << " S rows)" << std::endl;
+}
 
-                r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-                if(r_read_success)
-                    temp = r_line.substr(0, r_line.find('\t'));
-                else
-                    break;
-            }// For each row in R that has again the same key, generate all possible combinations with the buffered rows from S
-            while(temp == r_key);
+/**
+ * Range-partitioned merge join:
+ *   1. Boundary keys are sampled from R and S at evenly spaced byte offsets.
+ *   2. Both files are split at the first line of every boundary key, so all rows of a key land in the same
+ *      partition and duplicate-key buffering works as in the serial join.
+ *   3. The partitions are joined independently on a thread pool, each into its own temporary file.
+ *   4. The temporary files are appended to out in key order.
+ * @param r_sorted Contents of the sorted R file
+ * @param s_sorted Contents of the sorted S file
+ * @param join_file_name Path of the join result, used as prefix of the temporary files
+ * @param out Receives the joined tuples
+ * @param options Thread count, S buffer limit, output buffer size and direct I/O
+ * @return Buffer and spill counters, summed over all partitions
+ */
+JoinStatistics parallel_merge_join(const std::string_view r_sorted, const std::string_view s_sorted, const std::string& join_file_name, OutputSink& out, const ExecutionOptions& options) {
+    const size_t samples_per_file = options.threads * JOIN_PARTITIONS_PER_THREAD;
+
+    //Keys of the lines at evenly spaced offsets of both files, the boundaries are every other of them.
+    std::vector<std::string_view> sampled_keys;
+    for(const std::string_view file: {r_sorted, s_sorted}) {
+        for(size_t i = 1; i < samples_per_file; i++) {
+            const size_t line_start = next_line_start(file, file.size() / samples_per_file * i);
+            if(line_start < file.size())
+                sampled_keys.push_back(RecordCursor(file.substr(line_start)).key());
+        }
+    }
+    std::sort(sampled_keys.begin(), sampled_keys.end());
 
+    std::vector<std::string_view> boundaries;
+    for(size_t i = 1; i < sampled_keys.size(); i += 2)
+        if(boundaries.empty() || boundaries.back() != sampled_keys[i]) boundaries.push_back(sampled_keys[i]);
 
-            //Keeping record of buffer max size. Clearing the buffer also after each use.
-            buffer_max_size_reached = std::max(buffer_max_size_reached, buffer_s.size());
-            buffer_s.clear();
-        }else if(r_key < s_key){
-            //advance r pointer.
-            r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
+    //Partition p covers [offsets[p], offsets[p + 1]) of each file.
+    std::vector<size_t> r_offsets = {0}, s_offsets = {0};
+    for(const auto& boundary: boundaries) {
+        r_offsets.push_back(key_range_start(r_sorted, boundary));
+        s_offsets.push_back(key_range_start(s_sorted, boundary));
+    }
+    r_offsets.push_back(r_sorted.size());
+    s_offsets.push_back(s_sorted.size());
+
+    const size_t partitions = boundaries.size() + 1;
+    std::vector<std::string> partition_file_names(partitions);
+    std::vector<JoinStatistics> partition_statistics(partitions);
+    {
+        ThreadPool pool(options.threads);
+        for(size_t p = 0; p < partitions; p++) {
+            partition_file_names[p] = join_file_name + ".part" + std::to_string(p);
+            pool.submit([&, p] {
+                OutputSink partition_out(partition_file_names[p], options.output_buffer_size, false);
+                if(!partition_out.is_open()) {
+                    std::cerr << "Failed to open partition file " << partition_file_names[p] << std::endl;
+                    exit(-1);
+                }
+
+                RecordCursor r(r_sorted.substr(r_offsets[p], r_offsets[p + 1] - r_offsets[p]));
+                RecordCursor s(s_sorted.substr(s_offsets[p], s_offsets[p + 1] - s_offsets[p]));
+                partition_statistics[p] = merge_join_range(r, s, partition_out, options.join_buffer_rows);
+            });
         }
-        else {
-            //advance s pointer.
-            s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+        pool.wait();
+    }
+
+    for(const auto& partition_file_name: partition_file_names) {
+        {
+            const MappedFile partition(partition_file_name);
+            out.append(partition.contents());
         }
+        std::filesystem::remove(partition_file_name);
     }
 
-    std::cout << "Merge Join Completed." << std::endl;
-    std::cout << "Buffer max size reached: " << buffer_max_size_reached << std::endl;
-    std::cout << "--------" << std::endl;
+    std::cout << "Join partitions: " << partitions << " on " << options.threads << " threads" << std::endl;
+    JoinStatistics statistics;
+    for(const auto& partition: partition_statistics) {
+        statistics.buffer_max_size_reached = std::max(statistics.buffer_max_size_reached, partition.buffer_max_size_reached);
+        statistics.spilled_key_groups += partition.spilled_key_groups;
+        statistics.spilled_rows += partition.spilled_rows;
+    }
+    return statistics;
+}
+
+/**
+ * @param buffer Contents of a TSV file
+ * @param offset Any byte offset into buffer
+ * @return Offset of the first line that starts at or after offset (buffer.size() if there is none)
+ */
+size_t next_line_start(const std::string_view buffer, const size_t offset) {
+    if(offset == 0) return 0;
+    const size_t newline = buffer.find('\n', offset - 1);
+    return newline == std::string_view::npos ? buffer.size() : newline + 1;
+}
+
+/**
+ * Binary search over the lines of a key-sorted TSV buffer.
+ * @param buffer Contents of a TSV file sorted by key
+ * @param key The key to look for
+ * @return Offset of the first line whose key is not less than key (buffer.size() if there is none)
+ */
+size_t key_range_start(const std::string_view buffer, const std::string_view key) {
+    size_t low = 0, high = buffer.size();
+    while(low < high) {
+        //Start of the line containing the middle byte (low is always a line start).
+        const size_t middle = low + (high - low) / 2;
+        const size_t newline = buffer.rfind('\n', middle == 0 ? 0 : middle - 1);
+        const size_t line_start = newline == std::string_view::npos || newline < low ? low : newline + 1;
+
+        const RecordCursor line(buffer.substr(line_start));
+        if(line.key() < key)
+            low = line_start + line.line().size() + 1;
+        else
+            high = line_start;
+    }
+    return std::min(low, buffer.size());
 }
 
 /**
@@ -159,11 +645,12 @@ void merge_join(const std::string& r_file_name , const std::string& s_file_name,
  * @param r_file_name Path to the first sorted TSV file (R)
  * @param s_file_name Path to the second sorted TSV file (S)
  * @param union_file_name Path where the union result will be saved
+ * @param options Output buffer size and direct I/O
  */
-void union_(const std::string& r_file_name , const std::string& s_file_name, const std::string& union_file_name) {
-    std::ifstream r_sorted(r_file_name);
-    std::ifstream s_sorted(s_file_name);
-    std::ofstream r_union_s(union_file_name);
+void union_(const std::string& r_file_name , const std::string& s_file_name, const std::string& union_file_name, const ExecutionOptions& options) {
+    const MappedFile r_sorted(r_file_name);
+    const MappedFile s_sorted(s_file_name);
+    OutputSink r_union_s(union_file_name, options.output_buffer_size, options.direct_io);
 
 
     if(!r_sorted.is_open() || !s_sorted.is_open() || !r_union_s.is_open()) {
@@ -171,54 +658,54 @@ void union_(const std::string& r_file_name , const std::string& s_file_name, con
         return;
     }
 
-    std::string r_line, s_line;
-    std::string last_written_record;
-
-    bool r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-    bool s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+    RecordCursor r(r_sorted.contents());
+    RecordCursor s(s_sorted.contents());
+    std::string_view last_written_record;
 
 
     //while r_file has records still or s_file has records still
-    while(r_read_success || s_read_success) {
-        std::string record_to_write;
+    while(r.valid() || s.valid()) {
+        std::string_view record_to_write;
 
         //if both files have records
-        if(r_read_success && s_read_success) {
+        if(r.valid() && s.valid()) {
 
-            if(r_line < s_line) {
+            if(r.line() < s.line()) {
                 //add r record and advance r.
-                record_to_write = r_line;
-                r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-            }else if(r_line > s_line) {
+                record_to_write = r.line();
+                r.advance();
+            }else if(r.line() > s.line()) {
                 //add s record and advance s.
-                record_to_write = s_line;
-                s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+                record_to_write = s.line();
+                s.advance();
             }else {
                 //add r record (it's the same with s) and advance both.
-                record_to_write = r_line;
-                r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-                s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+                record_to_write = r.line();
+                r.advance();
+                s.advance();
             }
 
         }
-        else if(r_read_success) {
+        else if(r.valid()) {
             //s is finished at this point, so we add all the r records left.
-            record_to_write = r_line;
-            r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
+            record_to_write = r.line();
+            r.advance();
         }
         else {
             //r is finished at this point, so we add all the s records left.
-            record_to_write = s_line;
-            s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+            record_to_write = s.line();
+            s.advance();
         }
 
         // Ensure no duplicate records are added. Duplicate records appear consecutively, so comparing with the last written record is enough.
         if(record_to_write != last_written_record) {
-            r_union_s << record_to_write << std::endl;
+            r_union_s.append_all(record_to_write, "\n");
             last_written_record = record_to_write;
         }
     }
+    r_union_s.close();
     std::cout << "Union Completed." << std::endl;
+    print_output_statistics(r_union_s);
     std::cout << "--------" << std::endl;
 }
 
@@ -228,11 +715,12 @@ void union_(const std::string& r_file_name , const std::string& s_file_name, con
  * @param r_file_name Path to the first sorted TSV file (R)
  * @param s_file_name Path to the second sorted TSV file (S)
  * @param intersection_file_name Path where the intersection result will be saved
+ * @param options Output buffer size and direct I/O
  */
-void intersection(const std::string& r_file_name , const std::string& s_file_name, const std::string& intersection_file_name) {
-    std::ifstream r_sorted(r_file_name);
-    std::ifstream s_sorted(s_file_name);
-    std::ofstream r_intersection_s(intersection_file_name);
+void intersection(const std::string& r_file_name , const std::string& s_file_name, const std::string& intersection_file_name, const ExecutionOptions& options) {
+    const MappedFile r_sorted(r_file_name);
+    const MappedFile s_sorted(s_file_name);
+    OutputSink r_intersection_s(intersection_file_name, options.output_buffer_size, options.direct_io);
 
     if(!r_sorted.is_open() || !s_sorted.is_open() || !r_intersection_s.is_open()) {
         std::cerr << "Failed to open one or more files!" << std::endl;
@@ -240,37 +728,37 @@ void intersection(const std::string& r_file_name , const std::string& s_file_nam
     }
 
 
-    std::string r_line, s_line;
-    std::string last_written_record;
-
-    bool r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-    bool s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+    RecordCursor r(r_sorted.contents());
+    RecordCursor s(s_sorted.contents());
+    std::string_view last_written_record;
 
 
     //while r not empty and s not empty
-    while(r_read_success && s_read_success) {
+    while(r.valid() && s.valid()) {
 
-        if(r_line < s_line) {
+        if(r.line() < s.line()) {
             //Not a common record. Advance r
-            r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-        }else if(r_line > s_line) {
+            r.advance();
+        }else if(r.line() > s.line()) {
             //not a common record. advance s
-            s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+            s.advance();
         }else {
             // Ensure no duplicate records are added.
             // Duplicate records appear consecutively, so comparing with the last written record is enough.
-            if(r_line != last_written_record) {
-                r_intersection_s << r_line << std::endl;
-                last_written_record = r_line;
+            if(r.line() != last_written_record) {
+                r_intersection_s.append_all(r.line(), "\n");
+                last_written_record = r.line();
             }
 
             //after adding the common record, advance both.
-            r_read_success = static_cast<bool>(std::getline(r_sorted, r_line));
-            s_read_success = static_cast<bool>(std::getline(s_sorted, s_line));
+            r.advance();
+            s.advance();
         }
     }
 
+    r_intersection_s.close();
     std::cout << "Intersection Completed." << std::endl;
+    print_output_statistics(r_intersection_s);
     std::cout << "--------" << std::endl;
 }
 
@@ -280,58 +768,789 @@ void intersection(const std::string& r_file_name , const std::string& s_file_nam
  * @param r_file_name Path to the first sorted TSV file (R)
  * @param s_file_name Path to the second sorted TSV file (S)
  * @param difference_file_name Path where the difference result will be saved
+ * @param options Output buffer size and direct I/O
  */
-void R_difference_S(const std::string& r_file_name , const std::string& s_file_name, const std::string& difference_file_name) {
-    std::ifstream r_sorted(r_file_name);
-    std::ifstream s_sorted(s_file_name);
-    std::ofstream r_difference_s(difference_file_name);
+void R_difference_S(const std::string& r_file_name , const std::string& s_file_name, const std::string& difference_file_name, const ExecutionOptions& options) {
+    const MappedFile r_sorted(r_file_name);
+    const MappedFile s_sorted(s_file_name);
+    OutputSink r_difference_s(difference_file_name, options.output_buffer_size, options.direct_io);
 
     if(!r_sorted.is_open() || !s_sorted.is_open() || !r_difference_s.is_open()) {
         std::cerr << "Failed to open one or more files!" << std::endl;
         return;
     }
 
-    std::string r_line, s_line;
-    std::string last_written_record;
-
-    bool r_read_succeed = static_cast<bool>(std::getline(r_sorted, r_line));
-    bool s_read_succeed = static_cast<bool>(std::getline(s_sorted, s_line));
+    RecordCursor r(r_sorted.contents());
+    RecordCursor s(s_sorted.contents());
+    std::string_view last_written_record;
 
     //while r is not empty
-    while(r_read_succeed) {
+    while(r.valid()) {
         //if s is empty or s record != r record
-        if(!s_read_succeed || r_line < s_line) {
+        if(!s.valid() || r.line() < s.line()) {
             // Add r record.
             // Ensure no duplicate records are added.
             // Duplicate records appear consecutively, so comparing with the last written record is enough.
-            if(r_line != last_written_record) {
-                r_difference_s << r_line << std::endl;
-                last_written_record = r_line;
+            if(r.line() != last_written_record) {
+                r_difference_s.append_all(r.line(), "\n");
+                last_written_record = r.line();
             }
             //advance r pointer.
-            r_read_succeed = static_cast<bool>(std::getline(r_sorted, r_line));
-        }else if(r_line > s_line) {
+            r.advance();
+        }else if(r.line() > s.line()) {
             //Advance s
-            s_read_succeed = static_cast<bool>(std::getline(s_sorted, s_line));
+            s.advance();
         }else {
             //Advance both.
-            r_read_succeed = static_cast<bool>(std::getline(r_sorted, r_line));
-            s_read_succeed = static_cast<bool>(std::getline(s_sorted, s_line));
+            r.advance();
+            s.advance();
+        }
+    }
+
+    r_difference_s.close();
+    std::cout << "Difference Completed." << std::endl;
+    print_output_statistics(r_difference_s);
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * Walks buffered lines with the valid/line/advance interface of RecordCursor.
+ */
+struct BufferedLines {
+    const std::vector<std::string_view>& lines;
+    size_t index = 0;
+
+    [[nodiscard]] bool valid() const { return index < lines.size(); }
+    [[nodiscard]] std::string_view line() const { return lines[index]; }
+    void advance() { index++; }
+};
+
+/**
+ * Runs every requested operator of R and S (join, union, intersection, difference) in a single scan of both files.
+ * Both cursors advance one key at a time. The R and S rows of the current key are collected as views into the
+ * mappings, joined with each other, and merged line by line for the set operators, exactly as the standalone
+ * operators would see them. Groups with more than options.join_buffer_rows rows are not buffered but re-scanned
+ * from the mappings. Since a whole line sorts like its key followed by a tab, processing the inputs key by
+ * key visits the lines in the same order as merging them line by line, so every output is identical to its
+ * standalone operator's output.
+ * @param r_file_name Path to the first sorted TSV file (R)
+ * @param s_file_name Path to the second sorted TSV file (S)
+ * @param options Requested operators, S buffer limit, output buffer size and direct I/O
+ */
+void fused_merge_operators(const std::string& r_file_name , const std::string& s_file_name, const ExecutionOptions& options) {
+    const MappedFile r_sorted(r_file_name);
+    const MappedFile s_sorted(s_file_name);
+
+    if(!r_sorted.is_open() || !s_sorted.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    //One output per requested operator, the others are never created.
+    const OperatorSelection& operators = options.operators;
+    std::optional<OutputSink> r_join_s, r_union_s, r_intersection_s, r_difference_s;
+    if(operators.join) r_join_s.emplace(JOIN_FILE_NAME, options.output_buffer_size, options.direct_io);
+    if(operators.union_) r_union_s.emplace(UNION_FILE_NAME, options.output_buffer_size, options.direct_io);
+    if(operators.intersection) r_intersection_s.emplace(INTERSECTION_FILE_NAME, options.output_buffer_size, options.direct_io);
+    if(operators.difference) r_difference_s.emplace(DIFFERENCE_FILE_NAME, options.output_buffer_size, options.direct_io);
+
+    for(const auto* sink: {&r_join_s, &r_union_s, &r_intersection_s, &r_difference_s}) {
+        if(sink->has_value() && !(*sink)->is_open()) {
+            std::cerr << "Failed to open one or more files!" << std::endl;
+            return;
+        }
+    }
+
+    RecordCursor r(r_sorted.contents());
+    RecordCursor s(s_sorted.contents());
+
+    std::vector<std::string_view> group_r, group_s;
+    std::string_view last_union_record, last_intersection_record, last_difference_record;
+    JoinStatistics join_statistics;
+    const size_t buffer_limit = options.join_buffer_rows;
+
+    // Ensure no duplicate records are added. Duplicate records appear consecutively, so comparing with the last written record is enough.
+    auto write_distinct = [](std::optional<OutputSink>& sink, std::string_view& last_written_record, const std::string_view record) {
+        if(!sink || record == last_written_record) return;
+        sink->append_all(record, "\n");
+        last_written_record = record;
+    };
+
+    //Line-by-line merge of a group, with the same decisions as union_, intersection and R_difference_S.
+    //Works on BufferedLines as well as on RecordCursors re-scanning a spilled group.
+    auto merge_group = [&](auto group_r_lines, auto group_s_lines) {
+        while(group_r_lines.valid() || group_s_lines.valid()) {
+            if(!group_s_lines.valid() || (group_r_lines.valid() && group_r_lines.line() < group_s_lines.line())) {
+                write_distinct(r_union_s, last_union_record, group_r_lines.line());
+                write_distinct(r_difference_s, last_difference_record, group_r_lines.line());
+                group_r_lines.advance();
+            }else if(!group_r_lines.valid() || group_r_lines.line() > group_s_lines.line()) {
+                write_distinct(r_union_s, last_union_record, group_s_lines.line());
+                group_s_lines.advance();
+            }else {
+                write_distinct(r_union_s, last_union_record, group_r_lines.line());
+                write_distinct(r_intersection_s, last_intersection_record, group_r_lines.line());
+                group_r_lines.advance();
+                group_s_lines.advance();
+            }
+        }
+    };
+
+    while(r.valid() || s.valid()) {
+        //The smallest key of both cursors, and all rows of R and S that have it (buffered while they fit).
+        const std::string_view key = !s.valid() || (r.valid() && r.key() < s.key()) ? r.key() : s.key();
+        const size_t r_group_begin = r.offset();
+        const size_t s_group_begin = s.offset();
+        size_t r_group_rows = 0, s_group_rows = 0;
+        for(; r.valid() && r.key() == key; r.advance(), r_group_rows++)
+            if(group_r.size() < buffer_limit) group_r.push_back(r.line());
+        for(; s.valid() && s.key() == key; s.advance(), s_group_rows++)
+            if(group_s.size() < buffer_limit) group_s.push_back(s.line());
+
+        //A group larger than the buffer is spilled: it is contiguous in the mappings, so it is re-scanned from there.
+        const bool spilled = r_group_rows > group_r.size() || s_group_rows > group_s.size();
+        const std::string_view r_group = r_sorted.contents().substr(r_group_begin, r.offset() - r_group_begin);
+        const std::string_view s_group = s_sorted.contents().substr(s_group_begin, s.offset() - s_group_begin);
+
+        if(r_join_s && r_group_rows > 0 && s_group_rows > 0) {
+            join_statistics.buffer_max_size_reached = std::max(join_statistics.buffer_max_size_reached, group_s.size());
+            if(spilled) {
+                join_statistics.spilled_key_groups++;
+                join_statistics.spilled_rows += s_group_rows;
+                for(RecordCursor r_row(r_group); r_row.valid(); r_row.advance())
+                    for(RecordCursor s_row(s_group); s_row.valid(); s_row.advance())
+                        r_join_s->append_all(key, "\t", r_row.payload(), "\t", s_row.payload(), "\n");
+            }else {
+                //Payloads start after the key and its tab, a line without a tab is its own payload (as in RecordCursor).
+                auto payload = [&key](const std::string_view line) {
+                    return line.size() > key.size() ? line.substr(key.size() + 1) : line;
+                };
+                for(const auto &r_line: group_r)
+                    for(const auto &s_line: group_s)
+                        r_join_s->append_all(key, "\t", payload(r_line), "\t", payload(s_line), "\n");
+            }
+        }
+
+        if(r_union_s || r_intersection_s || r_difference_s) {
+            if(spilled) merge_group(RecordCursor(r_group), RecordCursor(s_group));
+            else merge_group(BufferedLines{group_r}, BufferedLines{group_s});
+        }
+
+        group_r.clear();
+        group_s.clear();
+    }
+
+    std::cout << "Fused scan of R and S Completed." << std::endl;
+    if(r_join_s) {
+        r_join_s->close();
+        print_join_statistics(join_statistics);
+        std::cout << "Merge Join: ";
+        print_output_statistics(*r_join_s);
+    }
+    if(r_union_s) {
+        r_union_s->close();
+        std::cout << "Union: ";
+        print_output_statistics(*r_union_s);
+    }
+    if(r_intersection_s) {
+        r_intersection_s->close();
+        std::cout << "Intersection: ";
+        print_output_statistics(*r_intersection_s);
+    }
+    if(r_difference_s) {
+        r_difference_s->close();
+        std::cout << "Difference: ";
+        print_output_statistics(*r_difference_s);
+    }
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * Ingest mode: converts a "key<TAB>int32" TSV file into the sorted columnar layout described in ColumnarRelation.h.
+ * Rows are sorted like LC_ALL=C sort would sort the lines, keys are dictionary-encoded and every block of
+ * COLUMNAR_BLOCK_ROWS rows gets a min/max header.
+ * Only rows that the columnar operators can turn back into the exact same text are accepted: one tab, no byte
+ * below the tab in the key (so that keys sort like lines) and a value written as a plain int32.
+ * @param tsv_file_name Path to the TSV file
+ * @param columnar_file_name Path where the columnar relation will be saved
+ * @return 0 on success, 1 on error
+ */
+int ingest_columnar(const std::string& tsv_file_name, const std::string& columnar_file_name) {
+    const MappedFile tsv_file(tsv_file_name);
+    if(!tsv_file.is_open()) {
+        std::cerr << "Failed to open " << tsv_file_name << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string_view> lines;
+    size_t line_number = 0;
+    for(RecordCursor record(tsv_file.contents()); record.valid(); record.advance()) {
+        line_number++;
+        int value;
+        char canonical[16];
+        const std::string_view value_text = record.payload();
+        const bool canonical_value = parse_value(value_text, value)
+                                     && std::string_view(canonical, std::to_chars(canonical, canonical + sizeof(canonical), value).ptr - canonical) == value_text;
+        const bool sortable_key = record.key().size() < record.line().size()
+                                  && std::none_of(record.key().begin(), record.key().end(), [](const char c) { return static_cast<unsigned char>(c) <= '\t'; });
+        if(!canonical_value || !sortable_key) {
+            std::cerr << tsv_file_name << ":" << line_number << ": not a key<TAB>int32 row: " << record.line() << std::endl;
+            return 1;
+        }
+        lines.push_back(record.line());
+    }
+    std::sort(lines.begin(), lines.end());
+
+    //Dictionary of the distinct keys, in ascending order, and the two columns.
+    std::vector<uint64_t> key_offsets = {0};
+    std::string key_bytes;
+    std::vector<uint32_t> key_ids;
+    std::vector<int32_t> values;
+    key_ids.reserve(lines.size());
+    values.reserve(lines.size());
+    for(const auto& line: lines) {
+        const size_t tab = line.find('\t');
+        const std::string_view key = line.substr(0, tab);
+        if(key_offsets.size() == 1 || std::string_view(key_bytes).substr(key_offsets[key_offsets.size() - 2]) != key) {
+            key_bytes.append(key);
+            key_offsets.push_back(key_bytes.size());
+        }
+        int value;
+        parse_value(line.substr(tab + 1), value);
+        key_ids.push_back(static_cast<uint32_t>(key_offsets.size() - 2));
+        values.push_back(value);
+    }
+
+    std::vector<ColumnarBlock> blocks;
+    for(size_t first_row = 0; first_row < lines.size(); first_row += COLUMNAR_BLOCK_ROWS) {
+        const size_t end_row = std::min<size_t>(first_row + COLUMNAR_BLOCK_ROWS, lines.size());
+        const auto [min_value, max_value] = std::minmax_element(values.begin() + first_row, values.begin() + end_row);
+        blocks.push_back({first_row, static_cast<uint32_t>(end_row - first_row), key_ids[first_row], key_ids[end_row - 1], *min_value, *max_value, 0});
+    }
+
+    auto padded = [](const size_t size) { return (size + 7) / 8 * 8; };
+    ColumnarHeader header{};
+    std::memcpy(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    header.row_count = lines.size();
+    header.key_count = key_offsets.size() - 1;
+    header.block_count = blocks.size();
+    header.key_offsets_offset = sizeof(ColumnarHeader);
+    header.key_bytes_offset = header.key_offsets_offset + key_offsets.size() * sizeof(uint64_t);
+    header.key_ids_offset = header.key_bytes_offset + padded(key_bytes.size());
+    header.values_offset = header.key_ids_offset + padded(key_ids.size() * sizeof(uint32_t));
+    header.blocks_offset = header.values_offset + padded(values.size() * sizeof(int32_t));
+    header.file_size = header.blocks_offset + blocks.size() * sizeof(ColumnarBlock);
+
+    std::ofstream columnar_file(columnar_file_name, std::ios::binary);
+    if(!columnar_file.is_open()) {
+        std::cerr << "Failed to open " << columnar_file_name << std::endl;
+        return 1;
+    }
+
+    const char padding[8] = {};
+    auto write_section = [&](const void* data, const size_t size) {
+        columnar_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        columnar_file.write(padding, static_cast<std::streamsize>(padded(size) - size));
+    };
+    write_section(&header, sizeof(header));
+    write_section(key_offsets.data(), key_offsets.size() * sizeof(uint64_t));
+    write_section(key_bytes.data(), key_bytes.size());
+    write_section(key_ids.data(), key_ids.size() * sizeof(uint32_t));
+    write_section(values.data(), values.size() * sizeof(int32_t));
+    write_section(blocks.data(), blocks.size() * sizeof(ColumnarBlock));
+
+    if(!columnar_file.good()) {
+        std::cerr << "Failed to write " << columnar_file_name << std::endl;
+        return 1;
+    }
+
+    std::cout << "Ingested " << header.row_count << " rows (" << header.key_count << " distinct keys, "
+              << header.block_count << " blocks) into " << columnar_file_name << std::endl;
+    return 0;
+}
+
+/**
+ * Looks for the columnar copy of a TSV file written by the ingest mode ("<file>.col").
+ * A copy older than the TSV file is ignored, so a stale copy is never read.
+ * @param tsv_file_name Path to the TSV file
+ * @param options Whether columnar inputs may be used at all
+ * @return Path of the columnar copy, or an empty string if there is no usable one
+ */
+std::string find_columnar_copy(const std::string& tsv_file_name, const ExecutionOptions& options) {
+    if(!options.columnar) return "";
+
+    const std::string columnar_file_name = tsv_file_name + COLUMNAR_SUFFIX;
+    std::error_code error;
+    const auto columnar_time = std::filesystem::last_write_time(columnar_file_name, error);
+    if(error) return "";
+    const auto tsv_time = std::filesystem::last_write_time(tsv_file_name, error);
+    if(!error && tsv_time > columnar_time) return "";
+    return columnar_file_name;
+}
+
+/**
+ * Compares the rows under two columnar cursors the way their TSV lines compare.
+ * Keys never contain bytes below the tab (checked on ingest), so different keys compare like their lines.
+ * @return Negative, zero or positive like std::string_view::compare
+ */
+int compare_lines(const ColumnarCursor& a, const ColumnarCursor& b) {
+    if(const int key_order = a.key().compare(b.key()); key_order != 0) return key_order;
+    if(a.value() == b.value()) return 0;
+
+    char a_text[16], b_text[16];
+    const char* a_end = std::to_chars(a_text, a_text + sizeof(a_text), a.value()).ptr;
+    const char* b_end = std::to_chars(b_text, b_text + sizeof(b_text), b.value()).ptr;
+    return std::string_view(a_text, a_end - a_text).compare(std::string_view(b_text, b_end - b_text));
+}
+
+/**
+ * Writes the row under a columnar cursor as a TSV line, unless it is the same as the previous line written.
+ * Duplicate records appear consecutively, so comparing with the last written record is enough.
+ * @param out Receives the line
+ * @param row The row to write
+ * @param last_written_row The last row written to out, updated
+ */
+void write_distinct_row(OutputSink& out, const ColumnarCursor& row, ColumnarRow& last_written_row) {
+    if(last_written_row.present && last_written_row.key == row.key() && last_written_row.value == row.value()) return;
+    out.append_all(row.key(), "\t", row.value(), "\n");
+    last_written_row = {row.key(), row.value(), true};
+}
+
+/**
+ * merge_join over columnar relations.
+ * While the keys differ, the cursor behind jumps straight to the other cursor's key, skipping whole blocks.
+ * @param r_relation Columnar R
+ * @param s_relation Columnar S
+ * @param join_file_name Path where the join result will be saved
+ * @param options S buffer limit, output buffer size and direct I/O
+ */
+void columnar_merge_join(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& join_file_name, const ExecutionOptions& options) {
+    OutputSink r_join_s(join_file_name, options.output_buffer_size, options.direct_io);
+    if(!r_join_s.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    ColumnarCursor r(r_relation);
+    ColumnarCursor s(s_relation);
+    std::vector<int32_t> buffer_s;
+    JoinStatistics statistics;
+    size_t skipped_blocks = 0;
+
+    while(r.valid() && s.valid()) {
+        const int key_order = r.key().compare(s.key());
+        if(key_order == 0) {
+            const std::string_view key = r.key();
+            const uint32_t r_key_id = r.key_id(), s_key_id = s.key_id();
+            const size_t s_group_begin = s.position();
+
+            do {
+                if(buffer_s.size() < options.join_buffer_rows) buffer_s.push_back(s.value());
+            }while(s.advance() && s.key_id() == s_key_id);
+
+            const size_t s_group_rows = s.position() - s_group_begin;
+            statistics.buffer_max_size_reached = std::max(statistics.buffer_max_size_reached, buffer_s.size());
+            const bool spilled = s_group_rows > buffer_s.size();
+            if(spilled) {
+                //The group is contiguous in the value column, which is re-scanned instead of buffered.
+                statistics.spilled_key_groups++;
+                statistics.spilled_rows += s_group_rows;
+                buffer_s.clear();
+            }
+
+            do {
+                if(!spilled) {
+                    for(const int32_t s_value: buffer_s)
+                        r_join_s.append_all(key, "\t", r.value(), "\t", s_value, "\n");
+                }else {
+                    for(size_t row = s_group_begin; row < s_group_begin + s_group_rows; row++)
+                        r_join_s.append_all(key, "\t", r.value(), "\t", s_relation.value(row), "\n");
+                }
+            }while(r.advance() && r.key_id() == r_key_id);
+
+            buffer_s.clear();
+        }else if(key_order < 0) {
+            skipped_blocks += r.skip_to(s.key());
+        }else {
+            skipped_blocks += s.skip_to(r.key());
+        }
+    }
+
+    r_join_s.close();
+    std::cout << "Merge Join Completed." << std::endl;
+    print_join_statistics(statistics);
+    std::cout << "Blocks skipped: " << skipped_blocks << std::endl;
+    print_output_statistics(r_join_s);
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * union_ over columnar relations. Every row is written, so no block can be skipped.
+ * @param r_relation Columnar R
+ * @param s_relation Columnar S
+ * @param union_file_name Path where the union result will be saved
+ * @param options Output buffer size and direct I/O
+ */
+void columnar_union(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& union_file_name, const ExecutionOptions& options) {
+    OutputSink r_union_s(union_file_name, options.output_buffer_size, options.direct_io);
+    if(!r_union_s.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    ColumnarCursor r(r_relation);
+    ColumnarCursor s(s_relation);
+    ColumnarRow last_written_row;
+
+    while(r.valid() || s.valid()) {
+        const int line_order = !s.valid() ? -1 : !r.valid() ? 1 : compare_lines(r, s);
+        if(line_order <= 0) {
+            write_distinct_row(r_union_s, r, last_written_row);
+            r.advance();
+            if(line_order == 0) s.advance();
+        }else {
+            write_distinct_row(r_union_s, s, last_written_row);
+            s.advance();
         }
     }
 
+    r_union_s.close();
+    std::cout << "Union Completed." << std::endl;
+    print_output_statistics(r_union_s);
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * intersection over columnar relations. A cursor behind on the key jumps to the other cursor's key.
+ * @param r_relation Columnar R
+ * @param s_relation Columnar S
+ * @param intersection_file_name Path where the intersection result will be saved
+ * @param options Output buffer size and direct I/O
+ */
+void columnar_intersection(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& intersection_file_name, const ExecutionOptions& options) {
+    OutputSink r_intersection_s(intersection_file_name, options.output_buffer_size, options.direct_io);
+    if(!r_intersection_s.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    ColumnarCursor r(r_relation);
+    ColumnarCursor s(s_relation);
+    ColumnarRow last_written_row;
+    size_t skipped_blocks = 0;
+
+    while(r.valid() && s.valid()) {
+        const int line_order = compare_lines(r, s);
+        if(line_order < 0) {
+            if(r.key() != s.key()) skipped_blocks += r.skip_to(s.key());
+            else r.advance();
+        }else if(line_order > 0) {
+            if(r.key() != s.key()) skipped_blocks += s.skip_to(r.key());
+            else s.advance();
+        }else {
+            write_distinct_row(r_intersection_s, r, last_written_row);
+            r.advance();
+            s.advance();
+        }
+    }
+
+    r_intersection_s.close();
+    std::cout << "Intersection Completed." << std::endl;
+    std::cout << "Blocks skipped: " << skipped_blocks << std::endl;
+    print_output_statistics(r_intersection_s);
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * R_difference_S over columnar relations. Every R row may be written, but S jumps to the current R key.
+ * @param r_relation Columnar R
+ * @param s_relation Columnar S
+ * @param difference_file_name Path where the difference result will be saved
+ * @param options Output buffer size and direct I/O
+ */
+void columnar_R_difference_S(const ColumnarRelation& r_relation, const ColumnarRelation& s_relation, const std::string& difference_file_name, const ExecutionOptions& options) {
+    OutputSink r_difference_s(difference_file_name, options.output_buffer_size, options.direct_io);
+    if(!r_difference_s.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    ColumnarCursor r(r_relation);
+    ColumnarCursor s(s_relation);
+    ColumnarRow last_written_row;
+    size_t skipped_blocks = 0;
+
+    while(r.valid()) {
+        const int line_order = s.valid() ? compare_lines(r, s) : -1;
+        if(line_order < 0) {
+            write_distinct_row(r_difference_s, r, last_written_row);
+            r.advance();
+        }else if(line_order > 0) {
+            if(r.key() != s.key()) skipped_blocks += s.skip_to(r.key());
+            else s.advance();
+        }else {
+            r.advance();
+            s.advance();
+        }
+    }
+
+    r_difference_s.close();
     std::cout << "Difference Completed." << std::endl;
+    std::cout << "Blocks skipped: " << skipped_blocks << std::endl;
+    print_output_statistics(r_difference_s);
     std::cout << "--------" << std::endl;
 }
 
+/**
+ * groupBy_with_aggregation over a columnar relation. Rows are sorted by key, so every group is summed
+ * as it streams by, with int32 values read straight from the value column and nothing parsed or spilled.
+ * @param r_relation Columnar R
+ * @param groupBy_with_sum_file Path where the grouped and aggregated result will be saved
+ * @param options Output buffer size and direct I/O
+ */
+void columnar_groupBy(const ColumnarRelation& r_relation, const std::string& groupBy_with_sum_file, const ExecutionOptions& options) {
+    OutputSink groupBy_with_sum(groupBy_with_sum_file, options.output_buffer_size, options.direct_io);
+    if(!groupBy_with_sum.is_open()) {
+        std::cerr << "Failed to open one or more files!" << std::endl;
+        return;
+    }
+
+    for(ColumnarCursor r(r_relation); r.valid();) {
+        const uint32_t key_id = r.key_id();
+        int sum = 0;
+        do {
+            sum += r.value();
+        }while(r.advance() && r.key_id() == key_id);
+        groupBy_with_sum.append_all(r_relation.key(key_id), "\t", sum, "\n");
+    }
+
+    groupBy_with_sum.close();
+    std::cout << "Group By strategy: columnar" << std::endl;
+    std::cout << "Group By with column 2 sum Completed." << std::endl;
+    std::cout << "--------" << std::endl;
+}
+
+/**
+ * Benchmark mode: generates synthetic relations, runs every operator variant on them and prints one JSON document
+ * with wall time, rows/s, bytes read and written, peak RSS and allocation counts per variant.
+ * Every variant runs in its own child process (measure_in_child), in its own directory.
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main, argv[1] is "bench"
+ * @return 0 if every variant succeeded, 1 otherwise
+ */
+int run_benchmark(const int argc, char *argv[]) {
+    BenchmarkOptions bench{};
+    for(int i = 2; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if(name == "--r-rows") { bench.r_rows = std::stoull(value); continue; }
+            if(name == "--s-rows") { bench.s_rows = std::stoull(value); continue; }
+            if(name == "--keys") {
+                bench.keys = std::stoull(value);
+                if(bench.keys == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--skew") {
+                bench.skew = std::stod(value);
+                if(bench.skew < 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--seed") { bench.seed = std::stoull(value); continue; }
+            if(name == "--threads") {
+                bench.threads = std::stoull(value);
+                if(bench.threads == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--memory-budget") {
+                bench.memory_budget_mib = std::stoull(value);
+                if(bench.memory_budget_mib == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if(name == "--directory") { bench.directory = value; continue; }
+            if(name == "--json") { bench.json_file = value; continue; }
+        }catch(const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << std::endl;
+        exit(-1);
+    }
+
+    const std::filesystem::path directory = std::filesystem::absolute(bench.directory);
+    std::filesystem::create_directories(directory);
+    const std::string r_file = directory / "R.tsv";
+    const std::string r_sorted = directory / "R_sorted.tsv";
+    const std::string s_sorted = directory / "S_sorted.tsv";
+
+    std::cerr << "Generating " << bench.r_rows << " R rows and " << bench.s_rows << " S rows over "
+              << bench.keys << " keys (skew " << bench.skew << ") in " << directory.string() << std::endl;
+    generate_relation(r_file, r_sorted, bench.r_rows, bench, bench.seed);
+    generate_relation("", s_sorted, bench.s_rows, bench, bench.seed + 1);
+
+    //Variants that read the TSV files, then the ingest itself, then the variants reading the columnar copies.
+    ExecutionOptions base{bench.memory_budget_mib * 1024 * 1024, GroupByStrategy::Auto, DEFAULT_OUTPUT_BUFFER_KIB * 1024,
+                          false, OperatorSelection{false, false, false, false, false}, false, 1, DEFAULT_JOIN_BUFFER_ROWS, false};
+    auto with = [&base](auto change) { ExecutionOptions options = base; change(options); return options; };
+    const std::vector<std::string> r_and_s = {r_sorted, s_sorted};
+    const size_t r_and_s_rows = bench.r_rows + bench.s_rows;
+
+    struct Variant {
+        std::string operator_name;
+        std::string variant;
+        ExecutionOptions options;
+        std::vector<std::string> inputs;
+        size_t input_rows;
+    };
+    std::vector<Variant> variants = {
+        {"merge_join", "serial", with([](auto& o) { o.operators.join = true; }), r_and_s, r_and_s_rows},
+        {"merge_join", "parallel-" + std::to_string(bench.threads), with([&](auto& o) { o.operators.join = true; o.threads = bench.threads; }), r_and_s, r_and_s_rows},
+        {"union", "serial", with([](auto& o) { o.operators.union_ = true; }), r_and_s, r_and_s_rows},
+        {"intersection", "serial", with([](auto& o) { o.operators.intersection = true; }), r_and_s, r_and_s_rows},
+        {"difference", "serial", with([](auto& o) { o.operators.difference = true; }), r_and_s, r_and_s_rows},
+        {"join+union+intersection+difference", "fused", with([](auto& o) {
+            o.operators = OperatorSelection{true, true, true, true, false};
+            o.fused = true;
+        }), r_and_s, r_and_s_rows},
+        {"group_by", "sort", with([](auto& o) { o.operators.group_by = true; o.group_by_strategy = GroupByStrategy::Sort; }), {r_file}, bench.r_rows},
+        {"group_by", "hash", with([](auto& o) { o.operators.group_by = true; o.group_by_strategy = GroupByStrategy::Hash; }), {r_file}, bench.r_rows},
+    };
+    const size_t tsv_variants = variants.size();
+    const std::vector<std::string> columnar_r_and_s = {r_sorted + COLUMNAR_SUFFIX, s_sorted + COLUMNAR_SUFFIX};
+    variants.push_back({"ingest", "columnar", base, {r_sorted, s_sorted, r_file}, r_and_s_rows + bench.r_rows});
+    for(const auto& [operator_name, selection]: std::vector<std::pair<std::string, OperatorSelection>>{
+            {"merge_join", {true, false, false, false, false}}, {"union", {false, true, false, false, false}},
+            {"intersection", {false, false, true, false, false}}, {"difference", {false, false, false, true, false}}})
+        variants.push_back({operator_name, "columnar", with([&](auto& o) { o.operators = selection; o.columnar = true; }), columnar_r_and_s, r_and_s_rows});
+    variants.push_back({"group_by", "columnar", with([](auto& o) { o.operators.group_by = true; o.columnar = true; }), {r_file + COLUMNAR_SUFFIX}, bench.r_rows});
+
+    std::ofstream json_file;
+    if(!bench.json_file.empty()) {
+        json_file.open(bench.json_file);
+        if(!json_file.is_open()) {
+            std::cerr << "Failed to open " << bench.json_file << std::endl;
+            return 1;
+        }
+    }
+    JsonWriter json(bench.json_file.empty() ? std::cout : json_file);
+
+    json.begin_object();
+    json.begin_object("config");
+    json.field("r_rows", bench.r_rows);
+    json.field("s_rows", bench.s_rows);
+    json.field("keys", bench.keys);
+    json.field("skew", bench.skew);
+    json.field("seed", bench.seed);
+    json.field("threads", bench.threads);
+    json.field("memory_budget_mib", bench.memory_budget_mib);
+    json.end_object();
+    json.begin_array("results");
+
+    bool all_succeeded = true;
+    for(size_t v = 0; v < variants.size(); v++) {
+        const Variant& variant = variants[v];
+        const std::filesystem::path work_directory = directory / ("run" + std::to_string(v));
+        std::filesystem::remove_all(work_directory);
+        std::filesystem::create_directories(work_directory);
+
+        const bool ingest = v == tsv_variants;
+        const BenchmarkMeasurement measurement = measure_in_child([&] {
+            if(ingest) {
+                for(const auto& input: variant.inputs)
+                    if(ingest_columnar(input, input + COLUMNAR_SUFFIX) != 0) exit(1);
+            }else {
+                run_operators(r_sorted, s_sorted, r_file, variant.options);
+            }
+        }, work_directory);
+
+        size_t bytes_read = 0, bytes_written = 0;
+        for(const auto& input: variant.inputs) bytes_read += std::filesystem::file_size(input);
+        if(ingest) {
+            for(const auto& input: variant.inputs) bytes_written += std::filesystem::file_size(input + COLUMNAR_SUFFIX);
+        }else {
+            for(const auto& output: std::filesystem::directory_iterator(work_directory)) bytes_written += output.file_size();
+        }
+        std::filesystem::remove_all(work_directory);
+
+        std::cerr << variant.operator_name << " (" << variant.variant << "): " << measurement.wall_seconds << " s" << std::endl;
+        json.begin_object();
+        json.field("operator", variant.operator_name);
+        json.field("variant", variant.variant);
+        json.field("succeeded", measurement.exit_status == 0 ? 1 : 0);
+        json.field("wall_seconds", measurement.wall_seconds);
+        json.field("rows_per_second", measurement.wall_seconds > 0 ? static_cast<double>(variant.input_rows) / measurement.wall_seconds : 0.0);
+        json.field("input_rows", variant.input_rows);
+        json.field("bytes_read", bytes_read);
+        json.field("bytes_written", bytes_written);
+        json.field("peak_rss_kib", measurement.peak_rss_kib);
+        json.field("allocations", measurement.allocations);
+        json.field("allocated_bytes", measurement.allocated_bytes);
+        json.end_object();
+        all_succeeded = all_succeeded && measurement.exit_status == 0;
+    }
+
+    json.end_array();
+    json.end_object();
+    return all_succeeded ? 0 : 1;
+}
+
+/**
+ * Writes a synthetic "key<TAB>value" relation. Keys are drawn from bench.keys distinct keys with Zipf skew
+ * bench.skew, hot keys being spread over the whole key range. Values are uniform in [0, 1000).
+ * @param unsorted_file_name Path for the rows in generation order (nothing is written if empty)
+ * @param sorted_file_name Path for the rows sorted like LC_ALL=C sort
+ * @param rows Number of rows
+ * @param bench Key count and skew
+ * @param seed Seed of the random generator
+ */
+void generate_relation(const std::string& unsorted_file_name, const std::string& sorted_file_name, const size_t rows, const BenchmarkOptions& bench, const uint64_t seed) {
+    std::mt19937_64 random(seed);
+    ZipfKeyGenerator key_rank(bench.keys, bench.skew);
+    std::uniform_int_distribution<int> value(0, 999);
+
+    std::vector<std::string> lines;
+    lines.reserve(rows);
+    char line[32];
+    for(size_t i = 0; i < rows; i++) {
+        //Odd multiplier: a bijection on 32-bit numbers, so distinct ranks give distinct, scattered keys.
+        const auto key = static_cast<uint32_t>(key_rank(random) * 2654435761ULL);
+        std::snprintf(line, sizeof(line), "k%010u\t%d", key, value(random));
+        lines.emplace_back(line);
+    }
+
+    auto write_lines = [](const std::string& file_name, const std::vector<std::string>& lines_to_write) {
+        OutputSink out(file_name, DEFAULT_OUTPUT_BUFFER_KIB * 1024, false);
+        if(!out.is_open()) {
+            std::cerr << "Failed to open " << file_name << std::endl;
+            exit(-1);
+        }
+        for(const auto& l: lines_to_write) out.append_all(l, "\n");
+    };
+
+    if(!unsorted_file_name.empty()) write_lines(unsorted_file_name, lines);
+    std::sort(lines.begin(), lines.end());
+    write_lines(sorted_file_name, lines);
+}
+
 /**
  * Groups records by the first column and sums the second column values.
- * Uses merge sort for sorting and aggregation.
+ * Depending on options.group_by_strategy the grouping is done by sort_groupBy or hash_groupBy,
+ * both produce the same (key-sorted) output. With GroupByStrategy::Auto the head of R is sampled
+ * and hash aggregation is used when the key cardinality is low.
  * @param r_file_name Path to the input TSV file
  * @param groupBy_with_sum_file Path where the grouped and aggregated result will be saved
+ * @param options Memory budget and grouping strategy
  */
-void groupBy_with_aggregation(const std::string& r_file_name , const std::string& groupBy_with_sum_file) {
-    std::ifstream r_file(r_file_name);
+void groupBy_with_aggregation(const std::string& r_file_name , const std::string& groupBy_with_sum_file, const ExecutionOptions& options) {
+    GroupByStrategy strategy = options.group_by_strategy;
+    if(strategy == GroupByStrategy::Auto)
+        strategy = choose_group_by_strategy(r_file_name);
+
+    const MappedFile r_file(r_file_name);
     std::ofstream groupBy_with_sum(groupBy_with_sum_file);
 
     if(!r_file.is_open() || !groupBy_with_sum.is_open()) {
@@ -339,83 +1558,404 @@ void groupBy_with_aggregation(const std::string& r_file_name , const std::string
         return;
     }
 
-    std::vector<Record> records;
+    RecordCursor r(r_file.contents());
+    const std::string run_file_prefix = groupBy_with_sum_file + ".run";
+
+    if(strategy == GroupByStrategy::Hash) {
+        const size_t spilled_partitions = hash_groupBy(r, groupBy_with_sum, run_file_prefix, options.group_by_memory_budget);
+        std::cout << "Group By strategy: hash" << std::endl;
+        if(spilled_partitions > 0)
+            std::cout << "Partitions spilled: " << spilled_partitions << std::endl;
+    }else {
+        const size_t spilled_runs = sort_groupBy(r, groupBy_with_sum, run_file_prefix, options.group_by_memory_budget);
+        std::cout << "Group By strategy: sort" << std::endl;
+        if(spilled_runs > 0)
+            std::cout << "Sorted runs spilled: " << spilled_runs << std::endl;
+    }
+
+    std::cout << "Group By with column 2 sum Completed." << std::endl;
+    std::cout << "--------" << std::endl;;
+}
 
-    //Load records to memory
-    std::string line;
-    while(std::getline(r_file, line)) {
-        std::string key = line.substr(0, line.find('\t'));
-        int value = std::stoi(line.substr(line.find('\t') + 1));
-        records.push_back({key, value});
+/**
+ * Picks the group-by algorithm from a sample of the first PLANNER_SAMPLE_ROWS rows of R.
+ * Few distinct keys per row mean a small hash table with most rows only updating a sum,
+ * which beats sorting every row. Otherwise, sorting is chosen.
+ * @param r_file_name Path to the input TSV file
+ * @return GroupByStrategy::Hash or GroupByStrategy::Sort
+ */
+GroupByStrategy choose_group_by_strategy(const std::string& r_file_name) {
+    const MappedFile r_file(r_file_name);
+    std::unordered_set<std::string_view> distinct_keys;
+    size_t sampled_rows = 0;
+
+    for(RecordCursor r(r_file.contents()); r.valid() && sampled_rows < PLANNER_SAMPLE_ROWS; r.advance()) {
+        distinct_keys.insert(r.key());
+        sampled_rows++;
     }
 
-    std::vector<Record> sorted_records_with_sum = merge_sort(records.begin(), records.end());
+    const bool low_cardinality = static_cast<double>(distinct_keys.size()) <= PLANNER_MAX_DISTINCT_RATIO * static_cast<double>(sampled_rows);
+    std::cout << "Group By planner: " << distinct_keys.size() << " distinct keys in " << sampled_rows << " sampled rows" << std::endl;
+    return low_cardinality ? GroupByStrategy::Hash : GroupByStrategy::Sort;
+}
+
+/**
+ * Prints how much an operator wrote and how many system calls it took.
+ * @param sink The closed output of the operator
+ */
+void print_output_statistics(const OutputSink& sink) {
+    std::cout << "Output: " << sink.bytes_written() << " bytes in " << sink.flush_count() << " writes"
+              << (sink.direct_io() ? " (direct I/O)" : "") << std::endl;
+}
+
+/**
+ * Parses the integer value column of a record without allocating.
+ * @param payload The payload (everything after the key) of a record
+ * @param value Receives the value
+ * @return False if the payload does not start with an integer
+ */
+bool parse_value(const std::string_view payload, int& value) {
+    return std::from_chars(payload.data(), payload.data() + payload.size(), value).ec == std::errc();
+}
 
-    //Write records to file
-    for(const auto&[column_1, column_2]: sorted_records_with_sum) {
-        groupBy_with_sum << column_1 << "\t" << column_2 << std::endl;
+/**
+ * Sort-based group-by with an external merge sort, so memory stays bounded whatever the size of R:
+ *   1. Records are read into memory until memory_budget is reached.
+ *   2. The run is sorted and records with identical keys are summed (partial aggregation),
+ *      then the run is spilled to a temporary file.
+ *   3. All runs are k-way merged, summing equal keys as they stream out.
+ * If R fits in a single run nothing is spilled and the run is written directly.
+ * @param r Cursor over the input records
+ * @param out Stream that receives the sorted, aggregated records
+ * @param run_file_prefix Prefix of the temporary run files
+ * @param memory_budget Maximum number of bytes used for in-memory records
+ * @return Number of runs spilled to disk
+ */
+size_t sort_groupBy(RecordCursor& r, std::ostream& out, const std::string& run_file_prefix, const size_t memory_budget) {
+    std::vector<std::string> run_files;
+
+    // Half of the budget holds the Record slots, the other half the keys too long for the small string optimization.
+    const size_t max_run_records = std::max<size_t>(1, memory_budget / 2 / sizeof(Record));
+    // No run holds more records than the input has lines left, and the shortest line ("1\n") takes 2 bytes.
+    const size_t input_records = (r.buffer_contents().size() - r.offset()) / 2 + 1;
+    std::vector<Record> run;
+    run.reserve(std::min(max_run_records, input_records));
+    size_t run_key_bytes = 0;
+
+    //Spills the current run as a sorted, aggregated temporary file.
+    auto spill_run = [&] {
+        sort_run_with_aggregation(run);
+
+        const std::string run_file_name = run_file_prefix + std::to_string(run_files.size());
+        std::ofstream run_file(run_file_name);
+        if(!run_file.is_open()) {
+            std::cerr << "Failed to open run file " << run_file_name << std::endl;
+            exit(-1);
+        }
+        write_records(run, run_file);
+        close_run_file(run_file, run_file_name);
+        run_files.push_back(run_file_name);
+
+        run.clear();
+        run_key_bytes = 0;
+    };
+
+    //Load records to memory, one run at a time.
+    int value;
+    for(; r.valid(); r.advance()) {
+        if(!parse_value(r.payload(), value)) continue;
+        run.push_back({std::string(r.key()), value});
+        run_key_bytes += key_heap_footprint(run.back());
+
+        if(run.size() == max_run_records || max_run_records * sizeof(Record) + run_key_bytes >= memory_budget)
+            spill_run();
     }
 
-    std::cout << "Group By with column 2 sum Completed." << std::endl;
-    std::cout << "--------" << std::endl;;
+    if(run_files.empty()) {
+        //Everything fit in memory. No need to touch the disk.
+        sort_run_with_aggregation(run);
+        write_records(run, out);
+        return 0;
+    }
+
+    if(!run.empty())
+        spill_run();
+    std::vector<Record>().swap(run);
+
+    const size_t spilled_runs = run_files.size();
+    run_files = reduce_runs_to_fan_in(std::move(run_files), run_file_prefix);
+    merge_runs_with_aggregation(run_files, out);
+    for(const auto& run_file: run_files)
+        std::filesystem::remove(run_file);
+
+    return spilled_runs;
 }
 
 /**
- * Implements merge sort algorithm for Records.
- * Used by groupBy_with_aggregation to sort records by key.
- * @param begin Iterator to the beginning of the range to sort
- * @param end Iterator to the end of the range to sort
- * @return Sorted vector of Records
+ * Hash-based group-by. Every row is summed into an open-addressing table keyed on the record key,
+ * and the table is emitted in key order at the end, so the output matches sort_groupBy.
+ * When the table would exceed memory_budget, rows of keys not yet in the table are hash-partitioned
+ * to disk (Grace-style) and each partition is aggregated on its own afterwards. Every key ends up in
+ * exactly one sorted run, and the runs are merged into the output.
+ * @param r Cursor over the input records
+ * @param out Stream that receives the sorted, aggregated records
+ * @param run_file_prefix Prefix of the temporary partition and run files
+ * @param memory_budget Maximum number of bytes used by a hash table
+ * @return Number of partitions spilled to disk
  */
-std::vector<Record> merge_sort(const std::vector<Record>::const_iterator begin, const std::vector<Record>::const_iterator end) {
-    if (std::distance(begin, end) <= 1)
-        return std::vector(begin, end);
+size_t hash_groupBy(RecordCursor& r, std::ostream& out, const std::string& run_file_prefix, const size_t memory_budget) {
+    std::vector<std::string> run_files;
+    size_t spilled_partitions = 0;
 
-    const auto middle = begin + std::distance(begin, end) / 2;
-    const std::vector<Record> left = merge_sort(begin, middle);
-    const std::vector<Record> right = merge_sort(middle, end);
+    hash_aggregate_partition(r, &out, run_file_prefix, 0, memory_budget, run_files, spilled_partitions);
 
-    return merge_with_aggregation(left, right);
+    if(!run_files.empty()) {
+        run_files = reduce_runs_to_fan_in(std::move(run_files), run_file_prefix);
+        merge_runs_with_aggregation(run_files, out);
+        for(const auto& run_file: run_files)
+            std::filesystem::remove(run_file);
+    }
+    return spilled_partitions;
 }
 
 /**
- * Merges two sorted vectors of Records while aggregating values for identical keys.
- * Used by merge_sort to combine sorted sub-arrays.
- * @param left First sorted vector of Records
- * @param right Second sorted vector of Records
- * @return Merged and aggregated vector of Records
+ * Aggregates one partition of the input with a hash table, used recursively by hash_groupBy.
+ * Keys that do not fit in the table go to GROUP_BY_PARTITIONS partition files chosen by the hash,
+ * which are processed one after the other at depth + 1 with a new hash seed. Past MAX_PARTITIONING_DEPTH
+ * (a partition whose keys still do not fit) the sort-based group-by takes over for that partition.
+ * @param partition Cursor over the records of this partition
+ * @param out If not null and nothing had to be partitioned, the table is written here directly
+ * @param run_file_prefix Prefix of the temporary partition and run files
+ * @param depth Partitioning depth, also the hash seed
+ * @param memory_budget Maximum number of bytes used by the hash table
+ * @param run_files Receives the sorted runs that still have to be merged
+ * @param spilled_partitions Incremented for every partition written to disk
  */
-std::vector<Record> merge_with_aggregation(const std::vector<Record>& left, const std::vector<Record>& right) {
-    std::vector<Record> merged;
-    size_t i = 0, j = 0;
+void hash_aggregate_partition(
+    RecordCursor& partition,
+    std::ostream* out,
+    const std::string& run_file_prefix,
+    const int depth,
+    const size_t memory_budget,
+    std::vector<std::string>& run_files,
+    size_t& spilled_partitions) {
+
+    HashAggregationTable table(depth);
+    std::vector<std::string> partition_file_names(GROUP_BY_PARTITIONS);
+    std::vector<std::ofstream> partition_files(GROUP_BY_PARTITIONS);
+    bool partitioned = false;
+
+    int value;
+    for(; partition.valid(); partition.advance()) {
+        if(!parse_value(partition.payload(), value)) continue;
+
+        const std::string_view key = partition.key();
+        const uint64_t hash = hash_key(key, depth);
+        const bool allow_insert = !partitioned && table.memory_footprint_after_insert(key.size()) <= memory_budget;
+        if(table.add(key, hash, value, allow_insert)) continue;
+
+        //Table is full. The row goes to the partition picked by the high bits of the hash.
+        partitioned = true;
+        const size_t p = hash >> 60;
+        if(!partition_files[p].is_open()) {
+            partition_file_names[p] = run_file_prefix + ".d" + std::to_string(depth) + ".p" + std::to_string(p);
+            partition_files[p].open(partition_file_names[p]);
+            if(!partition_files[p].is_open()) {
+                std::cerr << "Failed to open partition file " << partition_file_names[p] << std::endl;
+                exit(-1);
+            }
+            spilled_partitions++;
+        }
+        partition_files[p] << partition.line() << "\n";
+    }
+
+    if(!partitioned && out != nullptr) {
+        //Everything fit in memory. No need to touch the disk.
+        table.write_sorted(*out);
+        return;
+    }
+
+    if(table.size() > 0) {
+        const std::string run_file_name = run_file_prefix + std::to_string(run_files.size()) + ".d" + std::to_string(depth);
+        std::ofstream run_file(run_file_name);
+        if(!run_file.is_open()) {
+            std::cerr << "Failed to open run file " << run_file_name << std::endl;
+            exit(-1);
+        }
+        table.write_sorted(run_file);
+        close_run_file(run_file, run_file_name);
+        run_files.push_back(run_file_name);
+    }
+    table = HashAggregationTable(depth, 0);
+
+    for(size_t p = 0; p < GROUP_BY_PARTITIONS; p++) {
+        if(!partition_files[p].is_open()) continue;
+        close_run_file(partition_files[p], partition_file_names[p]);
 
-    //while both lists have records
-    while(i < left.size() && j < right.size()) {
-        //if left record key < right record key
-        if(left[i].column_1 < right[j].column_1) {
-            merged.push_back(left[i]);
-            i++;
-        }//if left record key > right record key
-        else if(left[i].column_1 > right[j].column_1) {
-            merged.push_back(right[j]);
-            j++;
-        }//if left record key == right record key we do the sum.
-        else{
-            Record record = {left[i].column_1, left[i].column_2 + right[j].column_2};
-            merged.push_back(record);
-            i++;
-            j++;
+        const MappedFile partition_file(partition_file_names[p]);
+        if(!partition_file.is_open()) {
+            std::cerr << "Failed to open partition file " << partition_file_names[p] << std::endl;
+            exit(-1);
         }
+
+        RecordCursor partition_records(partition_file.contents());
+        if(depth + 1 < MAX_PARTITIONING_DEPTH) {
+            hash_aggregate_partition(partition_records, nullptr, run_file_prefix, depth + 1, memory_budget, run_files, spilled_partitions);
+        }else {
+            const std::string run_file_name = run_file_prefix + std::to_string(run_files.size()) + ".sorted";
+            std::ofstream run_file(run_file_name);
+            if(!run_file.is_open()) {
+                std::cerr << "Failed to open run file " << run_file_name << std::endl;
+                exit(-1);
+            }
+            sort_groupBy(partition_records, run_file, run_file_name + ".run", memory_budget);
+            close_run_file(run_file, run_file_name);
+            run_files.push_back(run_file_name);
+        }
+        std::filesystem::remove(partition_file_names[p]);
     }
+}
+
+/**
+ * Estimates how many heap bytes the key of a record occupies.
+ * Keys short enough for the small string optimization live inside the Record itself.
+ * @param record The record to measure
+ * @return Bytes allocated for the key outside the Record (0 if none)
+ */
+size_t key_heap_footprint(const Record& record) {
+    const bool key_on_heap = record.column_1.capacity() > std::string().capacity();
+    return key_on_heap ? record.column_1.capacity() + 1 : 0;
+}
 
-    //if the left list has records
-    if(i < left.size()) {
-        merged.insert(merged.end(), left.begin() + i, left.end());
+/**
+ * Sorts a run of records by key and sums the values of identical keys in place.
+ * Used by groupBy_with_aggregation before a run is written out.
+ * @param run Records of a single run. On return, sorted by key with unique keys.
+ */
+void sort_run_with_aggregation(std::vector<Record>& run) {
+    std::sort(run.begin(), run.end(), [](const Record& a, const Record& b) {
+        return a.column_1 < b.column_1;
+    });
+
+    size_t last = 0;
+    for(size_t i = 1; i < run.size(); i++) {
+        if(run[i].column_1 == run[last].column_1)
+            run[last].column_2 += run[i].column_2;
+        else if(++last != i)
+            run[last] = std::move(run[i]);
     }
-    //if the right list has records
-    if(j < right.size()) {
-        merged.insert(merged.end(), right.begin() + j, right.end());
+    if(!run.empty())
+        run.resize(last + 1);
+}
+
+/**
+ * Writes records as "key<TAB>value" lines.
+ * @param records Records to write
+ * @param out Stream that receives the records
+ */
+void write_records(const std::vector<Record>& records, std::ostream& out) {
+    for(const auto&[column_1, column_2]: records) {
+        out << column_1 << "\t" << column_2 << "\n";
     }
+}
 
-    return merged;
+/**
+ * Closes a temporary file of the group-by, so that a short write (e.g. on a full disk) does not lose groups.
+ * @param run_file The file, written
+ * @param run_file_name Name of the file, for the error message
+ * @throw Exits with error if any write to the file or its closing failed
+ */
+void close_run_file(std::ofstream& run_file, const std::string& run_file_name) {
+    run_file.close();
+    if(!run_file) {
+        std::cerr << "Failed to write run file " << run_file_name << std::endl;
+        exit(-1);
+    }
+}
+
+/**
+ * Merges runs until at most MAX_MERGE_FAN_IN of them are left.
+ * Each pass merges groups of MAX_MERGE_FAN_IN runs into a new run and deletes the merged ones.
+ * @param run_files Sorted run files produced by groupBy_with_aggregation
+ * @param run_file_prefix Prefix used to name the intermediate runs
+ * @return The remaining run files, few enough to be merged in a single pass
+ */
+std::vector<std::string> reduce_runs_to_fan_in(std::vector<std::string> run_files, const std::string& run_file_prefix) {
+    size_t pass = 0;
+
+    while(run_files.size() > MAX_MERGE_FAN_IN) {
+        std::vector<std::string> merged_run_files;
+
+        for(size_t first = 0; first < run_files.size(); first += MAX_MERGE_FAN_IN) {
+            const size_t last = std::min(first + MAX_MERGE_FAN_IN, run_files.size());
+            const std::vector group(run_files.begin() + static_cast<long>(first), run_files.begin() + static_cast<long>(last));
+
+            const std::string merged_run_file_name = run_file_prefix + ".pass" + std::to_string(pass) + "." + std::to_string(merged_run_files.size());
+            std::ofstream merged_run_file(merged_run_file_name);
+            if(!merged_run_file.is_open()) {
+                std::cerr << "Failed to open run file " << merged_run_file_name << std::endl;
+                exit(-1);
+            }
+
+            merge_runs_with_aggregation(group, merged_run_file);
+            close_run_file(merged_run_file, merged_run_file_name);
+            for(const auto& run_file: group)
+                std::filesystem::remove(run_file);
+            merged_run_files.push_back(merged_run_file_name);
+        }
+
+        run_files = std::move(merged_run_files);
+        pass++;
+    }
+    return run_files;
+}
+
+/**
+ * K-way merges sorted run files while aggregating values for identical keys.
+ * Runs are memory-mapped and a min-heap holds the cursor of every run, so each record is read exactly once.
+ * @param run_files Sorted run files, each with unique keys
+ * @param out Stream that receives the merged and aggregated records
+ */
+void merge_runs_with_aggregation(const std::vector<std::string>& run_files, std::ostream& out) {
+    std::vector<MappedFile> runs;
+    std::vector<RecordCursor> cursors;
+    runs.reserve(run_files.size());
+    cursors.reserve(run_files.size());
+
+    for(const auto& run_file: run_files) {
+        runs.emplace_back(run_file);
+        if(!runs.back().is_open()) {
+            std::cerr << "Failed to open run file " << run_file << std::endl;
+            exit(-1);
+        }
+        cursors.emplace_back(runs.back().contents());
+    }
+
+    //Min-heap of run indices ordered by their current key.
+    auto greater_key = [&](const size_t a, const size_t b) {
+        return cursors[a].key() > cursors[b].key();
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater_key)> heap(greater_key);
+
+    for(size_t i = 0; i < cursors.size(); i++)
+        if(cursors[i].valid()) heap.push(i);
+
+    int value;
+    while(!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        const std::string_view key = cursors[i].key();
+        int sum = parse_value(cursors[i].payload(), value) ? value : 0;
+        if(cursors[i].advance()) heap.push(i);
+
+        //Every run holds a key at most once, the rest of this key's records are at the top of other runs.
+        while(!heap.empty() && cursors[heap.top()].key() == key) {
+            i = heap.top();
+            heap.pop();
+            if(parse_value(cursors[i].payload(), value)) sum += value;
+            if(cursors[i].advance()) heap.push(i);
+        }
+
+        out << key << "\t" << sum << "\n";
+    }
 }
@@ -0,0 +1,203 @@
+#ifndef EDGE_SCAN_H
+#define EDGE_SCAN_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <limits>
+#include "Node.h"
+
+/**
+ * Tests of a query against all edges of a polygon ring at once, on the vertex arrays of the polygons:
+ *
+ *   distance_squared()     squared distance from the query point to the polygon, 0 if the point is inside it
+ *   intersects()           whether the polygon, its inside included, shares a point with the query rectangle
+ *
+ * A ring is the polygon through vertices [begin, end), closed from the last vertex back to the first one; the
+ * edge from vertex i - 1 to vertex i of 4 consecutive i is read with unaligned loads of both arrays, and the
+ * closing edge and the edges left over are tested one by one. Whether a point is inside follows the even-odd
+ * rule, from the parity of the edges crossed by a ray from the point towards +x. The AVX2 kernels compute every
+ * edge as the scalar ones do, so both give the same results. The kernels are picked at run time, depending on
+ * the CPU.
+ */
+class EdgeScan {
+public:
+    using DistanceKernel = double (*)(const double*, const double*, size_t, size_t, double, double);
+    using IntersectKernel = bool (*)(const double*, const double*, size_t, size_t, const MBR&);
+
+    /**
+     * @param x X-coordinates of the vertices
+     * @param y Y-coordinates of the vertices
+     * @param begin First vertex of the ring
+     * @param end One past the last vertex of the ring, after begin
+     * @param qx X-coordinate of the query point
+     * @param qy Y-coordinate of the query point
+     * @return Squared Euclidean distance from the point to the polygon, 0 if the point is inside it
+     */
+    static double distance_squared(const double* x, const double* y, const size_t begin, const size_t end, const double qx, const double qy) {
+        static const DistanceKernel kernel = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &avx2_distance_kernel : &scalar_distance_kernel;
+        }();
+        return kernel(x, y, begin, end, qx, qy);
+    }
+
+    /**
+     * @param x X-coordinates of the vertices
+     * @param y Y-coordinates of the vertices
+     * @param begin First vertex of the ring
+     * @param end One past the last vertex of the ring, after begin
+     * @param query The query rectangle
+     * @return True if an edge of the polygon touches the rectangle, or the rectangle lies inside the polygon
+     */
+    static bool intersects(const double* x, const double* y, const size_t begin, const size_t end, const MBR& query) {
+        static const IntersectKernel kernel = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &avx2_intersect_kernel : &scalar_intersect_kernel;
+        }();
+        return kernel(x, y, begin, end, query);
+    }
+
+    static double scalar_distance_kernel(const double* x, const double* y, const size_t begin, const size_t end, const double qx, const double qy) {
+        double best = std::numeric_limits<double>::infinity();
+        bool inside = false;
+        for (size_t i = begin, previous = end - 1; i < end; previous = i++)
+            edge_distance(x[previous], y[previous], x[i], y[i], qx, qy, best, inside);
+        return inside ? 0.0 : best;
+    }
+
+    __attribute__((target("avx2")))
+    static double avx2_distance_kernel(const double* x, const double* y, const size_t begin, const size_t end, const double qx, const double qy) {
+        double best = std::numeric_limits<double>::infinity();
+        bool inside = false;
+        edge_distance(x[end - 1], y[end - 1], x[begin], y[begin], qx, qy, best, inside);
+
+        const __m256d point_x = _mm256_set1_pd(qx);
+        const __m256d point_y = _mm256_set1_pd(qy);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        __m256d best4 = _mm256_set1_pd(best);
+        unsigned crossings = 0;
+        size_t i = begin + 1;
+        for (; i + 4 <= end; i += 4) {
+            const __m256d ax = _mm256_loadu_pd(x + i - 1), ay = _mm256_loadu_pd(y + i - 1);
+            const __m256d bx = _mm256_loadu_pd(x + i), by = _mm256_loadu_pd(y + i);
+            const __m256d dx = _mm256_sub_pd(bx, ax), dy = _mm256_sub_pd(by, ay);
+            const __m256d to_x = _mm256_sub_pd(point_x, ax), to_y = _mm256_sub_pd(point_y, ay);
+
+            //Edges along which the point's y lies; the quotient of the others is masked out.
+            const __m256d spans_y = _mm256_xor_pd(_mm256_cmp_pd(ay, point_y, _CMP_GT_OQ), _mm256_cmp_pd(by, point_y, _CMP_GT_OQ));
+            const __m256d crossing_x = _mm256_add_pd(ax, _mm256_div_pd(_mm256_mul_pd(to_y, dx), dy));
+            crossings += std::popcount(static_cast<unsigned>(
+                _mm256_movemask_pd(_mm256_and_pd(spans_y, _mm256_cmp_pd(point_x, crossing_x, _CMP_LT_OQ)))));
+
+            //Nearest point of the edge: the projection, clamped to the edge; the first vertex for an empty edge.
+            const __m256d length_squared = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            const __m256d projection = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(to_x, dx), _mm256_mul_pd(to_y, dy)), length_squared);
+            const __m256d t = _mm256_and_pd(_mm256_max_pd(_mm256_min_pd(projection, one), zero),
+                                            _mm256_cmp_pd(length_squared, zero, _CMP_GT_OQ));
+            const __m256d ex = _mm256_sub_pd(_mm256_add_pd(ax, _mm256_mul_pd(t, dx)), point_x);
+            const __m256d ey = _mm256_sub_pd(_mm256_add_pd(ay, _mm256_mul_pd(t, dy)), point_y);
+            best4 = _mm256_min_pd(best4, _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey)));
+        }
+        for (; i < end; i++) edge_distance(x[i - 1], y[i - 1], x[i], y[i], qx, qy, best, inside);
+
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, best4);
+        best = std::min({best, lanes[0], lanes[1], lanes[2], lanes[3]});
+        return inside != ((crossings & 1) != 0) ? 0.0 : best;
+    }
+
+    static bool scalar_intersect_kernel(const double* x, const double* y, const size_t begin, const size_t end, const MBR& query) {
+        bool inside = false;
+        for (size_t i = begin, previous = end - 1; i < end; previous = i++) {
+            if (edge_touches(x[previous], y[previous], x[i], y[i], query)) return true;
+            inside ^= edge_crossed(x[previous], y[previous], x[i], y[i], query.x_low, query.y_low);
+        }
+        //No edge touches the rectangle: it is inside the polygon if any of its points is.
+        return inside;
+    }
+
+    __attribute__((target("avx2")))
+    static bool avx2_intersect_kernel(const double* x, const double* y, const size_t begin, const size_t end, const MBR& query) {
+        if (edge_touches(x[end - 1], y[end - 1], x[begin], y[begin], query)) return true;
+        bool inside = edge_crossed(x[end - 1], y[end - 1], x[begin], y[begin], query.x_low, query.y_low);
+
+        const __m256d x_low = _mm256_set1_pd(query.x_low), y_low = _mm256_set1_pd(query.y_low);
+        const __m256d x_high = _mm256_set1_pd(query.x_high), y_high = _mm256_set1_pd(query.y_high);
+        const __m256d zero = _mm256_setzero_pd();
+        unsigned crossings = 0;
+        size_t i = begin + 1;
+        for (; i + 4 <= end; i += 4) {
+            const __m256d ax = _mm256_loadu_pd(x + i - 1), ay = _mm256_loadu_pd(y + i - 1);
+            const __m256d bx = _mm256_loadu_pd(x + i), by = _mm256_loadu_pd(y + i);
+            const __m256d dx = _mm256_sub_pd(bx, ax), dy = _mm256_sub_pd(by, ay);
+
+            //The bounding box of the edge meets the rectangle...
+            const __m256d boxes_meet = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(_mm256_max_pd(ax, bx), x_low, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_min_pd(ax, bx), x_high, _CMP_LE_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(_mm256_max_pd(ay, by), y_low, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_min_pd(ay, by), y_high, _CMP_LE_OQ)));
+            //...and the corners of the rectangle are not all on one side of the line through the edge.
+            const __m256d low_y = _mm256_mul_pd(dx, _mm256_sub_pd(y_low, ay)), high_y = _mm256_mul_pd(dx, _mm256_sub_pd(y_high, ay));
+            const __m256d low_x = _mm256_mul_pd(dy, _mm256_sub_pd(x_low, ax)), high_x = _mm256_mul_pd(dy, _mm256_sub_pd(x_high, ax));
+            const __m256d sides[4] = {_mm256_sub_pd(low_y, low_x), _mm256_sub_pd(low_y, high_x),
+                                      _mm256_sub_pd(high_y, low_x), _mm256_sub_pd(high_y, high_x)};
+            __m256d all_left = _mm256_cmp_pd(sides[0], zero, _CMP_GT_OQ), all_right = _mm256_cmp_pd(sides[0], zero, _CMP_LT_OQ);
+            for (int corner = 1; corner < 4; corner++) {
+                all_left = _mm256_and_pd(all_left, _mm256_cmp_pd(sides[corner], zero, _CMP_GT_OQ));
+                all_right = _mm256_and_pd(all_right, _mm256_cmp_pd(sides[corner], zero, _CMP_LT_OQ));
+            }
+            if (_mm256_movemask_pd(_mm256_andnot_pd(_mm256_or_pd(all_left, all_right), boxes_meet)) != 0) return true;
+
+            const __m256d spans_y = _mm256_xor_pd(_mm256_cmp_pd(ay, y_low, _CMP_GT_OQ), _mm256_cmp_pd(by, y_low, _CMP_GT_OQ));
+            const __m256d crossing_x = _mm256_add_pd(ax, _mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(y_low, ay), dx), dy));
+            crossings += std::popcount(static_cast<unsigned>(
+                _mm256_movemask_pd(_mm256_and_pd(spans_y, _mm256_cmp_pd(x_low, crossing_x, _CMP_LT_OQ)))));
+        }
+        for (; i < end; i++) {
+            if (edge_touches(x[i - 1], y[i - 1], x[i], y[i], query)) return true;
+            inside ^= edge_crossed(x[i - 1], y[i - 1], x[i], y[i], query.x_low, query.y_low);
+        }
+        return inside != ((crossings & 1) != 0);
+    }
+
+private:
+    /**
+     * @return True if the edge from (ax, ay) to (bx, by) crosses the ray from (qx, qy) towards +x
+     */
+    static bool edge_crossed(const double ax, const double ay, const double bx, const double by, const double qx, const double qy) {
+        return (ay > qy) != (by > qy) && qx < ax + (qy - ay) * (bx - ax) / (by - ay);
+    }
+
+    /**
+     * Lowers best to the squared distance from (qx, qy) to the edge from (ax, ay) to (bx, by) if that is smaller,
+     * and flips inside if the edge crosses the ray from the point towards +x.
+     */
+    static void edge_distance(const double ax, const double ay, const double bx, const double by, const double qx, const double qy,
+                              double& best, bool& inside) {
+        inside ^= edge_crossed(ax, ay, bx, by, qx, qy);
+        const double dx = bx - ax, dy = by - ay;
+        const double length_squared = dx * dx + dy * dy;
+        const double t = length_squared > 0.0 ? std::clamp(((qx - ax) * dx + (qy - ay) * dy) / length_squared, 0.0, 1.0) : 0.0;
+        const double ex = ax + t * dx - qx, ey = ay + t * dy - qy;
+        best = std::min(best, ex * ex + ey * ey);
+    }
+
+    /**
+     * @return True if the edge from (ax, ay) to (bx, by) shares a point with the rectangle: its bounding box meets the
+     *         rectangle, and the corners of the rectangle are not all strictly on one side of the line through it
+     */
+    static bool edge_touches(const double ax, const double ay, const double bx, const double by, const MBR& query) {
+        if (std::max(ax, bx) < query.x_low || std::min(ax, bx) > query.x_high) return false;
+        if (std::max(ay, by) < query.y_low || std::min(ay, by) > query.y_high) return false;
+        const double dx = bx - ax, dy = by - ay;
+        const double sides[4] = {dx * (query.y_low - ay) - dy * (query.x_low - ax), dx * (query.y_low - ay) - dy * (query.x_high - ax),
+                                 dx * (query.y_high - ay) - dy * (query.x_low - ax), dx * (query.y_high - ay) - dy * (query.x_high - ax)};
+        const bool all_left = std::all_of(sides, sides + 4, [](const double side) { return side > 0.0; });
+        const bool all_right = std::all_of(sides, sides + 4, [](const double side) { return side < 0.0; });
+        return !all_left && !all_right;
+    }
+};
+
+#endif //EDGE_SCAN_H
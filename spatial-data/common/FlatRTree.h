@@ -0,0 +1,324 @@
+#ifndef FLAT_R_TREE_H
+#define FLAT_R_TREE_H
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Node.h"
+
+// Child slots of a node are a multiple of this, so every bound array fills whole cache lines (and SIMD registers).
+constexpr size_t FLAT_NODE_SLOT_ALIGNMENT = 8;
+constexpr size_t CACHE_LINE_BYTES = 64;
+
+/**
+ * R-tree stored as one array of fixed-size node blocks, linked by block index instead of pointers.
+ *
+ * Every block holds the children of one node, for a tree whose nodes have at most `slots` children
+ * (the largest fanout rounded up to a multiple of FLAT_NODE_SLOT_ALIGNMENT):
+ *
+ *   double   x_low[slots], y_low[slots], x_high[slots], y_high[slots]   the child MBRs, one array per bound
+ *   int32_t  child[slots]    block index of the child, or its object id if the children are leaves
+ *   uint32_t count           children used; the other slots hold empty MBRs (low bounds above high bounds)
+ *   uint32_t leaf            1 if the children are leaves (objects), 0 if they are nodes
+ *
+ * padded to whole cache lines, so blocks and bound arrays all start on a cache line. A node has no type to test,
+ * only the leaf flag, and its own MBR is the one stored in its parent's slot. Blocks are in breadth-first order
+ * from the root (block 0), so the top levels, read by every query, share a few cache lines.
+ *
+ * The blocks are either owned by the tree or a view of storage it keeps alive, such as a mapped tree file
+ * (RTreeFile.h), which holds the same bytes.
+ */
+class FlatRTree {
+public:
+    /**
+     * Children of a node, as read from the tree file or a pointer tree: (node id or object id, MBR) pairs.
+     */
+    struct NodeRecord {
+        bool children_are_leafs = false;
+        std::vector<std::pair<int, MBR>> children;
+    };
+
+    /**
+     * Read-only view of one block.
+     */
+    struct FlatNode {
+        const double* x_low;
+        const double* y_low;
+        const double* x_high;
+        const double* y_high;
+        const int32_t* child;
+        uint32_t count;
+        bool children_are_leafs;
+        size_t slots; ///< Length of every array, a multiple of FLAT_NODE_SLOT_ALIGNMENT
+
+        [[nodiscard]] MBR child_mbr(const size_t slot) const {
+            return {x_low[slot], y_low[slot], x_high[slot], y_high[slot]};
+        }
+    };
+
+    FlatRTree() = default;
+
+    /**
+     * @param records The nodes, by node id
+     * @param root_id Id of the root node
+     * @throw Exits with error if a node refers to a child node that is missing
+     */
+    FlatRTree(const std::unordered_map<int, NodeRecord>& records, const int root_id) {
+        //Breadth-first order from the root: block index of every node id.
+        std::vector<int> order{root_id};
+        std::unordered_map<int, int32_t> block_of{{root_id, 0}};
+        size_t max_children = 1;
+        for (size_t i = 0; i < order.size(); i++) {
+            const auto record = records.find(order[i]);
+            if (record == records.end()) {
+                std::cerr << "R-tree node " << order[i] << " is missing\n";
+                exit(-1);
+            }
+            max_children = std::max(max_children, record->second.children.size());
+            if (record->second.children_are_leafs) continue;
+            for (const auto& [child_id, mbr] : record->second.children) {
+                if (block_of.emplace(child_id, static_cast<int32_t>(order.size())).second) order.push_back(child_id);
+            }
+        }
+
+        slots = (max_children + FLAT_NODE_SLOT_ALIGNMENT - 1) / FLAT_NODE_SLOT_ALIGNMENT * FLAT_NODE_SLOT_ALIGNMENT;
+        block_lines = block_bytes_for(slots) / CACHE_LINE_BYTES;
+        lines.resize(order.size() * block_lines);
+        blocks = lines.front().bytes;
+        blocks_count = order.size();
+
+        for (size_t block = 0; block < order.size(); block++) {
+            const NodeRecord& record = records.at(order[block]);
+            std::byte* const data = lines[block * block_lines].bytes;
+            double* const x_low = reinterpret_cast<double*>(data);
+            double* const y_low = x_low + slots;
+            double* const x_high = y_low + slots;
+            double* const y_high = x_high + slots;
+            auto* const child = reinterpret_cast<int32_t*>(y_high + slots);
+            auto* const header = reinterpret_cast<uint32_t*>(child + slots);
+
+            std::fill(x_low, x_low + slots, std::numeric_limits<double>::infinity());
+            std::fill(y_low, y_low + slots, std::numeric_limits<double>::infinity());
+            std::fill(x_high, x_high + slots, -std::numeric_limits<double>::infinity());
+            std::fill(y_high, y_high + slots, -std::numeric_limits<double>::infinity());
+            std::fill(child, child + slots, -1);
+            for (size_t slot = 0; slot < record.children.size(); slot++) {
+                const auto& [child_id, mbr] = record.children[slot];
+                x_low[slot] = mbr.x_low;
+                y_low[slot] = mbr.y_low;
+                x_high[slot] = mbr.x_high;
+                y_high[slot] = mbr.y_high;
+                child[slot] = record.children_are_leafs ? child_id : block_of.at(child_id);
+            }
+            header[0] = static_cast<uint32_t>(record.children.size());
+            header[1] = record.children_are_leafs ? 1 : 0;
+        }
+
+        const NodeRecord& root = records.at(root_id);
+        root_bounds = root.children.empty() ? MBR{} : root.children.front().second;
+        for (const auto& [child_id, mbr] : root.children) update_parent_mbr(root_bounds, mbr);
+    }
+
+    /**
+     * Flattens a pointer tree.
+     * @param root Its root node
+     */
+    explicit FlatRTree(const InternalNode& root) : FlatRTree(records_of(root), root.node_id) {}
+
+    /**
+     * View of blocks laid out as above, which the tree does not copy.
+     * @param storage Keeps the blocks alive as long as the tree lives
+     * @param blocks The first block, aligned to CACHE_LINE_BYTES
+     * @param node_count Number of blocks
+     * @param slots Child slots per block, a multiple of FLAT_NODE_SLOT_ALIGNMENT
+     * @param root_mbr MBR of the root
+     */
+    FlatRTree(std::shared_ptr<const void> storage, const std::byte* blocks, const size_t node_count, const size_t slots, const MBR& root_mbr)
+        : storage(std::move(storage)), blocks(blocks), blocks_count(node_count), slots(slots),
+          block_lines(block_bytes_for(slots) / CACHE_LINE_BYTES), root_bounds(root_mbr) {}
+
+    FlatRTree(const FlatRTree&) = delete;
+    FlatRTree& operator=(const FlatRTree&) = delete;
+
+    FlatRTree(FlatRTree&& other) noexcept
+        : lines(std::move(other.lines)), storage(std::move(other.storage)), blocks(std::exchange(other.blocks, nullptr)),
+          blocks_count(std::exchange(other.blocks_count, 0)), slots(other.slots), block_lines(other.block_lines),
+          root_bounds(other.root_bounds) {}
+
+    FlatRTree& operator=(FlatRTree&& other) noexcept {
+        lines = std::move(other.lines);
+        storage = std::move(other.storage);
+        blocks = std::exchange(other.blocks, nullptr);
+        blocks_count = std::exchange(other.blocks_count, 0);
+        slots = other.slots;
+        block_lines = other.block_lines;
+        root_bounds = other.root_bounds;
+        return *this;
+    }
+
+    /**
+     * @param slots Child slots per block
+     * @return Bytes of a block with that many slots: the arrays and the two header words, rounded up to whole cache lines
+     */
+    static size_t block_bytes_for(const size_t slots) {
+        return (slots * (4 * sizeof(double) + sizeof(int32_t)) + 2 * sizeof(uint32_t) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+    }
+
+    [[nodiscard]] bool empty() const { return blocks_count == 0; }
+
+    /**
+     * @return Number of nodes (blocks)
+     */
+    [[nodiscard]] size_t node_count() const { return blocks_count; }
+
+    /**
+     * @return Child slots per block
+     */
+    [[nodiscard]] size_t slot_count() const { return slots; }
+
+    /**
+     * @return Bytes per block
+     */
+    [[nodiscard]] size_t block_bytes() const { return block_lines * CACHE_LINE_BYTES; }
+
+    /**
+     * @return Block index of the root
+     */
+    [[nodiscard]] static size_t root() { return 0; }
+
+    /**
+     * @return MBR of the root, covering every object
+     */
+    [[nodiscard]] const MBR& root_mbr() const { return root_bounds; }
+
+    /**
+     * @return All blocks, node_count() * block_bytes() bytes
+     */
+    [[nodiscard]] std::span<const std::byte> block_data() const { return {blocks, blocks_count * block_bytes()}; }
+
+    /**
+     * @param block Block index, in [0, node_count())
+     * @return View of the block
+     */
+    [[nodiscard]] FlatNode node(const size_t block) const {
+        const std::byte* const data = blocks + block * block_bytes();
+        const auto* const x_low = reinterpret_cast<const double*>(data);
+        const auto* const child = reinterpret_cast<const int32_t*>(x_low + 4 * slots);
+        const auto* const header = reinterpret_cast<const uint32_t*>(child + slots);
+        return {x_low, x_low + slots, x_low + 2 * slots, x_low + 3 * slots, child, header[0], header[1] != 0, slots};
+    }
+
+private:
+    struct alignas(CACHE_LINE_BYTES) CacheLine {
+        std::byte bytes[CACHE_LINE_BYTES];
+    };
+
+    static std::unordered_map<int, NodeRecord> records_of(const InternalNode& root) {
+        std::unordered_map<int, NodeRecord> records;
+        std::vector<const InternalNode*> pending{&root};
+        while (!pending.empty()) {
+            const InternalNode* node = pending.back();
+            pending.pop_back();
+            NodeRecord& record = records[node->node_id];
+            record.children_are_leafs = node->children_are_leafs;
+            for (const auto& child : node->children) {
+                record.children.emplace_back(child->node_id, child->mbr);
+                if (!node->children_are_leafs) pending.push_back(static_cast<const InternalNode*>(child.get()));
+            }
+        }
+        return records;
+    }
+
+    std::vector<CacheLine> lines; ///< The blocks, if owned
+    std::shared_ptr<const void> storage; ///< What holds the blocks, if not owned
+    const std::byte* blocks = nullptr;
+    size_t blocks_count = 0;
+    size_t slots = 0;
+    size_t block_lines = 0;
+    MBR root_bounds;
+};
+
+/**
+ * @brief Extracts numeric values from a string line
+ * @param line Input string containing numbers
+ * @return Vector of strings containing extracted numbers
+ *
+ * Extracts numbers (including negative numbers and decimals) from the input string,
+ * ignoring any non-numeric characters.
+ */
+inline std::vector<std::string> extract_numbers(const std::string& line) {
+    std::vector<std::string> numbers;
+    std::string curr;
+
+    for (size_t i = 0; i < line.length(); ++i) {
+        if (std::isdigit(line[i]) ||
+            (line[i] == '-' && (i == 0 || !std::isdigit(line[i-1]))) ||
+            (line[i] == '.' && !curr.empty() && std::isdigit(curr.back()))) {
+            curr += line[i];
+            } else {
+                if (!curr.empty()) {
+                    numbers.push_back(curr);
+                    curr.clear();
+                }
+            }
+    }
+    if (!curr.empty())
+        numbers.push_back(curr);
+
+    return numbers;
+}
+
+/**
+ * @brief Loads an R-tree text file into a flat R-tree
+ * @param filename Path to the input file containing R-tree structure
+ * @return The flat R-tree, empty if the file has no nodes
+ * @throw Exits with error if the file cannot be opened
+ *
+ * Each line in the file represents a node in the format written by the r_tree bulk loading program,
+ * children before their parents and the root last:
+ * [level_flag, node_id, [[child1_id, child1_MBR], [child2_id, child2_MBR], ...]]
+ */
+inline FlatRTree load_flat_rtree(const std::string& filename) {
+    std::ifstream infile(filename);
+    if (!infile.is_open()) {
+        std::cerr << "Failed to open file " << filename << "\n";
+        exit(-1);
+    }
+
+    std::unordered_map<int, FlatRTree::NodeRecord> records;
+    std::string line;
+    int root_id = -1;
+
+    while (std::getline(infile, line)) {
+        const std::vector<std::string> numbers = extract_numbers(line);
+        if (numbers.size() < 2) continue;
+
+        const int node_id = std::stoi(numbers[1]);
+        FlatRTree::NodeRecord& record = records[node_id];
+        record.children_are_leafs = numbers[0] == "0";
+        for (size_t i = 2; i + 4 < numbers.size(); i += 5) {
+            const int child_id = std::stoi(numbers[i]);
+            const double x_low = std::stod(numbers[i + 1]);
+            const double x_high = std::stod(numbers[i + 2]);
+            const double y_low = std::stod(numbers[i + 3]);
+            const double y_high = std::stod(numbers[i + 4]);
+            record.children.emplace_back(child_id, MBR(x_low, y_low, x_high, y_high));
+        }
+        root_id = node_id;
+    }
+
+    if (root_id < 0) return {};
+    return {records, root_id};
+}
+
+#endif //FLAT_R_TREE_H
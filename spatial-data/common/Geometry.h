@@ -0,0 +1,91 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "EdgeScan.h"
+#include "PolygonFiles.h"
+
+/**
+ * The polygons of the objects, as read from coords.txt and offsets.txt: the vertices of all polygons in one pair
+ * of coordinate arrays, and the range of vertices of every object id.
+ *
+ * A polygon is the ring through its vertices, closed from the last vertex back to the first one (a ring whose
+ * last vertex repeats the first one only gets an empty closing edge).
+ */
+class PolygonSet {
+public:
+    PolygonSet() = default;
+
+    /**
+     * @param x X-coordinates of all vertices
+     * @param y Y-coordinates of all vertices
+     * @param ranges For every object id, its first vertex and one past its last vertex
+     */
+    PolygonSet(std::vector<double> x, std::vector<double> y, std::vector<std::pair<size_t, size_t>> ranges)
+        : x(std::move(x)), y(std::move(y)), ranges(std::move(ranges)) {}
+
+    /**
+     * @param id An object id
+     * @return True if the object has a polygon
+     */
+    [[nodiscard]] bool contains(const int32_t id) const {
+        return id >= 0 && static_cast<size_t>(id) < ranges.size() && ranges[id].first < ranges[id].second;
+    }
+
+    /**
+     * @param id An object id, for which contains() holds
+     * @param qx X-coordinate of the point
+     * @param qy Y-coordinate of the point
+     * @return Squared Euclidean distance from the point to the polygon, 0 if the point is inside it
+     */
+    [[nodiscard]] double distance_squared(const int32_t id, const double qx, const double qy) const {
+        return EdgeScan::distance_squared(x.data(), y.data(), ranges[id].first, ranges[id].second, qx, qy);
+    }
+
+    /**
+     * @param id An object id, for which contains() holds
+     * @param rectangle The rectangle
+     * @return True if the polygon, its inside included, shares a point with the rectangle
+     */
+    [[nodiscard]] bool intersects(const int32_t id, const MBR& rectangle) const {
+        return EdgeScan::intersects(x.data(), y.data(), ranges[id].first, ranges[id].second, rectangle);
+    }
+
+    [[nodiscard]] size_t object_count() const { return ranges.size(); }
+
+private:
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<std::pair<size_t, size_t>> ranges;
+};
+
+/**
+ * @brief Loads the polygons of the objects
+ * @param coords_filename File with one "<x>,<y>" vertex per line
+ * @param offsets_filename File with one "<id>,<first vertex>,<last vertex>" line per object, both vertex indices included
+ * @param threads Threads parsing the files at most
+ * @return The polygons
+ * @throw Exits with error if a file cannot be read, or an object has a negative id or refers to vertices that are missing
+ */
+inline PolygonSet load_polygons(const std::string& coords_filename, const std::string& offsets_filename, const size_t threads) {
+    VertexColumns vertices = read_vertices(coords_filename, threads);
+    const std::vector<VertexRange> vertex_ranges = read_vertex_ranges(offsets_filename, vertices.x.size(), threads);
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (const auto& [id, first, last] : vertex_ranges) {
+        if (id < 0) {
+            std::cerr << "Error reading offsets file: negative id " << id << "\n";
+            exit(-1);
+        }
+        if (static_cast<size_t>(id) >= ranges.size()) ranges.resize(static_cast<size_t>(id) + 1);
+        ranges[id] = {first, last + 1};
+    }
+    return {std::move(vertices.x), std::move(vertices.y), std::move(ranges)};
+}
+
+#endif //GEOMETRY_H
@@ -0,0 +1,181 @@
+#ifndef NEAREST_NEIGHBORS_H
+#define NEAREST_NEIGHBORS_H
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include "FlatRTree.h"
+#include "Geometry.h"
+#include "NodeScan.h"
+
+/**
+ * @brief One result of a nearest neighbor search
+ */
+struct Neighbor {
+    int32_t id; ///< Object id
+    double distance; ///< Euclidean distance from the query point: to the polygon of the object, or else to its MBR
+};
+
+/**
+ * Incremental best-first nearest neighbor search on a flat R-tree.
+ *
+ * start() sets the query point, then every next() returns the next nearest object, so callers can stop after any
+ * number of results or page through them. Nodes, objects known by their MBR only and objects whose exact distance
+ * is known share one min-heap, keyed by squared distance. An object popped by its MBR distance, a lower bound,
+ * goes back into the heap with its distance to its polygon (when polygons are given); an object is returned once
+ * it is popped with its exact distance, which no entry left in the heap can beat.
+ *
+ * With a limit of k results, the k smallest exact distances seen so far bound the k-th result: an entry farther
+ * than the k-th of them is never pushed, and the search ends when the nearest entry left is farther. Entries at the
+ * same distance come out nodes last, then by id, so results do not depend on the order children were pushed in.
+ *
+ * The heap, the bound and the distance buffer are kept between queries, so a search allocates only while they grow.
+ * A search only reads the tree and the polygons, so every thread can run its own search on the same ones.
+ */
+class NearestNeighborSearch {
+public:
+    /**
+     * @param tree The tree, which must outlive the search
+     * @param polygons Polygons of the objects, or nullptr to measure distances to the object MBRs
+     */
+    explicit NearestNeighborSearch(const FlatRTree& tree, const PolygonSet* polygons = nullptr)
+        : tree(tree), polygons(polygons), distances(tree.slot_count()) {}
+
+    /**
+     * Starts a search; the results of the previous one are dropped.
+     * @param qx X-coordinate of the query point
+     * @param qy Y-coordinate of the query point
+     * @param limit Results next() returns at most, which lets it prune farther entries
+     */
+    void start(const double qx, const double qy, const size_t limit = std::numeric_limits<size_t>::max()) {
+        x = qx;
+        y = qy;
+        this->limit = limit;
+        returned = 0;
+        heap.clear();
+        bound.clear();
+        stats = {};
+        if (tree.empty() || limit == 0) return;
+
+        const MBR& root = tree.root_mbr();
+        const double dx = std::max({root.x_low - qx, qx - root.x_high, 0.0});
+        const double dy = std::max({root.y_low - qy, qy - root.y_high, 0.0});
+        push({dx * dx + dy * dy, static_cast<int32_t>(FlatRTree::root()), EntryKind::NODE});
+    }
+
+    /**
+     * @return The next nearest object, or nothing after the last one (or the limit)
+     */
+    std::optional<Neighbor> next() {
+        while (returned < limit && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), farther);
+            const HeapEntry entry = heap.back();
+            heap.pop_back();
+            if (entry.distance > k_th_bound()) break;
+
+            if (entry.kind == EntryKind::EXACT_OBJECT) {
+                returned++;
+                return Neighbor{entry.id, std::sqrt(entry.distance)};
+            }
+            if (entry.kind == EntryKind::OBJECT) {
+                stats.refined_objects++;
+                push_exact(entry.id, polygons->distance_squared(entry.id, x, y));
+                continue;
+            }
+
+            const FlatRTree::FlatNode node = tree.node(entry.id);
+            stats.visited_nodes++;
+            NodeScan::min_dist_squared(node, x, y, distances.data());
+            for (uint32_t slot = 0; slot < node.count; slot++) {
+                if (!node.children_are_leafs) push({distances[slot], node.child[slot], EntryKind::NODE});
+                else if (polygons != nullptr && polygons->contains(node.child[slot])) push({distances[slot], node.child[slot], EntryKind::OBJECT});
+                else push_exact(node.child[slot], distances[slot]);
+            }
+        }
+        heap.clear();
+        return std::nullopt;
+    }
+
+    /**
+     * Runs a whole search.
+     * @param qx X-coordinate of the query point
+     * @param qy Y-coordinate of the query point
+     * @param k Number of neighbors
+     * @param neighbors Receives the k nearest objects (fewer if the tree has fewer), nearest first
+     */
+    void nearest(const double qx, const double qy, const size_t k, std::vector<Neighbor>& neighbors) {
+        neighbors.clear();
+        start(qx, qy, k);
+        while (const std::optional<Neighbor> neighbor = next()) neighbors.push_back(*neighbor);
+    }
+
+    /**
+     * @brief Work done by the current search so far
+     */
+    struct Stats {
+        size_t visited_nodes = 0; ///< Nodes whose children were measured
+        size_t refined_objects = 0; ///< Objects measured against their polygon
+    };
+
+    [[nodiscard]] const Stats& search_stats() const { return stats; }
+
+private:
+    enum class EntryKind : uint8_t {
+        EXACT_OBJECT, ///< Object, with its exact distance
+        OBJECT,       ///< Object, with the distance to its MBR, to be refined
+        NODE          ///< Node (block index), with the distance to its MBR
+    };
+
+    struct HeapEntry {
+        double distance; ///< Squared distance, which orders entries as the distance does
+        int32_t id;
+        EntryKind kind;
+    };
+
+    static bool farther(const HeapEntry& a, const HeapEntry& b) {
+        if (a.distance != b.distance) return a.distance > b.distance;
+        if (a.kind != b.kind) return a.kind > b.kind;
+        return a.id > b.id;
+    }
+
+    [[nodiscard]] double k_th_bound() const {
+        return bound.size() < limit ? std::numeric_limits<double>::infinity() : bound.front();
+    }
+
+    void push(const HeapEntry& entry) {
+        if (entry.distance > k_th_bound()) return;
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end(), farther);
+    }
+
+    void push_exact(const int32_t id, const double distance) {
+        if (distance > k_th_bound()) return;
+        push({distance, id, EntryKind::EXACT_OBJECT});
+
+        //Max-heap of the `limit` smallest exact distances, returned ones included: results come out nearest
+        //first, so the limit-th result is at most as far as the largest of them. Unlimited searches keep none.
+        if (limit == std::numeric_limits<size_t>::max()) return;
+        bound.push_back(distance);
+        std::push_heap(bound.begin(), bound.end());
+        if (bound.size() > limit) {
+            std::pop_heap(bound.begin(), bound.end());
+            bound.pop_back();
+        }
+    }
+
+    const FlatRTree& tree;
+    const PolygonSet* polygons;
+    std::vector<double> distances;
+    std::vector<HeapEntry> heap;
+    std::vector<double> bound;
+    double x = 0.0;
+    double y = 0.0;
+    size_t limit = 0;
+    size_t returned = 0;
+    Stats stats;
+};
+
+#endif //NEAREST_NEIGHBORS_H
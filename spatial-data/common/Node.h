@@ -40,12 +40,12 @@ class Entry {
 public:
     int id;
     MBR mbr;
-    std::string z_value;
+    uint64_t curve_key; // Morton or Hilbert key of the MBR center, used to order the entries for packing
 
-    Entry(const int id, const MBR& mbr, std::string  z = "")
-        : id(id), mbr(mbr), z_value(std::move(z)) {}
+    Entry(const int id, const MBR& mbr, const uint64_t key = 0)
+        : id(id), mbr(mbr), curve_key(key) {}
 
-    Entry() : id(-1) {}
+    Entry() : id(-1), curve_key(0) {}
 
     [[nodiscard]] std::string toString() const {
         std::ostringstream oss;
@@ -0,0 +1,158 @@
+#ifndef NODE_SCAN_H
+#define NODE_SCAN_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include "FlatRTree.h"
+
+// Children whose hits fit one word of an intersection mask.
+constexpr size_t NODE_SCAN_MASK_BITS = 64;
+
+/**
+ * Tests of a query against all children of a flat R-tree node at once, on the node's bound arrays:
+ *
+ *   intersecting()         bit s of the mask set if child s's MBR intersects the query MBR
+ *   min_dist_squared()     squared MINDIST from the query point to every child MBR
+ *
+ * Bound arrays hold a multiple of 8 slots and unused slots hold empty MBRs, which are at infinite distance and
+ * intersect only an infinite query, so whole registers are processed without a tail; intersecting() clears the
+ * hits past the node's count. Squared distances order children as the
+ * distances do, with no square root. The AVX-512 kernels handle 8 children per instruction, the AVX2 ones 4.
+ * The kernels are picked at run time, depending on the CPU.
+ */
+class NodeScan {
+public:
+    using IntersectKernel = void (*)(const FlatRTree::FlatNode&, const MBR&, uint64_t*);
+    using DistanceKernel = void (*)(const FlatRTree::FlatNode&, double, double, double*);
+
+    /**
+     * @param slots Slots of the node
+     * @return Words of the intersection mask of a node with that many slots
+     */
+    static size_t mask_words(const size_t slots) { return (slots + NODE_SCAN_MASK_BITS - 1) / NODE_SCAN_MASK_BITS; }
+
+    /**
+     * @param node The node
+     * @param query The query MBR
+     * @param masks Receives mask_words(node.slots) words: bit s % 64 of word s / 64 is set if child s intersects the
+     *              query, for s below node.count only
+     */
+    static void intersecting(const FlatRTree::FlatNode& node, const MBR& query, uint64_t* masks) {
+        static const IntersectKernel kernel = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return &avx512_intersect_kernel;
+            if (__builtin_cpu_supports("avx2")) return &avx2_intersect_kernel;
+            return &scalar_intersect_kernel;
+        }();
+        kernel(node, query, masks);
+        for (size_t word = node.count / NODE_SCAN_MASK_BITS; word < mask_words(node.slots); word++) {
+            const size_t first = word * NODE_SCAN_MASK_BITS;
+            masks[word] &= node.count <= first ? 0 : (uint64_t{1} << (node.count - first)) - 1;
+        }
+    }
+
+    /**
+     * @param node The node
+     * @param qx X-coordinate of the query point
+     * @param qy Y-coordinate of the query point
+     * @param distances Receives node.slots squared distances, 0 for the children containing the point
+     */
+    static void min_dist_squared(const FlatRTree::FlatNode& node, const double qx, const double qy, double* distances) {
+        static const DistanceKernel kernel = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return &avx512_distance_kernel;
+            if (__builtin_cpu_supports("avx2")) return &avx2_distance_kernel;
+            return &scalar_distance_kernel;
+        }();
+        kernel(node, qx, qy, distances);
+    }
+
+    static void scalar_intersect_kernel(const FlatRTree::FlatNode& node, const MBR& query, uint64_t* masks) {
+        std::fill(masks, masks + mask_words(node.slots), 0);
+        for (size_t slot = 0; slot < node.slots; slot++) {
+            if (node.x_high[slot] < query.x_low || node.x_low[slot] > query.x_high) continue;
+            if (node.y_high[slot] < query.y_low || node.y_low[slot] > query.y_high) continue;
+            masks[slot / NODE_SCAN_MASK_BITS] |= uint64_t{1} << (slot % NODE_SCAN_MASK_BITS);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void avx2_intersect_kernel(const FlatRTree::FlatNode& node, const MBR& query, uint64_t* masks) {
+        const __m256d query_x_low = _mm256_set1_pd(query.x_low);
+        const __m256d query_y_low = _mm256_set1_pd(query.y_low);
+        const __m256d query_x_high = _mm256_set1_pd(query.x_high);
+        const __m256d query_y_high = _mm256_set1_pd(query.y_high);
+
+        std::fill(masks, masks + mask_words(node.slots), 0);
+        //Ordered compares: "x_high >= query x_low" is the negation of the scalar "x_high < query x_low".
+        for (size_t slot = 0; slot < node.slots; slot += 4) {
+            const __m256d x = _mm256_and_pd(
+                _mm256_cmp_pd(_mm256_load_pd(node.x_high + slot), query_x_low, _CMP_GE_OQ),
+                _mm256_cmp_pd(_mm256_load_pd(node.x_low + slot), query_x_high, _CMP_LE_OQ));
+            const __m256d y = _mm256_and_pd(
+                _mm256_cmp_pd(_mm256_load_pd(node.y_high + slot), query_y_low, _CMP_GE_OQ),
+                _mm256_cmp_pd(_mm256_load_pd(node.y_low + slot), query_y_high, _CMP_LE_OQ));
+            const auto hits = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_and_pd(x, y)));
+            masks[slot / NODE_SCAN_MASK_BITS] |= hits << (slot % NODE_SCAN_MASK_BITS);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    static void avx512_intersect_kernel(const FlatRTree::FlatNode& node, const MBR& query, uint64_t* masks) {
+        const __m512d query_x_low = _mm512_set1_pd(query.x_low);
+        const __m512d query_y_low = _mm512_set1_pd(query.y_low);
+        const __m512d query_x_high = _mm512_set1_pd(query.x_high);
+        const __m512d query_y_high = _mm512_set1_pd(query.y_high);
+
+        std::fill(masks, masks + mask_words(node.slots), 0);
+        for (size_t slot = 0; slot < node.slots; slot += 8) {
+            __mmask8 hits = _mm512_cmp_pd_mask(_mm512_load_pd(node.x_high + slot), query_x_low, _CMP_GE_OQ);
+            hits = _mm512_mask_cmp_pd_mask(hits, _mm512_load_pd(node.x_low + slot), query_x_high, _CMP_LE_OQ);
+            hits = _mm512_mask_cmp_pd_mask(hits, _mm512_load_pd(node.y_high + slot), query_y_low, _CMP_GE_OQ);
+            hits = _mm512_mask_cmp_pd_mask(hits, _mm512_load_pd(node.y_low + slot), query_y_high, _CMP_LE_OQ);
+            masks[slot / NODE_SCAN_MASK_BITS] |= static_cast<uint64_t>(hits) << (slot % NODE_SCAN_MASK_BITS);
+        }
+    }
+
+    static void scalar_distance_kernel(const FlatRTree::FlatNode& node, const double qx, const double qy, double* distances) {
+        for (size_t slot = 0; slot < node.slots; slot++) {
+            const double dx = std::max(std::max(node.x_low[slot] - qx, qx - node.x_high[slot]), 0.0);
+            const double dy = std::max(std::max(node.y_low[slot] - qy, qy - node.y_high[slot]), 0.0);
+            distances[slot] = dx * dx + dy * dy;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void avx2_distance_kernel(const FlatRTree::FlatNode& node, const double qx, const double qy, double* distances) {
+        const __m256d x = _mm256_set1_pd(qx);
+        const __m256d y = _mm256_set1_pd(qy);
+        const __m256d zero = _mm256_setzero_pd();
+        for (size_t slot = 0; slot < node.slots; slot += 4) {
+            //At most one of the two differences is positive: the gap on the side of the point, if any.
+            const __m256d dx = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(_mm256_load_pd(node.x_low + slot), x),
+                                                           _mm256_sub_pd(x, _mm256_load_pd(node.x_high + slot))), zero);
+            const __m256d dy = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(_mm256_load_pd(node.y_low + slot), y),
+                                                           _mm256_sub_pd(y, _mm256_load_pd(node.y_high + slot))), zero);
+            _mm256_storeu_pd(distances + slot, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    static void avx512_distance_kernel(const FlatRTree::FlatNode& node, const double qx, const double qy, double* distances) {
+        const __m512d x = _mm512_set1_pd(qx);
+        const __m512d y = _mm512_set1_pd(qy);
+        const __m512d zero = _mm512_setzero_pd();
+        //A zero-masked max over all lanes is the plain max, whose GCC 12 header warns about an uninitialized value.
+        constexpr __mmask8 ALL = 0xFF;
+        for (size_t slot = 0; slot < node.slots; slot += 8) {
+            const __m512d dx = _mm512_maskz_max_pd(ALL, _mm512_maskz_max_pd(ALL, _mm512_sub_pd(_mm512_load_pd(node.x_low + slot), x),
+                                                                            _mm512_sub_pd(x, _mm512_load_pd(node.x_high + slot))), zero);
+            const __m512d dy = _mm512_maskz_max_pd(ALL, _mm512_maskz_max_pd(ALL, _mm512_sub_pd(_mm512_load_pd(node.y_low + slot), y),
+                                                                            _mm512_sub_pd(y, _mm512_load_pd(node.y_high + slot))), zero);
+            _mm512_storeu_pd(distances + slot, _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+        }
+    }
+};
+
+#endif //NODE_SCAN_H
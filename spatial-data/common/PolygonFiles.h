@@ -0,0 +1,224 @@
+#ifndef POLYGON_FILES_H
+#define POLYGON_FILES_H
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "WorkStealing.h"
+
+// Bytes of a text file parsed as one batch, by one thread.
+constexpr size_t INGEST_CHUNK_BYTES = 1 << 20;
+
+/**
+ * A text file mapped read-only, unmapped when the object is destroyed.
+ */
+class MappedTextFile {
+public:
+    /**
+     * @param filename The file
+     * @throw Exits with error if the file cannot be opened or mapped
+     */
+    explicit MappedTextFile(const std::string& filename) {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        struct stat status{};
+        if (fd < 0 || ::fstat(fd, &status) != 0) {
+            std::cerr << "Failed to open file " << filename << "\n";
+            exit(-1);
+        }
+        size = static_cast<size_t>(status.st_size);
+        //An empty file cannot be mapped, and has no lines anyway.
+        void* mapping = size == 0 ? nullptr : ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Failed to map " << filename << "\n";
+            exit(-1);
+        }
+        if (mapping != nullptr) ::madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+    }
+
+    ~MappedTextFile() {
+        if (data != nullptr) ::munmap(const_cast<char*>(data), size);
+    }
+
+    MappedTextFile(const MappedTextFile&) = delete;
+    MappedTextFile& operator=(const MappedTextFile&) = delete;
+
+    [[nodiscard]] std::string_view text() const { return {data, size}; }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief Parses every line of a text file, in chunks spread over threads
+ * @param filename The file
+ * @param threads Threads parsing chunks at most
+ * @param resize Called once, as resize(line_count), before any line is parsed
+ * @param parse_line Called as parse_line(line_number, line) for every line, from 0 and without its line break,
+ *                   concurrently for lines of different chunks; returns false if the line is malformed
+ * @return Number of lines
+ * @throw Exits with error if the file cannot be mapped, or a line is malformed
+ *
+ * The mapped file is cut into chunks of about INGEST_CHUNK_BYTES, each starting after a line break. The threads
+ * first count the lines of every chunk, which gives the number of the first line of every chunk, then parse the
+ * chunks, so every line is parsed straight into its place in the caller's arrays.
+ */
+template<typename Resize, typename ParseLine>
+size_t parse_lines(const std::string& filename, const size_t threads, const Resize& resize, const ParseLine& parse_line) {
+    const MappedTextFile file(filename);
+    const std::string_view text = file.text();
+
+    const size_t chunk_count = std::max<size_t>(1, (text.size() + INGEST_CHUNK_BYTES - 1) / INGEST_CHUNK_BYTES);
+    std::vector<size_t> chunk_begin(chunk_count + 1, text.size());
+    chunk_begin[0] = 0;
+    for (size_t chunk = 1; chunk < chunk_count; chunk++) {
+        const size_t line_break = text.find('\n', std::max(chunk_begin[chunk - 1], text.size() * chunk / chunk_count));
+        chunk_begin[chunk] = line_break == std::string_view::npos ? text.size() : line_break + 1;
+    }
+
+    //first_line[c] counts the lines of chunk c first, then becomes the number of its first line.
+    std::vector<size_t> first_line(chunk_count + 1, 0);
+    for_each_batch_work_stealing(chunk_count, threads, [&](size_t, const size_t chunk) {
+        const std::string_view lines = text.substr(chunk_begin[chunk], chunk_begin[chunk + 1] - chunk_begin[chunk]);
+        first_line[chunk + 1] = static_cast<size_t>(std::count(lines.begin(), lines.end(), '\n')) +
+                                (!lines.empty() && lines.back() != '\n' ? 1 : 0);
+    });
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) first_line[chunk + 1] += first_line[chunk];
+    resize(first_line[chunk_count]);
+
+    //The first malformed line of every chunk; threads do not exit the process themselves.
+    std::vector<size_t> malformed(chunk_count, std::numeric_limits<size_t>::max());
+    for_each_batch_work_stealing(chunk_count, threads, [&](size_t, const size_t chunk) {
+        size_t position = chunk_begin[chunk];
+        for (size_t line_number = first_line[chunk]; position < chunk_begin[chunk + 1]; line_number++) {
+            size_t line_end = text.find('\n', position);
+            if (line_end == std::string_view::npos) line_end = text.size();
+            std::string_view line = text.substr(position, line_end - position);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (!parse_line(line_number, line)) {
+                malformed[chunk] = line_number;
+                return;
+            }
+            position = line_end + 1;
+        }
+    });
+
+    if (const size_t line_number = *std::min_element(malformed.begin(), malformed.end());
+        line_number != std::numeric_limits<size_t>::max()) {
+        std::cerr << "Error reading " << filename << " on line " << line_number + 1 << "\n";
+        exit(-1);
+    }
+    return first_line[chunk_count];
+}
+
+/**
+ * @brief Parses a number of a text line, after blanks
+ * @param position Start of the number, moved past it
+ * @param end End of the line
+ * @param value Receives the number, rounded as std::stod would
+ * @return False if no number starts there
+ */
+template<typename Number>
+bool parse_number(const char*& position, const char* const end, Number& value) {
+    while (position != end && (*position == ' ' || *position == '\t')) position++;
+    const auto [number_end, error] = std::from_chars(position, end, value);
+    if (error != std::errc()) return false;
+    position = number_end;
+    return true;
+}
+
+/**
+ * @brief Skips a separator of a text line, and the blanks before it
+ * @param position Start of the separator, moved past it
+ * @param end End of the line
+ * @param separator The separator; '\0' to skip blanks up to the end of the line
+ * @return False if the separator is not there, or something but blanks is left before the end of the line
+ */
+inline bool parse_separator(const char*& position, const char* const end, const char separator) {
+    while (position != end && (*position == ' ' || *position == '\t')) position++;
+    if (separator == '\0') return position == end;
+    if (position == end || *position != separator) return false;
+    position++;
+    return true;
+}
+
+/**
+ * @brief The vertices of all polygons, as two coordinate arrays
+ */
+struct VertexColumns {
+    std::vector<double> x; ///< X-coordinate of every vertex
+    std::vector<double> y; ///< Y-coordinate of every vertex
+};
+
+/**
+ * @brief The vertices of one polygon, as a line of an offsets file
+ */
+struct VertexRange {
+    int32_t id; ///< Object id
+    size_t first; ///< First vertex
+    size_t last; ///< Last vertex, included
+};
+
+/**
+ * @brief Reads a coords file
+ * @param filename File with one "<x>,<y>" vertex per line
+ * @param threads Threads parsing it at most
+ * @return The vertices, in file order
+ * @throw Exits with error if the file cannot be read, or a line is malformed
+ */
+inline VertexColumns read_vertices(const std::string& filename, const size_t threads) {
+    VertexColumns vertices;
+    parse_lines(filename, threads,
+        [&](const size_t line_count) {
+            vertices.x.resize(line_count);
+            vertices.y.resize(line_count);
+        },
+        [&](const size_t line_number, const std::string_view line) {
+            const char* position = line.data();
+            const char* const end = line.data() + line.size();
+            return parse_number(position, end, vertices.x[line_number]) && parse_separator(position, end, ',') &&
+                   parse_number(position, end, vertices.y[line_number]) && parse_separator(position, end, '\0');
+        });
+    return vertices;
+}
+
+/**
+ * @brief Reads an offsets file
+ * @param filename File with one "<id>,<first vertex>,<last vertex>" line per object, both vertex indices included
+ * @param vertex_count Number of vertices of the coords file the offsets refer to
+ * @param threads Threads parsing it at most
+ * @return The vertex ranges, in file order
+ * @throw Exits with error if the file cannot be read, or a line is malformed or refers to vertices that are missing
+ */
+inline std::vector<VertexRange> read_vertex_ranges(const std::string& filename, const size_t vertex_count, const size_t threads) {
+    std::vector<VertexRange> ranges;
+    parse_lines(filename, threads,
+        [&](const size_t line_count) { ranges.resize(line_count); },
+        [&](const size_t line_number, const std::string_view line) {
+            const char* position = line.data();
+            const char* const end = line.data() + line.size();
+            VertexRange& range = ranges[line_number];
+            return parse_number(position, end, range.id) && parse_separator(position, end, ',') &&
+                   parse_number(position, end, range.first) && parse_separator(position, end, ',') &&
+                   parse_number(position, end, range.last) && parse_separator(position, end, '\0') &&
+                   range.first <= range.last && range.last < vertex_count;
+        });
+    return ranges;
+}
+
+#endif //POLYGON_FILES_H
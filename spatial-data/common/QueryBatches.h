@@ -0,0 +1,100 @@
+#ifndef QUERY_BATCHES_H
+#define QUERY_BATCHES_H
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "WorkStealing.h"
+
+// Batches read, run and written out together, which bounds the memory held by results.
+constexpr size_t QUERY_BATCHES_PER_ROUND = 256;
+constexpr size_t DEFAULT_QUERY_BATCH_SIZE = 256;
+
+/**
+ * @brief How a query file is spread over threads
+ */
+struct QueryBatchOptions {
+    size_t threads; ///< Threads running queries
+    size_t batch_size; ///< Queries per batch: a thread takes or steals whole batches
+};
+
+/**
+ * @return The default options: one thread per core, DEFAULT_QUERY_BATCH_SIZE queries per batch
+ */
+inline QueryBatchOptions default_query_batch_options() {
+    return {std::max<size_t>(std::thread::hardware_concurrency(), 1), DEFAULT_QUERY_BATCH_SIZE};
+}
+
+/**
+ * @brief Parses "--threads=<N>" or "--batch-size=<N>"
+ * @param name Option name
+ * @param value Option value
+ * @param options Receives the value
+ * @return False if the option is neither of them
+ * @throw std::invalid_argument if the value is not a positive number
+ */
+inline bool parse_query_batch_option(const std::string& name, const std::string& value, QueryBatchOptions& options) {
+    size_t* const option = name == "--threads" ? &options.threads : name == "--batch-size" ? &options.batch_size : nullptr;
+    if (option == nullptr) return false;
+    *option = std::stoull(value);
+    if (*option == 0) throw std::invalid_argument(value);
+    return true;
+}
+
+/**
+ * @brief Appends a number to an output buffer, in the shortest form that reads back the same
+ * @param out The buffer
+ * @param value The number
+ */
+template<typename Number>
+void append_number(std::string& out, const Number value) {
+    char digits[32];
+    const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, end);
+}
+
+/**
+ * @brief Runs every line of a query file, in batches spread over threads, and writes out the output in query order
+ * @param infile The query file, one query per line
+ * @param options Threads and batch size
+ * @param run_query Called as run_query(thread, query_number, line, out) for every line, concurrently for lines of
+ *                  different batches; appends the output of the query to out
+ * @return Number of queries
+ *
+ * Lines are read in rounds of QUERY_BATCHES_PER_ROUND batches. The batches of a round are spread over the threads by
+ * for_each_batch_work_stealing(), so a thread may keep per-thread state, indexed by its thread number, in
+ * [0, options.threads). Every batch has its own output buffer; when the round is done, the buffers are written out
+ * in order, one write per batch, before the next round is read, so the output streams out in bounded memory and is
+ * the same for any number of threads.
+ */
+template<typename RunQuery>
+size_t run_query_batches(std::istream& infile, const QueryBatchOptions& options, const RunQuery& run_query) {
+    std::vector<std::string> lines(options.batch_size * QUERY_BATCHES_PER_ROUND);
+    std::vector<std::string> outputs(QUERY_BATCHES_PER_ROUND);
+
+    size_t first_query = 0;
+    while (infile) {
+        size_t query_count = 0;
+        while (query_count < lines.size() && std::getline(infile, lines[query_count])) query_count++;
+        const size_t batch_count = (query_count + options.batch_size - 1) / options.batch_size;
+
+        for_each_batch_work_stealing(batch_count, options.threads, [&](const size_t thread, const size_t batch) {
+            std::string& out = outputs[batch];
+            out.clear();
+            for (size_t i = batch * options.batch_size; i < std::min(query_count, (batch + 1) * options.batch_size); i++)
+                run_query(thread, first_query + i, lines[i], out);
+        });
+
+        for (size_t batch = 0; batch < batch_count; batch++)
+            std::cout.write(outputs[batch].data(), static_cast<std::streamsize>(outputs[batch].size()));
+        first_query += query_count;
+    }
+    std::cout.flush();
+    return first_query;
+}
+
+#endif //QUERY_BATCHES_H
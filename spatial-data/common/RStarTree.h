@@ -0,0 +1,410 @@
+#ifndef R_STAR_TREE_H
+#define R_STAR_TREE_H
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "FlatRTree.h"
+#include "Node.h"
+
+/**
+ * Dynamic R-tree on the InternalNode structure of the bulk loader, updated with the R*-tree algorithms
+ * (Beckmann et al., 1990):
+ *
+ *   insert()   ChooseSubtree (least overlap enlargement above the leaves, least area enlargement higher up),
+ *              then, on the first overflow of a level during an insertion, forced reinsert of the 30% of the
+ *              children farthest from the node center; on later overflows, the split along the axis with the
+ *              least margin, at the distribution with the least overlap
+ *   remove()   FindLeaf, then CondenseTree: underfull nodes are removed and their children inserted again
+ *
+ * Levels count from the nodes whose children are objects (level 0) up to the root. Node MBRs are kept up to date
+ * incrementally: they are enlarged on the way down an insertion, and recomputed (recompute_node_mbr) only for the
+ * nodes that lost children, and their ancestors until one's MBR does not change.
+ *
+ * Object MBRs are kept by id, so an object is removed (or replaced) by its id alone.
+ */
+class RStarTree {
+public:
+    // Share of the fanout moved out of a node on its first overflow, as R* proposes.
+    static constexpr double REINSERT_SHARE = 0.3;
+
+    /**
+     * An empty tree.
+     * @param max_children Children of a full node
+     * @param min_children Children of any node but the root at least, at most max_children / 2
+     */
+    RStarTree(const size_t max_children, const size_t min_children)
+        : max_children(max_children), min_children(min_children),
+          reinsert_count(std::max<size_t>(1, static_cast<size_t>(static_cast<double>(max_children) * REINSERT_SHARE))) {}
+
+    /**
+     * A tree holding the nodes of a flat R-tree. Nodes are numbered by block index, node MBRs recomputed from their children.
+     * @param tree The flat tree
+     * @param max_children Children of a full node
+     * @param min_children Children of any node but the root at least, at most max_children / 2
+     */
+    RStarTree(const FlatRTree& tree, const size_t max_children, const size_t min_children) : RStarTree(max_children, min_children) {
+        if (tree.empty()) return;
+        root = unflatten(tree, FlatRTree::root(), root_level);
+        next_node_id = static_cast<int>(tree.node_count());
+    }
+
+    /**
+     * Inserts an object, or replaces it if the tree has one with the same id.
+     * @param id Object id
+     * @param mbr Its MBR
+     * @return False if the object replaced one with the same id
+     */
+    bool insert(const int id, const MBR& mbr) {
+        const bool replaced = remove(id);
+        objects[id] = mbr;
+        if (!root) {
+            root = std::make_shared<InternalNode>(next_node_id++, mbr, true);
+            root_level = 0;
+        }
+        insert_entries({{std::make_shared<Node>(id, mbr), 0}});
+        return !replaced;
+    }
+
+    /**
+     * Removes an object.
+     * @param id Object id
+     * @return False if the tree has no object with that id
+     */
+    bool remove(const int id) {
+        const auto object = objects.find(id);
+        if (object == objects.end()) return false;
+
+        std::vector<InternalNode*> path{root.get()};
+        const bool found = find_leaf(id, object->second, path);
+        objects.erase(object);
+        if (!found) return false;
+        auto& leaf_children = path.back()->children;
+        leaf_children.erase(std::find_if(leaf_children.begin(), leaf_children.end(),
+                                         [id](const std::shared_ptr<Node>& child) { return child->node_id == id; }));
+
+        //CondenseTree: an underfull node leaves its parent, and its children are inserted again at its level.
+        std::vector<PendingEntry> orphans;
+        bool changed = true;
+        for (size_t depth = path.size() - 1; depth > 0 && changed; depth--) {
+            InternalNode& node = *path[depth];
+            if (node.children.size() >= min_children) {
+                changed = recompute_changed(node);
+                continue;
+            }
+            for (auto& child : node.children) orphans.push_back({std::move(child), root_level - depth});
+            auto& siblings = path[depth - 1]->children;
+            siblings.erase(std::find_if(siblings.begin(), siblings.end(),
+                                        [&node](const std::shared_ptr<Node>& child) { return child.get() == &node; }));
+        }
+        if (changed && !root->children.empty()) recompute_node_mbr(*root);
+
+        for (PendingEntry& orphan : orphans) insert_entries({std::move(orphan)});
+        while (!root->children_are_leafs && root->children.size() == 1) {
+            root = std::static_pointer_cast<InternalNode>(root->children.front());
+            root_level--;
+        }
+        if (root->children.empty()) root.reset();
+        return true;
+    }
+
+    /**
+     * @param id Object id
+     * @return True if the tree has an object with that id
+     */
+    [[nodiscard]] bool contains(const int id) const { return objects.count(id) != 0; }
+
+    /**
+     * @return Number of objects
+     */
+    [[nodiscard]] size_t size() const { return objects.size(); }
+
+    /**
+     * @return Number of node levels, 0 for an empty tree
+     */
+    [[nodiscard]] size_t height() const { return root ? root_level + 1 : 0; }
+
+    /**
+     * @return The root node, null for an empty tree
+     */
+    [[nodiscard]] const std::shared_ptr<InternalNode>& root_node() const { return root; }
+
+    /**
+     * @return The tree in the flat layout of the query programs
+     */
+    [[nodiscard]] FlatRTree flatten() const { return root ? FlatRTree(*root) : FlatRTree(); }
+
+private:
+    /**
+     * A node or an object to insert, and the level of the node to put it in.
+     */
+    struct PendingEntry {
+        std::shared_ptr<Node> node;
+        size_t level;
+    };
+
+    /**
+     * How inserting below a node changed it.
+     */
+    struct InsertResult {
+        std::shared_ptr<InternalNode> sibling; ///< The node split off it, to add to its parent
+        bool shrunk = false; ///< Its MBR may have shrunk: children moved out for reinsertion
+    };
+
+    std::shared_ptr<InternalNode> unflatten(const FlatRTree& tree, const size_t block, size_t& level) {
+        const FlatRTree::FlatNode flat_node = tree.node(block);
+        auto node = std::make_shared<InternalNode>(static_cast<int>(block), MBR(), flat_node.children_are_leafs);
+        level = 0;
+        for (uint32_t slot = 0; slot < flat_node.count; slot++) {
+            const MBR mbr = flat_node.child_mbr(slot);
+            if (flat_node.children_are_leafs) {
+                node->children.push_back(std::make_shared<Node>(flat_node.child[slot], mbr));
+                objects[flat_node.child[slot]] = mbr;
+                continue;
+            }
+            size_t child_level = 0;
+            node->children.push_back(unflatten(tree, flat_node.child[slot], child_level));
+            level = child_level + 1;
+        }
+        if (!node->children.empty()) recompute_node_mbr(*node);
+        return node;
+    }
+
+    /**
+     * Inserts entries, and the entries their insertion moves out for reinsertion, as one insertion: every level
+     * reinserts on its first overflow only.
+     */
+    void insert_entries(std::vector<PendingEntry> pending) {
+        std::vector<bool> reinserted(root_level + 1, false);
+        for (size_t i = 0; i < pending.size(); i++) {
+            const PendingEntry entry = std::move(pending[i]);
+            const InsertResult result = insert_below(*root, root_level, entry, reinserted, pending);
+            if (!result.sibling) continue;
+
+            //The root split: the tree grows by one level.
+            auto new_root = std::make_shared<InternalNode>(next_node_id++, root->mbr, false);
+            update_parent_mbr(new_root->mbr, result.sibling->mbr);
+            new_root->children = {root, result.sibling};
+            root = std::move(new_root);
+            root_level++;
+            reinserted.push_back(false);
+        }
+    }
+
+    InsertResult insert_below(InternalNode& node, const size_t level, const PendingEntry& entry,
+                              std::vector<bool>& reinserted, std::vector<PendingEntry>& pending) {
+        InsertResult result;
+        if (node.children.empty()) node.mbr = entry.node->mbr;
+        update_parent_mbr(node.mbr, entry.node->mbr);
+
+        if (level == entry.level) {
+            node.children.push_back(entry.node);
+        } else {
+            auto& child = static_cast<InternalNode&>(*node.children[choose_subtree(node, level, entry.node->mbr)]);
+            const InsertResult below = insert_below(child, level - 1, entry, reinserted, pending);
+            if (below.sibling) node.children.push_back(below.sibling);
+            if (below.shrunk) result.shrunk = recompute_changed(node);
+        }
+        if (node.children.size() <= max_children) return result;
+
+        //OverflowTreatment
+        if (level != root_level && !reinserted[level]) {
+            reinserted[level] = true;
+            reinsert(node, level, pending);
+            result.shrunk = true;
+        } else {
+            result.sibling = split(node);
+            result.shrunk = true;
+        }
+        return result;
+    }
+
+    /**
+     * @return Index of the child of the node to insert an MBR below
+     */
+    size_t choose_subtree(const InternalNode& node, const size_t level, const MBR& mbr) const {
+        size_t best = 0;
+        double best_overlap = std::numeric_limits<double>::infinity();
+        double best_enlargement = std::numeric_limits<double>::infinity();
+        double best_area = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < node.children.size(); i++) {
+            const MBR& child = node.children[i]->mbr;
+            MBR enlarged = child;
+            update_parent_mbr(enlarged, mbr);
+
+            //Above the leaves, the child whose overlap with its siblings grows least.
+            double overlap = 0.0;
+            if (level == 1) {
+                for (size_t j = 0; j < node.children.size(); j++) {
+                    if (j == i) continue;
+                    overlap += overlap_area(enlarged, node.children[j]->mbr) - overlap_area(child, node.children[j]->mbr);
+                }
+            }
+            const double child_area = area(child);
+            const double enlargement = area(enlarged) - child_area;
+            if (std::tie(overlap, enlargement, child_area) < std::tie(best_overlap, best_enlargement, best_area)) {
+                best = i;
+                best_overlap = overlap;
+                best_enlargement = enlargement;
+                best_area = child_area;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Forced reinsert: moves the reinsert_count children farthest from the node center out, nearest first.
+     */
+    void reinsert(InternalNode& node, const size_t level, std::vector<PendingEntry>& pending) const {
+        const double center_x = (node.mbr.x_low + node.mbr.x_high) / 2;
+        const double center_y = (node.mbr.y_low + node.mbr.y_high) / 2;
+        const auto distance = [center_x, center_y](const std::shared_ptr<Node>& child) {
+            const double dx = (child->mbr.x_low + child->mbr.x_high) / 2 - center_x;
+            const double dy = (child->mbr.y_low + child->mbr.y_high) / 2 - center_y;
+            return dx * dx + dy * dy;
+        };
+        std::stable_sort(node.children.begin(), node.children.end(),
+                         [&distance](const auto& a, const auto& b) { return distance(a) < distance(b); });
+
+        const size_t kept = node.children.size() - reinsert_count;
+        for (size_t i = kept; i < node.children.size(); i++) pending.push_back({std::move(node.children[i]), level});
+        node.children.resize(kept);
+        recompute_node_mbr(node);
+    }
+
+    /**
+     * R* split: the axis with the least margin over all distributions, then the distribution with the least overlap.
+     * @return The new node, with the second group of children; the node keeps the first one
+     */
+    std::shared_ptr<InternalNode> split(InternalNode& node) {
+        std::vector<std::shared_ptr<Node>>& children = node.children;
+        const size_t count = children.size();
+        const size_t distributions = count - 2 * min_children + 1;
+
+        //Bounding boxes of the first k (prefix) and of the last count - k (suffix) children, for an ordering.
+        std::vector<MBR> prefix(count), suffix(count);
+        const auto boxes = [&] {
+            prefix[0] = children[0]->mbr;
+            for (size_t i = 1; i < count; i++) update_parent_mbr(prefix[i] = prefix[i - 1], children[i]->mbr);
+            suffix[count - 1] = children[count - 1]->mbr;
+            for (size_t i = count - 1; i-- > 0;) update_parent_mbr(suffix[i] = suffix[i + 1], children[i]->mbr);
+        };
+        const auto sort_by = [&children](const int axis, const bool by_high) {
+            std::stable_sort(children.begin(), children.end(), [axis, by_high](const auto& a, const auto& b) {
+                const MBR& p = a->mbr;
+                const MBR& q = b->mbr;
+                const double pa = axis == 0 ? (by_high ? p.x_high : p.x_low) : (by_high ? p.y_high : p.y_low);
+                const double qa = axis == 0 ? (by_high ? q.x_high : q.x_low) : (by_high ? q.y_high : q.y_low);
+                const double pb = axis == 0 ? (by_high ? p.x_low : p.x_high) : (by_high ? p.y_low : p.y_high);
+                const double qb = axis == 0 ? (by_high ? q.x_low : q.x_high) : (by_high ? q.y_low : q.y_high);
+                return pa != qa ? pa < qa : pb < qb;
+            });
+        };
+
+        //ChooseSplitAxis
+        int best_axis = 0;
+        double best_margin = std::numeric_limits<double>::infinity();
+        for (int axis = 0; axis < 2; axis++) {
+            double margin_sum = 0.0;
+            for (const bool by_high : {false, true}) {
+                sort_by(axis, by_high);
+                boxes();
+                for (size_t d = 0; d < distributions; d++) {
+                    const size_t first = min_children + d;
+                    margin_sum += margin(prefix[first - 1]) + margin(suffix[first]);
+                }
+            }
+            if (margin_sum < best_margin) {
+                best_margin = margin_sum;
+                best_axis = axis;
+            }
+        }
+
+        //ChooseSplitIndex
+        bool best_by_high = false;
+        size_t best_first = min_children;
+        double best_overlap = std::numeric_limits<double>::infinity();
+        double best_area = std::numeric_limits<double>::infinity();
+        for (const bool by_high : {false, true}) {
+            sort_by(best_axis, by_high);
+            boxes();
+            for (size_t d = 0; d < distributions; d++) {
+                const size_t first = min_children + d;
+                const double overlap = overlap_area(prefix[first - 1], suffix[first]);
+                const double area_sum = area(prefix[first - 1]) + area(suffix[first]);
+                if (std::tie(overlap, area_sum) < std::tie(best_overlap, best_area)) {
+                    best_overlap = overlap;
+                    best_area = area_sum;
+                    best_by_high = by_high;
+                    best_first = first;
+                }
+            }
+        }
+
+        sort_by(best_axis, best_by_high);
+        auto sibling = std::make_shared<InternalNode>(next_node_id++, MBR(), node.children_are_leafs);
+        sibling->children.assign(std::make_move_iterator(children.begin() + static_cast<std::ptrdiff_t>(best_first)),
+                                 std::make_move_iterator(children.end()));
+        children.resize(best_first);
+        recompute_node_mbr(node);
+        recompute_node_mbr(*sibling);
+        return sibling;
+    }
+
+    /**
+     * FindLeaf: the path from the root to the node holding an object, following the children that contain its MBR.
+     * @return True if found, the path then ending with that node
+     */
+    bool find_leaf(const int id, const MBR& mbr, std::vector<InternalNode*>& path) const {
+        InternalNode& node = *path.back();
+        for (const auto& child : node.children) {
+            if (node.children_are_leafs) {
+                if (child->node_id == id) return true;
+                continue;
+            }
+            if (!contains_mbr(child->mbr, mbr)) continue;
+            path.push_back(static_cast<InternalNode*>(child.get()));
+            if (find_leaf(id, mbr, path)) return true;
+            path.pop_back();
+        }
+        return false;
+    }
+
+    /**
+     * @return True if recomputing the node's MBR from its children changed it
+     */
+    static bool recompute_changed(InternalNode& node) {
+        const MBR before = node.mbr;
+        recompute_node_mbr(node);
+        return node.mbr.x_low != before.x_low || node.mbr.y_low != before.y_low ||
+               node.mbr.x_high != before.x_high || node.mbr.y_high != before.y_high;
+    }
+
+    static double area(const MBR& mbr) { return (mbr.x_high - mbr.x_low) * (mbr.y_high - mbr.y_low); }
+
+    static double margin(const MBR& mbr) { return 2 * ((mbr.x_high - mbr.x_low) + (mbr.y_high - mbr.y_low)); }
+
+    static double overlap_area(const MBR& a, const MBR& b) {
+        const double width = std::min(a.x_high, b.x_high) - std::max(a.x_low, b.x_low);
+        const double height = std::min(a.y_high, b.y_high) - std::max(a.y_low, b.y_low);
+        return width > 0 && height > 0 ? width * height : 0.0;
+    }
+
+    static bool contains_mbr(const MBR& outer, const MBR& inner) {
+        return outer.x_low <= inner.x_low && outer.y_low <= inner.y_low && outer.x_high >= inner.x_high && outer.y_high >= inner.y_high;
+    }
+
+    std::shared_ptr<InternalNode> root;
+    size_t root_level = 0;
+    std::unordered_map<int, MBR> objects;
+    int next_node_id = 0;
+    size_t max_children;
+    size_t min_children;
+    size_t reinsert_count;
+};
+
+#endif //R_STAR_TREE_H
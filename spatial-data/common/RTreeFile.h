@@ -0,0 +1,201 @@
+#ifndef R_TREE_FILE_H
+#define R_TREE_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FlatRTree.h"
+
+/**
+ * Binary R-tree file: the blocks of a FlatRTree, as they are in memory, after a fixed-size header.
+ *
+ *   RTreeFileHeader                      padded to RTREE_FILE_BLOCKS_OFFSET bytes
+ *   block[node_count]                    block_bytes each, in breadth-first order from the root
+ *
+ * The query programs map the file and run on the mapping: nothing is parsed or copied when they start, and
+ * processes querying the same tree share its pages in the page cache. Files are written in the byte order of
+ * the machine that builds them.
+ */
+constexpr char RTREE_FILE_MAGIC[8] = {'S', 'D', 'R', 'T', 'R', 'E', 'E', '\0'};
+constexpr uint32_t RTREE_FILE_VERSION = 1;
+// Flag of a tree given inserts or deletes that the coords and offsets files it was built from do not have.
+constexpr uint64_t RTREE_FILE_STALE_POLYGONS = 1;
+
+struct RTreeFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots; ///< Child slots per block
+    uint64_t node_count;
+    uint64_t block_bytes;
+    uint64_t file_size;
+    double root_x_low;
+    double root_y_low;
+    double root_x_high;
+    double root_y_high;
+    uint64_t flags; ///< RTREE_FILE_* flags; files written before the field have zeros there, the padding
+    uint32_t fanout; ///< Children of a full node the tree was built with; 0 (the padding) if not recorded
+};
+
+// Blocks start on a cache line of the mapping, which itself starts on a page.
+constexpr size_t RTREE_FILE_BLOCKS_OFFSET = (sizeof(RTreeFileHeader) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+
+/**
+ * @brief Writes a flat R-tree as a binary tree file
+ * @param tree The tree, possibly empty
+ * @param filename The file to create or replace
+ * @param flags RTREE_FILE_* flags of the tree
+ * @param fanout Children of a full node the tree was built with, for later updates; 0 if unknown
+ * @throw Exits with error if the file cannot be written
+ *
+ * The file is written next to its final name and renamed over it, so processes still mapping the old file
+ * keep reading the old tree instead of a truncated one.
+ */
+inline void write_rtree_file(const FlatRTree& tree, const std::string& filename, const uint64_t flags = 0, const size_t fanout = 0) {
+    RTreeFileHeader header{};
+    std::memcpy(header.magic, RTREE_FILE_MAGIC, sizeof(RTREE_FILE_MAGIC));
+    header.version = RTREE_FILE_VERSION;
+    header.slots = static_cast<uint32_t>(tree.slot_count());
+    header.node_count = tree.node_count();
+    header.block_bytes = tree.block_bytes();
+    header.file_size = RTREE_FILE_BLOCKS_OFFSET + tree.block_data().size();
+    header.root_x_low = tree.root_mbr().x_low;
+    header.root_y_low = tree.root_mbr().y_low;
+    header.root_x_high = tree.root_mbr().x_high;
+    header.root_y_high = tree.root_mbr().y_high;
+    header.flags = flags;
+    header.fanout = static_cast<uint32_t>(fanout);
+
+    const std::string temporary_filename = filename + ".tmp";
+    std::ofstream out(temporary_filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open " << temporary_filename << " for writing!\n";
+        exit(-1);
+    }
+    static constexpr char zeros[RTREE_FILE_BLOCKS_OFFSET] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(zeros, RTREE_FILE_BLOCKS_OFFSET - sizeof(header));
+    out.write(reinterpret_cast<const char*>(tree.block_data().data()), static_cast<std::streamsize>(tree.block_data().size()));
+    out.close();
+    if (!out || std::rename(temporary_filename.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Failed to write " << filename << "\n";
+        exit(-1);
+    }
+}
+
+/**
+ * @param filename Any file
+ * @return True if the file starts like a binary tree file (of any version)
+ */
+inline bool is_rtree_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(RTREE_FILE_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    return file && std::memcmp(magic, RTREE_FILE_MAGIC, sizeof(RTREE_FILE_MAGIC)) == 0;
+}
+
+/**
+ * @param filename Any file
+ * @return The header of a binary tree file, all zeros for any other file (text trees have none)
+ */
+inline RTreeFileHeader read_rtree_file_header(const std::string& filename) {
+    RTreeFileHeader header{};
+    if (!is_rtree_file(filename)) return header;
+    std::ifstream file(filename, std::ios::binary);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    return file ? header : RTreeFileHeader{};
+}
+
+/**
+ * @brief Checks that the polygons of the objects can be used with a tree file
+ * @param filename The tree file
+ * @throw Exits with error if the tree has inserts or deletes that the polygon files do not have
+ */
+inline void check_polygons_current(const std::string& filename) {
+    if (read_rtree_file_header(filename).flags & RTREE_FILE_STALE_POLYGONS) {
+        std::cerr << filename << " has inserts or deletes that its coords and offsets files do not have. Query it"
+                     " without the polygons, or apply the deltas with --coords and --offsets to update both.\n";
+        exit(-1);
+    }
+}
+
+/**
+ * @brief Maps a binary tree file
+ * @param filename The tree file
+ * @return A flat R-tree on the mapping, which stays mapped as long as the tree lives
+ * @throw Exits with error if the file cannot be mapped, or if its header or blocks are inconsistent
+ *
+ * Queries follow the child indices of the blocks without checking them, so every block is checked once here:
+ * its count fits the slots, the blocks of its children come after it, which also rules out cycles, and its
+ * unused slots hold the empty MBR, as FlatRTree writes them.
+ */
+inline FlatRTree map_rtree_file(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat status{};
+    if (fd < 0 || ::fstat(fd, &status) != 0) {
+        std::cerr << "Failed to open file " << filename << "\n";
+        exit(-1);
+    }
+    const auto size = static_cast<size_t>(status.st_size);
+    void* mapping = size < RTREE_FILE_BLOCKS_OFFSET ? MAP_FAILED : ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << filename << "\n";
+        exit(-1);
+    }
+    std::shared_ptr<const void> storage(mapping, [size](const void* data) { ::munmap(const_cast<void*>(data), size); });
+
+    RTreeFileHeader header{};
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, RTREE_FILE_MAGIC, sizeof(RTREE_FILE_MAGIC)) != 0 || header.version != RTREE_FILE_VERSION) {
+        std::cerr << filename << " is not an R-tree file of version " << RTREE_FILE_VERSION << ". Rebuild it with r_tree_bulk_loading.\n";
+        exit(-1);
+    }
+    const bool valid_layout = header.node_count == 0 ||
+        (header.slots > 0 && header.slots % FLAT_NODE_SLOT_ALIGNMENT == 0 && header.block_bytes == FlatRTree::block_bytes_for(header.slots) &&
+         header.node_count <= static_cast<uint64_t>(INT32_MAX) && header.node_count <= (size - RTREE_FILE_BLOCKS_OFFSET) / header.block_bytes);
+    if (!valid_layout || header.file_size != size || RTREE_FILE_BLOCKS_OFFSET + header.node_count * header.block_bytes != size) {
+        std::cerr << filename << " is truncated or corrupt\n";
+        exit(-1);
+    }
+
+    const auto* const blocks = static_cast<const std::byte*>(mapping) + RTREE_FILE_BLOCKS_OFFSET;
+    FlatRTree tree(std::move(storage), blocks, header.node_count, header.slots,
+                   {header.root_x_low, header.root_y_low, header.root_x_high, header.root_y_high});
+    for (size_t block = 0; block < tree.node_count(); block++) {
+        const FlatRTree::FlatNode node = tree.node(block);
+        bool valid = node.count <= node.slots;
+        for (uint32_t slot = 0; valid && !node.children_are_leafs && slot < node.count; slot++)
+            valid = node.child[slot] > static_cast<int64_t>(block) && static_cast<size_t>(node.child[slot]) < tree.node_count();
+        for (size_t slot = node.count; valid && slot < node.slots; slot++)
+            valid = node.x_low[slot] == std::numeric_limits<double>::infinity() && node.y_low[slot] == std::numeric_limits<double>::infinity()
+                    && node.x_high[slot] == -std::numeric_limits<double>::infinity() && node.y_high[slot] == -std::numeric_limits<double>::infinity();
+        if (!valid) {
+            std::cerr << "Corrupt node block " << block << " in " << filename << "\n";
+            exit(-1);
+        }
+    }
+    return tree;
+}
+
+/**
+ * @brief Loads an R-tree from a binary tree file or a text file, whichever the file is
+ * @param filename The tree file
+ * @return The flat R-tree, empty if the file has no nodes
+ */
+inline FlatRTree load_rtree(const std::string& filename) {
+    return is_rtree_file(filename) ? map_rtree_file(filename) : load_flat_rtree(filename);
+}
+
+#endif //R_TREE_FILE_H
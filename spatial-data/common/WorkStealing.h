@@ -0,0 +1,71 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "FlatRTree.h"
+
+/**
+ * Runs process(thread, batch) for every batch in [0, batch_count), on `threads` threads, the calling thread being
+ * one of them (thread 0).
+ *
+ * Every thread starts with an equal, contiguous range of batches and takes batches from its front. A thread whose
+ * range is empty steals the back half of the range of another thread, so threads that got cheap batches take over
+ * the batches of the others. A range is [begin, end) packed into one atomic word, and both ends are moved by
+ * compare-and-swap, so the owner and the thieves never take the same batch. Ranges only shrink, or are refilled
+ * with batches nobody else has seen, so a word never comes back to an old value.
+ *
+ * @param batch_count Number of batches, below 2^32
+ * @param threads Threads running batches at most
+ * @param process Called concurrently, for distinct batches, with the index of the calling thread, in [0, threads)
+ */
+template<typename Process>
+void for_each_batch_work_stealing(const size_t batch_count, size_t threads, const Process& process) {
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(batch_count, 1));
+    const auto pack = [](const uint64_t begin, const uint64_t end) { return begin << 32 | end; };
+    const auto begin_of = [](const uint64_t range) { return range >> 32; };
+    const auto end_of = [](const uint64_t range) { return range & UINT32_MAX; };
+
+    struct alignas(CACHE_LINE_BYTES) Range {
+        std::atomic<uint64_t> batches;
+    };
+    std::vector<Range> ranges(threads);
+    for (size_t thread = 0; thread < threads; thread++)
+        ranges[thread].batches = pack(batch_count * thread / threads, batch_count * (thread + 1) / threads);
+
+    const auto work = [&](const size_t thread) {
+        std::atomic<uint64_t>& own = ranges[thread].batches;
+        while (true) {
+            uint64_t range = own.load();
+            if (begin_of(range) < end_of(range)) {
+                if (own.compare_exchange_weak(range, pack(begin_of(range) + 1, end_of(range)))) process(thread, begin_of(range));
+                continue;
+            }
+
+            bool stolen = false;
+            for (size_t offset = 1; offset < threads && !stolen; offset++) {
+                std::atomic<uint64_t>& victim = ranges[(thread + offset) % threads].batches;
+                uint64_t victim_range = victim.load();
+                while (!stolen && begin_of(victim_range) < end_of(victim_range)) {
+                    const uint64_t split = end_of(victim_range) - (end_of(victim_range) - begin_of(victim_range) + 1) / 2;
+                    if (victim.compare_exchange_weak(victim_range, pack(begin_of(victim_range), split))) {
+                        //Thieves skip an empty range, so nobody else writes the own range until it holds the stolen batches.
+                        own.store(pack(split, end_of(victim_range)));
+                        stolen = true;
+                    }
+                }
+            }
+            if (!stolen) return;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; thread++) workers.emplace_back(work, thread);
+    work(0);
+    for (std::thread& worker : workers) worker.join();
+}
+
+#endif //WORK_STEALING_H
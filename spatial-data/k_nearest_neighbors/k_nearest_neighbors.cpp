@@ -1,229 +1,247 @@
 /**
 * @brief Entry point for k-nearest neighbor search.
  * @param argc Number of command-line arguments
- * @param argv Argument list: expects [Rtree.txt knqueries.txt <k>]
+ * @param argv Argument list: expects [Rtree.bin knqueries.txt <k>], or a text Rtree.txt, then optionally
+ *             [--threads=<N>] [--batch-size=<N>] [--coords=coords.txt --offsets=offsets.txt] [--distances];
+ *             or [bench Rtree.bin knqueries.txt <k>], then optionally the polygons and [--warmup=<N>] [--repeat=<N>] [--json=<file>]
  *
- * Loads the R-tree, reads query points, and executes k-NN searches.
+ * Loads the R-tree (and the object polygons, if given), reads query points, and executes k-NN searches. In bench
+ * mode, every query is timed alone with every method instead, and a JSON report is written (see benchmarks/Benchmark.h).
  */
 
-#include <cmath>
+#include <cstdlib>
 #include <iostream>
-#include <queue>
-#include <unordered_map>
-#include "Node.h"
-
-/*
-* @brief Priority queue entry for k-nearest neighbor search.
-*
-* Contains a pointer to an R-tree node (leaf or internal) and its minimum distance
-* from the query point. Used to prioritize exploration in best-first search.
-*/
-struct PQEntry {
-    std::shared_ptr<Node> node; ///< Pointer to the R-tree node
-    double distance; ///< Distance from the query point
-
-    bool operator>(const PQEntry& other) const {
-        return distance > other.distance;
-    }
+#include <stdexcept>
+#include "../common/NearestNeighbors.h"
+#include "../common/QueryBatches.h"
+#include "../common/RTreeFile.h"
+#include "../../benchmarks/Benchmark.h"
+
+
+/**
+ * @brief How a batch of kNN queries is run
+ */
+struct KnnQueryOptions {
+    QueryBatchOptions batches; ///< Threads, one per core by default, and queries per batch
+    std::string coords_filename; ///< Vertices of the object polygons, if distances are measured to the polygons
+    std::string offsets_filename; ///< Vertex ranges of the object polygons
+    bool print_distances = false; ///< Print "<id>:<distance>" instead of "<id>"
 };
 
 
-std::shared_ptr<InternalNode> build_tree_from_file(const std::string& filename);
-std::vector<std::string> extract_numbers(const std::string& line);
-bool mbr_intersects(const MBR& a, const MBR& b);
-double min_dist(const MBR& mbr, double qx, double qy);
-void run_kn_queries(const std::shared_ptr<InternalNode>& root, const std::string& kn_queries_filename, int k);
+KnnQueryOptions parse_knn_query_options(int argc, char* argv[], int first_option, BenchmarkOptions* benchmark = nullptr);
+void run_kn_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& kn_queries_filename, int k,
+                    const KnnQueryOptions& options);
+void benchmark_kn_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& rtree_filename,
+                          const std::string& kn_queries_filename, int k, const BenchmarkOptions& benchmark);
 
 
 
 int main(const int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: ./knqueries.out Rtree.txt knqueries.txt  <kn>\n";
+    const bool bench = argc >= 2 && std::string(argv[1]) == "bench";
+    if (argc < (bench ? 5 : 4)) {
+        std::cerr << "Usage: ./knqueries.out Rtree.bin knqueries.txt  <kn> [--threads=<N>] [--batch-size=<N>]"
+                     " [--coords=coords.txt --offsets=offsets.txt] [--distances]\n"
+                     "       ./knqueries.out bench Rtree.bin knqueries.txt <kn> [--coords=coords.txt --offsets=offsets.txt]"
+                     " [--warmup=<N>] [--repeat=<N>] [--json=<file>]\n";
         return 1;
     }
 
-    const std::string rtree_filename = argv[1];
-    const std::string kn_queries_filename = argv[2];
-    const int k = std::stoi(argv[3]);
+    const int first_argument = bench ? 2 : 1;
+    const std::string rtree_filename = argv[first_argument];
+    const std::string kn_queries_filename = argv[first_argument + 1];
+    const int k = std::stoi(argv[first_argument + 2]);
+    BenchmarkOptions benchmark = DEFAULT_BENCHMARK_OPTIONS;
+    const KnnQueryOptions options = parse_knn_query_options(argc, argv, first_argument + 3, bench ? &benchmark : nullptr);
 
-    const std::shared_ptr<InternalNode> root = build_tree_from_file(rtree_filename);
-    run_kn_queries(root, kn_queries_filename, k);
+    const FlatRTree tree = load_rtree(rtree_filename);
+    if (tree.empty()) {
+        std::cerr << "Tree is empty!\n";
+        return 1;
+    }
+    if (!options.coords_filename.empty()) check_polygons_current(rtree_filename);
+    const PolygonSet polygons = options.coords_filename.empty()
+        ? PolygonSet() : load_polygons(options.coords_filename, options.offsets_filename, options.batches.threads);
+    if (bench) benchmark_kn_queries(tree, options.coords_filename.empty() ? nullptr : &polygons, rtree_filename, kn_queries_filename, k, benchmark);
+    else run_kn_queries(tree, options.coords_filename.empty() ? nullptr : &polygons, kn_queries_filename, k, options);
     return 0;
 }
 
 
 
 /**
- * @brief Checks if two MBRs intersect
- * @param a First MBR
- * @param b Second MBR
- * @return true if MBRs intersect, false otherwise
+ * @brief Parses the optional "--name=value" arguments that follow the positional arguments
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @param benchmark If given, also receives the benchmark options (--warmup, --repeat, --json)
+ * @return The parsed options, with defaults for everything not given
+ * @throw Exits with error on an unknown option, a malformed value, or only one of --coords and --offsets
  */
-bool mbr_intersects(const MBR& a, const MBR& b) {
-    if (a.x_high < b.x_low || a.x_low > b.x_high) return false;
-    if (a.y_high < b.y_low || a.y_low > b.y_high) return false;
-    return true;
-}
-
-/**
- * @brief Extracts numbers from a string line
- * @param line Input string containing numbers
- * @return Vector of strings representing extracted numbers
- */
-std::vector<std::string> extract_numbers(const std::string& line) {
-    std::vector<std::string> numbers;
-    std::string curr;
-
-    for (size_t i = 0; i < line.length(); ++i) {
-        if (std::isdigit(line[i]) ||
-            (line[i] == '-' && (i == 0 || !std::isdigit(line[i-1]))) ||
-            (line[i] == '.' && !curr.empty() && std::isdigit(curr.back()))) {
-            curr += line[i];
-            } else {
-                if (!curr.empty()) {
-                    numbers.push_back(curr);
-                    curr.clear();
-                }
+KnnQueryOptions parse_knn_query_options(const int argc, char* argv[], const int first_option, BenchmarkOptions* benchmark) {
+    KnnQueryOptions options{default_query_batch_options(), "", "", false};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (parse_query_batch_option(name, value, options.batches)) continue;
+            if (benchmark != nullptr && parse_benchmark_option(name, value, *benchmark)) continue;
+            if (name == "--coords" || name == "--offsets") {
+                if (value.empty()) throw std::invalid_argument(value);
+                (name == "--coords" ? options.coords_filename : options.offsets_filename) = value;
+                continue;
+            }
+            if (argument == "--distances") {
+                options.print_distances = true;
+                continue;
             }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << "\n";
+        exit(-1);
     }
-    if (!curr.empty())
-        numbers.push_back(curr);
 
-    return numbers;
+    if (options.coords_filename.empty() != options.offsets_filename.empty()) {
+        std::cerr << "Give both --coords and --offsets, or neither\n";
+        exit(-1);
+    }
+    return options;
 }
 
 /**
- * @brief Builds an R-tree from a text file
- * @param filename Name of the file containing R-tree data
- * @return Root node of the constructed R-tree
+ * @brief Processes k-nearest neighbor queries from a file
+ * @param tree The flat R-tree
+ * @param polygons Polygons of the objects, to measure exact distances; nullptr to measure distances to the object MBRs
+ * @param kn_queries_filename File containing query points
+ * @param k The Number of nearest neighbors to find
+ * @param options Threads, batch size and output format
  *
- * Expected file format: same as produced by the bulk loading program (Rtree.txt).
- * Each line represents a node:
- * [level_flag, node_id, [[child1_id, child1_MBR], [child2_id, child2_MBR], ...]]
+ * The query file should contain one point per line:
+ * <x> <y>
+ * where <x> and <y> are floating-point coordinates.
+ *
+ * Every query runs a NearestNeighborSearch limited to k results. The queries are run in batches spread over the
+ * threads by run_query_batches(), every thread with its own search (and heap), and the output is the same for any
+ * number of threads.
+ *
+ * With polygons, the MBR distances of the tree are the filter and the polygon distances the refinement: the nodes
+ * visited, the objects measured against their polygon and the neighbors found are printed to std::cerr at the end.
  */
-std::shared_ptr<InternalNode> build_tree_from_file(const std::string& filename) {
-    std::ifstream infile(filename);
+void run_kn_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& kn_queries_filename, const int k,
+                    const KnnQueryOptions& options) {
+    std::ifstream infile(kn_queries_filename);
     if (!infile.is_open()) {
-        std::cerr << "Failed to open file " << filename << "\n";
+        std::cerr << "Failed to open file " << kn_queries_filename << "\n";
         exit(-1);
     }
 
-    std::unordered_map<int, std::shared_ptr<InternalNode>> id_to_node;
-    std::string line;
-    std::shared_ptr<InternalNode> root = nullptr;
-
-    while (std::getline(infile, line)) {
-        std::vector<std::string> numbers = extract_numbers(line);
-
-        bool is_leaf = (numbers[0] == "0");
-        int node_id = std::stoi(numbers[1]);
-        auto internal_node = std::make_shared<InternalNode>(node_id, MBR{}, is_leaf);
-
-        for (int i = 2; i < numbers.size(); i += 5) {
-            int child_id = std::stoi(numbers[i]);
-            double x_low = std::stod(numbers[i + 1]);
-            double y_low = std::stod(numbers[i + 3]);
-            double x_high = std::stod(numbers[i + 2]);
-            double y_high = std::stod(numbers[i + 4]);
-
-            MBR mbr(x_low, y_low, x_high, y_high);
-
-            if (is_leaf) {
-                auto leaf = std::make_shared<Node>(child_id, mbr);
-                internal_node->children.push_back(leaf);
-            } else {
-                auto child_it = id_to_node.find(child_id);
-                internal_node->children.push_back(child_it->second);
+    //Per-thread state, on its own cache lines.
+    struct alignas(CACHE_LINE_BYTES) Worker {
+        NearestNeighborSearch search;
+        std::vector<Neighbor> neighbors;
+        size_t visited_nodes = 0;
+        size_t refined_objects = 0;
+        size_t results = 0;
+    };
+    std::vector<Worker> workers;
+    workers.reserve(options.batches.threads);
+    for (size_t thread = 0; thread < options.batches.threads; thread++) workers.push_back({NearestNeighborSearch(tree, polygons), {}});
+
+    const size_t query_count = run_query_batches(infile, options.batches, [&](const size_t thread, const size_t query_number, const std::string& line, std::string& out) {
+        Worker& worker = workers[thread];
+        char* end = nullptr;
+        const double x = std::strtod(line.c_str(), &end);
+        const double y = std::strtod(end, nullptr);
+        worker.search.nearest(x, y, static_cast<size_t>(std::max(k, 0)), worker.neighbors);
+        worker.visited_nodes += worker.search.search_stats().visited_nodes;
+        worker.refined_objects += worker.search.search_stats().refined_objects;
+        worker.results += worker.neighbors.size();
+
+        append_number(out, query_number);
+        out += "(";
+        append_number(out, worker.neighbors.size());
+        out += "): ";
+        for (const Neighbor& neighbor : worker.neighbors) {
+            append_number(out, neighbor.id);
+            if (options.print_distances) {
+                out += ':';
+                append_number(out, neighbor.distance);
             }
+            out += ' ';
         }
-
-        recompute_node_mbr(*internal_node);
-        id_to_node[node_id] = internal_node;
-        root = internal_node;
-    }
-
-    infile.close();
-
-    if (!root) {
-        std::cerr << "Tree is empty!\n";
-        return nullptr;
+        out += '\n';
+    });
+
+    if (polygons == nullptr) return;
+    size_t visited_nodes = 0, refined_objects = 0, results = 0;
+    for (const Worker& worker : workers) {
+        visited_nodes += worker.visited_nodes;
+        refined_objects += worker.refined_objects;
+        results += worker.results;
     }
-    return root;
+    std::cerr << query_count << " queries. Filter: " << visited_nodes << " nodes visited; refinement: " << refined_objects
+              << " candidates measured against their polygon, " << results << " neighbors" << std::endl;
 }
 
 /**
- * @brief Calculates minimum distance between a point and an MBR
- * @param mbr The minimum bounding rectangle
- * @param qx X-coordinate of the query point
- * @param qy Y-coordinate of the query point
- * @return Minimum distance between point and MBR
- *
- * Computes the Euclidean distance between a query point and the closest point of the MBR.
- * If the point lies inside the MBR, the distance is 0.
- */
-double min_dist(const MBR& mbr, const double qx, const double qy) {
-    double dx = 0.0;
-    if (qx < mbr.x_low)
-        dx = mbr.x_low - qx;
-    else if (qx > mbr.x_high)
-        dx = qx - mbr.x_high;
-
-    double dy = 0.0;
-    if (qy < mbr.y_low)
-        dy = mbr.y_low - qy;
-    else if (qy > mbr.y_high)
-        dy = qy - mbr.y_high;
-
-    return std::sqrt(dx * dx + dy * dy);
-}
-
-/**
- * @brief Processes k-nearest neighbor queries from a file
- * @param root Root node of the R-tree
- * @param kn_queries_filename File containing query points
+ * @brief Benchmarks the kNN search on every query of a file, and writes a JSON report
+ * @param tree The flat R-tree
+ * @param polygons Polygons of the objects, to also benchmark the search by polygon distance; nullptr if not given
+ * @param rtree_filename File the tree was loaded from, for the report
+ * @param kn_queries_filename File containing query points, as for run_kn_queries()
  * @param k The Number of nearest neighbors to find
+ * @param benchmark Passes and report file
  *
- * The query file should contain one point per line:
- * <x> <y>
- * where <x> and <y> are floating-point coordinates.
-
+ * The queries are read into memory first, then run one at a time on the calling thread (see benchmark_method()) by
+ * knn_mbr, the search by MBR distance, and with polygons knn_polygons, the search by polygon distance. Both count the
+ * nodes_visited and the results; knn_polygons also the refined_objects, measured against their polygon.
  */
-void run_kn_queries(const std::shared_ptr<InternalNode>& root, const std::string& kn_queries_filename, int k) {
+void benchmark_kn_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& rtree_filename,
+                          const std::string& kn_queries_filename, const int k, const BenchmarkOptions& benchmark) {
     std::ifstream infile(kn_queries_filename);
     if (!infile.is_open()) {
         std::cerr << "Failed to open file " << kn_queries_filename << "\n";
         exit(-1);
     }
-
+    std::vector<std::pair<double, double>> queries;
     std::string line;
-    int query_id = 0;
-
     while (std::getline(infile, line)) {
-        std::stringstream ss(line);
-        double x, y;
-        ss >> x >> y;
-
-        std::priority_queue<PQEntry, std::vector<PQEntry>, std::greater<>> pq;
-        pq.push({root, min_dist(root->mbr, x, y)});
-
-        std::vector<int> kn_leaf_ids;
-        while (!pq.empty() && kn_leaf_ids.size() < static_cast<size_t>(k)) {
-            PQEntry entry = pq.top();
-            pq.pop();
-
-            if (auto internal_node = std::dynamic_pointer_cast<InternalNode>(entry.node); internal_node != nullptr) {
-                for (const auto& child : internal_node->children) {
-                    pq.push({child, min_dist(child->mbr, x, y)});
-                }
-            } else {
-                kn_leaf_ids.push_back(entry.node->node_id);
-            }
-        }
-
-        std::cout << query_id++ << "(" << kn_leaf_ids.size() << "): ";
-        for (const auto& id : kn_leaf_ids) {
-            std::cout << id << " ";
-        }
-        std::cout << "\n";
+        char* end = nullptr;
+        const double x = std::strtod(line.c_str(), &end);
+        queries.emplace_back(x, std::strtod(end, nullptr));
     }
+
+    const PerfCounters perf;
+    std::vector<Neighbor> neighbors;
+    std::vector<MethodReport> reports;
+    const auto benchmark_search = [&](const std::string& name, const PolygonSet* refined_by) {
+        NearestNeighborSearch search(tree, refined_by);
+        reports.push_back(benchmark_method(name, queries.size(), benchmark, perf, [&](const size_t query, WorkCounters* counters) {
+            search.nearest(queries[query].first, queries[query].second, static_cast<size_t>(std::max(k, 0)), neighbors);
+            if (counters != nullptr) {
+                counters->add("nodes_visited", search.search_stats().visited_nodes);
+                if (refined_by != nullptr) counters->add("refined_objects", search.search_stats().refined_objects);
+                counters->add("results", neighbors.size());
+            }
+        }));
+    };
+    benchmark_search("knn_mbr", nullptr);
+    if (polygons != nullptr) benchmark_search("knn_polygons", polygons);
+
+    BenchmarkDataset dataset;
+    dataset.add("tree_file", rtree_filename);
+    dataset.add("queries_file", kn_queries_filename);
+    dataset.add("nodes", tree.node_count());
+    dataset.add("slots", tree.slot_count());
+    dataset.add("queries", queries.size());
+    dataset.add("k", static_cast<uint64_t>(std::max(k, 0)));
+    if (polygons != nullptr) dataset.add("polygons", polygons->object_count());
+    write_benchmark_report("knn", dataset, reports, benchmark, perf);
 }
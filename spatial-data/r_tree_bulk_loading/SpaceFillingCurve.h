@@ -0,0 +1,193 @@
+#ifndef SPACE_FILLING_CURVE_H
+#define SPACE_FILLING_CURVE_H
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+/**
+ * Grid cell of a longitude/latitude point: both axes are split into 2^32 cells, longitude over [-180, 180]
+ * and latitude over [-90, 90], and values outside are wrapped back in the same way as pymorton's
+ * interleave_latlng. A cell is 180 / 2^31 degrees wide in longitude and half that in latitude.
+ */
+struct GridCell {
+    uint32_t x;
+    uint32_t y;
+};
+
+// Degrees split by the most significant bit of a cell coordinate, on both axes as in pymorton.
+constexpr double GRID_TOP_BIT_DEGREES = 180.0;
+
+/**
+ * @param value Coordinate, shifted to start at 0 (longitude + 180 or latitude + 90)
+ * @return floor(value / GRID_TOP_BIT_DEGREES * 2^31), clamped to 32 bits
+ */
+inline uint32_t quantize_coordinate(const double value) {
+    if (!(value > 0.0)) return 0;
+    const double cell_size = std::ldexp(GRID_TOP_BIT_DEGREES, -31);
+    const double cells = std::floor(value / cell_size);
+    if (cells >= 4294967295.0) return UINT32_MAX;
+
+    //The division may round across a cell boundary. cell * cell_size is exact (at most 40 significant bits),
+    //so comparing it with value puts the point in the cell the exact quotient falls in.
+    auto cell = static_cast<uint64_t>(cells);
+    if (static_cast<double>(cell) * cell_size > value) cell--;
+    else if (static_cast<double>(cell + 1) * cell_size <= value) cell++;
+    return static_cast<uint32_t>(std::min<uint64_t>(cell, UINT32_MAX));
+}
+
+/**
+ * @param lng Longitude (x) of the point
+ * @param lat Latitude (y) of the point
+ * @return The grid cell of the point
+ */
+inline GridCell quantize_lng_lat(const double lng, const double lat) {
+    double x = lng + 180.0;
+    if (lng > 180.0) x = std::fmod(lng, 180.0) + 180.0;
+    else if (lng < -180.0) x = -std::fmod(-lng, 180.0) + 180.0;
+
+    double y = lat + 90.0;
+    if (lat > 90.0) y = std::fmod(lat, 90.0) + 90.0;
+    else if (lat < -90.0) y = -std::fmod(-lat, 90.0) + 90.0;
+
+    //Latitudes span only 180 degrees, so their cell coordinates never exceed 2^31.
+    return {quantize_coordinate(x), quantize_coordinate(y)};
+}
+
+/**
+ * Morton (Z-order) keys: the bits of x and y interleaved, y above x at every level, so that comparing two keys
+ * compares the base-4 digit strings of pymorton's interleave_latlng.
+ *
+ * The BMI2 kernel deposits the bits with two pdep instructions. The fallback spreads each byte through a 256-entry
+ * table. The kernel is picked at run time, depending on the CPU.
+ */
+class MortonEncoder {
+public:
+    /**
+     * @param cell A grid cell
+     * @return Its Morton key
+     */
+    static uint64_t encode(const GridCell cell) {
+        static const auto kernel = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("bmi2") ? &bmi2_kernel : &table_kernel;
+        }();
+        return kernel(cell);
+    }
+
+    __attribute__((target("bmi2")))
+    static uint64_t bmi2_kernel(const GridCell cell) {
+        return _pdep_u64(cell.x, 0x5555555555555555ULL) | _pdep_u64(cell.y, 0xAAAAAAAAAAAAAAAAULL);
+    }
+
+    static uint64_t table_kernel(const GridCell cell) {
+        return spread(cell.x) | (spread(cell.y) << 1);
+    }
+
+private:
+    // SPREAD_TABLE[b]: the bits of byte b moved to the even positions of 16 bits.
+    static constexpr std::array<uint16_t, 256> SPREAD_TABLE = [] {
+        std::array<uint16_t, 256> table{};
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t spread = 0;
+            for (int bit = 0; bit < 8; bit++) spread |= ((b >> bit) & 1) << (2 * bit);
+            table[b] = static_cast<uint16_t>(spread);
+        }
+        return table;
+    }();
+
+    static uint64_t spread(const uint32_t value) {
+        uint64_t spread = 0;
+        for (int byte = 0; byte < 4; byte++)
+            spread |= static_cast<uint64_t>(SPREAD_TABLE[(value >> (8 * byte)) & 0xFF]) << (16 * byte);
+        return spread;
+    }
+};
+
+/**
+ * @param cell A grid cell
+ * @return Its distance along the Hilbert curve of order 32 covering the grid
+ */
+inline uint64_t hilbert_key(GridCell cell) {
+    uint64_t key = 0;
+    for (uint32_t s = 1u << 31; s > 0; s >>= 1) {
+        const uint32_t rx = (cell.x & s) ? 1 : 0;
+        const uint32_t ry = (cell.y & s) ? 1 : 0;
+        key += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+
+        //Rotate the quadrant so the curve inside it starts and ends next to its neighbours. Complementing
+        //every bit reflects the lower levels, the only ones still read.
+        if (ry == 0) {
+            if (rx == 1) {
+                cell.x = ~cell.x;
+                cell.y = ~cell.y;
+            }
+            std::swap(cell.x, cell.y);
+        }
+    }
+    return key;
+}
+
+// Below this many keys per thread, keys are sorted by fewer threads.
+constexpr size_t RADIX_SORT_MIN_KEYS_PER_THREAD = size_t{1} << 16;
+constexpr int RADIX_BITS = 8;
+constexpr size_t RADIX_BUCKETS = size_t{1} << RADIX_BITS;
+
+/**
+ * Sorts (key, value) pairs by key with a least-significant-digit radix sort, one byte of the key per pass.
+ *
+ * Every pass splits the pairs into one block per thread: the threads count their block's digits, the counts are
+ * turned into a starting position per (digit, block), then every thread scatters its block. Blocks are scattered
+ * in order, so each pass is stable and pairs with equal keys keep their input order. A pass in which all keys
+ * share the digit is skipped.
+ *
+ * @param pairs The pairs to sort
+ * @param threads Threads sorting the pairs at most, one per core by default
+ */
+inline void parallel_radix_sort(std::vector<std::pair<uint64_t, int>>& pairs, size_t threads = std::thread::hardware_concurrency()) {
+    const size_t n = pairs.size();
+    threads = std::clamp<size_t>(n / RADIX_SORT_MIN_KEYS_PER_THREAD, 1, std::max<size_t>(threads, 1));
+    const auto block_begin = [n, threads](const size_t block) { return n * block / threads; };
+    const auto run_parallel = [threads](const auto& work) {
+        std::vector<std::thread> workers;
+        for (size_t block = 1; block < threads; block++) workers.emplace_back(work, block);
+        work(0);
+        for (std::thread& worker : workers) worker.join();
+    };
+
+    std::vector<std::pair<uint64_t, int>> buffer(n);
+    std::vector<std::array<size_t, RADIX_BUCKETS>> counts(threads);
+    for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+        run_parallel([&](const size_t block) {
+            counts[block].fill(0);
+            for (size_t i = block_begin(block); i < block_begin(block + 1); i++)
+                counts[block][(pairs[i].first >> shift) & (RADIX_BUCKETS - 1)]++;
+        });
+
+        size_t position = 0;
+        bool single_digit = false;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; digit++) {
+            const size_t digit_begin = position;
+            for (size_t block = 0; block < threads; block++) {
+                const size_t count = counts[block][digit];
+                counts[block][digit] = position;
+                position += count;
+            }
+            if (position - digit_begin == n) single_digit = true;
+        }
+        if (single_digit) continue;
+
+        run_parallel([&](const size_t block) {
+            for (size_t i = block_begin(block); i < block_begin(block + 1); i++)
+                buffer[counts[block][(pairs[i].first >> shift) & (RADIX_BUCKETS - 1)]++] = pairs[i];
+        });
+        pairs.swap(buffer);
+    }
+}
+
+#endif //SPACE_FILLING_CURVE_H
@@ -3,254 +3,294 @@
  * @brief Builds an R-tree from polygon data using MBRs and z-order values.
  *
  * This program:
- * - Reads 2D coordinates and offset records defining polygons
- * - Computes Minimum Bounding Rectangles (MBRs) for each polygon
- * - Calculates z-order values to spatially sort the entries
+ * - Reads 2D coordinates and offset records defining polygons, mapping the files and parsing them on threads
+ * - Computes Minimum Bounding Rectangles (MBRs) for each polygon, in batches spread over threads
+ * - Orders the entries for packing: by the Z-order (Morton) or Hilbert key of their MBR center, radix sorted,
+ *   or by Sort-Tile-Recursive (STR)
  * - Builds an R-tree with leaf and internal nodes (bulk loading)
- * - Outputs the R-tree structure to "Rtree.txt"
+ * - Writes the R-tree as a binary tree file ("Rtree.bin", or also as text to "Rtree.txt") and prints
+ *   the quality of every level to the console
  *
  * Usage:
- *   ./r_tree_build.out coords.txt offsets.txt
+ *   ./r_tree_build.out coords.txt offsets.txt [--packing=z-order|hilbert|str] [--fanout=<N>] [--min-children=<N>]
+ *                      [--output=<file>] [--text] [--threads=<N>]
  */
 
 
+#include <cmath>
 #include <iostream>
-#include "Node.h"
+#include <stdexcept>
+#include <thread>
+#include "../common/PolygonFiles.h"
+#include "../common/RTreeFile.h"
+#include "SpaceFillingCurve.h"
 
 
 /**
- * @brief Represents a 2D point with x and y coordinates
+ * @brief Order in which entries are packed into nodes
  */
-struct Point {
-    double x; ///< X-coordinate of the point
-    double y; ///< Y-coordinate of the point
+enum class PackingMethod {
+    Z_ORDER, ///< Entries sorted by the Morton key of their MBR center; upper levels keep that order
+    HILBERT, ///< Entries sorted by the Hilbert key of their MBR center; upper levels keep that order
+    STR      ///< Sort-Tile-Recursive: every level is cut into vertical slices by x center, each slice sorted by y center
 };
 
 /**
- * @brief Represents a record containing offset information for polygon coordinates
+ * @brief How the R-tree is bulk loaded
  */
-struct OffsetRecord {
-    int id; ///< Unique identifier for the record
-    int startOffset; ///< Starting index in the coordinates array
-    int endOffset; ///< Ending index in the coordinates array
+struct BulkLoadOptions {
+    PackingMethod packing; ///< Order of the entries and nodes packed together
+    size_t max_children; ///< Fanout: children of a full node
+    size_t min_children; ///< Children of the last node of a level at least, taken from the node before it if needed
+    std::string output = "Rtree.bin"; ///< The binary tree file to write
+    bool export_text = false; ///< Also write the tree as text to Rtree.txt
+    size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1); ///< Threads reading the input and sorting the entries
 };
 
+constexpr size_t DEFAULT_MAX_CHILDREN_PER_NODE = 20;
+// Without --min-children, a node has at least this share of the fanout (8 of 20)
+constexpr double DEFAULT_MIN_FILL = 0.4;
+// Objects whose MBRs are computed as one batch, by one thread
+constexpr size_t MBR_BATCH_OBJECTS = 4096;
 
-std::vector<Entry> computeMBRs(const std::vector<Point>& coords, const std::vector<OffsetRecord>& offsets);
-std::vector<Point> readCoords(const std::string& filename);
-std::vector<OffsetRecord> readOffsets(const std::string& filename);
-void update_z_value_to_entries(std::vector<Entry>& entries, const std::string& filename);
-void sortEntriesByZValue(std::vector<Entry>& entries);
-std::vector<std::shared_ptr<Node>> create_upper_level(const std::vector<std::shared_ptr<Node>>& nodes, int &node_id);
-void generate_z_value(std::vector<Entry>& entries);
+/**
+ * @brief Quality of the nodes of one tree level, the lower the better
+ */
+struct LevelQuality {
+    size_t nodes = 0; ///< Number of nodes of the level
+    size_t children = 0; ///< Number of children of those nodes
+    double area = 0.0; ///< Sum of the node MBR areas
+    double margin = 0.0; ///< Sum of the node MBR perimeters
+    double overlap = 0.0; ///< Sum of the areas shared by two nodes, over all pairs of nodes of the level
+    double dead_space = 0.0; ///< Sum of the node areas covered by none of their children
+};
+
+
+std::vector<Entry> computeMBRs(const VertexColumns& coords, const std::vector<VertexRange>& offsets, size_t threads);
+BulkLoadOptions parse_bulk_load_options(int argc, char* argv[], int first_option);
+void sortEntriesByCurveKey(std::vector<Entry>& entries, size_t threads);
+void sort_entries_for_packing(std::vector<Entry>& entries, const BulkLoadOptions& options);
+std::vector<std::shared_ptr<Node>> create_upper_level(const std::vector<std::shared_ptr<Node>>& nodes, int &node_id, const BulkLoadOptions& options);
+void generate_curve_keys(std::vector<Entry>& entries, PackingMethod packing);
 std::vector<std::shared_ptr<Node>> build_leaf_nodes(const std::vector<Entry>& entries);
-std::shared_ptr<InternalNode> build_tree(std::vector<std::shared_ptr<Node>>& nodes);
-std::string calculate_MBRs_centers(const std::vector<Entry>& entries);
+std::shared_ptr<InternalNode> build_tree(std::vector<std::shared_ptr<Node>>& nodes, const BulkLoadOptions& options);
+LevelQuality measure_level(const std::vector<std::shared_ptr<Node>>& nodes);
+void print_tree_quality(const std::vector<LevelQuality>& levels, const MBR& root_mbr);
+double union_area(const std::vector<MBR>& rectangles);
 
 
 int main(const int argc, char* argv[]) {
     if (argc < 3) {
-        std::cerr << "Usage: ./r_tree_build.out coords.txt offsets.txt\n";
+        std::cerr << "Usage: ./r_tree_build.out coords.txt offsets.txt [--packing=z-order|hilbert|str] [--fanout=<N>] [--min-children=<N>]"
+                     " [--output=<file>] [--text] [--threads=<N>]\n";
         return 1;
     }
 
-    const std::vector<Point> records = readCoords(argv[1]);
-    const std::vector<OffsetRecord> offsets = readOffsets(argv[2]);
-    std::vector<Entry> entries = computeMBRs(records, offsets);
-    generate_z_value(entries);
-    sortEntriesByZValue(entries);
+    const BulkLoadOptions options = parse_bulk_load_options(argc, argv, 3);
+    const VertexColumns records = read_vertices(argv[1], options.threads);
+    const std::vector<VertexRange> offsets = read_vertex_ranges(argv[2], records.x.size(), options.threads);
+    std::vector<Entry> entries = computeMBRs(records, offsets, options.threads);
+    sort_entries_for_packing(entries, options);
 
     std::vector<std::shared_ptr<Node>> leaf_nodes = build_leaf_nodes(entries);
-    std::shared_ptr<InternalNode> root = build_tree(leaf_nodes);
+    std::shared_ptr<InternalNode> root = build_tree(leaf_nodes, options);
+    //The query programs map these blocks as they are: how a fanout fits cache lines and pages.
+    const FlatRTree flat_tree = root ? FlatRTree(*root) : FlatRTree();
+    write_rtree_file(flat_tree, options.output, 0, options.max_children);
+    std::cout << "Wrote " << options.output << ": " << flat_tree.node_count() << " nodes of " << flat_tree.block_bytes()
+              << " bytes (" << flat_tree.slot_count() << " child slots)" << std::endl;
     return 0;
 }
 
 
-
 /**
- * @brief Reads coordinates from a file and converts them to Points
- * @param filename Path to the file containing coordinates
- * @return Vector of Points read from the file
- * @throw Exits with error if a file cannot be opened or read
+ * @brief Parses the optional "--name=value" arguments that follow the positional arguments
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @return The parsed options, with defaults for everything not given
+ * @throw Exits with error on an unknown option or a malformed value
  */
-std::vector<Point> readCoords(const std::string& filename) {
-    std::vector<Point> points;
-    std::string line;
-
-    std::ifstream coords_file(filename);
-    if(!coords_file.is_open()) {
-        std::cerr << "Error opening coords file\n";
-        exit(-1);
-    }
-
-
-    while (std::getline(coords_file, line)) {
-        std::stringstream ss(line);
-        std::string x, y;
-
-        bool x_read_success =  static_cast<bool>(std::getline(ss, x, ','));
-        bool y_read_success =  static_cast<bool>(std::getline(ss, y));
-        if (!x_read_success || !y_read_success) {
-            std::cerr << "Error reading coords file\n";
+BulkLoadOptions parse_bulk_load_options(const int argc, char* argv[], const int first_option) {
+    BulkLoadOptions options{PackingMethod::Z_ORDER, DEFAULT_MAX_CHILDREN_PER_NODE, 0};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (name == "--packing") {
+                if (value == "z-order") options.packing = PackingMethod::Z_ORDER;
+                else if (value == "hilbert") options.packing = PackingMethod::HILBERT;
+                else if (value == "str") options.packing = PackingMethod::STR;
+                else throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--fanout") {
+                options.max_children = std::stoull(value);
+                if (options.max_children < 2) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--min-children") {
+                options.min_children = std::stoull(value);
+                if (options.min_children == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--output") {
+                if (value.empty()) throw std::invalid_argument(value);
+                options.output = value;
+                continue;
+            }
+            if (name == "--threads") {
+                options.threads = std::stoull(value);
+                if (options.threads == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (argument == "--text") {
+                options.export_text = true;
+                continue;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
             exit(-1);
         }
 
-        points.push_back(Point{std::stod(x), std::stod(y)});
+        std::cerr << "Unknown option: " << argument << "\n";
+        exit(-1);
     }
-    return points;
-}
 
-/**
- * @brief Reads offset records from a file
- * @param filename Path to the file containing offset records
- * @return Vector of OffsetRecords read from the file
- * @throw Exits with error if a file cannot be opened or read
- */
-std::vector<OffsetRecord> readOffsets(const std::string& filename) {
-    std::vector<OffsetRecord> offsets;
-    std::string line;
-
-    std::ifstream offsets_file(filename);
-    if(!offsets_file.is_open()) {
-        std::cerr << "Error opening offsets file\n";
+    if (options.min_children == 0)
+        options.min_children = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(options.max_children) * DEFAULT_MIN_FILL));
+    //The node giving children to the last one of a level must keep at least min_children itself.
+    if (options.min_children > options.max_children / 2) {
+        std::cerr << "--min-children must be at most half of --fanout (" << options.max_children / 2 << ")\n";
         exit(-1);
     }
+    return options;
+}
 
 
-    while (std::getline(offsets_file, line)) {
-        std::stringstream ss(line);
-        std::string id, startOffset, endOffset;
-
-        bool id_read_success =  static_cast<bool>(std::getline(ss, id, ','));
-        bool startOffset_read_success =  static_cast<bool>(std::getline(ss, startOffset, ','));
-        bool endOffset_read_success =  static_cast<bool>(std::getline(ss, endOffset));
-
-        if (!id_read_success || !startOffset_read_success || !endOffset_read_success) {
-            std::cerr << "Error reading offsets file\n";
-            exit(-1);
-        }
-
-        offsets.push_back(OffsetRecord{std::stoi(id), std::stoi(startOffset), std::stoi(endOffset)});
-    }
-
-    return offsets;
-}
 
 /**
  * @brief Computes Minimum Bounding Rectangles (MBRs) for polygons defined by coordinate offsets.
  *
- * Each OffsetRecord specifies the start and end indices of a polygon's points in the coords vector.
- * The function calculates the bounding rectangle for each polygon.
+ * Each VertexRange specifies the first and last indices of a polygon's points in the coords arrays.
+ * The function calculates the bounding rectangle for each polygon. The polygons are cut into batches of
+ * MBR_BATCH_OBJECTS, spread over the threads, and every batch writes its own part of the entries.
  *
- * @param coords Vector of 2D points (all polygon coordinates)
- * @param offsets Vector of offset records defining which points belong to each polygon
- * @return Vector of Entries containing the computed MBRs
+ * @param coords Coordinates of all polygon points
+ * @param offsets Offset records defining which points belong to each polygon, all within coords
+ * @param threads Threads computing MBRs at most
+ * @return Vector of Entries containing the computed MBRs, in the order of the offsets
  */
-
-std::vector<Entry> computeMBRs(const std::vector<Point>& coords, const std::vector<OffsetRecord>& offsets) {
-    std::vector<Entry> entries;
-
-    for (const auto&[id, startOffset, endOffset] : offsets) {
-        double x_low = coords[startOffset].x;
-        double y_low = coords[startOffset].y;
-        double x_high = x_low;
-        double y_high = y_low;
-
-        for(int i = startOffset + 1; i <= endOffset; i++) {
-            x_low = std::min(x_low, coords[i].x);
-            y_low = std::min(y_low, coords[i].y);
-            x_high = std::max(x_high, coords[i].x);
-            y_high = std::max(y_high, coords[i].y);
+std::vector<Entry> computeMBRs(const VertexColumns& coords, const std::vector<VertexRange>& offsets, const size_t threads) {
+    std::vector<Entry> entries(offsets.size());
+
+    const size_t batch_count = (offsets.size() + MBR_BATCH_OBJECTS - 1) / MBR_BATCH_OBJECTS;
+    for_each_batch_work_stealing(batch_count, threads, [&](size_t, const size_t batch) {
+        for (size_t object = batch * MBR_BATCH_OBJECTS; object < std::min(offsets.size(), (batch + 1) * MBR_BATCH_OBJECTS); object++) {
+            const auto& [id, startOffset, endOffset] = offsets[object];
+            double x_low = coords.x[startOffset];
+            double y_low = coords.y[startOffset];
+            double x_high = x_low;
+            double y_high = y_low;
+
+            for (size_t i = startOffset + 1; i <= endOffset; i++) {
+                x_low = std::min(x_low, coords.x[i]);
+                y_low = std::min(y_low, coords.y[i]);
+                x_high = std::max(x_high, coords.x[i]);
+                y_high = std::max(y_high, coords.y[i]);
+            }
+            entries[object] = Entry(id, MBR(x_low, y_low, x_high, y_high));
         }
-        entries.emplace_back(id, MBR(x_low, y_low, x_high, y_high));
-    }
+    });
     return entries;
 }
 
 /**
- * @brief Calculates and writes the centers of MBRs to a file
- * @param entries Vector of entries containing MBRs
- * @return Name of the file where centers were written
- * @throw Exits with error if a file cannot be opened
+ * @brief Computes the curve key of every entry from the center of its MBR.
+ *
+ * The center is quantized to a 2^32 x 2^32 longitude/latitude grid and its cell is mapped to a 64-bit
+ * position along the Z-order or the Hilbert curve (see SpaceFillingCurve.h).
+ *
+ * @param entries Vector of entries to generate curve keys for
+ * @param packing PackingMethod::HILBERT for Hilbert keys, Morton keys otherwise
  */
-std::string calculate_MBRs_centers(const std::vector<Entry>& entries) {
-    std::ofstream out_file("MBRs_centers.txt");
-    if(!out_file.is_open()) {
-        std::cerr << "Error opening MBRs centers file\n";
-        exit(-1);
-    }
-
-    for (const auto& entry : entries) {
+void generate_curve_keys(std::vector<Entry>& entries, const PackingMethod packing) {
+    for (auto& entry : entries) {
         const double x_center = (entry.mbr.x_low + entry.mbr.x_high) / 2.0;
         const double y_center = (entry.mbr.y_low + entry.mbr.y_high) / 2.0;
-        out_file << std::setprecision(10) << x_center << "," << y_center << "\n";
+        const GridCell cell = quantize_lng_lat(x_center, y_center);
+        entry.curve_key = packing == PackingMethod::HILBERT ? hilbert_key(cell) : MortonEncoder::encode(cell);
     }
-    out_file.close();
-    return "MBRs_centers.txt";
 }
 
 /**
- * @brief Updates z-values of the provided entries by reading them from a file.
+ * @brief Sorts entries based on their curve keys
  *
- * Each line in the file corresponds to the z-value of an entry (same order as the entry vector).
+ * The (key, position) pairs are radix sorted, then the entries are moved into that order.
+ * Entries with equal keys keep their input order.
  *
- * @param entries Vector of entries to update
- * @param filename Path to the file containing z-values (one per line)
- * @throw Exits with error if the file cannot be opened
+ * @param entries Vector of entries to sort
+ * @param threads Threads sorting the keys at most
  */
-
-void update_z_value_to_entries(std::vector<Entry>& entries, const std::string& filename) {
-    std::ifstream in_file(filename);
-    if (!in_file.is_open()) {
-        std::cerr << "Failed to open z_values file\n";
-        exit(-1);
-    }
-
-    std::string line;
-    size_t index = 0;
-    while (std::getline(in_file, line) && index < entries.size()) {
-        entries[index++].z_value = line;
-    }
-
-    in_file.close();
+void sortEntriesByCurveKey(std::vector<Entry>& entries, const size_t threads) {
+    std::vector<std::pair<uint64_t, int>> keys;
+    keys.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) keys.emplace_back(entries[i].curve_key, static_cast<int>(i));
+    parallel_radix_sort(keys, threads);
+
+    std::vector<Entry> sorted;
+    sorted.reserve(entries.size());
+    for (const auto& [curve_key, i] : keys) sorted.push_back(std::move(entries[i]));
+    entries = std::move(sorted);
 }
 
-
 /**
- * @brief Generates z-values for entries using an external Python script.
+ * @brief Orders items Sort-Tile-Recursive style, so that every run of max_children items forms a compact node.
  *
- * This function:
- * 1. Calculates the centers of MBRs and writes them to "MBRs_centers.txt"
- * 2. Executes the "z_order.py" script to compute z-values
- * 3. Reads the computed z-values from "z_values.txt" and updates the entries
+ * With P = ceil(n / max_children) nodes to fill, the items are sorted by the x of their MBR center and cut into
+ * ceil(sqrt(P)) vertical slices of ceil(sqrt(P)) * max_children items, and every slice is sorted by y center.
  *
- * @param entries Vector of entries to generate z-values for
- * @throw Exits with error if the Python script fails or files cannot be accessed
+ * @param items Entries or nodes to order
+ * @param max_children Items per node
+ * @param mbr_of Returns the MBR of an item
  */
-
-void generate_z_value(std::vector<Entry>& entries) {
-    const std::string centers_file = calculate_MBRs_centers(entries);
-    const std::string z_values_file = "z_values.txt";
-    const std::string script_path = "z_order.py";
-
-    const std::string command = "python3 " + script_path + " " + centers_file + " " + z_values_file;
-
-    if (const int ret = system(command.c_str()); ret != 0) {
-        std::cerr << "Error running z_order.py script\n";
-        exit(-1);
+template<typename Item, typename MbrOf>
+void sort_tile_recursive(std::vector<Item>& items, const size_t max_children, const MbrOf& mbr_of) {
+    //Centers are compared doubled, which orders them the same.
+    const auto by_x_center = [&](const Item& a, const Item& b) {
+        return mbr_of(a).x_low + mbr_of(a).x_high < mbr_of(b).x_low + mbr_of(b).x_high;
+    };
+    const auto by_y_center = [&](const Item& a, const Item& b) {
+        return mbr_of(a).y_low + mbr_of(a).y_high < mbr_of(b).y_low + mbr_of(b).y_high;
+    };
+
+    const size_t node_count = (items.size() + max_children - 1) / max_children;
+    const auto slice_count = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(node_count))));
+    const size_t slice_size = std::max<size_t>(slice_count, 1) * max_children;
+
+    std::stable_sort(items.begin(), items.end(), by_x_center);
+    for (size_t begin = 0; begin < items.size(); begin += slice_size) {
+        const size_t end = std::min(begin + slice_size, items.size());
+        std::stable_sort(items.begin() + static_cast<std::ptrdiff_t>(begin), items.begin() + static_cast<std::ptrdiff_t>(end), by_y_center);
     }
-
-    update_z_value_to_entries(entries,z_values_file);
 }
 
 /**
- * @brief Sorts entries based on their z-values
+ * @brief Puts entries in the order in which they are packed into leaf parents
  * @param entries Vector of entries to sort
+ * @param options The packing method and fanout, and the threads sorting the entries
  */
-void sortEntriesByZValue(std::vector<Entry>& entries) {
-    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
-        return a.z_value < b.z_value;
-    });
+void sort_entries_for_packing(std::vector<Entry>& entries, const BulkLoadOptions& options) {
+    if (options.packing == PackingMethod::STR) {
+        sort_tile_recursive(entries, options.max_children, [](const Entry& entry) -> const MBR& { return entry.mbr; });
+        return;
+    }
+    generate_curve_keys(entries, options.packing);
+    sortEntriesByCurveKey(entries, options.threads);
 }
 
 /**
@@ -268,42 +308,164 @@ std::vector<std::shared_ptr<Node>> build_leaf_nodes(const std::vector<Entry>& en
 }
 
 /**
- * @brief Builds R-tree from leaf nodes
- * @param nodes Vector of leaf nodes to build a tree from
+ * @brief Builds R-tree from leaf nodes, then prints the quality of every level
+ * @param nodes Vector of leaf nodes to build a tree from, in packing order
+ * @param options The packing method and fanout, and whether to write the tree to Rtree.txt as well
  * @return Pointer to the root node of the tree
  * @throw Exits with error if an output file cannot be opened
  */
-std::shared_ptr<InternalNode> build_tree(std::vector<std::shared_ptr<Node>>& nodes) {
-    std::ofstream outfile("Rtree.txt");
-    if (!outfile.is_open()) {
-        std::cerr << "Failed to open Rtree.txt for writing!\n";
-        exit(-1);
+std::shared_ptr<InternalNode> build_tree(std::vector<std::shared_ptr<Node>>& nodes, const BulkLoadOptions& options) {
+    std::ofstream outfile;
+    if (options.export_text) {
+        outfile.open("Rtree.txt");
+        if (!outfile.is_open()) {
+            std::cerr << "Failed to open Rtree.txt for writing!\n";
+            exit(-1);
+        }
     }
 
     int node_id = 0;
     int level = 0;
+    std::vector<LevelQuality> levels;
 
     while (nodes.size() > 1) {
-        nodes = create_upper_level(nodes, node_id);
+        //Leaves come in packing order already; with STR, the nodes of every upper level are tiled again.
+        if (options.packing == PackingMethod::STR && level > 0)
+            sort_tile_recursive(nodes, options.max_children, [](const std::shared_ptr<Node>& node) -> const MBR& { return node->mbr; });
+        nodes = create_upper_level(nodes, node_id, options);
 
         std::cout << nodes.size() << " nodes at level " << level++ << std::endl;
-        for (const auto& node : nodes) outfile << node->toString() << "\n";
+        if (options.export_text)
+            for (const auto& node : nodes) outfile << node->toString() << "\n";
+        levels.push_back(measure_level(nodes));
     }
 
     outfile.close();
+    if (!levels.empty()) print_tree_quality(levels, nodes.front()->mbr);
     return std::dynamic_pointer_cast<InternalNode>(nodes.front());
 }
 
+/**
+ * @brief Area of the union of rectangles, by sweeping the slabs between consecutive x bounds
+ * @param rectangles The rectangles
+ * @return The area covered by at least one of them
+ */
+double union_area(const std::vector<MBR>& rectangles) {
+    std::vector<double> xs;
+    xs.reserve(2 * rectangles.size());
+    for (const auto& rectangle : rectangles) {
+        xs.push_back(rectangle.x_low);
+        xs.push_back(rectangle.x_high);
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+
+    double area = 0.0;
+    std::vector<std::pair<double, double>> spans;
+    for (size_t i = 0; i + 1 < xs.size(); i++) {
+        //Every rectangle either spans the whole slab or misses it.
+        spans.clear();
+        for (const auto& rectangle : rectangles) {
+            if (rectangle.x_low <= xs[i] && rectangle.x_high >= xs[i + 1]) spans.emplace_back(rectangle.y_low, rectangle.y_high);
+        }
+        std::sort(spans.begin(), spans.end());
+
+        double covered = 0.0;
+        double span_low = 0.0, span_high = 0.0;
+        bool open = false;
+        for (const auto& [low, high] : spans) {
+            if (open && low <= span_high) {
+                span_high = std::max(span_high, high);
+                continue;
+            }
+            if (open) covered += span_high - span_low;
+            span_low = low;
+            span_high = high;
+            open = true;
+        }
+        if (open) covered += span_high - span_low;
+        area += covered * (xs[i + 1] - xs[i]);
+    }
+    return area;
+}
+
+/**
+ * @brief Measures the nodes of one level: area, perimeter, overlap between nodes and dead space inside them
+ * @param nodes The internal nodes of the level
+ * @return The quality of the level
+ */
+LevelQuality measure_level(const std::vector<std::shared_ptr<Node>>& nodes) {
+    LevelQuality quality;
+    quality.nodes = nodes.size();
+
+    std::vector<MBR> child_mbrs;
+    for (const auto& node : nodes) {
+        const MBR& mbr = node->mbr;
+        const double area = (mbr.x_high - mbr.x_low) * (mbr.y_high - mbr.y_low);
+        quality.area += area;
+        quality.margin += 2.0 * ((mbr.x_high - mbr.x_low) + (mbr.y_high - mbr.y_low));
+
+        const auto internal_node = std::dynamic_pointer_cast<InternalNode>(node);
+        child_mbrs.clear();
+        for (const auto& child : internal_node->children) child_mbrs.push_back(child->mbr);
+        quality.children += child_mbrs.size();
+        quality.dead_space += std::max(0.0, area - union_area(child_mbrs));
+    }
+
+    //Sweep over x: only the nodes starting before a node ends can overlap it.
+    std::vector<const MBR*> by_x_low;
+    by_x_low.reserve(nodes.size());
+    for (const auto& node : nodes) by_x_low.push_back(&node->mbr);
+    std::sort(by_x_low.begin(), by_x_low.end(), [](const MBR* a, const MBR* b) { return a->x_low < b->x_low; });
+    for (size_t i = 0; i < by_x_low.size(); i++) {
+        const MBR& a = *by_x_low[i];
+        for (size_t j = i + 1; j < by_x_low.size() && by_x_low[j]->x_low < a.x_high; j++) {
+            const MBR& b = *by_x_low[j];
+            const double width = std::min(a.x_high, b.x_high) - b.x_low;
+            const double height = std::min(a.y_high, b.y_high) - std::max(a.y_low, b.y_low);
+            if (height > 0.0) quality.overlap += width * height;
+        }
+    }
+    return quality;
+}
+
+/**
+ * @brief Prints the quality of every level of a built tree.
+ *
+ * The expected node visits of a level are its total area over the root area: the number of its nodes containing
+ * a point drawn uniformly from the root MBR, i.e. the nodes of that level a point query reads.
+ *
+ * @param levels The quality of every level, from the leaf parents up to the root
+ * @param root_mbr MBR of the root
+ */
+void print_tree_quality(const std::vector<LevelQuality>& levels, const MBR& root_mbr) {
+    const double root_area = (root_mbr.x_high - root_mbr.x_low) * (root_mbr.y_high - root_mbr.y_low);
+    double point_query_visits = 0.0;
+
+    std::cout << "Level quality (areas in squared coordinate units):" << std::endl;
+    for (size_t level = 0; level < levels.size(); level++) {
+        const LevelQuality& quality = levels[level];
+        const double visits = root_area > 0.0 ? quality.area / root_area : static_cast<double>(quality.nodes);
+        point_query_visits += visits;
+        std::cout << "  level " << level << ": " << quality.nodes << " nodes, "
+                  << static_cast<double>(quality.children) / static_cast<double>(quality.nodes) << " children per node, "
+                  << "area = " << quality.area << ", margin = " << quality.margin << ", overlap = " << quality.overlap
+                  << ", dead space = " << quality.dead_space << ", point query visits = " << visits << std::endl;
+    }
+    std::cout << "Expected node visits per point query = " << point_query_visits << std::endl;
+}
+
 /**
  * @brief Creates the upper level of R-tree from given nodes
  * @param nodes Vector of nodes to group into upper level
  * @param node_id Reference to current node ID counter
+ * @param options The fanout and the minimum number of children of a node
  * @return Vector of nodes forming the upper level
  */
-std::vector<std::shared_ptr<Node>> create_upper_level(const std::vector<std::shared_ptr<Node>>& nodes, int &node_id) {
+std::vector<std::shared_ptr<Node>> create_upper_level(const std::vector<std::shared_ptr<Node>>& nodes, int &node_id, const BulkLoadOptions& options) {
     std::vector<std::shared_ptr<Node>> upper_level_nodes;
-    constexpr int MAX_CHILDREN_PER_NODE = 20;
-    constexpr int MIN_CHILDREN_PER_NODE = 8;
+    const size_t MAX_CHILDREN_PER_NODE = options.max_children;
+    const size_t MIN_CHILDREN_PER_NODE = options.min_children;
     const size_t number_of_full_nodes = nodes.size() / MAX_CHILDREN_PER_NODE;
 
     bool children_are_leafs = node_id == 0;
@@ -330,8 +492,8 @@ std::vector<std::shared_ptr<Node>> create_upper_level(const std::vector<std::sha
             internal_node_with_remainders->children.push_back(nodes[i]);
         }
 
-        if(const size_t needed_children = MIN_CHILDREN_PER_NODE - remaining_nodes; needed_children > 0 && !upper_level_nodes.empty()) {
-            for(int i = 0; i < needed_children; i++) {
+        if(remaining_nodes < MIN_CHILDREN_PER_NODE && !upper_level_nodes.empty()) {
+            for(size_t i = 0; i < MIN_CHILDREN_PER_NODE - remaining_nodes; i++) {
                 auto last_full_internal_node = std::dynamic_pointer_cast<InternalNode>(upper_level_nodes.back());
                 auto child = last_full_internal_node->children.back();
                 update_parent_mbr(internal_node_with_remainders->mbr, child->mbr);
@@ -0,0 +1,299 @@
+/**
+ * @file r_tree_updates.cpp
+ * @brief Applies inserts and deletes of polygons to a built R-tree, without bulk loading it again.
+ *
+ * This program:
+ * - Loads an R-tree written by r_tree_bulk_loading (binary Rtree.bin or text Rtree.txt)
+ * - Reads a delta file: polygons to insert (or replace) and polygon ids to delete
+ * - Applies them one by one with the R*-tree insert and delete algorithms
+ * - Writes the updated tree as a binary tree file, in place of the input by default
+ * - Writes the polygon files with the same changes, if given; otherwise marks the tree as ahead of them
+ *
+ * Usage:
+ *   ./r_tree_updates.out Rtree.bin deltas.txt [--fanout=<N>] [--min-children=<N>] [--output=<file>]
+ *                        [--coords=coords.txt --offsets=offsets.txt [--coords-output=<file>] [--offsets-output=<file>]]
+ */
+
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../common/PolygonFiles.h"
+#include "../common/RStarTree.h"
+#include "../common/RTreeFile.h"
+
+
+/**
+ * @brief How the updates are applied
+ */
+struct UpdateOptions {
+    size_t max_children; ///< Fanout: children of a full node, as the tree was bulk loaded with
+    size_t min_children; ///< Children of any node but the root at least
+    std::string output; ///< The binary tree file to write, the input tree file if empty
+    std::string coords_filename; ///< Vertices of the object polygons, updated with the tree if given
+    std::string offsets_filename; ///< Vertex ranges of the object polygons
+    std::string coords_output; ///< The coords file to write, the input coords file if empty
+    std::string offsets_output; ///< The offsets file to write, the input offsets file if empty
+};
+
+/**
+ * @brief Counts of the applied deltas
+ */
+struct UpdateCounts {
+    size_t inserted = 0; ///< Polygons inserted
+    size_t replaced = 0; ///< Polygons inserted in place of one with the same id
+    size_t deleted = 0; ///< Polygons deleted
+    size_t missing = 0; ///< Deletes of ids the tree does not have
+};
+
+// The vertices of every polygon the deltas inserted, by id, and no vertices for every id they deleted.
+using PolygonChanges = std::map<int, std::vector<std::pair<double, double>>>;
+
+constexpr size_t DEFAULT_MAX_CHILDREN_PER_NODE = 20;
+// Without --min-children, a node has at least this share of the fanout (8 of 20), as in the bulk loader
+constexpr double DEFAULT_MIN_FILL = 0.4;
+
+
+UpdateOptions parse_update_options(int argc, char* argv[], int first_option, size_t default_max_children);
+UpdateCounts apply_deltas(RStarTree& tree, const std::string& deltas_filename, PolygonChanges& changes);
+void write_polygon_files(const UpdateOptions& options, const PolygonChanges& changes);
+
+
+int main(const int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./r_tree_updates.out Rtree.bin deltas.txt [--fanout=<N>] [--min-children=<N>] [--output=<file>]"
+                     " [--coords=coords.txt --offsets=offsets.txt [--coords-output=<file>] [--offsets-output=<file>]]\n";
+        return 1;
+    }
+
+    //Updates fill nodes as the bulk loader did: the fanout it recorded, or the child slots of an older file.
+    const RTreeFileHeader header = read_rtree_file_header(argv[1]);
+    const size_t tree_fanout = header.fanout != 0 ? header.fanout : header.slots != 0 ? header.slots : DEFAULT_MAX_CHILDREN_PER_NODE;
+    UpdateOptions options = parse_update_options(argc, argv, 3, tree_fanout);
+    if (options.output.empty()) options.output = argv[1];
+
+    RStarTree tree(load_rtree(argv[1]), options.max_children, options.min_children);
+    PolygonChanges changes;
+    const UpdateCounts counts = apply_deltas(tree, argv[2], changes);
+    std::cout << "Inserted " << counts.inserted << ", replaced " << counts.replaced << ", deleted " << counts.deleted
+              << " polygons (" << counts.missing << " deletes of missing ids)" << std::endl;
+
+    //The polygon files go first: if writing the tree fails, applying the same deltas again gives the same files.
+    uint64_t flags = header.flags;
+    if (!options.coords_filename.empty()) write_polygon_files(options, changes);
+    else if (counts.inserted + counts.replaced + counts.deleted > 0) flags |= RTREE_FILE_STALE_POLYGONS;
+    if (flags & RTREE_FILE_STALE_POLYGONS)
+        std::cout << "The polygon files do not have all updates of the tree: its queries cannot use them" << std::endl;
+
+    const FlatRTree flat_tree = tree.flatten();
+    write_rtree_file(flat_tree, options.output, flags, options.max_children);
+    std::cout << "Wrote " << options.output << ": " << tree.size() << " objects, height " << tree.height() << ", "
+              << flat_tree.node_count() << " nodes of " << flat_tree.block_bytes() << " bytes (" << flat_tree.slot_count()
+              << " child slots)" << std::endl;
+    return 0;
+}
+
+
+/**
+ * @brief Parses the optional "--name=value" arguments that follow the positional arguments
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @param default_max_children Fanout without --fanout, the one of the loaded tree
+ * @return The parsed options, with defaults for everything not given
+ * @throw Exits with error on an unknown option or a malformed value
+ */
+UpdateOptions parse_update_options(const int argc, char* argv[], const int first_option, const size_t default_max_children) {
+    UpdateOptions options{default_max_children, 0, "", "", "", "", ""};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (name == "--fanout") {
+                options.max_children = std::stoull(value);
+                if (options.max_children < 2) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--min-children") {
+                options.min_children = std::stoull(value);
+                if (options.min_children == 0) throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--output") {
+                if (value.empty()) throw std::invalid_argument(value);
+                options.output = value;
+                continue;
+            }
+            if (name == "--coords" || name == "--offsets" || name == "--coords-output" || name == "--offsets-output") {
+                if (value.empty()) throw std::invalid_argument(value);
+                (name == "--coords" ? options.coords_filename : name == "--offsets" ? options.offsets_filename
+                 : name == "--coords-output" ? options.coords_output : options.offsets_output) = value;
+                continue;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
+            exit(-1);
+        }
+
+        std::cerr << "Unknown option: " << argument << "\n";
+        exit(-1);
+    }
+
+    if (options.min_children == 0)
+        options.min_children = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(options.max_children) * DEFAULT_MIN_FILL));
+    //A split must leave both nodes with at least min_children.
+    if (options.min_children > options.max_children / 2) {
+        std::cerr << "--min-children must be at most half of --fanout (" << options.max_children / 2 << ")\n";
+        exit(-1);
+    }
+    if (options.coords_filename.empty() != options.offsets_filename.empty()
+        || (options.coords_filename.empty() && (!options.coords_output.empty() || !options.offsets_output.empty()))) {
+        std::cerr << "Give both --coords and --offsets, or neither (and then no polygon outputs)\n";
+        exit(-1);
+    }
+    if (options.coords_output.empty()) options.coords_output = options.coords_filename;
+    if (options.offsets_output.empty()) options.offsets_output = options.offsets_filename;
+    return options;
+}
+
+/**
+ * @brief Applies the deltas of a file to the tree, in file order
+ * @param tree The tree
+ * @param deltas_filename The delta file
+ * @param changes Receives the polygons inserted and deleted, the last delta of every id
+ * @return How many deltas of every kind were applied
+ * @throw Exits with error if the file cannot be opened or a line is malformed
+ *
+ * Each line of the file is one delta:
+ *   + <id> <x>,<y> <x>,<y> ...    insert the polygon with these vertices, replacing the polygon with that id if any
+ *   - <id>                        delete the polygon with that id
+ * Empty lines are skipped.
+ */
+UpdateCounts apply_deltas(RStarTree& tree, const std::string& deltas_filename, PolygonChanges& changes) {
+    std::ifstream infile(deltas_filename);
+    if (!infile.is_open()) {
+        std::cerr << "Failed to open file " << deltas_filename << "\n";
+        exit(-1);
+    }
+
+    UpdateCounts counts;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(infile, line)) {
+        line_number++;
+        std::stringstream ss(line);
+        char operation;
+        if (!(ss >> operation)) continue;
+
+        int id;
+        bool valid = static_cast<bool>(ss >> id) && (operation == '+' || operation == '-');
+        if (valid && operation == '-') {
+            std::string rest;
+            valid = !(ss >> rest);
+            if (valid) {
+                (tree.remove(id) ? counts.deleted : counts.missing)++;
+                changes[id].clear();
+            }
+        } else if (valid) {
+            //The MBR of the vertices, as computeMBRs of the bulk loader makes it.
+            MBR mbr;
+            size_t vertices = 0;
+            std::string vertex;
+            std::vector<std::pair<double, double>> polygon;
+            while (valid && ss >> vertex) {
+                const size_t comma = vertex.find(',');
+                size_t x_length = 0, y_length = 0;
+                try {
+                    const double x = std::stod(vertex.substr(0, comma), &x_length);
+                    const double y = comma == std::string::npos ? 0.0 : std::stod(vertex.substr(comma + 1), &y_length);
+                    if (vertices++ == 0) mbr = MBR(x, y, x, y);
+                    else update_parent_mbr(mbr, MBR(x, y, x, y));
+                    polygon.emplace_back(x, y);
+                } catch (const std::exception&) {
+                    valid = false;
+                }
+                valid = valid && comma == x_length && comma + 1 + y_length == vertex.size();
+            }
+            valid = valid && vertices > 0;
+            if (valid) {
+                (tree.insert(id, mbr) ? counts.inserted : counts.replaced)++;
+                changes[id] = std::move(polygon);
+            }
+        }
+
+        if (!valid) {
+            std::cerr << "Malformed delta on line " << line_number << " of " << deltas_filename << ": " << line << "\n";
+            exit(-1);
+        }
+    }
+    return counts;
+}
+
+/**
+ * @brief Writes the coords and offsets files with the changes of the deltas
+ * @param options The polygon files to read and to write
+ * @param changes The polygons inserted and deleted by the deltas
+ * @throw Exits with error if a polygon file cannot be read or written, or is malformed
+ *
+ * The polygons of the ids the deltas did not touch keep their order, then the inserted ones follow by id.
+ * Vertices are written in the shortest form that reads back as the same coordinates. Every file is written
+ * next to its final name and renamed over it, as the tree file.
+ */
+void write_polygon_files(const UpdateOptions& options, const PolygonChanges& changes) {
+    const size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const VertexColumns vertices = read_vertices(options.coords_filename, threads);
+    const std::vector<VertexRange> ranges = read_vertex_ranges(options.offsets_filename, vertices.x.size(), threads);
+
+    std::ofstream coords(options.coords_output + ".tmp", std::ios::trunc);
+    std::ofstream offsets(options.offsets_output + ".tmp", std::ios::trunc);
+    if (!coords.is_open() || !offsets.is_open()) {
+        std::cerr << "Failed to open " << options.coords_output << ".tmp or " << options.offsets_output << ".tmp for writing!\n";
+        exit(-1);
+    }
+
+    size_t written = 0;
+    char number[64];
+    const auto write_vertex = [&](const double x, const double y) {
+        char* end = std::to_chars(number, number + sizeof(number), x).ptr;
+        *end++ = ',';
+        end = std::to_chars(end, number + sizeof(number), y).ptr;
+        *end++ = '\n';
+        coords.write(number, end - number);
+    };
+    const auto write_range = [&](const int id, const size_t vertex_count) {
+        offsets << id << ',' << written << ',' << written + vertex_count - 1 << '\n';
+        written += vertex_count;
+    };
+
+    for (const auto& [id, first, last] : ranges) {
+        if (changes.count(id) > 0) continue;
+        for (size_t vertex = first; vertex <= last; vertex++) write_vertex(vertices.x[vertex], vertices.y[vertex]);
+        write_range(id, last - first + 1);
+    }
+    for (const auto& [id, polygon] : changes) {
+        if (polygon.empty()) continue;
+        for (const auto& [x, y] : polygon) write_vertex(x, y);
+        write_range(id, polygon.size());
+    }
+
+    coords.close();
+    offsets.close();
+    if (!coords || !offsets || std::rename((options.coords_output + ".tmp").c_str(), options.coords_output.c_str()) != 0
+        || std::rename((options.offsets_output + ".tmp").c_str(), options.offsets_output.c_str()) != 0) {
+        std::cerr << "Failed to write " << options.coords_output << " and " << options.offsets_output << "\n";
+        exit(-1);
+    }
+    std::cout << "Wrote " << options.coords_output << " and " << options.offsets_output << ": " << written << " vertices" << std::endl;
+}
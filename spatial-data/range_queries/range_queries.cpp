@@ -1,36 +1,94 @@
 /**
 * @brief Entry point of the program.
  * @param argc Argument count
- * @param argv Argument vector: expects [rtree.txt rqueries.txt]
+ * @param argv Argument vector: expects [Rtree.bin rqueries.txt], or a text Rtree.txt, then optionally
+ *             [--threads=<N>] [--batch-size=<N>] [--report=ids|counts|total] [--coords=coords.txt --offsets=offsets.txt];
+ *             or [bench Rtree.bin rqueries.txt], then optionally the polygons and [--warmup=<N>] [--repeat=<N>] [--json=<file>]
  *
- * Loads the R-tree from a file and runs range queries specified in the query file.
+ * Loads the R-tree from a file (and the object polygons, if given) and runs range queries specified in the query
+ * file, in batches spread over threads. In bench mode, every query is timed alone with every method instead, and a
+ * JSON report is written (see benchmarks/Benchmark.h).
  */
 
 
 
-#include <unordered_map>
+#include <bit>
+#include <cstdlib>
 #include <iostream>
-#include "Node.h"
+#include <stdexcept>
+#include "../common/Geometry.h"
+#include "../common/RTreeFile.h"
+#include "../common/NodeScan.h"
+#include "../common/QueryBatches.h"
+#include "../../benchmarks/Benchmark.h"
 
 
-std::shared_ptr<InternalNode> build_tree_from_file(const std::string &filename);
-std::vector<std::string> extract_numbers(const std::string &line);
-bool mbr_intersects(const MBR &a, const MBR &b);
-void range_query(const std::shared_ptr<InternalNode> &node, const MBR &query_mbr, std::vector<int> &results);
-void run_range_queries(const std::shared_ptr<InternalNode>& root, const std::string& r_queries_filename);
+/**
+ * @brief Buffers of a range query, kept between queries so that they allocate only while they grow
+ */
+struct RangeQueryBuffers {
+    std::vector<size_t> pending; ///< Blocks left to visit, the next one last
+    std::vector<uint64_t> masks; ///< Hit mask of the node being visited
+    size_t visited_nodes = 0; ///< Nodes visited by all the queries run with these buffers
+};
+
+/**
+ * @brief What is printed for the queries
+ */
+enum class ReportMode {
+    IDS,    ///< "<query> (<count>): <id> <id> ...", one line per query
+    COUNTS, ///< "<query> (<count>)" only: the ids are counted, never collected
+    TOTAL   ///< One line with the number of queries and the sum of their counts
+};
+
+/**
+ * @brief How a batch of range queries is run
+ */
+struct RangeQueryOptions {
+    QueryBatchOptions batches; ///< Threads, one per core by default, and queries per batch
+    ReportMode report; ///< What is printed
+    std::string coords_filename; ///< Vertices of the object polygons, if the results are refined against the polygons
+    std::string offsets_filename; ///< Vertex ranges of the object polygons
+};
+
+
+void range_query(const FlatRTree &tree, const MBR &query_mbr, std::vector<int> &results, RangeQueryBuffers &buffers);
+size_t range_count(const FlatRTree& tree, const MBR& query_mbr, RangeQueryBuffers& buffers);
+void refine_range_results(const PolygonSet& polygons, const MBR& query_mbr, std::vector<int>& results);
+RangeQueryOptions parse_range_query_options(int argc, char* argv[], int first_option, BenchmarkOptions* benchmark = nullptr);
+MBR parse_query_mbr(const std::string& line);
+void run_range_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& r_queries_filename,
+                       const RangeQueryOptions& options);
+void benchmark_range_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& rtree_filename,
+                             const std::string& r_queries_filename, const BenchmarkOptions& benchmark);
 
 
 int main(const int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: ./program rtree.txt rqueries.txt\n";
+    const bool bench = argc >= 2 && std::string(argv[1]) == "bench";
+    if (argc < (bench ? 4 : 3)) {
+        std::cerr << "Usage: ./program Rtree.bin rqueries.txt [--threads=<N>] [--batch-size=<N>] [--report=ids|counts|total]"
+                     " [--coords=coords.txt --offsets=offsets.txt]\n"
+                     "       ./program bench Rtree.bin rqueries.txt [--coords=coords.txt --offsets=offsets.txt]"
+                     " [--warmup=<N>] [--repeat=<N>] [--json=<file>]\n";
         return 1;
     }
 
-    const std::string rtree_filename = argv[1];
-    const std::string r_queries_filename = argv[2];
+    const int first_argument = bench ? 2 : 1;
+    const std::string rtree_filename = argv[first_argument];
+    const std::string r_queries_filename = argv[first_argument + 1];
+    BenchmarkOptions benchmark = DEFAULT_BENCHMARK_OPTIONS;
+    const RangeQueryOptions options = parse_range_query_options(argc, argv, first_argument + 2, bench ? &benchmark : nullptr);
 
-    const std::shared_ptr<InternalNode> root = build_tree_from_file(rtree_filename);
-    run_range_queries(root, r_queries_filename);
+    const FlatRTree tree = load_rtree(rtree_filename);
+    if (tree.empty()) {
+        std::cerr << "Tree is empty!\n";
+        return 1;
+    }
+    if (!options.coords_filename.empty()) check_polygons_current(rtree_filename);
+    const PolygonSet polygons = options.coords_filename.empty()
+        ? PolygonSet() : load_polygons(options.coords_filename, options.offsets_filename, options.batches.threads);
+    if (bench) benchmark_range_queries(tree, options.coords_filename.empty() ? nullptr : &polygons, rtree_filename, r_queries_filename, benchmark);
+    else run_range_queries(tree, options.coords_filename.empty() ? nullptr : &polygons, r_queries_filename, options);
 
     return 0;
 }
@@ -38,168 +96,304 @@ int main(const int argc, char* argv[]) {
 
 
 /**
- * @brief Extracts numeric values from a string line
- * @param line Input string containing numbers
- * @return Vector of strings containing extracted numbers
+ * @brief Performs a range query on the R-tree
+ * @param tree The flat R-tree
+ * @param query_mbr Query region as MBR
+ * @param results Vector to store matching object IDs
+ * @param buffers Working buffers, reused between queries
  * 
- * Extracts numbers (including negative numbers and decimals) from the input string,
- * ignoring any non-numeric characters.
+ * Traverses the R-tree depth-first to find all leaf entries whose MBRs intersect with the query MBR.
+ * All children of a node are tested at once by NodeScan::intersecting(), which gives a hit mask;
+ * the leaf flag tells whether the hits are objects or nodes to visit. Child nodes are pushed in
+ * reverse, so they are visited, and results found, in the order of a recursive traversal.
  */
-std::vector<std::string> extract_numbers(const std::string& line) {
-    std::vector<std::string> numbers;
-    std::string curr;
-
-    for (size_t i = 0; i < line.length(); ++i) {
-        if (std::isdigit(line[i]) ||
-            (line[i] == '-' && (i == 0 || !std::isdigit(line[i-1]))) ||
-            (line[i] == '.' && !curr.empty() && std::isdigit(curr.back()))) {
-            curr += line[i];
-            } else {
-                if (!curr.empty()) {
-                    numbers.push_back(curr);
-                    curr.clear();
-                }
+void range_query(const FlatRTree& tree, const MBR& query_mbr, std::vector<int>& results, RangeQueryBuffers& buffers) {
+    buffers.masks.resize(NodeScan::mask_words(tree.slot_count()));
+    buffers.pending.assign(1, FlatRTree::root());
+
+    while (!buffers.pending.empty()) {
+        const FlatRTree::FlatNode node = tree.node(buffers.pending.back());
+        buffers.pending.pop_back();
+        buffers.visited_nodes++;
+        NodeScan::intersecting(node, query_mbr, buffers.masks.data());
+
+        if (node.children_are_leafs) {
+            for (size_t word = 0; word < buffers.masks.size(); word++) {
+                for (uint64_t hits = buffers.masks[word]; hits != 0; hits &= hits - 1)
+                    results.push_back(node.child[word * NODE_SCAN_MASK_BITS + std::countr_zero(hits)]);
             }
+            continue;
+        }
+        for (size_t word = buffers.masks.size(); word-- > 0;) {
+            for (uint64_t hits = buffers.masks[word]; hits != 0; hits &= ~(uint64_t{1} << (63 - std::countl_zero(hits))))
+                buffers.pending.push_back(node.child[word * NODE_SCAN_MASK_BITS + 63 - std::countl_zero(hits)]);
+        }
     }
-    if (!curr.empty())
-        numbers.push_back(curr);
-
-    return numbers;
 }
 
 /**
- * @brief Constructs an R-tree from a text file
- * @param filename Path to the input file containing R-tree structure
- * @return The root node of the constructed R-tree
- * 
- * Each line in the file represents a node in the format used by the r_tree bulk loading process before:
- * [level_flag, node_id, [[child1_id, child1_MBR], [child2_id, child2_MBR], ...]]
+ * @brief Runs range queries on the R-tree, counting the leaf entries that intersect the query MBR without collecting them
+ * @param tree The flat R-tree
+ * @param query_mbr Query region as MBR
+ * @param buffers Working buffers, reused between queries
+ * @return Number of leaf entries whose MBRs intersect the query MBR, as range_query() would return
+ *
+ * Same traversal as range_query(), in any order: the hits of a leaf node are counted with a popcount of its mask.
  */
-std::shared_ptr<InternalNode> build_tree_from_file(const std::string& filename) {
-    std::ifstream infile(filename);
-    if (!infile.is_open()) {
-        std::cerr << "Failed to open file " << filename << "\n";
-        exit(-1);
-    }
-
-    std::unordered_map<int, std::shared_ptr<InternalNode>> id_to_node;
-    std::string line;
-    std::shared_ptr<InternalNode> root = nullptr;
-
-    while (std::getline(infile, line)) {
-        std::vector<std::string> numbers = extract_numbers(line);
-
-        bool is_leaf = (numbers[0] == "0");
-        int node_id = std::stoi(numbers[1]);
-        auto internal_node = std::make_shared<InternalNode>(node_id, MBR{}, is_leaf);
-
-        for (int i = 2; i < numbers.size(); i += 5) {
-            int child_id = std::stoi(numbers[i]);
-            double x_low = std::stod(numbers[i + 1]);
-            double x_high = std::stod(numbers[i + 2]);
-            double y_low = std::stod(numbers[i + 3]);
-            double y_high = std::stod(numbers[i + 4]);
-
-            MBR mbr(x_low, y_low, x_high, y_high);
-
-            if (is_leaf) {
-                auto leaf = std::make_shared<Node>(child_id, mbr);
-                internal_node->children.push_back(leaf);
-            } else {
-                auto child_it = id_to_node.find(child_id);
-                internal_node->children.push_back(child_it->second);
+size_t range_count(const FlatRTree& tree, const MBR& query_mbr, RangeQueryBuffers& buffers) {
+    buffers.masks.resize(NodeScan::mask_words(tree.slot_count()));
+    buffers.pending.assign(1, FlatRTree::root());
+
+    size_t count = 0;
+    while (!buffers.pending.empty()) {
+        const FlatRTree::FlatNode node = tree.node(buffers.pending.back());
+        buffers.pending.pop_back();
+        buffers.visited_nodes++;
+        NodeScan::intersecting(node, query_mbr, buffers.masks.data());
+
+        for (size_t word = 0; word < buffers.masks.size(); word++) {
+            if (node.children_are_leafs) {
+                count += static_cast<size_t>(std::popcount(buffers.masks[word]));
+                continue;
             }
+            for (uint64_t hits = buffers.masks[word]; hits != 0; hits &= hits - 1)
+                buffers.pending.push_back(node.child[word * NODE_SCAN_MASK_BITS + std::countr_zero(hits)]);
         }
-
-        recompute_node_mbr(*internal_node);
-        id_to_node[node_id] = internal_node;
-        root = internal_node;
-    }
-
-    infile.close();
-
-    if (!root) {
-        std::cerr << "Tree is empty!\n";
-        return nullptr;
     }
-    return root;
+    return count;
 }
 
 /**
- * @brief Checks if two MBRs intersect
- * @param a First MBR
- * @param b Second MBR
- * @return True, if the MBRs intersect, false otherwise
- * 
- * Determines whether two minimum bounding rectangles have any overlapping area.
+ * @brief Keeps the results of a range query whose polygon intersects the query MBR
+ * @param polygons Polygons of the objects
+ * @param query_mbr Query region as MBR
+ * @param results Object IDs whose MBRs intersect the query MBR, as range_query() finds them; the IDs whose polygon
+ *                misses the query MBR are removed, the others keep their order
+ *
+ * The MBR filter of the tree leaves only candidates whose polygon can intersect the query. Each is tested by
+ * PolygonSet::intersects(), against the edges of its polygon; objects without a polygon keep their MBR result.
  */
-bool mbr_intersects(const MBR& a, const MBR& b) {
-    if (a.x_high < b.x_low || a.x_low > b.x_high) return false;
-    if (a.y_high < b.y_low || a.y_low > b.y_high) return false;
-    return true;
+void refine_range_results(const PolygonSet& polygons, const MBR& query_mbr, std::vector<int>& results) {
+    std::erase_if(results, [&](const int id) { return polygons.contains(id) && !polygons.intersects(id, query_mbr); });
 }
 
 /**
- * @brief Performs a range query on the R-tree
- * @param node Current node being examined
- * @param query_mbr Query region as MBR
- * @param results Vector to store matching node IDs
- * 
- * Recursively traverses the R-tree to find all leaf nodes whose MBRs
- * intersect with the query MBR.
+ * @brief Parses the optional "--name=value" arguments that follow the positional arguments
+ * @param argc Argument count as received by main
+ * @param argv Argument vector as received by main
+ * @param first_option Index of the first optional argument
+ * @param benchmark If given, also receives the benchmark options (--warmup, --repeat, --json)
+ * @return The parsed options, with defaults for everything not given
+ * @throw Exits with error on an unknown option or a malformed value
  */
-void range_query(const std::shared_ptr<InternalNode>& node, const MBR& query_mbr, std::vector<int>& results) {
-    if(node == nullptr) return;
+RangeQueryOptions parse_range_query_options(const int argc, char* argv[], const int first_option, BenchmarkOptions* benchmark) {
+    RangeQueryOptions options{default_query_batch_options(), ReportMode::IDS, "", ""};
+
+    for (int i = first_option; i < argc; i++) {
+        const std::string argument = argv[i];
+        const size_t equals = argument.find('=');
+        const std::string name = argument.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+        try {
+            if (parse_query_batch_option(name, value, options.batches)) continue;
+            if (benchmark != nullptr && parse_benchmark_option(name, value, *benchmark)) continue;
+            if (name == "--report") {
+                if (value == "ids") options.report = ReportMode::IDS;
+                else if (value == "counts") options.report = ReportMode::COUNTS;
+                else if (value == "total") options.report = ReportMode::TOTAL;
+                else throw std::invalid_argument(value);
+                continue;
+            }
+            if (name == "--coords" || name == "--offsets") {
+                if (value.empty()) throw std::invalid_argument(value);
+                (name == "--coords" ? options.coords_filename : options.offsets_filename) = value;
+                continue;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
+            exit(-1);
+        }
 
-    for(const auto& child : node->children) {
-        if(!mbr_intersects(child->mbr, query_mbr)) continue;
+        std::cerr << "Unknown option: " << argument << "\n";
+        exit(-1);
+    }
 
-        if(auto internal_node = std::dynamic_pointer_cast<InternalNode>(child); internal_node != nullptr) {
-            range_query(internal_node, query_mbr, results);
-        }else {
-            results.push_back(child->node_id);
+    if (options.coords_filename.empty() != options.offsets_filename.empty()) {
+        std::cerr << "Give both --coords and --offsets, or neither\n";
+        exit(-1);
+    }
+    return options;
+}
+
+/**
+ * @brief Parses a query line
+ * @param line "<x_low> <y_low> <x_high> <y_high>"
+ * @return The query MBR, with 0 for the numbers missing from the line
+ */
+MBR parse_query_mbr(const std::string& line) {
+    double values[4] = {};
+    const char* position = line.c_str();
+    for (double& value : values) {
+        char* end = nullptr;
+        value = std::strtod(position, &end);
+        if (end == position) {
+            value = 0.0;
+            break;
         }
+        position = end;
     }
+    return {values[0], values[1], values[2], values[3]};
 }
 
 /**
  * @brief Executes multiple range queries from a file
- * @param root Root node of the R-tree
+ * @param tree The flat R-tree
+ * @param polygons Polygons of the objects, to refine the results; nullptr to report the objects whose MBR intersects
  * @param r_queries_filename File containing query MBRs
+ * @param options Threads, batch size and what to report
  *
- * Reads query MBRs from a file and performs range queries on the R-tree,
- * printing results for each query.
+ * Reads query MBRs from a file and performs range queries on the R-tree, printing results for each query
+ * (or only their number, or the totals over all queries).
  *
  * The query file should contain one query MBR per line in the format: <x_low> <y_low> <x_high> <y_high>
+ *
+ * The queries are run in batches spread over the threads by run_query_batches(). Every thread keeps its own
+ * traversal buffers, and the output is the same for any number of threads.
+ *
+ * With polygons, every query has a filter step, range_query() on the MBRs, and a refinement step,
+ * refine_range_results() on the candidates it found; the counts of both are printed to std::cerr at the end.
  */
-void run_range_queries(const std::shared_ptr<InternalNode>& root, const std::string& r_queries_filename) {
+void run_range_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& r_queries_filename,
+                       const RangeQueryOptions& options) {
     std::ifstream infile(r_queries_filename);
     if (!infile.is_open()) {
         std::cerr << "Failed to open file " << r_queries_filename << "\n";
         exit(-1);
     }
 
-    std::string line;
-    std::vector<int> results;
+    //Per-thread state, on its own cache lines.
+    struct alignas(CACHE_LINE_BYTES) Worker {
+        RangeQueryBuffers buffers;
+        std::vector<int> results;
+        size_t total_candidates = 0;
+        size_t total_results = 0;
+    };
+    std::vector<Worker> workers(options.batches.threads);
+
+    const size_t query_count = run_query_batches(infile, options.batches,
+        [&](const size_t thread, const size_t query_number, const std::string& line, std::string& out) {
+            Worker& worker = workers[thread];
+            const MBR query_mbr = parse_query_mbr(line);
+            //Refinement needs the candidates themselves; without it, counts need no ids.
+            size_t count;
+            if (options.report != ReportMode::IDS && polygons == nullptr) {
+                count = range_count(tree, query_mbr, worker.buffers);
+            } else {
+                worker.results.clear();
+                range_query(tree, query_mbr, worker.results, worker.buffers);
+                worker.total_candidates += worker.results.size();
+                if (polygons != nullptr) refine_range_results(*polygons, query_mbr, worker.results);
+                count = worker.results.size();
+            }
+            worker.total_results += count;
+            if (options.report == ReportMode::TOTAL) return;
+
+            append_number(out, query_number);
+            out += " (";
+            append_number(out, count);
+            if (options.report == ReportMode::COUNTS) {
+                out += ")\n";
+                return;
+            }
+            out += "): ";
+            for (const int result : worker.results) {
+                append_number(out, result);
+                out += ' ';
+            }
+            out += '\n';
+        });
 
-    int line_count = 0;
-    while(std::getline(infile, line)) {
-        std::stringstream ss(line);
-        double x_low, x_high, y_low, y_high;
-        ss >> x_low >> y_low >> x_high >> y_high;
-        MBR query_mbr(x_low, y_low, x_high, y_high);
-        range_query(root, query_mbr, results);
-
-        std::cout << line_count++ << " (" << results.size() << "): ";
-        for(const auto& result : results) {
-            std::cout << result << " ";
-        }
-        std::cout << "\n";
-        results.clear();
+    size_t total_candidates = 0, total_results = 0;
+    for (const Worker& worker : workers) {
+        total_candidates += worker.total_candidates;
+        total_results += worker.total_results;
     }
+    if (options.report == ReportMode::TOTAL) std::cout << query_count << " queries, " << total_results << " results" << std::endl;
+    if (polygons != nullptr)
+        std::cerr << "Filter: " << total_candidates << " candidates; refinement: " << total_results << " results, "
+                  << total_candidates - total_results << " false drops" << std::endl;
 }
 
+/**
+ * @brief Benchmarks the range query methods on every query of a file, and writes a JSON report
+ * @param tree The flat R-tree
+ * @param polygons Polygons of the objects, to also benchmark the refined queries; nullptr if not given
+ * @param rtree_filename File the tree was loaded from, for the report
+ * @param r_queries_filename File containing query MBRs, as for run_range_queries()
+ * @param benchmark Passes and report file
+ *
+ * The queries are read into memory first, then run one at a time on the calling thread (see benchmark_method()) by:
+ * range_count (nodes_visited, results), range_query (nodes_visited, results) and, with polygons, range_query_refined
+ * (nodes_visited, candidates of the MBR filter, false_drops removed by the refinement, results).
+ */
+void benchmark_range_queries(const FlatRTree& tree, const PolygonSet* polygons, const std::string& rtree_filename,
+                             const std::string& r_queries_filename, const BenchmarkOptions& benchmark) {
+    std::ifstream infile(r_queries_filename);
+    if (!infile.is_open()) {
+        std::cerr << "Failed to open file " << r_queries_filename << "\n";
+        exit(-1);
+    }
+    std::vector<MBR> queries;
+    std::string line;
+    while (std::getline(infile, line)) queries.push_back(parse_query_mbr(line));
 
+    const PerfCounters perf;
+    RangeQueryBuffers buffers;
+    std::vector<int> results;
+    std::vector<MethodReport> reports;
+
+    reports.push_back(benchmark_method("range_count", queries.size(), benchmark, perf, [&](const size_t query, WorkCounters* counters) {
+        const size_t visited_nodes = buffers.visited_nodes;
+        const size_t count = range_count(tree, queries[query], buffers);
+        if (counters != nullptr) {
+            counters->add("nodes_visited", buffers.visited_nodes - visited_nodes);
+            counters->add("results", count);
+        }
+    }));
 
+    reports.push_back(benchmark_method("range_query", queries.size(), benchmark, perf, [&](const size_t query, WorkCounters* counters) {
+        const size_t visited_nodes = buffers.visited_nodes;
+        results.clear();
+        range_query(tree, queries[query], results, buffers);
+        if (counters != nullptr) {
+            counters->add("nodes_visited", buffers.visited_nodes - visited_nodes);
+            counters->add("results", results.size());
+        }
+    }));
+
+    if (polygons != nullptr) {
+        reports.push_back(benchmark_method("range_query_refined", queries.size(), benchmark, perf, [&](const size_t query, WorkCounters* counters) {
+            const size_t visited_nodes = buffers.visited_nodes;
+            results.clear();
+            range_query(tree, queries[query], results, buffers);
+            const size_t candidates = results.size();
+            refine_range_results(*polygons, queries[query], results);
+            if (counters != nullptr) {
+                counters->add("nodes_visited", buffers.visited_nodes - visited_nodes);
+                counters->add("candidates", candidates);
+                counters->add("false_drops", candidates - results.size());
+                counters->add("results", results.size());
+            }
+        }));
+    }
 
-
+    BenchmarkDataset dataset;
+    dataset.add("tree_file", rtree_filename);
+    dataset.add("queries_file", r_queries_filename);
+    dataset.add("nodes", tree.node_count());
+    dataset.add("slots", tree.slot_count());
+    dataset.add("queries", queries.size());
+    if (polygons != nullptr) dataset.add("polygons", polygons->object_count());
+    write_benchmark_report("range", dataset, reports, benchmark, perf);
+}